@@ -0,0 +1,35 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include <Benchmark.h>
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// The decoder benchmark on its own, without the player or its window, for CI to run on every build and compare the
+// JSON it writes against the last.
+//
+//     tacrad-bench [musicDir] [jsonFile]
+//
+// musicDir defaults to music/, jsonFile to bench-decode.json. Exits with 1 if the results couldn't be written.
+int main(int argc, char** argv)
+{
+    if (argc > 3)
+    {
+        std::fprintf(stderr, "usage: tacrad-bench [musicDir] [jsonFile]\n");
+        return 2;
+    }
+    fs::path dir = argc > 1 ? fs::path(argv[1]) : MusicLibrary::root;
+    fs::path jsonFile = argc > 2 ? fs::path(argv[2]) : fs::path("bench-decode.json");
+
+    std::string json;
+    std::fputs(Benchmark::decoders(dir, json).c_str(), stdout);
+    if (!Benchmark::writeJson(jsonFile, json))
+    {
+        std::fprintf(stderr, "couldn't write results to %s\n", jsonFile.string().c_str());
+        return 1;
+    }
+    std::printf("written to %s\n", jsonFile.string().c_str());
+    return 0;
+}
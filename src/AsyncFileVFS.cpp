@@ -0,0 +1,385 @@
+#include "AsyncFileVFS.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <ThreadTuning.h>
+#if _WIN32
+#define NOMINMAX 1
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if __linux__
+#include <sys/vfs.h>
+#endif
+
+AsyncFileVFS::AsyncFileVFS()
+{
+    this->callbacks = ma_vfs_callbacks
+    {
+        .onOpen = AsyncFileVFS::onOpen,
+        .onOpenW = AsyncFileVFS::onOpenW,
+        .onClose = AsyncFileVFS::onClose,
+        .onRead = AsyncFileVFS::onRead,
+        .onWrite = AsyncFileVFS::onWrite,
+        .onSeek = AsyncFileVFS::onSeek,
+        .onTell = AsyncFileVFS::onTell,
+        .onInfo = AsyncFileVFS::onInfo
+    };
+    ma_default_vfs_init(&this->fallback, nullptr);
+}
+
+bool AsyncFileVFS::asynchronous()
+{
+    return IoUring::supported();
+}
+
+bool AsyncFileVFS::isRemote(const fs::path& path)
+{
+#if __linux__
+    struct statfs info;
+    if (statfs(path.c_str(), &info) != 0)
+        return false;
+    switch ((uint32_t)info.f_type)
+    {
+    case 0x6969:     // NFS
+    case 0x517b:     // SMB
+    case 0xff534d42: // CIFS
+    case 0xfe534d42: // SMB2
+    case 0x65735546: // FUSE (sshfs, rclone, ...)
+    case 0x00c36400: // Ceph
+    case 0x01021997: // 9P
+    case 0x5346414f: // AFS
+        return true;
+    default:
+        return false;
+    }
+#elif _WIN32
+    std::error_code ec;
+    fs::path root = fs::absolute(path, ec).root_path();
+    return GetDriveTypeW(root.c_str()) == DRIVE_REMOTE;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+ma_result AsyncFileVFS::openFile(AsyncFileVFS* self, const fs::path& path, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+#if !_WIN32
+    if ((openMode & MA_OPEN_MODE_WRITE) == 0)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return MA_DOES_NOT_EXIST;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            ::close(fd);
+            return MA_INVALID_FILE;
+        }
+
+        File* file = new(std::nothrow) File();
+        if (!file)
+        {
+            ::close(fd);
+            return MA_OUT_OF_MEMORY;
+        }
+        file->fd = fd;
+        file->size = (uint64_t)info.st_size;
+#if __linux__
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        if (IoUring::supported())
+        {
+            file->ring = IoUring(self->windowCount * 2);
+            if (file->ring)
+            {
+                file->windows.resize(std::max(self->windowCount, 2u));
+                for (Window& window : file->windows)
+                    window.data.reset(new(std::nothrow) std::byte[self->windowSize]);
+                if (std::any_of(file->windows.begin(), file->windows.end(), [](const Window& window) { return !window.data; }))
+                {
+                    file->windows.clear();
+                    file->ring = IoUring();
+                }
+                for (Window& window : file->windows)
+                    window.locked = MemoryLock::lock(window.data.get(), self->windowSize);
+            }
+        }
+        // Get the head of the file moving before the decoder even asks.
+        self->prefetchAhead(*file);
+
+        *pFile = file;
+        return MA_SUCCESS;
+    }
+#endif
+
+    File* file = new(std::nothrow) File();
+    if (!file)
+        return MA_OUT_OF_MEMORY;
+#if _WIN32
+    ma_result result = ma_vfs_open_w(&self->fallback, path.c_str(), openMode, &file->fallback);
+#else
+    ma_result result = ma_vfs_open(&self->fallback, path.c_str(), openMode, &file->fallback);
+#endif
+    if (result != MA_SUCCESS)
+    {
+        delete file;
+        return result;
+    }
+    *pFile = file;
+    return MA_SUCCESS;
+}
+
+AsyncFileVFS::Window* AsyncFileVFS::findWindow(File& file, uint64_t offset)
+{
+    for (Window& window : file.windows)
+    {
+        size_t span = window.state == Window::State::InFlight ? this->windowSize : window.length;
+        if ((window.state == Window::State::InFlight || window.state == Window::State::Ready) && offset >= window.offset && offset < window.offset + span)
+            return &window;
+    }
+    return nullptr;
+}
+AsyncFileVFS::Window* AsyncFileVFS::issueWindow(File& file, uint64_t offset)
+{
+    uint64_t cursorWindow = file.cursor / this->windowSize * this->windowSize;
+    uint64_t prefetchEnd = cursorWindow + (uint64_t)file.windows.size() * this->windowSize;
+
+    // Reuse empty windows first, then ones behind the cursor, then ones stranded beyond the prefetch range by a seek.
+    Window* victim = nullptr;
+    for (Window& window : file.windows)
+    {
+        if (window.state == Window::State::Empty)
+        {
+            victim = &window;
+            break;
+        }
+        if (window.state == Window::State::Ready && (window.offset < cursorWindow || window.offset >= prefetchEnd) &&
+            (!victim || window.offset < victim->offset))
+            victim = &window;
+    }
+    if (!victim)
+        return nullptr;
+
+    if (!file.ring.queueRead(file.fd, victim->data.get(), (uint32_t)std::min<uint64_t>(this->windowSize, file.size - offset), offset,
+                             (uint64_t)(victim - file.windows.data())))
+    {
+        file.ring.submit();
+        return nullptr;
+    }
+    victim->offset = offset;
+    victim->length = 0;
+    victim->error = 0;
+    victim->state = Window::State::InFlight;
+    return victim;
+}
+bool AsyncFileVFS::reapCompletions(File& file, bool block)
+{
+    IoCompletion completion;
+    bool reaped = false;
+    while (block ? file.ring.wait(completion) : file.ring.poll(completion))
+    {
+        Window& window = file.windows[completion.userData];
+        reaped = true;
+        // A stale window's read is of no use to anyone any more, but its buffer is free again.
+        if (window.state == Window::State::Stale)
+            window.state = Window::State::Empty;
+        else
+        {
+            window.state = Window::State::Ready;
+            window.length = completion.result > 0 ? (size_t)completion.result : 0;
+            window.error = completion.result < 0 ? -completion.result : 0;
+        }
+        if (block)
+            break;
+    }
+    return reaped;
+}
+void AsyncFileVFS::prefetchAhead(File& file)
+{
+#if __linux__
+    if (!file.ring)
+    {
+        // The kernel's own read-ahead is the best the synchronous path can do.
+        posix_fadvise(file.fd, (off_t)file.cursor, (off_t)(this->windowSize * this->windowCount), POSIX_FADV_WILLNEED);
+        return;
+    }
+
+    this->reapCompletions(file, false);
+    uint64_t base = file.cursor / this->windowSize * this->windowSize;
+    for (size_t i = 0; i < file.windows.size(); i++)
+    {
+        uint64_t offset = base + i * this->windowSize;
+        if (offset >= file.size)
+            break;
+        if (!this->findWindow(file, offset) && !this->issueWindow(file, offset))
+            break;
+    }
+    file.ring.submit();
+#else
+    (void)file;
+#endif
+}
+size_t AsyncFileVFS::readSync(File& file, void* pDst, size_t sizeInBytes)
+{
+    size_t done = 0;
+#if !_WIN32
+    while (done < sizeInBytes && file.cursor < file.size)
+    {
+        ssize_t got = pread(file.fd, static_cast<std::byte*>(pDst) + done, sizeInBytes - done, (off_t)file.cursor);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        done += (size_t)got;
+        file.cursor += (uint64_t)got;
+    }
+#else
+    (void)file, (void)pDst, (void)sizeInBytes;
+#endif
+    return done;
+}
+
+ma_result AsyncFileVFS::onOpen(ma_vfs* pVFS, const char* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+    return AsyncFileVFS::openFile(static_cast<AsyncFileVFS*>(pVFS), fs::path(pFilePath), openMode, pFile);
+}
+ma_result AsyncFileVFS::onOpenW(ma_vfs* pVFS, const wchar_t* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+    return AsyncFileVFS::openFile(static_cast<AsyncFileVFS*>(pVFS), fs::path(pFilePath), openMode, pFile);
+}
+ma_result AsyncFileVFS::onClose(ma_vfs* pVFS, ma_vfs_file file)
+{
+    File* f = static_cast<File*>(file);
+    ma_result result = MA_SUCCESS;
+    if (f->fallback)
+        result = ma_vfs_close(&static_cast<AsyncFileVFS*>(pVFS)->fallback, f->fallback);
+    // Drains reads still in flight before their windows are freed.
+    f->ring = IoUring();
+    for (Window& window : f->windows)
+    {
+        if (window.locked)
+            MemoryLock::unlock(window.data.get(), static_cast<AsyncFileVFS*>(pVFS)->windowSize);
+    }
+#if !_WIN32
+    if (f->fd >= 0)
+        ::close(f->fd);
+#endif
+    delete f;
+    return result;
+}
+ma_result AsyncFileVFS::onRead(ma_vfs* pVFS, ma_vfs_file file, void* pDst, size_t sizeInBytes, size_t* pBytesRead)
+{
+    AsyncFileVFS* self = static_cast<AsyncFileVFS*>(pVFS);
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_read(&self->fallback, f->fallback, pDst, sizeInBytes, pBytesRead);
+
+    size_t done = 0;
+    int error = 0;
+    if (!f->ring)
+        done = self->readSync(*f, pDst, sizeInBytes);
+    else while (done < sizeInBytes && f->cursor < f->size)
+    {
+        Window* window = self->findWindow(*f, f->cursor);
+        if (!window)
+        {
+            uint64_t aligned = f->cursor / self->windowSize * self->windowSize;
+            // A short read left the aligned window incomplete, so refill from the cursor itself.
+            window = self->issueWindow(*f, self->findWindow(*f, aligned) ? f->cursor : aligned);
+            if (!window && f->ring.pending() > 0 && self->reapCompletions(*f, true))
+                continue;
+            f->ring.submit();
+        }
+        if (!window)
+        {
+            done += self->readSync(*f, static_cast<std::byte*>(pDst) + done, sizeInBytes - done);
+            break;
+        }
+
+        while (window->state == Window::State::InFlight)
+        {
+            if (!self->reapCompletions(*f, true))
+                break;
+        }
+        if (window->state == Window::State::InFlight)
+        {
+            // The ring is stuck, so rather than wait on it forever the rest is read directly.
+            window->state = Window::State::Stale;
+            done += self->readSync(*f, static_cast<std::byte*>(pDst) + done, sizeInBytes - done);
+            break;
+        }
+        if (window->error == 0 && window->length > 0 && f->cursor >= window->offset + window->length)
+            continue; // Came up short of the cursor.
+        if (window->error != 0 || window->length == 0)
+        {
+            error = window->error;
+            window->state = Window::State::Empty;
+            if (error == 0)
+                done += self->readSync(*f, static_cast<std::byte*>(pDst) + done, sizeInBytes - done);
+            break;
+        }
+
+        size_t toCopy = (size_t)std::min<uint64_t>(sizeInBytes - done, window->offset + window->length - f->cursor);
+        std::memcpy(static_cast<std::byte*>(pDst) + done, window->data.get() + (f->cursor - window->offset), toCopy);
+        done += toCopy;
+        f->cursor += toCopy;
+    }
+    self->prefetchAhead(*f);
+
+    if (pBytesRead)
+        *pBytesRead = done;
+    if (done == 0 && error != 0)
+        return MA_IO_ERROR;
+    return done == 0 && sizeInBytes > 0 ? MA_AT_END : MA_SUCCESS;
+}
+ma_result AsyncFileVFS::onWrite(ma_vfs* pVFS, ma_vfs_file file, const void* pSrc, size_t sizeInBytes, size_t* pBytesWritten)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_write(&static_cast<AsyncFileVFS*>(pVFS)->fallback, f->fallback, pSrc, sizeInBytes, pBytesWritten);
+    return MA_ACCESS_DENIED;
+}
+ma_result AsyncFileVFS::onSeek(ma_vfs* pVFS, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_seek(&static_cast<AsyncFileVFS*>(pVFS)->fallback, f->fallback, offset, origin);
+
+    ma_int64 base = 0;
+    switch (origin)
+    {
+    case ma_seek_origin_start: base = 0; break;
+    case ma_seek_origin_current: base = (ma_int64)f->cursor; break;
+    case ma_seek_origin_end: base = (ma_int64)f->size; break;
+    }
+    if (base + offset < 0)
+        return MA_INVALID_ARGS;
+    f->cursor = (uint64_t)(base + offset);
+    return MA_SUCCESS;
+}
+ma_result AsyncFileVFS::onTell(ma_vfs* pVFS, ma_vfs_file file, ma_int64* pCursor)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_tell(&static_cast<AsyncFileVFS*>(pVFS)->fallback, f->fallback, pCursor);
+
+    *pCursor = (ma_int64)f->cursor;
+    return MA_SUCCESS;
+}
+ma_result AsyncFileVFS::onInfo(ma_vfs* pVFS, ma_vfs_file file, ma_file_info* pInfo)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_info(&static_cast<AsyncFileVFS*>(pVFS)->fallback, f->fallback, pInfo);
+
+    pInfo->sizeInBytes = f->size;
+    return MA_SUCCESS;
+}
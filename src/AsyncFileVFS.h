@@ -0,0 +1,83 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <IoUring.h>
+
+namespace fs = std::filesystem;
+
+// miniaudio VFS for streamed playback off slow (network) storage. Sequential reads are served from a set of
+// prefetch windows that io_uring fills ahead of the read cursor, so the decoding thread rarely waits on the disk.
+// Without io_uring it falls back to plain pread() plus kernel read-ahead hints, and off Linux to the default VFS.
+class AsyncFileVFS
+{
+    ma_vfs_callbacks callbacks; // Must stay the first member, miniaudio reinterprets ma_vfs* as ma_vfs_callbacks*.
+    ma_default_vfs fallback;
+
+    struct Window
+    {
+        enum class State
+        {
+            Empty,
+            InFlight,
+            Ready,
+            Stale // Given up on while in flight. The kernel may still write to it, so it's only free again once reaped.
+        };
+
+        std::unique_ptr<std::byte[]> data;
+        uint64_t offset = 0;
+        size_t length = 0;
+        State state = State::Empty;
+        int error = 0;
+        bool locked = false;  // Pinned through MemoryLock.
+    };
+    struct File
+    {
+        int fd = -1;
+        uint64_t size = 0;
+        uint64_t cursor = 0;
+        std::vector<Window> windows;
+        IoUring ring; // Declared after `windows` so in-flight reads are drained before the buffers go.
+        ma_vfs_file fallback = nullptr;
+    };
+
+    static ma_result onOpen(ma_vfs* pVFS, const char* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile);
+    static ma_result onOpenW(ma_vfs* pVFS, const wchar_t* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile);
+    static ma_result onClose(ma_vfs* pVFS, ma_vfs_file file);
+    static ma_result onRead(ma_vfs* pVFS, ma_vfs_file file, void* pDst, size_t sizeInBytes, size_t* pBytesRead);
+    static ma_result onWrite(ma_vfs* pVFS, ma_vfs_file file, const void* pSrc, size_t sizeInBytes, size_t* pBytesWritten);
+    static ma_result onSeek(ma_vfs* pVFS, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin);
+    static ma_result onTell(ma_vfs* pVFS, ma_vfs_file file, ma_int64* pCursor);
+    static ma_result onInfo(ma_vfs* pVFS, ma_vfs_file file, ma_file_info* pInfo);
+
+    static ma_result openFile(AsyncFileVFS* self, const fs::path& path, ma_uint32 openMode, ma_vfs_file* pFile);
+
+    Window* findWindow(File& file, uint64_t offset);
+    Window* issueWindow(File& file, uint64_t offset);
+    // Whether it reaped anything. Blocking, false only if the ring can't make progress, as when it can't submit.
+    bool reapCompletions(File& file, bool block);
+    void prefetchAhead(File& file);
+    size_t readSync(File& file, void* pDst, size_t sizeInBytes);
+public:
+    // Size of each prefetch window, and how many are kept in flight ahead of the cursor.
+    size_t windowSize = 256 * 1024;
+    uint32_t windowCount = 4;
+
+    AsyncFileVFS();
+    AsyncFileVFS(const AsyncFileVFS&) = delete;
+
+    inline ma_vfs* vfs()
+    {
+        return this;
+    }
+
+    // Whether reads will actually go through io_uring.
+    static bool asynchronous();
+    // Whether `path` lives on a network filesystem, where streaming beats mapping.
+    static bool isRemote(const fs::path& path);
+};
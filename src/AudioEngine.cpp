@@ -0,0 +1,514 @@
+#include "AudioEngine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <AudioStats.h>
+#include <MusicPlayer.h>
+#include <PlaybackClock.h>
+
+namespace
+{
+    std::string_view trim(std::string_view text)
+    {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+            return {};
+        return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+    }
+    bool parseUnsigned(std::string_view text, uint32_t& out)
+    {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+
+    ma_device_config deviceConfig(const AudioEngineSettings& settings, ma_device_data_proc callback, void* userData)
+    {
+        ma_device_config config = ma_device_config_init(ma_device_type_playback);
+        config.playback.format = ma_format_f32;
+        config.playback.channels = settings.channels;
+        config.sampleRate = settings.sampleRate;
+        config.periodSizeInFrames = settings.periodFrames;
+        config.periods = settings.periods;
+        config.performanceProfile = settings.lowLatency ? ma_performance_profile_low_latency : ma_performance_profile_conservative;
+        config.dataCallback = callback;
+        config.pUserData = userData;
+        // As ma_engine sets up its own: the mixer writes every frame and clips itself.
+        config.noPreSilencedOutputBuffer = MA_TRUE;
+        config.noClip = MA_TRUE;
+        return config;
+    }
+    // The device thread is miniaudio's, so it's tuned from inside, on its first callback.
+    void tunedDataCallback(ma_device* device, void* framesOut, const void* framesIn, ma_uint32 frameCount)
+    {
+        static thread_local bool tuned = false;
+        if (!tuned)
+        {
+            ThreadTuning::apply(ThreadRole::Audio, AudioEngine::settings.audioThread);
+            tuned = true;
+        }
+        AudioEngine::noteCallback();
+        PlaybackClock::dataCallback(device, framesOut, framesIn, frameCount);
+    }
+    const char* backendName(AudioBackend backend)
+    {
+        switch (backend)
+        {
+        case AudioBackend::Null: return "null";
+        case AudioBackend::NoDevice: return "none";
+        default: return "default";
+        }
+    }
+}
+
+bool AudioEngine::loadConfig(std::string& errors)
+{
+    std::ifstream file(AudioEngine::configFile);
+    if (!file)
+        return !fs::exists(AudioEngine::configFile);
+
+    AudioEngineSettings& settings = AudioEngine::settings;
+    std::string line;
+    for (uint32_t number = 1; std::getline(file, line); number++)
+    {
+        std::string_view text = trim(std::string_view(line).substr(0, line.find('#')));
+        if (text.empty())
+            continue;
+        size_t equals = text.find('=');
+        std::string_view key = trim(text.substr(0, equals)), value = equals == std::string_view::npos ? std::string_view() : trim(text.substr(equals + 1));
+
+        bool ok = true;
+        if (key == "period_frames")
+            ok = parseUnsigned(value, settings.periodFrames);
+        else if (key == "periods")
+            ok = parseUnsigned(value, settings.periods);
+        else if (key == "sample_rate")
+            ok = parseUnsigned(value, settings.sampleRate);
+        else if (key == "channels")
+            ok = parseUnsigned(value, settings.channels) && settings.channels <= MA_MAX_CHANNELS;
+        else if (key == "profile")
+        {
+            if (value == "low_latency")
+                settings.lowLatency = true;
+            else if (value == "conservative")
+                settings.lowLatency = false;
+            else ok = false;
+        }
+        else if (key == "backend")
+        {
+            if (value == "default")
+                settings.backend = AudioBackend::Default;
+            else if (value == "null")
+                settings.backend = AudioBackend::Null;
+            else if (value == "none")
+                settings.backend = AudioBackend::NoDevice;
+            else ok = false;
+        }
+        else if (key == "job_threads")
+            // Streamed tracks only make progress on a job thread, so there's always at least one.
+            ok = parseUnsigned(value, settings.jobThreads) && settings.jobThreads >= 1;
+        else if (key == "audio_scheduling")
+            ok = ThreadTuning::parsePolicy(value, settings.audioThread);
+        else if (key == "decode_scheduling")
+            ok = ThreadTuning::parsePolicy(value, settings.decodeThreads);
+        else if (key == "audio_cpus")
+            ok = ThreadTuning::parseCpus(value, settings.audioThread.cpus);
+        else if (key == "decode_cpus")
+            ok = ThreadTuning::parseCpus(value, settings.decodeThreads.cpus);
+        else if (key == "ui_cpus")
+            ok = ThreadTuning::parseCpus(value, settings.uiThread.cpus);
+        else if (key == "lock_memory")
+        {
+            if (value == "on")
+                settings.lockMemory = true;
+            else if (value == "off")
+                settings.lockMemory = false;
+            else ok = false;
+        }
+        else if (key == "idle_suspend_ms")
+            ok = parseUnsigned(value, settings.idleSuspendMs);
+        else
+        {
+            errors.append(AudioEngine::configFile.string()).append(":").append(std::to_string(number)).append(": unknown key \"").append(key).append("\"\n");
+            continue;
+        }
+        if (!ok)
+            errors.append(AudioEngine::configFile.string()).append(":").append(std::to_string(number)).append(": invalid value for \"").append(key).append("\"\n");
+    }
+    return true;
+}
+
+ma_result AudioEngine::init()
+{
+    const AudioEngineSettings& settings = AudioEngine::settings;
+    MemoryLock::enabled = settings.lockMemory;
+    ma_result result;
+    if (settings.backend == AudioBackend::Null)
+    {
+        ma_backend backend = ma_backend_null;
+        ma_context_config config = ma_context_config_init();
+        if ((result = ma_context_init(&backend, 1, &config, &AudioEngine::context)) != MA_SUCCESS)
+            return result;
+        AudioEngine::hasContext = true;
+    }
+
+    uint32_t sampleRate = settings.sampleRate, channels = settings.channels;
+    if (settings.backend != AudioBackend::NoDevice)
+    {
+        // Ours rather than the engine's, since ma_engine_config has no way to ask for periods or a profile.
+        ma_device_config config = deviceConfig(settings, tunedDataCallback, &MusicPlayer::engine);
+        if ((result = ma_device_init(AudioEngine::hasContext ? &AudioEngine::context : nullptr, &config, &AudioEngine::device)) != MA_SUCCESS)
+        {
+            AudioEngine::uninit();
+            return result;
+        }
+        AudioEngine::hasDevice = true;
+        sampleRate = AudioEngine::device.sampleRate;
+        channels = AudioEngine::device.playback.channels;
+    }
+    else
+    {
+        sampleRate = sampleRate ? sampleRate : 48000;
+        channels = channels ? channels : 2;
+    }
+
+    ma_resource_manager_config resourceConfig = ma_resource_manager_config_init();
+    resourceConfig.decodedFormat = ma_format_f32;
+    resourceConfig.decodedChannels = 0;
+    resourceConfig.decodedSampleRate = sampleRate;
+    resourceConfig.jobThreadCount = 0;
+    resourceConfig.pVFS = MusicPlayer::vfs.vfs();
+    if ((result = ma_resource_manager_init(&resourceConfig, &AudioEngine::resourceManager)) != MA_SUCCESS)
+    {
+        AudioEngine::uninit();
+        return result;
+    }
+    AudioEngine::hasResourceManager = true;
+    for (uint32_t i = 0; i < std::max(settings.jobThreads, 1u); i++)
+    {
+        AudioEngine::jobThreads.emplace_back([]
+        {
+            ThreadTuning::apply(ThreadRole::Decode, AudioEngine::settings.decodeThreads);
+            // Blocks for the next job. The quit job posted on uninit stays queued, so it reaches every thread.
+            while (ma_resource_manager_process_next_job(&AudioEngine::resourceManager) != MA_CANCELLED);
+        });
+    }
+
+    ma_engine_config engineConfig = ma_engine_config_init();
+    engineConfig.pResourceManager = &AudioEngine::resourceManager;
+    engineConfig.pDevice = AudioEngine::hasDevice ? &AudioEngine::device : nullptr;
+    engineConfig.noDevice = !AudioEngine::hasDevice;
+    engineConfig.sampleRate = sampleRate;
+    engineConfig.channels = channels;
+    engineConfig.periodSizeInFrames = settings.periodFrames;
+    if ((result = ma_engine_init(&engineConfig, &MusicPlayer::engine)) != MA_SUCCESS)
+    {
+        AudioEngine::uninit();
+        return result;
+    }
+    AudioEngine::hasEngine = true;
+
+    if (!AudioEngine::hasDevice)
+        AudioEngine::startPump(sampleRate, channels);
+    AudioEngine::isSuspended = AudioEngine::waking = false;
+    AudioEngine::lastActive = Clock::now();
+    return MA_SUCCESS;
+}
+void AudioEngine::uninit()
+{
+    if (AudioEngine::pump.joinable())
+    {
+        AudioEngine::pump.request_stop();
+        AudioEngine::unparkPump();
+        AudioEngine::pump.join();
+    }
+    // Stops the device first when there is one, so nothing mixes from here on.
+    if (AudioEngine::hasEngine)
+        ma_engine_uninit(&MusicPlayer::engine);
+    if (AudioEngine::hasDevice)
+        ma_device_uninit(&AudioEngine::device);
+    if (AudioEngine::hasResourceManager)
+    {
+        ma_resource_manager_post_job_quit(&AudioEngine::resourceManager);
+        AudioEngine::jobThreads.clear();
+        ma_resource_manager_uninit(&AudioEngine::resourceManager);
+    }
+    if (AudioEngine::hasContext)
+        ma_context_uninit(&AudioEngine::context);
+    AudioEngine::isSuspended = AudioEngine::waking = false;
+    AudioEngine::hasEngine = AudioEngine::hasDevice = AudioEngine::hasResourceManager = AudioEngine::hasContext = false;
+}
+
+void AudioEngine::startPump(uint32_t sampleRate, uint32_t channels)
+{
+    uint32_t period = AudioEngine::settings.periodFrames ? AudioEngine::settings.periodFrames : sampleRate / 100;
+    AudioEngine::pumpState.store(PumpState::Running, std::memory_order_relaxed);
+    AudioEngine::pump = std::jthread([period, sampleRate, channels](std::stop_token stop)
+    {
+        ThreadTuning::apply(ThreadRole::Audio, AudioEngine::settings.audioThread);
+        std::vector<float> buffer(size_t(period) * channels);
+        const auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(double(period) / sampleRate));
+        Clock::time_point next = Clock::now();
+        while (!stop.stop_requested())
+        {
+            if (AudioEngine::pumpState.load(std::memory_order_acquire) == PumpState::Parking) [[unlikely]]
+            {
+                AudioEngine::pumpState.store(PumpState::Parked, std::memory_order_release);
+                AudioEngine::pumpState.notify_all();
+                AudioEngine::pumpState.wait(PumpState::Parked, std::memory_order_acquire);
+                // Periods missed while parked aren't owed.
+                next = Clock::now();
+                continue;
+            }
+            AudioEngine::noteCallback();
+            PlaybackClock::mix(&MusicPlayer::engine, buffer.data(), period);
+            next += interval;
+            // Fallen behind by more than a few periods, catching up would only play them back to back.
+            if (Clock::now() - next > interval * 4)
+                next = Clock::now();
+            std::this_thread::sleep_until(next);
+        }
+    });
+}
+void AudioEngine::parkPump()
+{
+    // Returns once the pump is between periods, so nothing mixes until it's unparked.
+    AudioEngine::pumpState.store(PumpState::Parking, std::memory_order_release);
+    AudioEngine::pumpState.wait(PumpState::Parking, std::memory_order_acquire);
+}
+void AudioEngine::unparkPump()
+{
+    AudioEngine::pumpState.store(PumpState::Running, std::memory_order_release);
+    AudioEngine::pumpState.notify_all();
+}
+void AudioEngine::noteCallback()
+{
+    if (AudioEngine::firstCallbackNs.load(std::memory_order_relaxed) < 0) [[unlikely]]
+        AudioEngine::firstCallbackNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count(), std::memory_order_release);
+}
+
+void AudioEngine::wake()
+{
+    AudioEngine::lastActive = Clock::now();
+    if (!AudioEngine::isSuspended)
+        return;
+    // Stopping left the device and its thread set up, so all that's between here and the first callback is the
+    // backend starting its stream again.
+    AudioEngine::firstCallbackNs.store(-1, std::memory_order_relaxed);
+    AudioEngine::wokeAt = AudioEngine::lastActive;
+    if (AudioEngine::hasDevice)
+    {
+        if (ma_device_start(&AudioEngine::device) != MA_SUCCESS) [[unlikely]]
+            return;
+    }
+    else AudioEngine::unparkPump();
+    AudioEngine::isSuspended = false;
+    AudioEngine::waking = true;
+    AudioEngine::wakes++;
+}
+void AudioEngine::tick()
+{
+    if (!AudioEngine::hasEngine)
+        return;
+    if (AudioEngine::waking)
+    {
+        if (int64_t heardNs = AudioEngine::firstCallbackNs.load(std::memory_order_acquire); heardNs >= 0)
+        {
+            double ms = (heardNs - std::chrono::duration_cast<std::chrono::nanoseconds>(AudioEngine::wokeAt.time_since_epoch()).count()) / 1e6;
+            AudioEngine::lastWakeMs = ms;
+            AudioEngine::totalWakeMs += ms;
+            AudioEngine::peakWakeMs = std::max(AudioEngine::peakWakeMs, ms);
+            AudioEngine::measuredWakes++;
+            AudioEngine::waking = false;
+        }
+    }
+
+    Clock::time_point now = Clock::now();
+    // A seek grain plays while paused, and a fade out runs on after the pause that started it, so anything still
+    // playing counts as well.
+    if (MusicPlayer::playing && (!MusicPlayer::paused || ma_sound_is_playing(&MusicPlayer::music)))
+    {
+        AudioEngine::lastActive = now;
+        return;
+    }
+    if (AudioEngine::isSuspended || !AudioEngine::settings.idleSuspendMs || now - AudioEngine::lastActive < std::chrono::milliseconds(AudioEngine::settings.idleSuspendMs))
+        return;
+
+    if (AudioEngine::hasDevice)
+    {
+        // Waits for the callback in flight, so nothing mixes once this returns.
+        if (ma_device_stop(&AudioEngine::device) != MA_SUCCESS) [[unlikely]]
+            return;
+    }
+    else AudioEngine::parkPump();
+    AudioStats::deviceStopped();
+    AudioEngine::isSuspended = true;
+    AudioEngine::waking = false;
+    AudioEngine::suspends++;
+}
+AudioEngine::IdleStats AudioEngine::idleStats()
+{
+    IdleStats stats {};
+    stats.suspends = AudioEngine::suspends;
+    stats.wakes = AudioEngine::wakes;
+    stats.measured = AudioEngine::measuredWakes;
+    stats.lastWakeMs = AudioEngine::lastWakeMs;
+    stats.averageWakeMs = AudioEngine::measuredWakes ? AudioEngine::totalWakeMs / AudioEngine::measuredWakes : 0.0;
+    stats.peakWakeMs = AudioEngine::peakWakeMs;
+    return stats;
+}
+
+std::string AudioEngine::describe()
+{
+    const AudioEngineSettings& settings = AudioEngine::settings;
+    auto orDefault = [](uint32_t value) { return value ? std::to_string(value) : std::string("default"); };
+    std::ostringstream info;
+    info << std::fixed << std::setprecision(1);
+    info << "configured (" << AudioEngine::configFile.string() << "): backend " << backendName(settings.backend) << ", " << orDefault(settings.periodFrames)
+         << " frame periods x " << orDefault(settings.periods) << ", " << orDefault(settings.sampleRate) << " Hz, " << orDefault(settings.channels)
+         << " channels, " << (settings.lowLatency ? "low latency" : "conservative") << " profile, " << settings.jobThreads << " job threads.\n";
+    if (AudioEngine::hasDevice)
+    {
+        const ma_device& device = AudioEngine::device;
+        uint32_t periodFrames = device.playback.internalPeriodSizeInFrames, periods = device.playback.internalPeriods;
+        info << "    device: \"" << device.playback.name << "\" on " << ma_get_backend_name(device.pContext->backend) << ", " << device.sampleRate << " Hz ("
+             << device.playback.internalSampleRate << " internally), " << device.playback.channels << " channels, " << periodFrames << " frame periods x "
+             << periods << " = " << periodFrames * periods * 1000.0 / std::max(device.playback.internalSampleRate, 1u) << " ms buffered.\n";
+    }
+    else if (AudioEngine::hasEngine)
+        info << "    no device: pumped at " << ma_engine_get_sample_rate(&MusicPlayer::engine) << " Hz by a thread of our own.\n";
+    else info << "    not running.\n";
+    if (AudioEngine::hasEngine)
+    {
+        IdleStats idle = AudioEngine::idleStats();
+        info << "    idle suspend: ";
+        if (settings.idleSuspendMs)
+            info << "after " << settings.idleSuspendMs << " ms idle, ";
+        else info << "off, ";
+        info << (AudioEngine::isSuspended ? "suspended now" : "running now") << ", " << idle.suspends << " suspends, " << idle.wakes << " wakes";
+        if (idle.measured)
+            info << std::setprecision(2) << ", wake to first callback " << idle.lastWakeMs << " ms last, " << idle.averageWakeMs << " ms average, "
+                 << idle.peakWakeMs << " ms peak" << std::setprecision(1);
+        info << ".\n";
+    }
+    info << "    audio thread: " << ThreadTuning::describe(ThreadRole::Audio, settings.audioThread) << ".\n"
+         << "    decode threads: " << ThreadTuning::describe(ThreadRole::Decode, settings.decodeThreads) << ".\n"
+         << "    ui thread: " << ThreadTuning::describe(ThreadRole::Ui, settings.uiThread) << ".\n"
+         << "    memory locking: " << MemoryLock::describe() << ".\n";
+    return std::move(info).str();
+}
+
+std::string AudioEngine::measureLatency(uint32_t trials)
+{
+    using Clock = std::chrono::steady_clock;
+    struct Probe
+    {
+        ma_engine engine;
+        uint32_t sampleRate = 0, channels = 0;
+        // When the first frame of the sound came out of the mixer, or -1 while waiting for it.
+        std::atomic<int64_t> heardNs = -1;
+    };
+    auto probe = std::make_unique<Probe>();
+
+    ma_context nullContext;
+    ma_backend backend = ma_backend_null;
+    ma_context_config contextConfig = ma_context_config_init();
+    if (ma_context_init(&backend, 1, &contextConfig, &nullContext) != MA_SUCCESS)
+        return "couldn't start the null backend\n";
+
+    ma_device probeDevice;
+    ma_device_config config = deviceConfig(AudioEngine::settings, [](ma_device* device, void* framesOut, const void*, ma_uint32 frameCount)
+    {
+        Probe& probe = *(Probe*)device->pUserData;
+        Clock::time_point begin = Clock::now();
+        ma_engine_read_pcm_frames(&probe.engine, framesOut, frameCount, nullptr);
+        if (probe.heardNs.load(std::memory_order_relaxed) >= 0)
+            return;
+        const float* samples = (const float*)framesOut;
+        for (uint32_t i = 0; i < frameCount * probe.channels; i++)
+        {
+            if (samples[i] != 0.0f)
+            {
+                // Where in the period it falls, as if the period were played out from when the callback started.
+                auto at = begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(double(i / probe.channels) / probe.sampleRate));
+                probe.heardNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count(), std::memory_order_release);
+                return;
+            }
+        }
+    }, probe.get());
+    if (ma_device_init(&nullContext, &config, &probeDevice) != MA_SUCCESS)
+    {
+        ma_context_uninit(&nullContext);
+        return "couldn't open a null device\n";
+    }
+    probe->sampleRate = probeDevice.sampleRate;
+    probe->channels = probeDevice.playback.channels;
+
+    ma_engine_config engineConfig = ma_engine_config_init();
+    engineConfig.pDevice = &probeDevice;
+    engineConfig.periodSizeInFrames = AudioEngine::settings.periodFrames;
+    ma_waveform tone;
+    ma_waveform_config toneConfig = ma_waveform_config_init(ma_format_f32, probe->channels, probe->sampleRate, ma_waveform_type_square, 0.5, 440.0);
+    ma_sound sound;
+    if (ma_engine_init(&engineConfig, &probe->engine) != MA_SUCCESS)
+    {
+        ma_device_uninit(&probeDevice);
+        ma_context_uninit(&nullContext);
+        return "couldn't start an engine on the null device\n";
+    }
+    ma_waveform_init(&toneConfig, &tone);
+    if (ma_sound_init_from_data_source(&probe->engine, &tone, MA_SOUND_FLAG_NO_SPATIALIZATION, nullptr, &sound) != MA_SUCCESS)
+    {
+        ma_engine_uninit(&probe->engine);
+        ma_device_uninit(&probeDevice);
+        ma_context_uninit(&nullContext);
+        return "couldn't start a test tone\n";
+    }
+
+    // Starts land anywhere within a period, as commands do.
+    std::minstd_rand random(1);
+    std::uniform_int_distribution<int> jitterUs(2000, 20000);
+    std::vector<double> mixed;
+    for (uint32_t i = 0; i < trials; i++)
+    {
+        ma_sound_stop(&sound);
+        std::this_thread::sleep_for(std::chrono::microseconds(jitterUs(random)));
+        probe->heardNs.store(-1, std::memory_order_relaxed);
+        Clock::time_point issued = Clock::now();
+        ma_sound_start(&sound);
+        while (probe->heardNs.load(std::memory_order_acquire) < 0 && Clock::now() - issued < std::chrono::seconds(1))
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        int64_t heardNs = probe->heardNs.load(std::memory_order_acquire);
+        if (heardNs >= 0)
+            mixed.push_back((heardNs - std::chrono::duration_cast<std::chrono::nanoseconds>(issued.time_since_epoch()).count()) / 1e6);
+    }
+
+    uint32_t periodFrames = probeDevice.playback.internalPeriodSizeInFrames, periods = probeDevice.playback.internalPeriods;
+    double bufferedMs = periodFrames * periods * 1000.0 / std::max(probe->sampleRate, 1u);
+    ma_sound_uninit(&sound);
+    ma_engine_uninit(&probe->engine);
+    ma_device_uninit(&probeDevice);
+    ma_waveform_uninit(&tone);
+    ma_context_uninit(&nullContext);
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "null device at " << probe->sampleRate << " Hz, " << periodFrames << " frame periods x " << periods << ", " << (AudioEngine::settings.lowLatency ? "low latency" : "conservative")
+           << " profile, " << mixed.size() << '/' << trials << " starts heard\n";
+    if (mixed.empty())
+        return std::move(report).str();
+    std::sort(mixed.begin(), mixed.end());
+    auto percentile = [&](uint32_t p) { return mixed[std::min(mixed.size() - 1, mixed.size() * p / 100)]; };
+    report << "  start to mixed    " << std::setw(8) << percentile(50) << " ms median, " << std::setw(8) << percentile(95) << " ms p95, " << std::setw(8) << mixed.back() << " ms max\n"
+           << "  start to audible  " << std::setw(8) << percentile(50) + bufferedMs << " ms median, " << std::setw(8) << percentile(95) + bufferedMs << " ms p95, "
+           << std::setw(8) << mixed.back() + bufferedMs << " ms max (" << bufferedMs << " ms device buffer)\n"
+           << "  (commands typed or clicked wait up to one frame for the next tick before this starts)\n";
+    return std::move(report).str();
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ThreadTuning.h>
+
+namespace fs = std::filesystem;
+
+enum class AudioBackend
+{
+    Default,  // The platform's usual devices.
+    Null,     // miniaudio's null device: paced in real time, heard by nobody.
+    NoDevice  // No device at all. The engine is pumped at the device rate from a thread of our own.
+};
+
+// How the engine is set up, read from the config file at startup. Zeroes leave the choice to miniaudio or the device.
+struct AudioEngineSettings
+{
+    uint32_t periodFrames = 0;
+    uint32_t periods = 0;
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    bool lowLatency = false;  // ma_performance_profile_low_latency, for smaller periods when none are given.
+    AudioBackend backend = AudioBackend::Default;
+    uint32_t jobThreads = 1;  // Resource manager threads, which stream and decode tracks loaded asynchronously.
+    ThreadSettings audioThread, decodeThreads, uiThread;
+    bool lockMemory = false;  // Pins mapped tracks and streaming buffers in RAM. See MemoryLock.
+    uint32_t idleSuspendMs = 10000; // How long nothing plays before the device is stopped. 0 keeps it running.
+};
+
+// Owns the device, context and resource manager behind MusicPlayer::engine, so they can be configured rather than left
+// to ma_engine_init's defaults.
+struct AudioEngine
+{
+    AudioEngine() = delete;
+
+    inline static fs::path configFile = "tacrad.cfg";
+    inline static AudioEngineSettings settings;
+
+    // Applies what the config file sets, as `key = value` lines, over the current settings. A missing file is no error.
+    // Lines that can't be understood are skipped and described in `errors`, one per line.
+    static bool loadConfig(std::string& errors);
+
+    // Starts MusicPlayer::engine as configured.
+    static ma_result init();
+    static void uninit();
+
+    // The settings asked for, and what the device actually gave.
+    static std::string describe();
+    // From starting a sound on the control thread to its first frame leaving the mixer, and then to the end of the
+    // device's buffer, on a null device configured like the real one. Leaves the running engine alone.
+    static std::string measureLatency(uint32_t trials = 32);
+
+    // Control thread. Starts the device again if it was suspended, before anything that should be heard. Cheap when
+    // it's running, so it's called before every start.
+    static void wake();
+    // Control thread, every tick. Suspends the device once nothing has played for settings.idleSuspendMs, and
+    // collects how long the last wake took to reach its first callback.
+    static void tick();
+    inline static bool suspended()
+    {
+        return AudioEngine::isSuspended;
+    }
+
+    struct IdleStats
+    {
+        uint64_t suspends, wakes, measured;
+        double lastWakeMs, averageWakeMs, peakWakeMs;
+    };
+    static IdleStats idleStats();
+    // Audio thread, at the top of every callback.
+    static void noteCallback();
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static void startPump(uint32_t sampleRate, uint32_t channels);
+    static void parkPump();
+    static void unparkPump();
+
+    inline static ma_context context;
+    inline static ma_device device;
+    inline static ma_resource_manager resourceManager;
+    inline static bool hasContext = false, hasDevice = false, hasResourceManager = false, hasEngine = false;
+    inline static std::jthread pump;
+    // Asked to park while suspended, and parked, it waits without mixing rather than ending, as a device's thread does.
+    enum class PumpState : int { Running, Parking, Parked };
+    inline static std::atomic<PumpState> pumpState = PumpState::Running;
+    // Run by us rather than the resource manager, so they can be tuned as they start.
+    inline static std::vector<std::jthread> jobThreads;
+
+    inline static bool isSuspended = false, waking = false;
+    inline static Clock::time_point lastActive, wokeAt;
+    // When the first callback after a wake ran, or -1 until it has. Cleared while the device is stopped, so the audio
+    // thread only ever sets it.
+    inline static std::atomic<int64_t> firstCallbackNs = -1;
+    inline static uint64_t suspends = 0, wakes = 0, measuredWakes = 0;
+    inline static double lastWakeMs = 0.0, totalWakeMs = 0.0, peakWakeMs = 0.0;
+};
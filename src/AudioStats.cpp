@@ -0,0 +1,199 @@
+#include "AudioStats.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+#include <utility>
+
+#include <MusicPlayer.h>
+
+namespace
+{
+    uint32_t bucketOf(uint64_t ns)
+    {
+        uint64_t us = ns / 1000;
+        return us < 2 ? 0 : std::min<uint32_t>(uint32_t(std::bit_width(us)) - 1, AudioStats::histogramBuckets - 1);
+    }
+    uint32_t saturate(uint64_t value)
+    {
+        return uint32_t(std::min<uint64_t>(value, UINT32_MAX));
+    }
+    void raise(std::atomic<uint32_t>& peak, uint32_t value)
+    {
+        // One writer, so no compare-exchange.
+        if (value > peak.load(std::memory_order_relaxed))
+            peak.store(value, std::memory_order_relaxed);
+    }
+}
+
+void AudioStats::record(Clock::time_point begin, Clock::time_point read, uint32_t frames, uint32_t delivered, const PlaybackClockSample& sample, bool atEnd)
+{
+    uint64_t callbackNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(read - begin).count());
+    uint64_t effectsNs = std::exchange(AudioStats::effectNs, 0);
+    uint64_t decodeNs = callbackNs > effectsNs ? callbackNs - effectsNs : 0;
+    uint64_t budgetNs = sample.sampleRate ? uint64_t(frames) * 1'000'000'000 / sample.sampleRate : 0;
+
+    uint32_t flags = 0;
+    uint64_t gapNs = 0;
+    if (AudioStats::lastBegin != Clock::time_point())
+    {
+        gapNs = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(begin - AudioStats::lastBegin).count());
+        uint64_t dueNs = sample.sampleRate ? uint64_t(AudioStats::lastFrames) * 1'000'000'000 / sample.sampleRate : 0;
+        if (dueNs && gapNs > dueNs + dueNs / 2 && gapNs < uint64_t(AudioStats::restartSeconds * 1e9))
+            flags |= AudioStats::Late;
+    }
+    if (budgetNs && callbackNs > budgetNs)
+        flags |= AudioStats::Overrun;
+    if (delivered < frames)
+        flags |= AudioStats::Short;
+    // Only between two callbacks that both saw the same track playing, and not as it runs out. Off 1x, the stretcher
+    // takes whole windows at a time, so the track only has to keep up within one.
+    uint64_t trackShort = 0;
+    uint64_t due = sample.speed == 1.0f ? frames : uint64_t(frames * double(sample.speed));
+    uint64_t slack = sample.speed == 1.0f ? 0 : MusicPlayer::stretcher.hopFrames();
+    if (sample.running && AudioStats::lastRunning && sample.generation == AudioStats::lastGeneration && !atEnd &&
+        sample.cursor >= AudioStats::lastCursor && sample.cursor - AudioStats::lastCursor + slack < due)
+    {
+        trackShort = due - (sample.cursor - AudioStats::lastCursor);
+        flags |= AudioStats::TrackShort;
+    }
+    AudioStats::lastBegin = begin;
+    AudioStats::lastFrames = frames;
+    AudioStats::lastCursor = sample.cursor;
+    AudioStats::lastGeneration = sample.generation;
+    AudioStats::lastRunning = sample.running;
+
+    AudioStats::callbacks.fetch_add(1, std::memory_order_relaxed);
+    if (flags & AudioStats::Late)
+        AudioStats::late.fetch_add(1, std::memory_order_relaxed);
+    if (flags & AudioStats::Overrun)
+        AudioStats::overruns.fetch_add(1, std::memory_order_relaxed);
+    if (flags & AudioStats::Short)
+        AudioStats::shortCallbacks.fetch_add(1, std::memory_order_relaxed);
+    AudioStats::framesRequested.fetch_add(frames, std::memory_order_relaxed);
+    AudioStats::framesDelivered.fetch_add(delivered, std::memory_order_relaxed);
+    AudioStats::trackFramesShort.fetch_add(trackShort, std::memory_order_relaxed);
+    AudioStats::totalNs.fetch_add(callbackNs, std::memory_order_relaxed);
+    AudioStats::totalDecodeNs.fetch_add(decodeNs, std::memory_order_relaxed);
+    AudioStats::totalBudgetNs.fetch_add(budgetNs, std::memory_order_relaxed);
+    raise(AudioStats::peakNs, saturate(callbackNs));
+    raise(AudioStats::peakDecodeNs, saturate(decodeNs));
+    if (budgetNs)
+        raise(AudioStats::peakLoadPermille, saturate(callbackNs * 1000 / budgetNs));
+    AudioStats::callbackHistogram[bucketOf(callbackNs)].fetch_add(1, std::memory_order_relaxed);
+    AudioStats::decodeHistogram[bucketOf(decodeNs)].fetch_add(1, std::memory_order_relaxed);
+
+    HistoryEntry& entry = AudioStats::history[AudioStats::historyWrites.load(std::memory_order_relaxed) % AudioStats::historyLength];
+    entry.timestampNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(read.time_since_epoch()).count(), std::memory_order_relaxed);
+    entry.frames.store(frames, std::memory_order_relaxed);
+    entry.delivered.store(delivered, std::memory_order_relaxed);
+    entry.callbackUs.store(saturate(callbackNs / 1000), std::memory_order_relaxed);
+    entry.decodeUs.store(saturate(decodeNs / 1000), std::memory_order_relaxed);
+    entry.effectsUs.store(saturate(effectsNs / 1000), std::memory_order_relaxed);
+    entry.gapUs.store(saturate(gapNs / 1000), std::memory_order_relaxed);
+    entry.flags.store(flags, std::memory_order_relaxed);
+    AudioStats::historyWrites.fetch_add(1, std::memory_order_release);
+}
+
+AudioStats::Stats AudioStats::stats()
+{
+    uint64_t callbacks = AudioStats::callbacks.load(std::memory_order_relaxed);
+    uint64_t budgetNs = AudioStats::totalBudgetNs.load(std::memory_order_relaxed);
+    uint64_t totalNs = AudioStats::totalNs.load(std::memory_order_relaxed);
+    Stats ret
+    {
+        .callbacks = callbacks,
+        .late = AudioStats::late.load(std::memory_order_relaxed),
+        .overruns = AudioStats::overruns.load(std::memory_order_relaxed),
+        .shortCallbacks = AudioStats::shortCallbacks.load(std::memory_order_relaxed),
+        .framesRequested = AudioStats::framesRequested.load(std::memory_order_relaxed),
+        .framesDelivered = AudioStats::framesDelivered.load(std::memory_order_relaxed),
+        .trackFramesShort = AudioStats::trackFramesShort.load(std::memory_order_relaxed),
+        .averageUs = callbacks ? totalNs / 1000.0 / callbacks : 0.0,
+        .peakUs = AudioStats::peakNs.load(std::memory_order_relaxed) / 1000.0,
+        .averageDecodeUs = callbacks ? AudioStats::totalDecodeNs.load(std::memory_order_relaxed) / 1000.0 / callbacks : 0.0,
+        .peakDecodeUs = AudioStats::peakDecodeNs.load(std::memory_order_relaxed) / 1000.0,
+        .averageLoad = budgetNs ? double(totalNs) / budgetNs : 0.0,
+        .peakLoad = AudioStats::peakLoadPermille.load(std::memory_order_relaxed) / 1000.0
+    };
+    for (uint32_t b = 0; b < AudioStats::histogramBuckets; b++)
+    {
+        ret.callbackHistogram[b] = AudioStats::callbackHistogram[b].load(std::memory_order_relaxed);
+        ret.decodeHistogram[b] = AudioStats::decodeHistogram[b].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+void AudioStats::resetStats()
+{
+    for (std::atomic<uint64_t>* counter : { &AudioStats::callbacks, &AudioStats::late, &AudioStats::overruns, &AudioStats::shortCallbacks,
+                                            &AudioStats::framesRequested, &AudioStats::framesDelivered, &AudioStats::trackFramesShort,
+                                            &AudioStats::totalNs, &AudioStats::totalDecodeNs, &AudioStats::totalBudgetNs })
+        counter->store(0, std::memory_order_relaxed);
+    AudioStats::peakNs.store(0, std::memory_order_relaxed);
+    AudioStats::peakDecodeNs.store(0, std::memory_order_relaxed);
+    AudioStats::peakLoadPermille.store(0, std::memory_order_relaxed);
+    for (uint32_t b = 0; b < AudioStats::histogramBuckets; b++)
+    {
+        AudioStats::callbackHistogram[b].store(0, std::memory_order_relaxed);
+        AudioStats::decodeHistogram[b].store(0, std::memory_order_relaxed);
+    }
+}
+void AudioStats::deviceStopped()
+{
+    // Nothing records while the device is stopped, and starting it again orders this before its first callback.
+    AudioStats::lastBegin = Clock::time_point();
+    AudioStats::lastRunning = false;
+}
+
+bool AudioStats::dump(const fs::path& file)
+{
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    Stats stats = AudioStats::stats();
+    out << std::fixed << std::setprecision(1);
+    out << "callbacks " << stats.callbacks << ", late " << stats.late << ", overruns " << stats.overruns << ", short " << stats.shortCallbacks << '\n'
+        << "frames requested " << stats.framesRequested << ", delivered " << stats.framesDelivered << ", track short " << stats.trackFramesShort << '\n'
+        << "callback us average " << stats.averageUs << ", peak " << stats.peakUs << "; decode us average " << stats.averageDecodeUs
+        << ", peak " << stats.peakDecodeUs << "; load average " << stats.averageLoad * 100.0 << "%, peak " << stats.peakLoad * 100.0 << "%\n\n";
+
+    out << "bucket_us,callbacks,decodes\n";
+    for (uint32_t b = 0; b < AudioStats::histogramBuckets; b++)
+        out << AudioStats::bucketFloorUs(b) << ',' << stats.callbackHistogram[b] << ',' << stats.decodeHistogram[b] << '\n';
+
+    out << "\ntimestamp_ns,frames,delivered,callback_us,decode_us,effects_us,gap_us,flags\n";
+    uint64_t writes = AudioStats::historyWrites.load(std::memory_order_acquire);
+    for (uint64_t i = writes - std::min<uint64_t>(writes, AudioStats::historyLength); i < writes; i++)
+    {
+        const HistoryEntry& entry = AudioStats::history[i % AudioStats::historyLength];
+        Period period
+        {
+            .timestampNs = entry.timestampNs.load(std::memory_order_relaxed),
+            .frames = entry.frames.load(std::memory_order_relaxed),
+            .delivered = entry.delivered.load(std::memory_order_relaxed),
+            .callbackUs = entry.callbackUs.load(std::memory_order_relaxed),
+            .decodeUs = entry.decodeUs.load(std::memory_order_relaxed),
+            .effectsUs = entry.effectsUs.load(std::memory_order_relaxed),
+            .gapUs = entry.gapUs.load(std::memory_order_relaxed),
+            .flags = entry.flags.load(std::memory_order_relaxed)
+        };
+        out << period.timestampNs << ',' << period.frames << ',' << period.delivered << ',' << period.callbackUs << ',' << period.decodeUs << ','
+            << period.effectsUs << ',' << period.gapUs << ',';
+        if (period.flags & AudioStats::Late)
+            out << 'L';
+        if (period.flags & AudioStats::Overrun)
+            out << 'O';
+        if (period.flags & AudioStats::Short)
+            out << 'S';
+        if (period.flags & AudioStats::TrackShort)
+            out << 'T';
+        out << '\n';
+    }
+    return bool(out);
+}
+uint32_t AudioStats::bucketFloorUs(uint32_t b)
+{
+    return b == 0 ? 0 : 1u << b;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include <PlaybackClock.h>
+
+namespace fs = std::filesystem;
+
+// What the device callback does each period, counted on the audio thread into fixed-size atomic storage so recording
+// never allocates, locks or waits. Durations are binned by powers of two of microseconds, and the last `historyLength`
+// periods are kept whole for dumping.
+struct AudioStats
+{
+    AudioStats() = delete;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Bucket `b` counts durations from 2^b up to 2^(b + 1) microseconds. The first takes everything shorter, the last
+    // everything longer.
+    static constexpr uint32_t histogramBuckets = 20;
+    static constexpr uint32_t historyLength = 512;
+    // Gaps between callbacks longer than this are the device restarting, not a late callback.
+    static constexpr double restartSeconds = 1.0;
+
+    enum PeriodFlags : uint32_t
+    {
+        Late = 1,        // Started more than half a period after it was due. The device likely ran dry.
+        Overrun = 2,     // Took longer than the audio it produced lasts.
+        Short = 4,       // The engine delivered fewer frames than the device asked for.
+        TrackShort = 8   // The playing track advanced less than the period.
+    };
+    struct Period
+    {
+        int64_t timestampNs;
+        uint32_t frames, delivered;
+        // Decoding counts everything outside the effect nodes: the track's decoder, resampling and mixing.
+        uint32_t callbackUs, decodeUs, effectsUs, gapUs;
+        uint32_t flags;
+    };
+    struct Stats
+    {
+        uint64_t callbacks, late, overruns, shortCallbacks;
+        uint64_t framesRequested, framesDelivered, trackFramesShort;
+        double averageUs, peakUs, averageDecodeUs, peakDecodeUs;
+        // Share of the period's own duration.
+        double averageLoad, peakLoad;
+        std::array<uint64_t, histogramBuckets> callbackHistogram, decodeHistogram;
+    };
+
+    // Audio thread, from the device callback. `begin` is when it was entered and `read` when the engine finished mixing.
+    static void record(Clock::time_point begin, Clock::time_point read, uint32_t frames, uint32_t delivered, const PlaybackClockSample& sample, bool atEnd);
+
+    // Audio thread. Time an effect node spends on this callback's audio, so it can be told apart from decoding.
+    struct EffectScope
+    {
+        Clock::time_point begin = Clock::now();
+        inline ~EffectScope()
+        {
+            AudioStats::effectNs += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - this->begin).count());
+        }
+    };
+
+    // Any thread.
+    static Stats stats();
+    static void resetStats();
+    // Any thread, only while the device is stopped. The gap until its next callback is a restart, however short.
+    static void deviceStopped();
+    // Writes the totals, both histograms and the recent periods as CSV to `file`.
+    static bool dump(const fs::path& file);
+    // The lower edge of bucket `b`, in microseconds.
+    static uint32_t bucketFloorUs(uint32_t b);
+private:
+    // Per thread: offline renders run the same nodes elsewhere, and only the device callback's share is read back.
+    inline static thread_local uint64_t effectNs = 0;
+
+    // Audio thread only.
+    inline static Clock::time_point lastBegin;
+    inline static uint32_t lastFrames = 0;
+    inline static uint64_t lastCursor = 0, lastGeneration = 0;
+    inline static bool lastRunning = false;
+
+    inline static std::atomic<uint64_t> callbacks = 0, late = 0, overruns = 0, shortCallbacks = 0;
+    inline static std::atomic<uint64_t> framesRequested = 0, framesDelivered = 0, trackFramesShort = 0;
+    inline static std::atomic<uint64_t> totalNs = 0, totalDecodeNs = 0, totalBudgetNs = 0;
+    inline static std::atomic<uint32_t> peakNs = 0, peakDecodeNs = 0;
+    inline static std::atomic<uint32_t> peakLoadPermille = 0;
+    inline static std::array<std::atomic<uint64_t>, histogramBuckets> callbackHistogram {}, decodeHistogram {};
+
+    // Zeroed as statics. A reader racing the writer can see an entry half updated, which a dump can live with.
+    struct HistoryEntry
+    {
+        std::atomic<int64_t> timestampNs;
+        std::atomic<uint32_t> frames, delivered;
+        std::atomic<uint32_t> callbackUs, decodeUs, effectsUs, gapUs;
+        std::atomic<uint32_t> flags;
+    };
+    inline static std::array<HistoryEntry, historyLength> history;
+    inline static std::atomic<uint64_t> historyWrites = 0;
+};
@@ -0,0 +1,737 @@
+#include "Benchmark.h"
+
+#include <miniaudio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <map>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#include <AsyncFileVFS.h>
+#include <Convolution.h>
+#include <Equalizer.h>
+#include <JobPool.h>
+#include <Loudness.h>
+#include <MappedFileVFS.h>
+#include <MusicLibrary.h>
+#include <Resampler.h>
+#include <SeekTables.h>
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace
+{
+    struct LatencySummary
+    {
+        double median = 0.0;
+        double p95 = 0.0;
+        double minimum = 0.0;
+        bool failed = false;
+    };
+
+    LatencySummary summarize(std::vector<double>& samples)
+    {
+        if (samples.empty())
+            return LatencySummary { .failed = true };
+
+        std::sort(samples.begin(), samples.end());
+        return LatencySummary
+        {
+            .median = samples[samples.size() / 2],
+            .p95 = samples[std::min(samples.size() - 1, samples.size() * 95 / 100)],
+            .minimum = samples.front()
+        };
+    }
+
+    bool readFirstFrame(ma_decoder& decoder)
+    {
+        float frame[MA_MAX_CHANNELS];
+        ma_uint64 read = 0;
+        bool ok = ma_decoder_read_pcm_frames(&decoder, frame, 1, &read) == MA_SUCCESS && read == 1;
+        ma_decoder_uninit(&decoder);
+        return ok;
+    }
+
+    struct Backends
+    {
+        MappedFileVFS mapped;
+        AsyncFileVFS async;
+    };
+
+    // A line of /proc/self/status, in kilobytes, 0 where there's no such thing.
+    uint64_t statusKb([[maybe_unused]] std::string_view field)
+    {
+#if __linux__
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.starts_with(field))
+                return std::strtoull(line.c_str() + field.size(), nullptr, 10);
+        }
+#endif
+        return 0;
+    }
+    // Resets the process's resident high-water mark, so that the peak afterwards is down to whatever runs next rather
+    // than everything before it, and returns what's resident now. Only Linux can reset it, so nothing elsewhere.
+    std::optional<uint64_t> resetPeakRssKb()
+    {
+#if __linux__
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        if (clearRefs << '5' << std::flush)
+            return statusKb("VmRSS:");
+#endif
+        return std::nullopt;
+    }
+
+    std::string jsonString(std::string_view text)
+    {
+        std::string out = "\"";
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (uint8_t(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else out += c;
+            }
+        }
+        return out += '"';
+    }
+}
+
+std::string Benchmark::fileOpenLatency(const fs::path& file, uint32_t iterations)
+{
+    Backends backends;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    std::string pathStr = file.string();
+
+    struct Mode
+    {
+        const char* name;
+        bool (*open)(Backends& vfs, const std::string& path, const ma_decoder_config& config);
+    } modes[]
+    {
+        { "stdio vfs, whole-file load", [](Backends& vfs, const std::string& path, const ma_decoder_config& config) -> bool
+        {
+            // What the resource manager does for non-streamed sounds on the default VFS.
+            void* data = nullptr;
+            size_t size = 0;
+            if (ma_vfs_open_and_read_file(vfs.mapped.stdioVFS(), path.c_str(), &data, &size, nullptr) != MA_SUCCESS)
+                return false;
+            ma_decoder decoder;
+            bool ok = ma_decoder_init_memory(data, size, &config, &decoder) == MA_SUCCESS && readFirstFrame(decoder);
+            ma_free(data, nullptr);
+            return ok;
+        } },
+        { "stdio vfs, streamed", [](Backends& vfs, const std::string& path, const ma_decoder_config& config) -> bool
+        {
+            ma_decoder decoder;
+            return ma_decoder_init_vfs(vfs.mapped.stdioVFS(), path.c_str(), &config, &decoder) == MA_SUCCESS && readFirstFrame(decoder);
+        } },
+        { "mmap vfs, streamed", [](Backends& vfs, const std::string& path, const ma_decoder_config& config) -> bool
+        {
+            ma_decoder decoder;
+            return ma_decoder_init_vfs(vfs.mapped.vfs(), path.c_str(), &config, &decoder) == MA_SUCCESS && readFirstFrame(decoder);
+        } },
+        { "io_uring vfs, streamed", [](Backends& vfs, const std::string& path, const ma_decoder_config& config) -> bool
+        {
+            // What MusicPlayer does for tracks on network mounts.
+            ma_decoder decoder;
+            return ma_decoder_init_vfs(vfs.async.vfs(), path.c_str(), &config, &decoder) == MA_SUCCESS && readFirstFrame(decoder);
+        } },
+        { "mmap, zero-copy", [](Backends& vfs, const std::string& path, const ma_decoder_config& config) -> bool
+        {
+            // What MusicPlayer does: decode straight out of the mapping.
+            FileMapping mapping { fs::path(path) };
+            if (!mapping)
+                return false;
+            mapping.advise(FileAccessPattern::Sequential);
+            ma_decoder decoder;
+            return ma_decoder_init_memory(mapping.data(), mapping.size(), &config, &decoder) == MA_SUCCESS && readFirstFrame(decoder);
+        } }
+    };
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << "open-to-first-frame latency, " << iterations << " iterations, microseconds (median / p95 / min)\n";
+    for (bool cold : { true, false })
+    {
+        for (Mode& mode : modes)
+        {
+            std::vector<double> samples;
+            samples.reserve(iterations);
+            if (!cold)
+                mode.open(backends, pathStr, config); // Warm the page cache.
+            for (uint32_t i = 0; i < iterations; i++)
+            {
+                if (cold)
+                    FileMapping::evictFromCache(file);
+
+                auto beg = BenchClock::now();
+                bool ok = mode.open(backends, pathStr, config);
+                auto end = BenchClock::now();
+                if (!ok)
+                {
+                    samples.clear();
+                    break;
+                }
+                samples.push_back(std::chrono::duration<double, std::micro>(end - beg).count());
+            }
+
+            LatencySummary summary = summarize(samples);
+            report << "  " << (cold ? "cold" : "warm") << "  " << std::left << std::setw(28) << mode.name << std::right;
+            if (summary.failed)
+                report << "failed to decode\n";
+            else report << std::setw(10) << summary.median << " / " << std::setw(10) << summary.p95 << " / " << std::setw(10) << summary.minimum << '\n';
+        }
+    }
+    if (!AsyncFileVFS::asynchronous())
+        report << "  (io_uring is unavailable, so its row measures the synchronous pread fallback)\n";
+#if _WIN32
+    report << "  (cache eviction is unsupported here, so cold and warm runs are both warm)\n";
+#endif
+    return std::move(report).str();
+}
+std::string Benchmark::libraryScan(const fs::path& dir, uint32_t iterations)
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+    report << "library scan, " << iterations << " iterations, milliseconds (median / p95 / min)\n";
+    for (bool batched : { true, false })
+    {
+        std::vector<double> samples;
+        size_t trackCount = 0;
+        bool usedIoUring = false;
+        MusicLibrary::scan(dir, batched); // Warm the dentry cache, cold metadata is a different benchmark.
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            LibrarySnapshot snapshot = MusicLibrary::scan(dir, batched);
+            samples.push_back(snapshot.scanMs);
+            trackCount = snapshot.tracks.size();
+            usedIoUring = snapshot.usedIoUring;
+        }
+
+        LatencySummary summary = summarize(samples);
+        report << "  " << std::left << std::setw(24) << (batched ? (usedIoUring ? "io_uring statx" : "io_uring (unavailable)") : "stat per file") << std::right
+               << std::setw(10) << summary.median << " / " << std::setw(10) << summary.p95 << " / " << std::setw(10) << summary.minimum
+               << "  (" << trackCount << " files)\n";
+    }
+    return std::move(report).str();
+}
+std::string Benchmark::loudnessThroughput(const fs::path& dir, uint32_t maxTracks)
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    {
+        // DSP alone, on a stereo 48 kHz sweep so neither the gate nor the peak path gets to idle.
+        constexpr uint32_t sampleRate = 48000, seconds = 20;
+        std::vector<float> signal(size_t(sampleRate) * seconds * 2);
+        for (size_t i = 0; i < signal.size() / 2; i++)
+        {
+            double t = double(i) / sampleRate;
+            signal[i * 2] = signal[i * 2 + 1] = float(0.5 * std::sin(2.0 * std::numbers::pi * (20.0 + 500.0 * t) * t));
+        }
+        LoudnessMeter meter(2, sampleRate);
+        auto beg = BenchClock::now();
+        meter.process(signal.data(), signal.size() / 2);
+        double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - beg).count();
+        report << "meter only, stereo: " << ns / (signal.size() / 2) << " ns/frame (" << meter.integrated() << " LUFS)\n";
+    }
+
+    std::vector<fs::path> files;
+    for (const LibraryTrack& track : MusicLibrary::scan(dir).tracks)
+        if (files.size() < maxTracks)
+            files.push_back(track.path);
+    if (files.empty())
+    {
+        report << "no tracks to analyze\n";
+        return std::move(report).str();
+    }
+
+    report << "decode + analysis of " << files.size() << " tracks (wall ms / tracks per s / x realtime / speedup)\n";
+    double baseline = 0.0;
+    uint32_t hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t threads = 1;; threads = std::min(threads * 2, hardwareThreads))
+    {
+        JobPool pool(threads);
+        std::atomic<uint64_t> audioMicroseconds = 0;
+        std::atomic<uint32_t> decoded = 0;
+        auto beg = BenchClock::now();
+        for (const fs::path& file : files)
+        {
+            pool.submit([&, file](std::stop_token stop)
+            {
+                if (std::optional<TrackLoudness> result = Loudness::analyzeFile(file, stop))
+                {
+                    audioMicroseconds += uint64_t(double(result->frames) / result->sampleRate * 1'000'000.0);
+                    ++decoded;
+                }
+            });
+        }
+        pool.waitIdle();
+        double ms = std::chrono::duration<double, std::milli>(BenchClock::now() - beg).count();
+        if (threads == 1)
+            baseline = ms;
+
+        report << "  " << std::setw(3) << threads << " threads  " << std::setw(10) << ms << " / " << std::setw(8) << decoded * 1000.0 / ms
+               << " / " << std::setw(8) << audioMicroseconds / 1000.0 / ms << " / " << std::setw(5) << baseline / ms << "x\n";
+        if (threads == hardwareThreads)
+            break;
+    }
+    return std::move(report).str();
+}
+
+std::string Benchmark::equalizer(uint32_t seconds)
+{
+    constexpr uint32_t sampleRate = 48000, block = 480;
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2) << "channels  simd ns/frame  ns/frame/band  scalar ns/frame  speedup\n";
+
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    for (uint32_t channels : { 1u, 2u, 6u })
+    {
+        const size_t frames = size_t(sampleRate) * seconds;
+        std::vector<float> signal(frames * channels), output(signal.size());
+        for (float& sample : signal)
+            sample = noise(random);
+
+        EqualizerNode eq;
+        if (eq.init(nullptr, channels, sampleRate) != MA_SUCCESS)
+        {
+            report << std::setw(8) << channels << "  failed to initialize\n";
+            continue;
+        }
+        for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
+        {
+            EqBand band = eq.band(i);
+            band.gainDb = i % 2 ? -3.0f : 3.0f;
+            eq.setBand(i, band);
+        }
+
+        auto beg = BenchClock::now();
+        for (size_t at = 0; at < frames; at += block)
+            eq.process(signal.data() + at * channels, output.data() + at * channels, uint32_t(std::min<size_t>(block, frames - at)));
+        double simdNs = std::chrono::duration<double, std::nano>(BenchClock::now() - beg).count() / frames;
+
+        // Reference: direct form II transposed, one channel and one band at a time, same per-band arithmetic.
+        struct Biquad
+        {
+            float b0, b1, b2, a1, a2;
+        };
+        std::vector<Biquad> cascade(EqualizerNode::bandCount, Biquad { 1.02f, -1.78f, 0.8f, -1.8f, 0.81f });
+        std::vector<float> state(size_t(channels) * EqualizerNode::bandCount * 2, 0.0f);
+        FlushDenormals flush;
+        beg = BenchClock::now();
+        for (size_t at = 0; at < frames; at++)
+        {
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                float x = signal[at * channels + c];
+                float* z = &state[size_t(c) * EqualizerNode::bandCount * 2];
+                for (const Biquad& q : cascade)
+                {
+                    float y = q.b0 * x + z[0];
+                    z[0] = q.b1 * x - q.a1 * y + z[1];
+                    z[1] = q.b2 * x - q.a2 * y;
+                    x = y;
+                    z += 2;
+                }
+                output[at * channels + c] = x;
+            }
+        }
+        double scalarNs = std::chrono::duration<double, std::nano>(BenchClock::now() - beg).count() / frames;
+        eq.uninit();
+
+        report << std::setw(8) << channels << "  " << std::setw(13) << simdNs << "  " << std::setw(13) << simdNs / EqualizerNode::bandCount << "  "
+               << std::setw(15) << scalarNs << "  " << std::setw(6) << scalarNs / simdNs << "x\n";
+    }
+    return std::move(report).str();
+}
+
+std::string Benchmark::convolution(uint32_t seconds)
+{
+    constexpr uint32_t sampleRate = 48000, channels = 2, period = 480;
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(2);
+
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    const size_t frames = size_t(sampleRate) * seconds;
+    std::vector<float> signal(frames * channels);
+    for (float& sample : signal)
+        sample = noise(random);
+
+    {
+        Fft fft(ConvolutionNode::blockFrames * 2);
+        std::vector<float> re(fft.bins()), im(fft.bins()), out(fft.size());
+        constexpr uint32_t iterations = 4096;
+        auto beg = BenchClock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            fft.forward(signal.data() + i % 1024, re.data(), im.data());
+            fft.inverse(re.data(), im.data(), out.data());
+        }
+        double us = std::chrono::duration<double, std::micro>(BenchClock::now() - beg).count() / iterations;
+        report << fft.size() << "-point real fft, forward + inverse: " << us << " us\n";
+    }
+
+    double budgetUs = ConvolutionNode::blockFrames * 1'000'000.0 / sampleRate;
+    report << "stereo, " << ConvolutionNode::blockFrames << "-frame blocks (" << budgetUs << " us of audio each)\n"
+           << "impulse s  partitions  avg us/block  peak us/block  avg load  x realtime\n";
+    for (float impulseSeconds : { 0.5f, 1.0f, 2.0f, 4.0f, 8.0f })
+    {
+        // Decaying noise, like a room's tail.
+        const uint32_t impulseFrames = uint32_t(impulseSeconds * sampleRate);
+        std::vector<float> impulse(size_t(impulseFrames) * channels);
+        for (size_t i = 0; i < impulse.size(); i++)
+            impulse[i] = noise(random) * std::exp(-6.9f * float(i / channels) / impulseFrames);
+
+        ConvolutionNode node;
+        node.init(nullptr, channels, sampleRate);
+        node.setImpulse(impulse.data(), impulseFrames, channels);
+        std::vector<float> output(size_t(std::max(period, ConvolutionNode::blockFrames)) * channels);
+        // One block to swap the impulse in, then measure from a clean slate.
+        node.process(signal.data(), output.data(), ConvolutionNode::blockFrames);
+        node.resetStats();
+        for (size_t at = 0; at + period <= frames; at += period)
+            node.process(signal.data() + at * channels, output.data(), period);
+        ConvolutionNode::BlockStats stats = node.stats();
+        node.uninit();
+
+        report << std::setw(9) << impulseSeconds << "  " << std::setw(10) << node.impulse().partitions << "  " << std::setw(12) << stats.averageUs << "  "
+               << std::setw(13) << stats.peakUs << "  " << std::setw(7) << stats.averageLoad * 100.0 << "%  " << std::setw(9)
+               << (stats.averageLoad > 0.0 ? 1.0 / stats.averageLoad : 0.0) << "x\n";
+    }
+    return std::move(report).str();
+}
+
+std::string Benchmark::decoders(const fs::path& dir, std::string& json, uint32_t tracksPerFormat, uint32_t seeks)
+{
+    struct Corpus
+    {
+        fs::path file;
+        std::string format;
+    };
+    std::vector<Corpus> corpus;
+
+    // miniaudio only encodes WAV, so the generated part of the corpus covers the rates and sample formats, and the
+    // compressed formats come from the library.
+    fs::path generatedDir = fs::temp_directory_path() / "tacrad-bench";
+    std::error_code ec;
+    fs::create_directories(generatedDir, ec);
+    struct Generated
+    {
+        uint32_t sampleRate;
+        ma_format format;
+        const char* name;
+    } generated[]
+    {
+        { 44100, ma_format_s16, "wav s16 44.1k" },
+        { 48000, ma_format_s24, "wav s24 48k" },
+        { 96000, ma_format_f32, "wav f32 96k" }
+    };
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> noise(-0.05f, 0.05f);
+    for (const Generated& spec : generated)
+    {
+        fs::path file = generatedDir / (std::to_string(spec.sampleRate) + "-" + std::to_string(ma_get_bytes_per_sample(spec.format) * 8) + ".wav");
+        if (!fs::exists(file))
+        {
+            // A minute of sweep over noise, so no stretch is trivially compressible should anyone convert it.
+            ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, spec.format, 2, spec.sampleRate);
+            ma_encoder encoder;
+            if (ma_encoder_init_file(file.string().c_str(), &config, &encoder) != MA_SUCCESS)
+                continue;
+            std::vector<float> chunk(size_t(spec.sampleRate) * 2);
+            std::vector<uint8_t> converted(chunk.size() * ma_get_bytes_per_sample(spec.format));
+            for (uint32_t second = 0; second < 60; second++)
+            {
+                for (uint32_t i = 0; i < spec.sampleRate; i++)
+                {
+                    double t = second + double(i) / spec.sampleRate;
+                    chunk[i * 2] = chunk[i * 2 + 1] = float(0.4 * std::sin(2.0 * std::numbers::pi * (20.0 + 150.0 * t) * t)) + noise(random);
+                }
+                ma_pcm_convert(converted.data(), spec.format, chunk.data(), ma_format_f32, chunk.size(), ma_dither_mode_none);
+                ma_encoder_write_pcm_frames(&encoder, converted.data(), spec.sampleRate, nullptr);
+            }
+            ma_encoder_uninit(&encoder);
+        }
+        corpus.push_back(Corpus { file, spec.name });
+    }
+
+    std::map<std::string, uint32_t> perFormat;
+    for (const LibraryTrack& track : MusicLibrary::scan(dir).tracks)
+    {
+        std::string extension = track.path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(std::tolower(uint8_t(c))); });
+        if (extension.size() > 1 && perFormat[extension]++ < tracksPerFormat)
+            corpus.push_back(Corpus { track.path, extension.substr(1) });
+    }
+
+    std::ostringstream report, out;
+    report << std::fixed << std::setprecision(1);
+    out << std::fixed << std::setprecision(3);
+    report << "decode through the mmap zero-copy path, " << seeks << " random seeks per file\n"
+           << "format          open cold/warm us   decode MB/s   Mframes/s   x realtime   seek us p50 / p95 / p99 / max   RSS growth MB\n";
+    out << "{\"benchmark\":\"decoders\",\"seeks\":" << seeks << ",\"files\":[";
+
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    bool first = true, isolated = true;
+    for (const Corpus& entry : corpus)
+    {
+        std::optional<uint64_t> baseRssKb = resetPeakRssKb();
+        isolated = isolated && baseRssKb;
+        // Same as MusicPlayer: decode straight out of a mapping, advised sequential until the first seek.
+        auto open = [&](FileMapping& mapping, ma_decoder& decoder)
+        {
+            mapping = FileMapping(entry.file);
+            if (!mapping)
+                return false;
+            mapping.advise(FileAccessPattern::Sequential);
+            return ma_decoder_init_memory(mapping.data(), mapping.size(), &config, &decoder) == MA_SUCCESS;
+        };
+        auto openToFirstFrame = [&]() -> double
+        {
+            auto beg = BenchClock::now();
+            FileMapping mapping;
+            ma_decoder decoder;
+            if (!open(mapping, decoder) || !readFirstFrame(decoder))
+                return -1.0;
+            return std::chrono::duration<double, std::micro>(BenchClock::now() - beg).count();
+        };
+
+        FileMapping::evictFromCache(entry.file);
+        double coldUs = openToFirstFrame();
+        std::vector<double> warm;
+        for (uint32_t i = 0; i < 8 && coldUs >= 0.0; i++)
+            warm.push_back(openToFirstFrame());
+        FileMapping mapping;
+        ma_decoder decoder;
+        if (coldUs < 0.0 || !open(mapping, decoder))
+        {
+            report << std::left << std::setw(14) << entry.format << std::right << "  failed to decode " << entry.file.filename().string() << '\n';
+            continue;
+        }
+        double warmUs = summarize(warm).median;
+
+        ma_format format;
+        ma_uint32 channels, sampleRate;
+        ma_decoder_get_data_format(&decoder, &format, &channels, &sampleRate, nullptr, 0);
+        constexpr ma_uint64 chunkFrames = 4096;
+        std::vector<float> buffer(size_t(chunkFrames) * channels);
+        uint64_t frames = 0;
+        auto beg = BenchClock::now();
+        for (;;)
+        {
+            ma_uint64 read = 0;
+            ma_result result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunkFrames, &read);
+            frames += read;
+            if (result != MA_SUCCESS || read < chunkFrames)
+                break;
+        }
+        double decodeSeconds = std::max(std::chrono::duration<double>(BenchClock::now() - beg).count(), 1e-9);
+
+        mapping.advise(FileAccessPattern::Random);
+        std::uniform_int_distribution<uint64_t> position(0, std::max<uint64_t>(frames, 1) - 1);
+        auto timeSeeks = [&](ma_data_source* source)
+        {
+            std::vector<double> samples;
+            for (uint32_t i = 0; i < seeks; i++)
+            {
+                ma_uint64 target = position(random), read = 0;
+                auto seekBeg = BenchClock::now();
+                if (ma_data_source_seek_to_pcm_frame(source, target) != MA_SUCCESS || ma_data_source_read_pcm_frames(source, buffer.data(), 1, &read) != MA_SUCCESS)
+                    break;
+                samples.push_back(std::chrono::duration<double, std::micro>(BenchClock::now() - seekBeg).count());
+            }
+            std::sort(samples.begin(), samples.end());
+            return samples;
+        };
+        std::vector<double> seekUs = timeSeeks(&decoder);
+        ma_decoder_uninit(&decoder);
+
+        // Long MP3s play through a seek table instead, so time that too.
+        std::vector<double> tableSeekUs;
+        if (SeekTables::applies(entry.file))
+        {
+            std::optional<TrackSeekTable> table = SeekTables::buildFile(entry.file);
+            Mp3Source source;
+            if (table && table->pointCount && source.init(mapping.data(), mapping.size(), *table) == MA_SUCCESS)
+            {
+                tableSeekUs = timeSeeks(source.dataSource());
+                source.uninit();
+            }
+        }
+
+        auto percentile = [](const std::vector<double>& samples, uint32_t p)
+        {
+            return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+        };
+        auto seekRow = [&](const std::vector<double>& samples)
+        {
+            report << std::setw(7) << percentile(samples, 50) << " /" << std::setw(7) << percentile(samples, 95) << " /" << std::setw(7) << percentile(samples, 99)
+                   << " /" << std::setw(7) << (samples.empty() ? 0.0 : samples.back());
+        };
+        auto seekJson = [&](const std::vector<double>& samples)
+        {
+            out << "{\"p50\":" << percentile(samples, 50) << ",\"p95\":" << percentile(samples, 95) << ",\"p99\":" << percentile(samples, 99)
+                << ",\"max\":" << (samples.empty() ? 0.0 : samples.back()) << ",\"count\":" << samples.size() << '}';
+        };
+        double megabytesPerSecond = mapping.size() / decodeSeconds / (1024.0 * 1024.0);
+        double framesPerSecond = frames / decodeSeconds;
+        double realtime = double(frames) / std::max(sampleRate, 1u) / decodeSeconds;
+        uint64_t peakKb = baseRssKb ? std::max(statusKb("VmHWM:"), *baseRssKb) : 0;
+
+        report << std::left << std::setw(14) << entry.format << std::right << std::setw(10) << coldUs << " /" << std::setw(8) << warmUs
+               << std::setw(14) << megabytesPerSecond << std::setw(12) << framesPerSecond / 1e6 << std::setw(13) << realtime << "   ";
+        seekRow(seekUs);
+        if (baseRssKb)
+            report << std::setw(16) << (peakKb - *baseRssKb) / 1024.0 << '\n';
+        else report << std::setw(16) << '-' << '\n';
+        if (!tableSeekUs.empty())
+        {
+            report << std::left << std::setw(76) << "  with its seek table" << std::right;
+            seekRow(tableSeekUs);
+            report << '\n';
+        }
+
+        out << (first ? "" : ",") << "{\"file\":" << jsonString(entry.file.generic_string()) << ",\"format\":" << jsonString(entry.format)
+            << ",\"bytes\":" << mapping.size() << ",\"sampleRate\":" << sampleRate << ",\"channels\":" << channels << ",\"frames\":" << frames
+            << ",\"openColdUs\":" << coldUs << ",\"openWarmUs\":" << warmUs << ",\"decodeMBps\":" << megabytesPerSecond
+            << ",\"framesPerSecond\":" << framesPerSecond << ",\"realtime\":" << realtime << ",\"seekUs\":";
+        seekJson(seekUs);
+        if (!tableSeekUs.empty())
+        {
+            out << ",\"seekTableUs\":";
+            seekJson(tableSeekUs);
+        }
+        if (baseRssKb)
+            out << ",\"peakRssKb\":" << peakKb << ",\"rssGrowthKb\":" << peakKb - *baseRssKb;
+        out << '}';
+        first = false;
+    }
+    out << "]}\n";
+    json = std::move(out).str();
+
+    if (perFormat.empty())
+        report << "  (no tracks in " << dir.string() << ", so only generated WAVs were measured)\n";
+    if (!isolated)
+        report << "  (the resident high-water mark can't be reset here, so memory isn't measured per file)\n";
+    return std::move(report).str();
+}
+
+bool Benchmark::writeJson(const fs::path& file, const std::string& json)
+{
+    std::ofstream stream(file, std::ios::binary | std::ios::trunc);
+    stream << json;
+    stream.close();
+    return !stream.fail();
+}
+
+std::string Benchmark::resampler(uint32_t seconds)
+{
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1);
+
+    // The whole of `in`, through either miniaudio's linear resampler or ours.
+    auto resample = [](ResamplerQuality quality, const std::vector<float>& in, uint32_t channels, uint32_t rateIn, uint32_t rateOut)
+    {
+        const uint64_t frames = in.size() / channels;
+        std::vector<float> out(size_t((frames * rateOut / rateIn + 64) * channels));
+        uint64_t consumed = 0, produced = 0;
+        if (quality == ResamplerQuality::Linear)
+        {
+            ma_resampler_config config = ma_resampler_config_init(ma_format_f32, channels, rateIn, rateOut, ma_resample_algorithm_linear);
+            ma_resampler resampler;
+            if (ma_resampler_init(&config, nullptr, &resampler) != MA_SUCCESS)
+                return std::vector<float>();
+            while (consumed < frames && produced < out.size() / channels)
+            {
+                ma_uint64 inCount = frames - consumed, outCount = out.size() / channels - produced;
+                ma_resampler_process_pcm_frames(&resampler, in.data() + consumed * channels, &inCount, out.data() + produced * channels, &outCount);
+                if (inCount == 0 && outCount == 0)
+                    break;
+                consumed += inCount, produced += outCount;
+            }
+            ma_resampler_uninit(&resampler, nullptr);
+        }
+        else
+        {
+            SincResampler resampler(channels, rateIn, rateOut, quality);
+            while (consumed < frames && produced < out.size() / channels)
+            {
+                uint64_t inCount = frames - consumed, outCount = out.size() / channels - produced;
+                resampler.process(in.data() + consumed * channels, inCount, out.data() + produced * channels, outCount);
+                if (inCount == 0 && outCount == 0)
+                    break;
+                consumed += inCount, produced += outCount;
+            }
+        }
+        out.resize(size_t(produced * channels));
+        return out;
+    };
+    auto tone = [](double frequency, uint32_t rate, uint32_t frames)
+    {
+        std::vector<float> signal(frames);
+        for (uint32_t i = 0; i < frames; i++)
+            signal[i] = float(std::sin(2.0 * std::numbers::pi * frequency * i / rate));
+        return signal;
+    };
+    auto levelDb = [](const std::vector<float>& signal)
+    {
+        // Skips the edges, where the filters are still filling.
+        double sum = 0.0;
+        size_t from = signal.size() / 8, to = signal.size() - signal.size() / 8;
+        for (size_t i = from; i < to; i++)
+            sum += double(signal[i]) * signal[i];
+        return 10.0 * std::log10(std::max(sum / std::max<size_t>(to - from, 1) * 2.0, 1e-30));
+    };
+
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+    std::vector<float> stereo(size_t(44100) * seconds * 2);
+    for (float& sample : stereo)
+        sample = noise(random);
+
+    constexpr const char* names[] { "linear", "fast", "balanced", "best" };
+    report << "quality   44.1->48 kHz stereo (x realtime)  aliasing 96->44.1 kHz, 24-46 kHz tones (dB)  passband at 1/10/18 kHz (dB)\n";
+    for (ResamplerQuality quality : { ResamplerQuality::Linear, ResamplerQuality::Fast, ResamplerQuality::Balanced, ResamplerQuality::Best })
+    {
+        if (quality != ResamplerQuality::Linear)
+            SincFilterBank::get(quality, 44100, 48000); // Bank construction is a one-off per track, so not timed.
+        auto beg = BenchClock::now();
+        std::vector<float> out = resample(quality, stereo, 2, 44100, 48000);
+        double ms = std::chrono::duration<double, std::milli>(BenchClock::now() - beg).count();
+
+        double worstAlias = -300.0;
+        for (double frequency : { 24000.0, 26000.0, 30000.0, 36000.0, 42000.0, 46000.0 })
+            worstAlias = std::max(worstAlias, levelDb(resample(quality, tone(frequency, 96000, 96000), 1, 96000, 44100)));
+        report << std::left << std::setw(8) << names[int(quality)] << std::right << "  " << std::setw(32) << seconds * 1000.0 / ms << "  " << std::setw(43) << worstAlias << "  ";
+        for (double frequency : { 1000.0, 10000.0, 18000.0 })
+            report << std::setw(6) << std::setprecision(2) << levelDb(resample(quality, tone(frequency, 96000, 96000), 1, 96000, 44100)) << std::setprecision(1);
+        report << '\n';
+    }
+    return std::move(report).str();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// In-process benchmarks behind the "bench" command, and the tacrad-bench tool for the decoder one. Each returns a
+// human-readable report.
+struct Benchmark
+{
+    Benchmark() = delete;
+
+    // Open-to-first-frame latency of `file`, cold and warm, for the stdio VFS, memory-mapped and io_uring paths.
+    static std::string fileOpenLatency(const fs::path& file, uint32_t iterations = 16);
+    // Library scan time of `dir`, with batched io_uring statx and with one stat per file.
+    static std::string libraryScan(const fs::path& dir, uint32_t iterations = 8);
+    // Loudness analysis of up to `maxTracks` tracks from `dir`, on pools of 1, 2, 4... threads, plus the meter's DSP cost alone.
+    static std::string loudnessThroughput(const fs::path& dir, uint32_t maxTracks = 16);
+    // Equalizer cost per frame with every band active, for mono, stereo and 5.1, against a plain scalar biquad cascade.
+    static std::string equalizer(uint32_t seconds = 10);
+    // Convolver time per block, stereo at 48 kHz, for impulses from half a second up to several seconds.
+    static std::string convolution(uint32_t seconds = 10);
+    // Decoder cost, through the zero-copy path the player uses, over tracks of each format in `dir` plus generated WAVs at
+    // several rates and sample formats: open-to-first-frame latency, sustained decode rate, random seek latency percentiles
+    // and, where the process's resident high-water mark can be reset between files, the memory each one took. `json`
+    // receives the same numbers for tracking regressions across builds.
+    static std::string decoders(const fs::path& dir, std::string& json, uint32_t tracksPerFormat = 4, uint32_t seeks = 64);
+    // Throughput of each resampler quality, and how well each keeps content above the new Nyquist frequency from aliasing.
+    static std::string resampler(uint32_t seconds = 10);
+
+    // Writes what one of the above left in its `json`. False if it couldn't be.
+    static bool writeJson(const fs::path& file, const std::string& json);
+};
@@ -0,0 +1,376 @@
+#include "Convolution.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <AudioStats.h>
+#include <Simd.h>
+
+struct ConvolutionNode::Kernel
+{
+    uint32_t partitions = 0; // 0 for a plain delay.
+    uint32_t impulseChannels = 0;
+    uint32_t binsPadded = 0;
+    // Partition spectra, [impulse channel][partition][bin], prescaled by the inverse transform's 1 / n.
+    std::vector<float> spectrumRe, spectrumIm;
+    // Per output channel: the last two blocks of input, and a ring of the spectra of the last `partitions` of those.
+    std::vector<float> history;
+    std::vector<float> lineRe, lineIm;
+    uint32_t head = 0;
+};
+
+namespace
+{
+    // Zero padding past the real bins keeps the multiply-accumulate in whole vectors.
+    constexpr uint32_t binsPadded = (ConvolutionNode::blockFrames + 1 + 3) & ~3u;
+}
+
+ConvolutionNode::~ConvolutionNode()
+{
+    this->uninit();
+}
+
+ma_result ConvolutionNode::init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate)
+{
+    this->channels = channels;
+    this->sampleRate = sampleRate;
+
+    const size_t blockSamples = size_t(ConvolutionNode::blockFrames) * channels;
+    this->inputFifo.assign(blockSamples, 0.0f);
+    this->outputFifo.assign(blockSamples, 0.0f);
+    this->fadeBlock.assign(blockSamples, 0.0f);
+    this->time.assign(ConvolutionNode::blockFrames * 2, 0.0f);
+    this->accRe.assign(binsPadded, 0.0f);
+    this->accIm.assign(binsPadded, 0.0f);
+    this->fifoFill = 0;
+    this->active = new Kernel();
+    this->resetStats();
+
+    if (!graph)
+        return MA_SUCCESS;
+
+    static ma_node_vtable vtable
+    {
+        .onProcess = ConvolutionNode::onProcess,
+        .onGetRequiredInputFrameCount = nullptr,
+        .inputBusCount = 1,
+        .outputBusCount = 1,
+        .flags = 0
+    };
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &vtable;
+    config.pInputChannels = &this->channels;
+    config.pOutputChannels = &this->channels;
+    ma_result result = ma_node_init(graph, &config, nullptr, &this->base);
+    this->nodeInitialized = result == MA_SUCCESS;
+    return result;
+}
+void ConvolutionNode::uninit()
+{
+    if (this->nodeInitialized)
+    {
+        ma_node_uninit(&this->base, nullptr);
+        this->nodeInitialized = false;
+    }
+    // Nothing is rendering anymore, so everything can go.
+    delete this->active;
+    this->active = nullptr;
+    delete this->incoming.exchange(nullptr);
+    delete this->retired.exchange(nullptr);
+}
+
+ConvolutionNode::Kernel* ConvolutionNode::build(const float* frames, uint32_t frameCount, uint32_t impulseChannels) const
+{
+    constexpr uint32_t B = ConvolutionNode::blockFrames;
+    Kernel* kernel = new Kernel();
+    kernel->partitions = (frameCount + B - 1) / B;
+    kernel->impulseChannels = impulseChannels;
+    kernel->binsPadded = binsPadded;
+    if (kernel->partitions == 0)
+        return kernel;
+
+    const size_t partitionCount = size_t(impulseChannels) * kernel->partitions;
+    kernel->spectrumRe.assign(partitionCount * binsPadded, 0.0f);
+    kernel->spectrumIm.assign(partitionCount * binsPadded, 0.0f);
+    kernel->history.assign(size_t(this->channels) * B * 2, 0.0f);
+    kernel->lineRe.assign(size_t(this->channels) * kernel->partitions * binsPadded, 0.0f);
+    kernel->lineIm.assign(size_t(this->channels) * kernel->partitions * binsPadded, 0.0f);
+
+    // Each partition zero-padded to twice its length, so the linear convolution fits without wrapping.
+    Fft fft(B * 2);
+    std::vector<float> padded(B * 2);
+    const float scale = 1.0f / fft.size();
+    for (uint32_t ic = 0; ic < impulseChannels; ic++)
+    {
+        for (uint32_t p = 0; p < kernel->partitions; p++)
+        {
+            std::fill(padded.begin(), padded.end(), 0.0f);
+            for (uint32_t i = 0; i < B && p * B + i < frameCount; i++)
+                padded[i] = frames[size_t(p * B + i) * impulseChannels + ic];
+
+            size_t at = (size_t(ic) * kernel->partitions + p) * binsPadded;
+            fft.forward(padded.data(), &kernel->spectrumRe[at], &kernel->spectrumIm[at]);
+            for (uint32_t k = 0; k < fft.bins(); k++)
+            {
+                kernel->spectrumRe[at + k] *= scale;
+                kernel->spectrumIm[at + k] *= scale;
+            }
+        }
+    }
+    return kernel;
+}
+void ConvolutionNode::publish(Kernel* kernel, ImpulseInfo info)
+{
+    this->collect();
+    // A kernel still sitting in the mailbox was never picked up, so it's ours to free.
+    delete this->incoming.exchange(kernel, std::memory_order_acq_rel);
+
+    std::lock_guard guard(this->infoMutex);
+    this->info = std::move(info);
+    this->error.clear();
+}
+void ConvolutionNode::collect()
+{
+    delete this->retired.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+bool ConvolutionNode::setImpulse(const float* frames, uint32_t frameCount, uint32_t impulseChannels, const fs::path& source)
+{
+    if (this->channels == 0 || impulseChannels == 0)
+        return false;
+    Kernel* kernel = this->build(frames, frameCount, impulseChannels);
+    this->publish(kernel, ImpulseInfo { .source = source, .frames = frameCount, .channels = impulseChannels, .partitions = kernel->partitions });
+    return true;
+}
+bool ConvolutionNode::load(const fs::path& file, std::stop_token stop)
+{
+    this->loads.fetch_add(1, std::memory_order_relaxed);
+    struct LoadGuard
+    {
+        std::atomic<uint32_t>& loads;
+        inline ~LoadGuard()
+        {
+            this->loads.fetch_sub(1, std::memory_order_relaxed);
+        }
+    } guard { this->loads };
+
+    auto fail = [&](std::string message)
+    {
+        std::lock_guard guard(this->infoMutex);
+        this->error = std::move(message);
+        return false;
+    };
+    if (this->channels == 0)
+        return fail("the audio engine isn't running");
+
+    // Resampled to the node's rate by the decoder, so the impulse lines up with what it's convolved with.
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, this->sampleRate);
+    ma_decoder decoder;
+#if _WIN32
+    ma_result result = ma_decoder_init_file_w(file.c_str(), &config, &decoder);
+#else
+    ma_result result = ma_decoder_init_file(file.c_str(), &config, &decoder);
+#endif
+    if (result != MA_SUCCESS)
+        return fail("couldn't decode \"" + file.string() + "\"");
+
+    const uint32_t impulseChannels = decoder.outputChannels;
+    const ma_uint64 maxFrames = ma_uint64(ConvolutionNode::maxImpulseSeconds) * this->sampleRate;
+    constexpr ma_uint64 chunkFrames = 4096;
+    std::vector<float> frames;
+    ma_uint64 frameCount = 0;
+    bool truncated = false;
+    while (!stop.stop_requested())
+    {
+        if (frameCount == maxFrames)
+        {
+            ma_uint64 extra = 0;
+            float probe[MA_MAX_CHANNELS];
+            truncated = ma_decoder_read_pcm_frames(&decoder, probe, 1, &extra) == MA_SUCCESS && extra > 0;
+            break;
+        }
+        ma_uint64 want = std::min(chunkFrames, maxFrames - frameCount), read = 0;
+        frames.resize(size_t(frameCount + want) * impulseChannels);
+        result = ma_decoder_read_pcm_frames(&decoder, &frames[size_t(frameCount) * impulseChannels], want, &read);
+        frameCount += read;
+        if (result != MA_SUCCESS || read < want)
+            break;
+    }
+    ma_decoder_uninit(&decoder);
+    if (stop.stop_requested())
+        return fail("loading was cancelled");
+    if (frameCount == 0)
+        return fail("\"" + file.string() + "\" is empty");
+
+    Kernel* kernel = this->build(frames.data(), uint32_t(frameCount), impulseChannels);
+    this->publish(kernel, ImpulseInfo
+    {
+        .source = file,
+        .frames = uint32_t(frameCount),
+        .channels = impulseChannels,
+        .partitions = kernel->partitions,
+        .truncated = truncated
+    });
+    return true;
+}
+void ConvolutionNode::clear()
+{
+    if (this->channels)
+        this->publish(new Kernel(), ImpulseInfo());
+}
+
+ImpulseInfo ConvolutionNode::impulse()
+{
+    std::lock_guard guard(this->infoMutex);
+    return this->info;
+}
+std::string ConvolutionNode::lastError()
+{
+    std::lock_guard guard(this->infoMutex);
+    return this->error;
+}
+
+ConvolutionNode::BlockStats ConvolutionNode::stats() const
+{
+    uint64_t blocks = this->blocks.load(std::memory_order_relaxed);
+    double budgetUs = this->sampleRate ? ConvolutionNode::blockFrames * 1'000'000.0 / this->sampleRate : 0.0;
+    BlockStats ret
+    {
+        .blocks = blocks,
+        .averageUs = blocks ? this->totalNs.load(std::memory_order_relaxed) / 1000.0 / blocks : 0.0,
+        .lastUs = this->lastNs.load(std::memory_order_relaxed) / 1000.0,
+        .peakUs = this->peakNs.load(std::memory_order_relaxed) / 1000.0
+    };
+    ret.averageLoad = budgetUs > 0.0 ? ret.averageUs / budgetUs : 0.0;
+    ret.peakLoad = budgetUs > 0.0 ? ret.peakUs / budgetUs : 0.0;
+    return ret;
+}
+void ConvolutionNode::resetStats()
+{
+    this->blocks.store(0, std::memory_order_relaxed);
+    this->totalNs.store(0, std::memory_order_relaxed);
+    this->lastNs.store(0, std::memory_order_relaxed);
+    this->peakNs.store(0, std::memory_order_relaxed);
+}
+
+void ConvolutionNode::render(Kernel& kernel, float* out)
+{
+    constexpr uint32_t B = ConvolutionNode::blockFrames;
+    const uint32_t channels = this->channels;
+    if (kernel.partitions == 0)
+    {
+        std::copy(this->inputFifo.begin(), this->inputFifo.end(), out);
+        return;
+    }
+
+    const uint32_t P = kernel.partitions;
+    for (uint32_t c = 0; c < channels; c++)
+    {
+        float* history = &kernel.history[size_t(c) * B * 2];
+        std::memmove(history, history + B, B * sizeof(float));
+        for (uint32_t i = 0; i < B; i++)
+            history[B + i] = this->inputFifo[size_t(i) * channels + c];
+
+        float* lineRe = &kernel.lineRe[size_t(c) * P * binsPadded];
+        float* lineIm = &kernel.lineIm[size_t(c) * P * binsPadded];
+        this->fft.forward(history, lineRe + size_t(kernel.head) * binsPadded, lineIm + size_t(kernel.head) * binsPadded);
+
+        // Newest input spectrum against the first partition, the one before against the second, and so on.
+        const float* spectrumRe = &kernel.spectrumRe[size_t(c % kernel.impulseChannels) * P * binsPadded];
+        const float* spectrumIm = &kernel.spectrumIm[size_t(c % kernel.impulseChannels) * P * binsPadded];
+        float* accRe = this->accRe.data();
+        float* accIm = this->accIm.data();
+        std::fill(this->accRe.begin(), this->accRe.end(), 0.0f);
+        std::fill(this->accIm.begin(), this->accIm.end(), 0.0f);
+        for (uint32_t p = 0, slot = kernel.head; p < P; p++, slot = slot ? slot - 1 : P - 1)
+        {
+            const float* xRe = lineRe + size_t(slot) * binsPadded;
+            const float* xIm = lineIm + size_t(slot) * binsPadded;
+            const float* hRe = spectrumRe + size_t(p) * binsPadded;
+            const float* hIm = spectrumIm + size_t(p) * binsPadded;
+            for (uint32_t k = 0; k < binsPadded; k += 4)
+            {
+                f32x4 xr = f32x4::load(xRe + k), xi = f32x4::load(xIm + k);
+                f32x4 hr = f32x4::load(hRe + k), hi = f32x4::load(hIm + k);
+                f32x4 ar = f32x4::load(accRe + k), ai = f32x4::load(accIm + k);
+                (f32x4::mulAdd(xr, hr, ar) - xi * hi).store(accRe + k);
+                f32x4::mulAdd(xr, hi, f32x4::mulAdd(xi, hr, ai)).store(accIm + k);
+            }
+        }
+
+        // Overlap-save: the first half wrapped around, the second is this block's output.
+        this->fft.inverse(accRe, accIm, this->time.data());
+        for (uint32_t i = 0; i < B; i++)
+            out[size_t(i) * channels + c] = this->time[B + i];
+    }
+    kernel.head = kernel.head + 1 == P ? 0 : kernel.head + 1;
+}
+void ConvolutionNode::processBlock()
+{
+    auto beg = std::chrono::steady_clock::now();
+
+    Kernel* previous = nullptr;
+    if (!this->retired.load(std::memory_order_acquire))
+    {
+        if (Kernel* kernel = this->incoming.exchange(nullptr, std::memory_order_acq_rel))
+        {
+            previous = this->active;
+            this->active = kernel;
+        }
+    }
+
+    this->render(*this->active, this->outputFifo.data());
+    if (previous)
+    {
+        // The new impulse starts with no history, so let the old one ring out underneath it for a block.
+        this->render(*previous, this->fadeBlock.data());
+        constexpr float step = 1.0f / ConvolutionNode::blockFrames;
+        for (uint32_t i = 0; i < ConvolutionNode::blockFrames; i++)
+        {
+            float t = (i + 1) * step;
+            for (uint32_t c = 0; c < this->channels; c++)
+            {
+                size_t at = size_t(i) * this->channels + c;
+                this->outputFifo[at] = this->fadeBlock[at] + (this->outputFifo[at] - this->fadeBlock[at]) * t;
+            }
+        }
+        this->retired.store(previous, std::memory_order_release);
+    }
+
+    uint32_t ns = uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beg).count());
+    this->blocks.fetch_add(1, std::memory_order_relaxed);
+    this->totalNs.fetch_add(ns, std::memory_order_relaxed);
+    this->lastNs.store(ns, std::memory_order_relaxed);
+    if (ns > this->peakNs.load(std::memory_order_relaxed))
+        this->peakNs.store(ns, std::memory_order_relaxed);
+}
+
+void ConvolutionNode::process(const float* in, float* out, uint32_t frameCount)
+{
+    FlushDenormals flush;
+
+    // Input goes in one block at a time; output comes out of the block computed from the previous one.
+    const uint32_t channels = this->channels;
+    uint32_t done = 0;
+    while (done < frameCount)
+    {
+        uint32_t count = std::min(frameCount - done, ConvolutionNode::blockFrames - this->fifoFill);
+        size_t offset = size_t(done) * channels, fifoOffset = size_t(this->fifoFill) * channels, samples = size_t(count) * channels;
+        std::copy(in + offset, in + offset + samples, this->inputFifo.begin() + fifoOffset);
+        std::copy(this->outputFifo.begin() + fifoOffset, this->outputFifo.begin() + fifoOffset + samples, out + offset);
+
+        done += count;
+        if ((this->fifoFill += count) == ConvolutionNode::blockFrames)
+        {
+            this->processBlock();
+            this->fifoFill = 0;
+        }
+    }
+}
+
+void ConvolutionNode::onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut)
+{
+    AudioStats::EffectScope timed;
+    static_cast<ConvolutionNode*>(pNode)->process(ppFramesIn[0], ppFramesOut[0], *pFrameCountOut);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include <Fft.h>
+
+namespace fs = std::filesystem;
+
+struct ImpulseInfo
+{
+    fs::path source; // Empty for none, or an impulse given from memory.
+    uint32_t frames = 0;
+    uint32_t channels = 0;
+    uint32_t partitions = 0;
+    bool truncated = false;
+};
+
+// Uniformly partitioned overlap-save convolution, for room correction and other long impulse responses. The impulse is
+// cut into `blockFrames` partitions whose spectra are multiplied against a delay line of past input spectra, so the
+// cost per block grows with the impulse length but the latency stays at one block.
+// Impulses are prepared on whichever thread loads them and handed over through a mailbox the audio thread only ever
+// polls; it crossfades from the old impulse to the new one over a block. Without an impulse the node just delays.
+class ConvolutionNode
+{
+public:
+    static constexpr uint32_t blockFrames = 512;
+    static constexpr uint32_t maxImpulseSeconds = 10;
+private:
+    ma_node_base base; // Must stay the first member, miniaudio reinterprets ma_node* as ma_node_base*.
+
+    struct Kernel;
+
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    bool nodeInitialized = false;
+
+    // Audio side.
+    Fft fft { ConvolutionNode::blockFrames * 2 };
+    Kernel* active = nullptr;
+    std::vector<float> inputFifo, outputFifo, fadeBlock, time, accRe, accIm;
+    uint32_t fifoFill = 0;
+
+    // Hand-off. The audio thread only takes from `incoming` while `retired` is empty, and only it fills `retired`.
+    std::atomic<Kernel*> incoming = nullptr;
+    std::atomic<Kernel*> retired = nullptr;
+
+    std::mutex infoMutex;
+    ImpulseInfo info;
+    std::string error;
+    std::atomic<uint32_t> loads = 0;
+
+    std::atomic<uint64_t> blocks = 0, totalNs = 0;
+    std::atomic<uint32_t> lastNs = 0, peakNs = 0;
+
+    static void onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+
+    void render(Kernel& kernel, float* out);
+    void processBlock();
+    Kernel* build(const float* frames, uint32_t frameCount, uint32_t impulseChannels) const;
+    void publish(Kernel* kernel, ImpulseInfo info);
+public:
+    ConvolutionNode() = default;
+    ConvolutionNode(const ConvolutionNode&) = delete;
+    ~ConvolutionNode();
+
+    // `graph` may be null, for using process() directly.
+    ma_result init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate);
+    void uninit();
+
+    inline ma_node* node()
+    {
+        return &this->base;
+    }
+
+    // Loader side. Any thread, but these do the heavy lifting, so not the audio thread, and not the UI thread for
+    // anything long. Output channel c is convolved with impulse channel c % impulseChannels.
+    bool setImpulse(const float* frames, uint32_t frameCount, uint32_t impulseChannels, const fs::path& source = {});
+    // Decodes and resamples `file` to the node's rate. False with error() set on failure.
+    bool load(const fs::path& file, std::stop_token stop = {});
+    // Back to a plain delay.
+    void clear();
+    // Frees impulses the audio thread has swapped out. Cheap, call it now and then from a non-audio thread.
+    void collect();
+
+    ImpulseInfo impulse();
+    std::string lastError();
+    inline bool loading() const
+    {
+        return this->loads.load(std::memory_order_relaxed) > 0;
+    }
+
+    inline uint32_t latencyFrames() const
+    {
+        return ConvolutionNode::blockFrames;
+    }
+    // Time spent per block on the audio thread.
+    struct BlockStats
+    {
+        uint64_t blocks;
+        double averageUs, lastUs, peakUs;
+        // Share of the block's own duration.
+        double averageLoad, peakLoad;
+    };
+    BlockStats stats() const;
+    void resetStats();
+
+    // Audio side. `in` and `out` are interleaved and may alias.
+    void process(const float* in, float* out, uint32_t frameCount);
+};
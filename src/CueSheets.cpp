@@ -0,0 +1,269 @@
+#include "CueSheets.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+#include <Silence.h>
+
+namespace
+{
+    // UTF-8, or false at the first byte that can't be.
+    bool decodeUtf8(std::string_view text, std::u32string& out)
+    {
+        out.clear();
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size();)
+        {
+            uint8_t lead = uint8_t(text[i]);
+            size_t length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 : (lead & 0xF8) == 0xF0 ? 4 : 0;
+            if (length == 0 || i + length > text.size())
+                return false;
+            char32_t c = length == 1 ? lead : lead & (0x7F >> length);
+            for (size_t j = 1; j < length; j++)
+            {
+                uint8_t next = uint8_t(text[i + j]);
+                if ((next & 0xC0) != 0x80)
+                    return false;
+                c = c << 6 | (next & 0x3F);
+            }
+            out.push_back(c);
+            i += length;
+        }
+        return true;
+    }
+
+    bool isSpace(char32_t c)
+    {
+        return c == U' ' || c == U'\t' || c == U'\r';
+    }
+    std::u32string_view trimmed(std::u32string_view str)
+    {
+        while (!str.empty() && isSpace(str.front()))
+            str.remove_prefix(1);
+        while (!str.empty() && isSpace(str.back()))
+            str.remove_suffix(1);
+        return str;
+    }
+    // The next word of `line`, taken off it. Quoted, everything up to the closing quote.
+    std::u32string_view nextWord(std::u32string_view& line)
+    {
+        line = trimmed(line);
+        std::u32string_view word;
+        if (!line.empty() && line.front() == U'"')
+        {
+            size_t close = line.find(U'"', 1);
+            word = line.substr(1, close == line.npos ? line.npos : close - 1);
+            line.remove_prefix(close == line.npos ? line.size() : close + 1);
+            return word;
+        }
+        size_t end = 0;
+        while (end < line.size() && !isSpace(line[end]))
+            ++end;
+        word = line.substr(0, end);
+        line.remove_prefix(end);
+        return word;
+    }
+    // Commands are uppercase by the format, but not always by the tools writing it.
+    bool isCommand(std::u32string_view word, std::u32string_view command)
+    {
+        return word.size() == command.size() &&
+               std::equal(word.begin(), word.end(), command.begin(), [](char32_t a, char32_t b) { return (a >= U'a' && a <= U'z' ? a - 32 : a) == b; });
+    }
+    bool parseNumber(std::u32string_view str, uint32_t& value)
+    {
+        if (str.empty() || str.size() > 6)
+            return false;
+        value = 0;
+        for (char32_t c : str)
+        {
+            if (c < U'0' || c > U'9')
+                return false;
+            value = value * 10 + uint32_t(c - U'0');
+        }
+        return true;
+    }
+    // mm:ss:ff, in CD frames. Minutes go past 99 on long rips.
+    bool parseTime(std::u32string_view str, uint32_t& frames)
+    {
+        size_t first = str.find(U':'), second = first == str.npos ? str.npos : str.find(U':', first + 1);
+        uint32_t minutes, seconds, remainder;
+        if (second == str.npos || !parseNumber(str.substr(0, first), minutes) || !parseNumber(str.substr(first + 1, second - first - 1), seconds) ||
+            !parseNumber(str.substr(second + 1), remainder) || seconds >= 60 || remainder >= 75)
+            return false;
+        frames = (minutes * 60 + seconds) * 75 + remainder;
+        return true;
+    }
+
+    std::u32string entryName(const CueEntry& entry, const fs::path& sheet)
+    {
+        if (!entry.title.empty())
+            return entry.title;
+        std::u32string name = sheet.stem().u32string();
+        name.push_back(U' ');
+        if (entry.number < 10)
+            name.push_back(U'0');
+        for (char c : std::to_string(entry.number))
+            name.push_back(char32_t(c));
+        return name;
+    }
+}
+
+CueSheet CueSheets::parse(std::string_view text)
+{
+    if (text.starts_with("\xEF\xBB\xBF"))
+        text.remove_prefix(3);
+    std::u32string decoded;
+    if (!decodeUtf8(text, decoded))
+    {
+        // Older rippers write the system's code page. Latin-1 gets the ASCII right and keeps the rest distinct.
+        decoded.assign(text.size(), U'\0');
+        std::transform(text.begin(), text.end(), decoded.begin(), [](char c) { return char32_t(uint8_t(c)); });
+    }
+
+    CueSheet sheet;
+    std::u8string file;
+    std::optional<CueEntry> entry; // The TRACK being read, until the next one or the end.
+    bool hasStart = false;
+    auto finish = [&]
+    {
+        if (entry && hasStart)
+            sheet.entries.push_back(std::move(*entry));
+        entry.reset();
+        hasStart = false;
+    };
+
+    std::u32string_view rest = decoded;
+    while (!rest.empty())
+    {
+        size_t end = rest.find(U'\n');
+        std::u32string_view line = rest.substr(0, end);
+        rest.remove_prefix(end == rest.npos ? rest.size() : end + 1);
+
+        std::u32string_view command = nextWord(line);
+        if (isCommand(command, U"FILE"))
+        {
+            finish();
+            file = fs::path(std::u32string(nextWord(line))).generic_u8string();
+        }
+        else if (isCommand(command, U"TRACK"))
+        {
+            finish();
+            uint32_t number;
+            if (!file.empty() && parseNumber(nextWord(line), number) && isCommand(nextWord(line), U"AUDIO"))
+                entry = CueEntry { .file = file, .number = number };
+        }
+        else if (isCommand(command, U"TITLE") && entry)
+        {
+            // Unquoted titles run to the end of the line.
+            line = trimmed(line);
+            entry->title = line.starts_with(U'"') ? std::u32string(nextWord(line)) : std::u32string(line);
+        }
+        else if (isCommand(command, U"INDEX") && entry)
+        {
+            uint32_t number, start;
+            if (parseNumber(nextWord(line), number) && number == 1 && parseTime(nextWord(line), start))
+            {
+                entry->start = start;
+                hasStart = true;
+            }
+        }
+    }
+    finish();
+    return sheet;
+}
+CueSheet CueSheets::parseFile(const fs::path& file)
+{
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream)
+        return {};
+    std::string text { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+    return CueSheets::parse(text);
+}
+
+size_t CueSheets::split(std::vector<LibraryTrack>& tracks, const std::vector<std::pair<fs::path, std::shared_ptr<const CueSheet>>>& sheets)
+{
+    std::unordered_map<std::u8string, size_t> byPath, byStem;
+    for (size_t i = 0; i < tracks.size(); i++)
+    {
+        fs::path path = tracks[i].path.lexically_normal();
+        byPath.emplace(path.generic_u8string(), i);
+        byStem.emplace((path.parent_path() / path.stem()).generic_u8string(), i);
+    }
+
+    std::vector<bool> claimed(tracks.size());
+    std::vector<LibraryTrack> entries;
+    size_t replaced = 0;
+    for (const auto& [sheetFile, sheet] : sheets)
+    {
+        // A file at a time, as the sheet lists them.
+        for (size_t first = 0, last; first < sheet->entries.size(); first = last)
+        {
+            last = first + 1;
+            while (last < sheet->entries.size() && sheet->entries[last].file == sheet->entries[first].file)
+                ++last;
+            // A file with a single entry is a track already, sheet or not.
+            if (last - first < 2)
+                continue;
+
+            fs::path named = (sheetFile.parent_path() / fs::path(sheet->entries[first].file)).lexically_normal();
+            auto it = byPath.find(named.generic_u8string());
+            if (it == byPath.end())
+            {
+                it = byStem.find((named.parent_path() / named.stem()).generic_u8string());
+                if (it == byStem.end())
+                    continue;
+            }
+            if (claimed[it->second])
+                continue;
+            claimed[it->second] = true;
+            ++replaced;
+
+            const LibraryTrack& whole = tracks[it->second];
+            for (size_t i = first; i < last; i++)
+            {
+                uint32_t end = i + 1 < last ? sheet->entries[i + 1].start : 0;
+                if (end != 0 && end <= sheet->entries[i].start)
+                    continue; // Out of order, so there's no telling where it ends.
+                LibraryTrack& entry = entries.emplace_back(whole);
+                entry.name = entryName(sheet->entries[i], sheetFile);
+                entry.key = MusicLibrary::lowered(entry.name);
+                entry.span = CueSpan { .start = sheet->entries[i].start, .end = end };
+            }
+        }
+    }
+
+    entries.reserve(entries.size() + tracks.size() - replaced);
+    for (size_t i = 0; i < tracks.size(); i++)
+        if (!claimed[i])
+            entries.push_back(std::move(tracks[i]));
+    tracks = std::move(entries);
+    return replaced;
+}
+
+bool CueSheets::range(const std::optional<CueSpan>& span, const std::optional<TrackTrim>& trim, uint32_t sampleRate, uint64_t length,
+                      uint64_t& begin, uint64_t& end)
+{
+    // Left open-ended if the length isn't known, which is what an unset range is.
+    uint64_t whole = length ? length : ~uint64_t(0);
+    begin = 0;
+    end = whole;
+    if (span)
+    {
+        begin = span->startFrame(sampleRate);
+        if (span->end)
+            end = std::min(end, span->endFrame(sampleRate));
+        if (begin >= end)
+            return false; // Past the end of a file shorter than the sheet says.
+    }
+    // The trim points are the file's, so they only ever cut into its first and last entries.
+    uint64_t trimBegin, trimEnd;
+    if (trim && Silence::range(*trim, sampleRate, length, trimBegin, trimEnd) && std::max(begin, trimBegin) < std::min(end, trimEnd))
+    {
+        begin = std::max(begin, trimBegin);
+        end = std::min(end, trimEnd);
+    }
+    return begin != 0 || end != whole;
+}
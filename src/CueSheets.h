@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// Single-file rips split into their tracks by the CUE sheets next to them. Sheets are parsed while the library is
+// scanned and kept in the index, and each entry then plays as a track of its own: a span of the file it's in, set as
+// the range of that file's data source, so consecutive entries can go on reading through the same decoder.
+struct CueSheets
+{
+    CueSheets() = delete;
+
+    // Parses the text of a sheet, as UTF-8 or, failing that, Latin-1. Entries without an INDEX 01 and data tracks are
+    // left out.
+    static CueSheet parse(std::string_view text);
+    // Empty if `file` can't be read.
+    static CueSheet parseFile(const fs::path& file);
+    // Replaces the files among `tracks` that `sheets` split up with the sheets' entries. A sheet naming a file that
+    // isn't there is matched to one of the same stem beside it, as rips are often re-encoded without touching the
+    // sheet. The first sheet to claim a file wins. Returns how many files were replaced.
+    static size_t split(std::vector<LibraryTrack>& tracks, const std::vector<std::pair<fs::path, std::shared_ptr<const CueSheet>>>& sheets);
+
+    // The frames of its file a track plays at `sampleRate`: its span, if it has one, less whatever silence `trim`
+    // finds at the file's ends. `length` is the file's at that rate, 0 if unknown. False if that's all of it.
+    static bool range(const std::optional<CueSpan>& span, const std::optional<TrackTrim>& trim, uint32_t sampleRate, uint64_t length,
+                      uint64_t& begin, uint64_t& end);
+};
@@ -0,0 +1,317 @@
+#include "Equalizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include <AudioStats.h>
+
+namespace
+{
+    struct BiquadDesign
+    {
+        double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    };
+
+    // RBJ audio EQ cookbook, normalized by a0.
+    BiquadDesign design(const EqBand& band, uint32_t sampleRate)
+    {
+        bool hasGain = band.type == EqBandType::Peak || band.type == EqBandType::LowShelf || band.type == EqBandType::HighShelf;
+        if (hasGain && band.gainDb == 0.0f)
+            return BiquadDesign(); // Exactly flat, rather than a pole-zero pair that nearly cancels.
+
+        double frequency = std::clamp(double(band.frequency), 10.0, sampleRate * 0.49);
+        double q = std::max(double(band.q), 0.05);
+        double w0 = 2.0 * std::numbers::pi * frequency / sampleRate;
+        double cosW = std::cos(w0), alpha = std::sin(w0) / (2.0 * q);
+        double a = std::pow(10.0, band.gainDb / 40.0), sqrtA2Alpha = 2.0 * std::sqrt(a) * alpha;
+
+        double b0, b1, b2, a0, a1, a2;
+        switch (band.type)
+        {
+        case EqBandType::Peak:
+            b0 = 1.0 + alpha * a, b1 = -2.0 * cosW, b2 = 1.0 - alpha * a;
+            a0 = 1.0 + alpha / a, a1 = -2.0 * cosW, a2 = 1.0 - alpha / a;
+            break;
+        case EqBandType::LowShelf:
+            b0 = a * ((a + 1.0) - (a - 1.0) * cosW + sqrtA2Alpha), b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cosW), b2 = a * ((a + 1.0) - (a - 1.0) * cosW - sqrtA2Alpha);
+            a0 = (a + 1.0) + (a - 1.0) * cosW + sqrtA2Alpha, a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cosW), a2 = (a + 1.0) + (a - 1.0) * cosW - sqrtA2Alpha;
+            break;
+        case EqBandType::HighShelf:
+            b0 = a * ((a + 1.0) + (a - 1.0) * cosW + sqrtA2Alpha), b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cosW), b2 = a * ((a + 1.0) + (a - 1.0) * cosW - sqrtA2Alpha);
+            a0 = (a + 1.0) - (a - 1.0) * cosW + sqrtA2Alpha, a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cosW), a2 = (a + 1.0) - (a - 1.0) * cosW - sqrtA2Alpha;
+            break;
+        case EqBandType::LowPass:
+            b0 = (1.0 - cosW) / 2.0, b1 = 1.0 - cosW, b2 = (1.0 - cosW) / 2.0;
+            a0 = 1.0 + alpha, a1 = -2.0 * cosW, a2 = 1.0 - alpha;
+            break;
+        case EqBandType::HighPass:
+        default:
+            b0 = (1.0 + cosW) / 2.0, b1 = -(1.0 + cosW), b2 = (1.0 + cosW) / 2.0;
+            a0 = 1.0 + alpha, a1 = -2.0 * cosW, a2 = 1.0 - alpha;
+            break;
+        }
+        return BiquadDesign { b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0 };
+    }
+
+    constexpr float defaultFrequencies[EqualizerNode::bandCount] { 31.25f, 62.5f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f, 16000.0f };
+}
+
+EqualizerNode::~EqualizerNode()
+{
+    this->uninit();
+}
+
+ma_result EqualizerNode::init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate)
+{
+    this->channels = channels;
+    this->sampleRate = sampleRate;
+    this->lanesPerBand = channels <= 2 ? channels : 0;
+
+    size_t stageCount, stateCount;
+    if (this->lanesPerBand)
+    {
+        uint32_t bandsPerVector = 4 / this->lanesPerBand;
+        stageCount = stateCount = (EqualizerNode::bandCount + bandsPerVector - 1) / bandsPerVector;
+    }
+    else
+    {
+        stageCount = EqualizerNode::bandCount;
+        stateCount = EqualizerNode::bandCount * ((channels + 3) / 4);
+    }
+    // Everything the audio thread touches is sized here, and never again.
+    this->pending.forEach([&](Coefficients& coefficients) { coefficients.stages.resize(stageCount); });
+    this->current.stages.resize(stageCount);
+    this->step.stages.resize(stageCount);
+    this->z1.assign(stateCount, f32x4::zero());
+    this->z2.assign(stateCount, f32x4::zero());
+    this->wave.assign(stateCount, f32x4::zero());
+    this->rampRemaining = 0;
+
+    for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
+        this->bands[i] = EqBand { .frequency = defaultFrequencies[i] };
+    this->computeCoefficients(this->current);
+
+    if (!graph)
+        return MA_SUCCESS;
+
+    static ma_node_vtable vtable
+    {
+        .onProcess = EqualizerNode::onProcess,
+        .onGetRequiredInputFrameCount = nullptr,
+        .inputBusCount = 1,
+        .outputBusCount = 1,
+        .flags = 0
+    };
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &vtable;
+    config.pInputChannels = &this->channels;
+    config.pOutputChannels = &this->channels;
+    ma_result result = ma_node_init(graph, &config, nullptr, &this->base);
+    this->nodeInitialized = result == MA_SUCCESS;
+    return result;
+}
+void EqualizerNode::uninit()
+{
+    if (this->nodeInitialized)
+    {
+        ma_node_uninit(&this->base, nullptr);
+        this->nodeInitialized = false;
+    }
+}
+
+void EqualizerNode::computeCoefficients(Coefficients& out) const
+{
+    out.preamp = f32x4::splat(float(std::pow(10.0, this->_preampDb / 20.0)));
+
+    if (this->lanesPerBand)
+    {
+        // Band b sits in vector b / bandsPerVector, in lanes [(b % bandsPerVector) * lanesPerBand, +lanesPerBand).
+        uint32_t bandsPerVector = 4 / this->lanesPerBand;
+        for (size_t v = 0; v < out.stages.size(); v++)
+        {
+            float lanes[5][4];
+            for (uint32_t slot = 0; slot < bandsPerVector; slot++)
+            {
+                uint32_t b = uint32_t(v) * bandsPerVector + slot;
+                BiquadDesign d = b < EqualizerNode::bandCount ? design(this->bands[b], this->sampleRate) : BiquadDesign();
+                for (uint32_t lane = slot * this->lanesPerBand; lane < (slot + 1) * this->lanesPerBand; lane++)
+                {
+                    lanes[0][lane] = float(d.b0);
+                    lanes[1][lane] = float(d.b1);
+                    lanes[2][lane] = float(d.b2);
+                    lanes[3][lane] = float(-d.a1);
+                    lanes[4][lane] = float(-d.a2);
+                }
+            }
+            out.stages[v] = Stage { f32x4::load(lanes[0]), f32x4::load(lanes[1]), f32x4::load(lanes[2]), f32x4::load(lanes[3]), f32x4::load(lanes[4]) };
+        }
+    }
+    else for (uint32_t b = 0; b < EqualizerNode::bandCount; b++)
+    {
+        BiquadDesign d = design(this->bands[b], this->sampleRate);
+        out.stages[b] = Stage { f32x4::splat(float(d.b0)), f32x4::splat(float(d.b1)), f32x4::splat(float(d.b2)), f32x4::splat(float(-d.a1)), f32x4::splat(float(-d.a2)) };
+    }
+}
+void EqualizerNode::publish()
+{
+    this->computeCoefficients(this->pending.writeBuffer());
+    this->pending.publish();
+}
+
+void EqualizerNode::setBand(uint32_t index, const EqBand& band)
+{
+    this->bands[index] = band;
+    this->publish();
+}
+void EqualizerNode::setPreampDb(float db)
+{
+    this->_preampDb = db;
+    this->publish();
+}
+void EqualizerNode::reset()
+{
+    for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
+        this->bands[i] = EqBand { .frequency = defaultFrequencies[i] };
+    this->_preampDb = 0.0f;
+    this->publish();
+}
+
+template <uint32_t N, bool Ramp>
+void EqualizerNode::processPacked(const float* in, float* out, uint32_t frameCount)
+{
+    Stage* stages = this->current.stages.data();
+    const Stage* steps = this->step.stages.data();
+    size_t vectorCount = this->current.stages.size();
+    f32x4 preamp = this->current.preamp;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        f32x4 feed = N == 1 ? f32x4::splat(in[i]) : f32x4::set(in[i * 2], in[i * 2 + 1], 0.0f, 0.0f);
+        feed = feed * preamp;
+        for (size_t v = 0; v < vectorCount; v++)
+        {
+            Stage& s = stages[v];
+            f32x4 prev = this->wave[v];
+            f32x4 x = f32x4::shiftIn<N>(feed, prev);
+            f32x4 y = f32x4::mulAdd(s.b0, x, this->z1[v]);
+            this->z1[v] = f32x4::mulAdd(s.b1, x, f32x4::mulAdd(s.a1, y, this->z2[v]));
+            this->z2[v] = f32x4::mulAdd(s.b2, x, s.a2 * y);
+            this->wave[v] = y;
+            // What left the top of this vector is the input of the next one's first band.
+            feed = f32x4::topLanes<N>(prev);
+
+            if constexpr (Ramp)
+                s = Stage { s.b0 + steps[v].b0, s.b1 + steps[v].b1, s.b2 + steps[v].b2, s.a1 + steps[v].a1, s.a2 + steps[v].a2 };
+        }
+        if constexpr (Ramp)
+            preamp += this->step.preamp;
+
+        float lanes[4];
+        feed.store(lanes);
+        for (uint32_t c = 0; c < N; c++)
+            out[i * N + c] = lanes[c];
+    }
+    this->current.preamp = preamp;
+}
+template <bool Ramp>
+void EqualizerNode::processGrouped(const float* in, float* out, uint32_t frameCount)
+{
+    Stage* stages = this->current.stages.data();
+    const Stage* steps = this->step.stages.data();
+    uint32_t groupCount = (this->channels + 3) / 4;
+    f32x4 preamp = this->current.preamp;
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        for (uint32_t g = 0; g < groupCount; g++)
+        {
+            uint32_t first = g * 4, width = std::min(this->channels - first, 4u);
+            float lanes[4] { };
+            std::copy(in + size_t(i) * this->channels + first, in + size_t(i) * this->channels + first + width, lanes);
+            f32x4 x = f32x4::load(lanes) * preamp;
+
+            f32x4* z1 = &this->z1[size_t(g) * EqualizerNode::bandCount];
+            f32x4* z2 = &this->z2[size_t(g) * EqualizerNode::bandCount];
+            for (uint32_t b = 0; b < EqualizerNode::bandCount; b++)
+            {
+                const Stage& s = stages[b];
+                f32x4 y = f32x4::mulAdd(s.b0, x, z1[b]);
+                z1[b] = f32x4::mulAdd(s.b1, x, f32x4::mulAdd(s.a1, y, z2[b]));
+                z2[b] = f32x4::mulAdd(s.b2, x, s.a2 * y);
+                x = y;
+            }
+
+            x.store(lanes);
+            std::copy(lanes, lanes + width, out + size_t(i) * this->channels + first);
+        }
+
+        if constexpr (Ramp)
+        {
+            for (uint32_t b = 0; b < EqualizerNode::bandCount; b++)
+            {
+                Stage& s = stages[b];
+                s = Stage { s.b0 + steps[b].b0, s.b1 + steps[b].b1, s.b2 + steps[b].b2, s.a1 + steps[b].a1, s.a2 + steps[b].a2 };
+            }
+            preamp += this->step.preamp;
+        }
+    }
+    this->current.preamp = preamp;
+}
+
+void EqualizerNode::process(const float* in, float* out, uint32_t frameCount)
+{
+    FlushDenormals flush;
+
+    if (this->pending.update())
+    {
+        // Glide from wherever we are, even mid-ramp, to the newest settings.
+        const Coefficients& target = this->pending.readBuffer();
+        f32x4 inv = f32x4::splat(1.0f / EqualizerNode::rampFrames);
+        for (size_t v = 0; v < target.stages.size(); v++)
+        {
+            const Stage& t = target.stages[v];
+            const Stage& c = this->current.stages[v];
+            this->step.stages[v] = Stage { (t.b0 - c.b0) * inv, (t.b1 - c.b1) * inv, (t.b2 - c.b2) * inv, (t.a1 - c.a1) * inv, (t.a2 - c.a2) * inv };
+        }
+        this->step.preamp = (target.preamp - this->current.preamp) * inv;
+        this->rampRemaining = EqualizerNode::rampFrames;
+    }
+
+    uint32_t done = 0;
+    while (done < frameCount)
+    {
+        const float* blockIn = in + size_t(done) * this->channels;
+        float* blockOut = out + size_t(done) * this->channels;
+        bool ramping = this->rampRemaining > 0;
+        uint32_t count = ramping ? std::min(frameCount - done, this->rampRemaining) : frameCount - done;
+
+        switch (this->lanesPerBand)
+        {
+        case 1:
+            ramping ? this->processPacked<1, true>(blockIn, blockOut, count) : this->processPacked<1, false>(blockIn, blockOut, count);
+            break;
+        case 2:
+            ramping ? this->processPacked<2, true>(blockIn, blockOut, count) : this->processPacked<2, false>(blockIn, blockOut, count);
+            break;
+        default:
+            ramping ? this->processGrouped<true>(blockIn, blockOut, count) : this->processGrouped<false>(blockIn, blockOut, count);
+            break;
+        }
+
+        if (ramping && (this->rampRemaining -= count) == 0)
+        {
+            // Land exactly on target rather than on the accumulated steps. Same sizes, so this doesn't allocate.
+            const Coefficients& target = this->pending.readBuffer();
+            std::copy(target.stages.begin(), target.stages.end(), this->current.stages.begin());
+            this->current.preamp = target.preamp;
+        }
+        done += count;
+    }
+}
+
+void EqualizerNode::onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut)
+{
+    AudioStats::EffectScope timed;
+    static_cast<EqualizerNode*>(pNode)->process(ppFramesIn[0], ppFramesOut[0], *pFrameCountOut);
+}
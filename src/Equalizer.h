@@ -0,0 +1,107 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <cstdint>
+#include <vector>
+
+#include <Simd.h>
+#include <TripleBuffer.h>
+
+enum class EqBandType
+{
+    Peak,
+    LowShelf,
+    HighShelf,
+    LowPass,
+    HighPass
+};
+
+struct EqBand
+{
+    EqBandType type = EqBandType::Peak;
+    float frequency = 1000.0f;
+    float gainDb = 0.0f;
+    float q = 1.41f;
+};
+
+// Parametric EQ node: a preamp and a cascade of biquads. For mono and stereo the cascade is run as a wavefront, with
+// several bands' worth of channels sharing a vector (one sample apart), which costs a few samples of constant latency.
+// Wider layouts put channels in the lanes instead.
+// Settings change from one (non-audio) thread through a triple buffer, and coefficients glide to new values over
+// `rampFrames`, so moving a band never clicks or zippers.
+class EqualizerNode
+{
+public:
+    static constexpr uint32_t bandCount = 10;
+    static constexpr uint32_t rampFrames = 1024;
+private:
+    ma_node_base base; // Must stay the first member, miniaudio reinterprets ma_node* as ma_node_base*.
+
+    struct Stage
+    {
+        f32x4 b0, b1, b2, a1, a2; // Feedback coefficients negated.
+    };
+    struct Coefficients
+    {
+        std::vector<Stage> stages;
+        f32x4 preamp = f32x4::splat(1.0f);
+    };
+
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t lanesPerBand = 0; // 1 or 2 if bands are packed into lanes, 0 if lanes hold channels.
+    bool nodeInitialized = false;
+
+    // Settings side.
+    EqBand bands[EqualizerNode::bandCount];
+    float _preampDb = 0.0f;
+    TripleBuffer<Coefficients> pending;
+
+    // Audio side.
+    Coefficients current, step;
+    uint32_t rampRemaining = 0;
+    std::vector<f32x4> z1, z2, wave;
+
+    static void onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+
+    void computeCoefficients(Coefficients& out) const;
+    void publish();
+    template <uint32_t N, bool Ramp>
+    void processPacked(const float* in, float* out, uint32_t frameCount);
+    template <bool Ramp>
+    void processGrouped(const float* in, float* out, uint32_t frameCount);
+public:
+    EqualizerNode() = default;
+    EqualizerNode(const EqualizerNode&) = delete;
+    ~EqualizerNode();
+
+    // `graph` may be null, for using process() directly.
+    ma_result init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate);
+    void uninit();
+
+    inline ma_node* node()
+    {
+        return &this->base;
+    }
+
+    // Settings side. Single thread only.
+    inline const EqBand& band(uint32_t index) const
+    {
+        return this->bands[index];
+    }
+    void setBand(uint32_t index, const EqBand& band);
+    inline float preampDb() const
+    {
+        return this->_preampDb;
+    }
+    void setPreampDb(float db);
+    // Flat, with the default octave-spaced peaking bands.
+    void reset();
+
+    // Audio side. `in` and `out` are interleaved and may alias.
+    void process(const float* in, float* out, uint32_t frameCount);
+    inline uint32_t latencyFrames() const
+    {
+        return this->lanesPerBand ? uint32_t(this->current.stages.size() * 4 / this->lanesPerBand) : 0;
+    }
+};
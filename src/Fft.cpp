@@ -0,0 +1,137 @@
+#include "Fft.h"
+
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+
+#include <Simd.h>
+
+Fft::Fft(uint32_t size) : n(size), half(size / 2)
+{
+    assert(std::has_single_bit(size) && size >= 16);
+
+    uint32_t bits = std::countr_zero(this->half);
+    this->reversed.resize(this->half);
+    for (uint32_t i = 0; i < this->half; i++)
+    {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        this->reversed[i] = r;
+    }
+
+    this->twiddleRe.resize(this->half);
+    this->twiddleIm.resize(this->half);
+    for (uint32_t h = 1; h < this->half; h *= 2)
+    {
+        for (uint32_t j = 0; j < h; j++)
+        {
+            double angle = -std::numbers::pi * j / h;
+            this->twiddleRe[h + j] = float(std::cos(angle));
+            this->twiddleIm[h + j] = float(std::sin(angle));
+        }
+    }
+    this->splitRe.resize(this->half + 1);
+    this->splitIm.resize(this->half + 1);
+    for (uint32_t k = 0; k <= this->half; k++)
+    {
+        double angle = -2.0 * std::numbers::pi * k / this->n;
+        this->splitRe[k] = float(std::cos(angle));
+        this->splitIm[k] = float(std::sin(angle));
+    }
+    this->workRe.resize(this->half);
+    this->workIm.resize(this->half);
+}
+
+void Fft::transform(float* re, float* im) const
+{
+    const uint32_t m = this->half;
+
+    // Spans 1 and 2 together, as one radix-4 pass: their twiddles are 1 and -i.
+    for (uint32_t i = 0; i < m; i += 4)
+    {
+        float ar = re[i] + re[i + 1], ai = im[i] + im[i + 1];
+        float br = re[i] - re[i + 1], bi = im[i] - im[i + 1];
+        float cr = re[i + 2] + re[i + 3], ci = im[i + 2] + im[i + 3];
+        float dr = re[i + 2] - re[i + 3], di = im[i + 2] - im[i + 3];
+        re[i] = ar + cr, im[i] = ai + ci;
+        re[i + 2] = ar - cr, im[i + 2] = ai - ci;
+        // d * -i = (di, -dr)
+        re[i + 1] = br + di, im[i + 1] = bi - dr;
+        re[i + 3] = br - di, im[i + 3] = bi + dr;
+    }
+
+    for (uint32_t h = 4; h < m; h *= 2)
+    {
+        const float* wRe = &this->twiddleRe[h];
+        const float* wIm = &this->twiddleIm[h];
+        for (uint32_t s = 0; s < m; s += h * 2)
+        {
+            for (uint32_t j = 0; j < h; j += 4)
+            {
+                f32x4 wr = f32x4::load(wRe + j), wi = f32x4::load(wIm + j);
+                f32x4 ar = f32x4::load(re + s + j), ai = f32x4::load(im + s + j);
+                f32x4 br = f32x4::load(re + s + h + j), bi = f32x4::load(im + s + h + j);
+                f32x4 tr = br * wr - bi * wi;
+                f32x4 ti = f32x4::mulAdd(br, wi, bi * wr);
+                (ar + tr).store(re + s + j);
+                (ai + ti).store(im + s + j);
+                (ar - tr).store(re + s + h + j);
+                (ai - ti).store(im + s + h + j);
+            }
+        }
+    }
+}
+
+void Fft::forward(const float* in, float* re, float* im)
+{
+    const uint32_t m = this->half;
+
+    // Even samples as the real part, odd as the imaginary, straight into bit-reversed order.
+    for (uint32_t i = 0; i < m; i++)
+    {
+        this->workRe[this->reversed[i]] = in[i * 2];
+        this->workIm[this->reversed[i]] = in[i * 2 + 1];
+    }
+    this->transform(this->workRe.data(), this->workIm.data());
+
+    // Pull the spectra of the even and odd samples back apart, then combine them into the full-size spectrum.
+    for (uint32_t k = 0; k <= m; k++)
+    {
+        uint32_t a = k == m ? 0 : k, b = k == 0 ? 0 : m - k;
+        float zr = this->workRe[a], zi = this->workIm[a];
+        float cr = this->workRe[b], ci = -this->workIm[b];
+        float er = (zr + cr) * 0.5f, ei = (zi + ci) * 0.5f;
+        float or_ = (zi - ci) * 0.5f, oi = (cr - zr) * 0.5f;
+        float wr = this->splitRe[k], wi = this->splitIm[k];
+        re[k] = er + or_ * wr - oi * wi;
+        im[k] = ei + or_ * wi + oi * wr;
+    }
+}
+
+void Fft::inverse(const float* re, const float* im, float* out)
+{
+    const uint32_t m = this->half;
+
+    // Inverting is a forward transform with real and imaginary swapped on the way in and out.
+    for (uint32_t k = 0; k < m; k++)
+    {
+        float xr = re[k], xi = im[k];
+        float cr = re[m - k], ci = -im[m - k];
+        float er = xr + cr, ei = xi + ci;
+        float dr = xr - cr, di = xi - ci;
+        float wr = this->splitRe[k], wi = -this->splitIm[k];
+        float or_ = dr * wr - di * wi, oi = dr * wi + di * wr;
+        // z = e + i * o
+        this->workRe[this->reversed[k]] = ei + or_;
+        this->workIm[this->reversed[k]] = er - oi;
+    }
+    this->transform(this->workRe.data(), this->workIm.data());
+
+    for (uint32_t i = 0; i < m; i++)
+    {
+        out[i * 2] = this->workIm[i];
+        out[i * 2 + 1] = this->workRe[i];
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Real-input FFT of a fixed power-of-two size, as a half-size complex radix-2 transform over split re/im arrays with
+// the butterflies done four at a time. Owns its scratch space, so one instance per thread.
+class Fft
+{
+    uint32_t n;
+    uint32_t half;
+    std::vector<uint32_t> reversed;
+    // Butterfly twiddles of the stage with span h at [h, 2h). Then e^(-2 pi i k / n) for k in [0, n / 2], for the real split.
+    std::vector<float> twiddleRe, twiddleIm;
+    std::vector<float> splitRe, splitIm;
+    std::vector<float> workRe, workIm;
+
+    // In place, forward, on bit-reversed input of `half` points.
+    void transform(float* re, float* im) const;
+public:
+    // `size` is a power of two, at least 16.
+    explicit Fft(uint32_t size);
+
+    inline uint32_t size() const
+    {
+        return this->n;
+    }
+    inline uint32_t bins() const
+    {
+        return this->half + 1;
+    }
+
+    // `in` holds size() samples, `re` and `im` receive bins() values.
+    void forward(const float* in, float* re, float* im);
+    // Unnormalized: inverse(forward(x)) is size() * x.
+    void inverse(const float* re, const float* im, float* out);
+};
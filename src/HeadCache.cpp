@@ -0,0 +1,435 @@
+#include "HeadCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <unordered_set>
+
+#include <JobPool.h>
+#include <MappedFileVFS.h>
+#include <MusicPlayer.h>
+#include <SeekTables.h>
+
+namespace
+{
+    // A track decoded out of a mapping to f32 at a fixed rate, the same way for the cached opening and for the rest of
+    // the track, so where one ends the other carries on sample for sample.
+    struct TrackDecoder
+    {
+        FileMapping mapping;
+        ma_decoder decoder;
+        bool decoderInitialized = false;
+        std::unique_ptr<Mp3Source> mp3;
+        std::unique_ptr<ResampledSource> resampled;
+        ma_data_source* source = nullptr;
+        uint32_t channels = 0;
+
+        TrackDecoder() = default;
+        TrackDecoder(const TrackDecoder&) = delete;
+        ~TrackDecoder()
+        {
+            this->resampled.reset();
+            this->mp3.reset();
+            if (this->decoderInitialized)
+                ma_decoder_uninit(&this->decoder);
+        }
+
+        static std::unique_ptr<TrackDecoder> open(const fs::path& file, uint32_t sampleRate, ResamplerQuality quality)
+        {
+            auto track = std::make_unique<TrackDecoder>();
+            track->mapping = FileMapping(file);
+            if (!track->mapping)
+                return nullptr;
+            track->mapping.advise(FileAccessPattern::Sequential);
+
+            ma_data_source* decoded = nullptr;
+            uint32_t nativeSampleRate = 0;
+            std::shared_ptr<const TrackSeekTable> seekTable = SeekTables::find(file);
+            if (seekTable && seekTable->pointCount > 0)
+            {
+                track->mp3 = std::make_unique<Mp3Source>();
+                if (track->mp3->init(track->mapping.data(), track->mapping.size(), *seekTable) == MA_SUCCESS)
+                {
+                    decoded = track->mp3->dataSource();
+                    nativeSampleRate = track->mp3->sampleRate();
+                }
+                else track->mp3.reset();
+            }
+            if (!decoded)
+            {
+                ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+                if (ma_decoder_init_memory(track->mapping.data(), track->mapping.size(), &config, &track->decoder) != MA_SUCCESS)
+                    return nullptr;
+                track->decoderInitialized = true;
+                decoded = &track->decoder;
+                nativeSampleRate = track->decoder.outputSampleRate;
+            }
+
+            track->source = decoded;
+            if (nativeSampleRate != sampleRate)
+            {
+                // The sound can't resample half a track, so it all comes at the device's rate. Linear, which would
+                // leave it to the sound, gets the cheapest sinc instead.
+                track->resampled = std::make_unique<ResampledSource>();
+                if (track->resampled->init(decoded, sampleRate, quality == ResamplerQuality::Linear ? ResamplerQuality::Fast : quality) != MA_SUCCESS)
+                    return nullptr;
+                track->source = track->resampled->dataSource();
+            }
+            ma_format format;
+            if (ma_data_source_get_data_format(track->source, &format, &track->channels, nullptr, nullptr, 0) != MA_SUCCESS || track->channels == 0)
+                return nullptr;
+            return track;
+        }
+    };
+
+    // Their own threads rather than the background pool, which a library scan can keep busy for minutes. Opening the
+    // rest of a playing track can't wait behind decoding openings, so it gets one to itself.
+    JobPool& buildPool()
+    {
+        static JobPool pool(1);
+        return pool;
+    }
+    JobPool& openPool()
+    {
+        static JobPool pool(1);
+        return pool;
+    }
+}
+
+struct HeadStartSource::Tail
+{
+    std::atomic<TrackDecoder*> ready = nullptr;
+    std::atomic<bool> failed = false;
+    std::atomic<bool> abandoned = false;
+
+    ~Tail()
+    {
+        delete this->ready.load(std::memory_order_acquire);
+    }
+};
+
+std::shared_ptr<TrackHead> HeadCache::buildFile(const fs::path& file, uint32_t sampleRate, ResamplerQuality quality, float seconds, std::stop_token stop)
+{
+    std::unique_ptr<TrackDecoder> track = TrackDecoder::open(file, sampleRate, quality);
+    if (!track)
+        return nullptr;
+
+    auto head = std::make_shared<TrackHead>();
+    head->file = file;
+    head->channels = track->channels;
+    head->sampleRate = sampleRate;
+    head->quality = quality;
+    uint64_t target = uint64_t(double(seconds) * sampleRate);
+    head->samples.resize(size_t(target) * track->channels);
+
+    constexpr uint64_t chunkFrames = 4096;
+    bool ended = false;
+    while (head->frames < target && !stop.stop_requested())
+    {
+        ma_uint64 read = 0;
+        ma_result result = ma_data_source_read_pcm_frames(track->source, head->samples.data() + head->frames * track->channels,
+            std::min(chunkFrames, target - head->frames), &read);
+        head->frames += read;
+        if (result == MA_AT_END || (result == MA_SUCCESS && read == 0))
+        {
+            ended = true;
+            break;
+        }
+        if (result != MA_SUCCESS)
+            return nullptr;
+    }
+    if (stop.stop_requested() || head->frames == 0)
+        return nullptr;
+    head->samples.resize(size_t(head->frames) * track->channels);
+    head->samples.shrink_to_fit();
+
+    ma_uint64 length = head->frames;
+    if (!ended && (ma_data_source_get_length_in_pcm_frames(track->source, &length) != MA_SUCCESS || length < head->frames))
+        return nullptr;
+    head->length = length;
+    return head;
+}
+
+void HeadCache::sync()
+{
+    uint32_t sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine);
+    std::vector<fs::path> upcoming;
+    if (MusicPlayer::type == PlaylistType::Queued && HeadCache::seconds > 0.0f && sampleRate && !MusicPlayer::queue.empty())
+    {
+        // Budgeted as stereo. Anything wider that doesn't fit once decoded is dropped then.
+        size_t estimate = size_t(HeadCache::seconds * sampleRate) * 2 * sizeof(float), total = 0;
+        std::unordered_set<std::u8string> seen;
+        auto it = MusicPlayer::queuePos;
+        for (size_t i = 0; i < MusicPlayer::queue.size(); i++)
+        {
+            it = it == MusicPlayer::queue.end() ? MusicPlayer::queue.begin() : std::next(it);
+            if (it == MusicPlayer::queue.end())
+            {
+                if (!MusicPlayer::loop)
+                    break;
+                it = MusicPlayer::queue.begin();
+            }
+            if (it == MusicPlayer::queuePos || total + estimate > HeadCache::budgetBytes)
+                break;
+            // Streamed tracks already buffer ahead through the VFS, and their openings would cost the very reads this
+            // is meant to save. Entries of CUE sheets that start further into their file have no use for its opening.
+            if (MusicPlayer::streamed(it->path) || (it->span && it->span->start != 0) || !seen.insert(it->path.generic_u8string()).second)
+                continue;
+            upcoming.push_back(it->path);
+            total += estimate;
+        }
+    }
+
+    bool settingsChanged = sampleRate != HeadCache::wantedSampleRate || MusicPlayer::resampleQuality != HeadCache::wantedQuality ||
+        HeadCache::seconds != HeadCache::wantedSeconds || HeadCache::budgetBytes != HeadCache::wantedBudget;
+    if (!settingsChanged && upcoming == HeadCache::wanted)
+        return;
+
+    std::lock_guard guard(HeadCache::mutex);
+    if (settingsChanged)
+    {
+        HeadCache::entries.clear();
+        ++HeadCache::generation;
+    }
+    std::unordered_set<std::u8string> keys;
+    for (const fs::path& file : upcoming)
+        keys.insert(file.generic_u8string());
+    std::erase_if(HeadCache::entries, [&](const auto& entry) { return !keys.contains(entry.first); });
+
+    for (const fs::path& file : upcoming)
+    {
+        if (!HeadCache::entries.emplace(file.generic_u8string(), nullptr).second)
+            continue;
+        buildPool().submit([file, generation = HeadCache::generation, sampleRate, quality = MusicPlayer::resampleQuality, seconds = HeadCache::seconds](std::stop_token stop)
+        {
+            auto wanted = [&]
+            {
+                return generation == HeadCache::generation && HeadCache::entries.contains(file.generic_u8string());
+            };
+            {
+                std::lock_guard guard(HeadCache::mutex);
+                if (!wanted())
+                    return; // Dropped from the queue while this waited.
+            }
+
+            std::shared_ptr<TrackHead> head = HeadCache::buildFile(file, sampleRate, quality, seconds, stop);
+            std::lock_guard guard(HeadCache::mutex);
+            if (!wanted())
+                return;
+            if (!head)
+            {
+                if (!stop.stop_requested())
+                    HeadCache::failed.fetch_add(1, std::memory_order_relaxed);
+                HeadCache::entries.erase(file.generic_u8string());
+                return;
+            }
+            size_t bytes = 0;
+            for (auto& [key, cached] : HeadCache::entries)
+                bytes += cached ? cached->bytes() : 0;
+            if (bytes + head->bytes() > HeadCache::budgetBytes)
+            {
+                HeadCache::entries.erase(file.generic_u8string());
+                return;
+            }
+            HeadCache::entries[file.generic_u8string()] = std::move(head);
+            HeadCache::built.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    HeadCache::wanted = std::move(upcoming);
+    HeadCache::wantedSampleRate = sampleRate;
+    HeadCache::wantedQuality = MusicPlayer::resampleQuality;
+    HeadCache::wantedSeconds = HeadCache::seconds;
+    HeadCache::wantedBudget = HeadCache::budgetBytes;
+}
+
+std::shared_ptr<const TrackHead> HeadCache::find(const fs::path& file)
+{
+    std::lock_guard guard(HeadCache::mutex);
+    auto it = HeadCache::entries.find(file.generic_u8string());
+    if (it == HeadCache::entries.end())
+        return nullptr;
+    if (!it->second)
+    {
+        HeadCache::misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    // The settings may have changed since the last sync.
+    if (it->second->sampleRate != ma_engine_get_sample_rate(&MusicPlayer::engine) || it->second->quality != MusicPlayer::resampleQuality)
+        return nullptr;
+    HeadCache::hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second;
+}
+
+size_t HeadCache::cachedCount()
+{
+    std::lock_guard guard(HeadCache::mutex);
+    return size_t(std::count_if(HeadCache::entries.begin(), HeadCache::entries.end(), [](const auto& entry) { return entry.second != nullptr; }));
+}
+size_t HeadCache::cachedBytes()
+{
+    std::lock_guard guard(HeadCache::mutex);
+    size_t bytes = 0;
+    for (auto& [key, head] : HeadCache::entries)
+        bytes += head ? head->bytes() : 0;
+    return bytes;
+}
+
+HeadStartSource::~HeadStartSource()
+{
+    this->uninit();
+}
+
+ma_result HeadStartSource::init(std::shared_ptr<const TrackHead> head)
+{
+    if (!head || head->frames == 0)
+        return MA_INVALID_ARGS;
+    this->head = std::move(head);
+    this->cursor = 0;
+    this->tailCursor = this->head->frames;
+
+    static ma_data_source_vtable vtable
+    {
+        .onRead = HeadStartSource::onRead,
+        .onSeek = HeadStartSource::onSeek,
+        .onGetDataFormat = HeadStartSource::onGetDataFormat,
+        .onGetCursor = HeadStartSource::onGetCursor,
+        .onGetLength = HeadStartSource::onGetLength,
+        .onSetLooping = nullptr,
+        .flags = 0
+    };
+    ma_data_source_config config = ma_data_source_config_init();
+    config.vtable = &vtable;
+    if (ma_result result = ma_data_source_init(&config, &this->base); result != MA_SUCCESS)
+        return result;
+    this->sourceInitialized = true;
+
+    this->tail = std::make_shared<Tail>();
+    if (this->head->complete())
+        return MA_SUCCESS;
+    openPool().submit([tail = this->tail, head = this->head](std::stop_token)
+    {
+        if (tail->abandoned.load(std::memory_order_acquire))
+            return;
+        std::unique_ptr<TrackDecoder> track = TrackDecoder::open(head->file, head->sampleRate, head->quality);
+        if (track && ma_data_source_seek_to_pcm_frame(track->source, head->frames) == MA_SUCCESS)
+        {
+            // Only when lock_memory is on, as for any playing track.
+            track->mapping.lock();
+            tail->ready.store(track.release(), std::memory_order_release);
+        }
+        else tail->failed.store(true, std::memory_order_release);
+    });
+    return MA_SUCCESS;
+}
+void HeadStartSource::uninit()
+{
+    if (this->sourceInitialized)
+    {
+        ma_data_source_uninit(&this->base);
+        this->sourceInitialized = false;
+    }
+    if (this->tail)
+    {
+        this->tail->abandoned.store(true, std::memory_order_release);
+        this->tail.reset();
+    }
+    this->head.reset();
+}
+
+bool HeadStartSource::caughtUp() const
+{
+    return this->head && (this->head->complete() || (this->tail && this->tail->ready.load(std::memory_order_acquire)));
+}
+
+size_t HeadStartSource::bytes() const
+{
+    TrackDecoder* decoder = this->tail ? this->tail->ready.load(std::memory_order_acquire) : nullptr;
+    return (this->head ? this->head->bytes() : 0) + (decoder ? decoder->mapping.size() : 0);
+}
+
+ma_result HeadStartSource::onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    HeadStartSource* self = static_cast<HeadStartSource*>(pDataSource);
+    const TrackHead& head = *self->head;
+    float* out = static_cast<float*>(pFramesOut);
+    ma_uint64 done = 0;
+    ma_result result = MA_SUCCESS;
+    while (done < frameCount)
+    {
+        if (self->cursor < head.frames)
+        {
+            ma_uint64 count = std::min<ma_uint64>(frameCount - done, head.frames - self->cursor);
+            std::memcpy(out + done * head.channels, head.samples.data() + self->cursor * head.channels, size_t(count) * head.channels * sizeof(float));
+            self->cursor += count;
+            done += count;
+            continue;
+        }
+        if (head.complete() || self->cursor >= head.length)
+        {
+            result = MA_AT_END;
+            break;
+        }
+
+        TrackDecoder* track = self->tail->ready.load(std::memory_order_acquire);
+        if (!track)
+        {
+            result = self->tail->failed.load(std::memory_order_acquire) ? MA_AT_END : MA_BUSY;
+            break;
+        }
+        if (self->tailCursor != self->cursor)
+        {
+            if ((result = ma_data_source_seek_to_pcm_frame(track->source, self->cursor)) != MA_SUCCESS)
+                break;
+            self->tailCursor = self->cursor;
+        }
+        ma_uint64 read = 0;
+        result = ma_data_source_read_pcm_frames(track->source, out + done * head.channels, frameCount - done, &read);
+        self->cursor += read;
+        self->tailCursor += read;
+        done += read;
+        if (result != MA_SUCCESS || read == 0)
+        {
+            if (result == MA_SUCCESS)
+                result = MA_AT_END;
+            break;
+        }
+    }
+
+    if (pFramesRead)
+        *pFramesRead = done;
+    // Whatever was read still plays; being busy only matters once there's nothing.
+    return done > 0 && result == MA_BUSY ? MA_SUCCESS : result;
+}
+ma_result HeadStartSource::onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+{
+    HeadStartSource* self = static_cast<HeadStartSource*>(pDataSource);
+    if (frameIndex > self->head->length)
+        return MA_INVALID_ARGS;
+    // The decoder follows on the next read past the opening, if it's ready by then.
+    self->cursor = frameIndex;
+    return MA_SUCCESS;
+}
+ma_result HeadStartSource::onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+{
+    HeadStartSource* self = static_cast<HeadStartSource*>(pDataSource);
+    if (pFormat)
+        *pFormat = ma_format_f32;
+    if (pChannels)
+        *pChannels = self->head->channels;
+    if (pSampleRate)
+        *pSampleRate = self->head->sampleRate;
+    if (pChannelMap)
+        ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, self->head->channels);
+    return MA_SUCCESS;
+}
+ma_result HeadStartSource::onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+{
+    *pCursor = static_cast<HeadStartSource*>(pDataSource)->cursor;
+    return MA_SUCCESS;
+}
+ma_result HeadStartSource::onGetLength(ma_data_source* pDataSource, ma_uint64* pLength)
+{
+    *pLength = static_cast<HeadStartSource*>(pDataSource)->head->length;
+    return MA_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <Resampler.h>
+
+namespace fs = std::filesystem;
+
+// The opening of a track, decoded to f32 at the rate it'd play at, in the track's own channel count.
+struct TrackHead
+{
+    fs::path file;
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    ResamplerQuality quality = ResamplerQuality::Balanced;
+    uint64_t frames = 0; // In `samples`.
+    uint64_t length = 0; // Of the whole track.
+    std::vector<float> samples;
+
+    inline size_t bytes() const
+    {
+        return this->samples.size() * sizeof(float);
+    }
+    inline bool complete() const
+    {
+        return this->frames >= this->length;
+    }
+};
+
+// Openings of the tracks coming up in the queue, decoded in the background so they start without waiting on the disk
+// or on their decoder opening. Kept for as many of the next tracks as the budget allows, nearest first.
+struct HeadCache
+{
+    HeadCache() = delete;
+
+    // How much of each track is kept. 0 turns the cache off.
+    inline static float seconds = 5.0f;
+    inline static size_t budgetBytes = size_t(64) << 20;
+
+    inline static std::atomic<uint32_t> built = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+    inline static std::atomic<uint32_t> hits = 0;   // Tracks started from their cached opening.
+    inline static std::atomic<uint32_t> misses = 0; // Tracks started while their opening was still decoding.
+
+    // Decodes the first `seconds` of `file` as it'd play at `sampleRate`, the way `quality` would resample it.
+    // Null if it can't be mapped or decoded, or `stop` trips first.
+    static std::shared_ptr<TrackHead> buildFile(const fs::path& file, uint32_t sampleRate, ResamplerQuality quality, float seconds, std::stop_token stop = {});
+    // Control thread. Brings the cache in line with the queue: openings no longer coming up are dropped, and those
+    // that are and fit the budget are decoded. Cheap when nothing changed, so it runs every tick.
+    static void sync();
+    // Control thread. The opening of `file`, if it's decoded and still matches how the track would play.
+    static std::shared_ptr<const TrackHead> find(const fs::path& file);
+
+    static size_t cachedCount();
+    static size_t cachedBytes();
+private:
+    inline static std::mutex mutex;
+    // Null while decoding.
+    inline static std::unordered_map<std::u8string, std::shared_ptr<const TrackHead>> entries;
+    // Bumped whenever what's in the cache no longer matches the settings, so stale decodes are thrown away.
+    inline static uint64_t generation = 0;
+
+    // What the last sync() asked for.
+    inline static std::vector<fs::path> wanted;
+    inline static uint32_t wantedSampleRate = 0;
+    inline static ResamplerQuality wantedQuality = ResamplerQuality::Balanced;
+    inline static float wantedSeconds = 0.0f;
+    inline static size_t wantedBudget = 0;
+};
+
+// Plays a cached opening while the track's decoder opens in the background, then carries on from the decoder,
+// seeked to exactly where the opening ends. If the opening runs out first, it reports busy until the decoder is
+// ready, the way a stream that hasn't buffered does. Seeks past the opening wait for it the same way.
+class HeadStartSource
+{
+    ma_data_source_base base; // Must stay the first member, miniaudio reinterprets ma_data_source* as ma_data_source_base*.
+    bool sourceInitialized = false;
+
+    std::shared_ptr<const TrackHead> head;
+    // Shared with the job opening the decoder, which may outlive the source.
+    struct Tail;
+    std::shared_ptr<Tail> tail;
+
+    // Audio side.
+    uint64_t cursor = 0;
+    uint64_t tailCursor = 0; // Where the decoder is, once it's ready.
+
+    static ma_result onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead);
+    static ma_result onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex);
+    static ma_result onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap);
+    static ma_result onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor);
+    static ma_result onGetLength(ma_data_source* pDataSource, ma_uint64* pLength);
+public:
+    HeadStartSource() = default;
+    HeadStartSource(const HeadStartSource&) = delete;
+    ~HeadStartSource();
+
+    // Starts opening the rest of the track right away.
+    ma_result init(std::shared_ptr<const TrackHead> head);
+    void uninit();
+
+    inline ma_data_source* dataSource()
+    {
+        return &this->base;
+    }
+    // Any thread. Whether the rest of the track can be read yet.
+    bool caughtUp() const;
+    // The opening, and the mapping of the rest once it's open.
+    size_t bytes() const;
+};
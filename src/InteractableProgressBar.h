@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
 #include <EntityComponentSystem/ComponentData.h>
 
 #include <NanoVGContext.h>
+#include <Waveforms.h>
 
 #define PROGRESS_BAR_EXTRA_HITBOX_X_PADDING 2.0f
 #define PROGRESS_BAR_EXTRA_HITBOX_Y_PADDING 5.0f
@@ -14,21 +19,69 @@ class InteractableProgressBar : public ComponentData2D
 {
     inline void renderOffload()
     {
-        CoreEngine::queueRenderJobForFrame([w = Window::pixelWidth(), h = Window::pixelHeight(), bounds = NanoVG::boundsFromRectTransform(this->rectTransform()), progress = this->progress]
+        std::shared_ptr<const TrackWaveform> waveform = Waveforms::display ? this->waveform : nullptr;
+        CoreEngine::queueRenderJobForFrame([w = Window::pixelWidth(), h = Window::pixelHeight(), bounds = NanoVG::boundsFromRectTransform(this->rectTransform()), progress = this->progress,
+                                            waveform = std::move(waveform), waveformHeight = this->waveformHeight, waveformBegin = this->waveformBegin, waveformEnd = this->waveformEnd]
         {
             nvgBeginFrame(NanoVG::context, +w, +h, 1.0f);
 
-            nvgBeginPath(NanoVG::context);
-            nvgRect(NanoVG::context, bounds.x, bounds.y, bounds.width, bounds.height);
-            nvgFillColor(NanoVG::context, nvgRGB(0x4c, 0x4c, 0x4c));
-            nvgFill(NanoVG::context);
-            nvgClosePath(NanoVG::context);
+            if (waveform && !waveform->levels.empty())
+            {
+                // A column per pixel, from whichever level has about that many buckets, so resizing never rebuilds anything.
+                const WaveformLevel& level = Waveforms::levelFor(*waveform, bounds.width);
+                // Only the part of the track that plays spans the bar.
+                size_t offset = std::min(size_t(waveformBegin * level.min.size()), level.min.size() - 1);
+                size_t buckets = std::max(std::min(size_t(waveformEnd * level.min.size()), level.min.size()), offset + 1) - offset;
+                uint32_t columns = uint32_t(std::max(bounds.width, 1.0f));
+                uint32_t played = uint32_t(bounds.width * progress);
+                float half = (waveformHeight > 0.0f ? waveformHeight : bounds.height) / 2.0f;
+                float middle = bounds.y + bounds.height / 2.0f;
 
-            nvgBeginPath(NanoVG::context);
-            nvgRect(NanoVG::context, bounds.x, bounds.y, bounds.width * progress, bounds.height);
-            nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
-            nvgFill(NanoVG::context);
-            nvgClosePath(NanoVG::context);
+                auto draw = [&](uint32_t from, uint32_t to, bool rms, NVGcolor color)
+                {
+                    nvgBeginPath(NanoVG::context);
+                    for (uint32_t x = from; x < to; x++)
+                    {
+                        size_t first = offset + size_t(x) * buckets / columns, last = std::max(offset + size_t(x + 1) * buckets / columns, first + 1);
+                        float top, bottom;
+                        if (rms)
+                        {
+                            float sum = 0.0f;
+                            for (size_t i = first; i < last; i++)
+                                sum += float(level.rms[i]) * level.rms[i];
+                            top = std::sqrt(sum / (last - first)) / 255.0f;
+                            bottom = -top;
+                        }
+                        else
+                        {
+                            top = *std::max_element(level.max.begin() + first, level.max.begin() + last) / 127.0f;
+                            bottom = *std::min_element(level.min.begin() + first, level.min.begin() + last) / 127.0f;
+                        }
+                        nvgRect(NanoVG::context, bounds.x + x, middle - top * half, 1.0f, std::max((top - bottom) * half, 1.0f));
+                    }
+                    nvgFillColor(NanoVG::context, color);
+                    nvgFill(NanoVG::context);
+                    nvgClosePath(NanoVG::context);
+                };
+                draw(0, played, false, nvgRGB(0xa0, 0xa0, 0xa0));
+                draw(0, played, true, nvgRGB(0xff, 0xff, 0xff));
+                draw(played, columns, false, nvgRGB(0x3a, 0x3a, 0x3a));
+                draw(played, columns, true, nvgRGB(0x4c, 0x4c, 0x4c));
+            }
+            else
+            {
+                nvgBeginPath(NanoVG::context);
+                nvgRect(NanoVG::context, bounds.x, bounds.y, bounds.width, bounds.height);
+                nvgFillColor(NanoVG::context, nvgRGB(0x4c, 0x4c, 0x4c));
+                nvgFill(NanoVG::context);
+                nvgClosePath(NanoVG::context);
+
+                nvgBeginPath(NanoVG::context);
+                nvgRect(NanoVG::context, bounds.x, bounds.y, bounds.width * progress, bounds.height);
+                nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                nvgFill(NanoVG::context);
+                nvgClosePath(NanoVG::context);
+            }
 
             nvgEndFrame(NanoVG::context);
         }, false);
@@ -73,7 +126,11 @@ class InteractableProgressBar : public ComponentData2D
                 case MouseButton::Left:
                     EntityManager2D::foreachEntityWithAll<InteractableProgressBar>([&](Entity2D* entity, InteractableProgressBar* bar)
                     {
-                        bar->dragging = false;
+                        if (bar->dragging)
+                        {
+                            bar->dragging = false;
+                            bar->OnDragEnded();
+                        }
                     });
                     break;
                 }
@@ -94,10 +151,16 @@ public:
     // Progress from 0.0 to 1.0.
     float progress = 0.0f;
     bool dragging = false;
+    // Drawn instead of the bar when set, `waveformHeight` tall (the bar's own height if 0) and centered on it.
+    std::shared_ptr<const TrackWaveform> waveform;
+    float waveformHeight = 0.0f;
+    // The span of `waveform` drawn across the bar, as fractions of it.
+    float waveformBegin = 0.0f, waveformEnd = 1.0f;
 
     RectTransform* hitbox;
 
     func::function<void()> OnDragProgressChanged = []() -> void { };
+    func::function<void()> OnDragEnded = []() -> void { };
 
     inline void onCreate()
     {
@@ -0,0 +1,288 @@
+#include "IoUring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#if __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if __linux__
+namespace
+{
+    int sysIoUringSetup(uint32_t entries, io_uring_params* params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+    int sysIoUringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    inline uint32_t loadAcquire(uint32_t* p)
+    {
+        return std::atomic_ref<uint32_t>(*p).load(std::memory_order_acquire);
+    }
+    inline void storeRelease(uint32_t* p, uint32_t value)
+    {
+        std::atomic_ref<uint32_t>(*p).store(value, std::memory_order_release);
+    }
+}
+#endif
+
+IoUring::IoUring(uint32_t entries)
+{
+#if __linux__
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    int fd = sysIoUringSetup(entries, &params);
+    if (fd < 0)
+        return;
+    this->ringFd = fd;
+
+    this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+        this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+
+    void* sq = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+    {
+        this->release();
+        return;
+    }
+    this->sqRing = sq;
+
+    if (singleMmap)
+        this->cqRing = sq;
+    else
+    {
+        void* cq = mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+        {
+            this->release();
+            return;
+        }
+        this->cqRing = cq;
+    }
+
+    this->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        this->release();
+        return;
+    }
+    this->sqes = static_cast<io_uring_sqe*>(sqes);
+
+    std::byte* sqBase = static_cast<std::byte*>(this->sqRing);
+    this->sqHead = reinterpret_cast<uint32_t*>(sqBase + params.sq_off.head);
+    this->sqTail = reinterpret_cast<uint32_t*>(sqBase + params.sq_off.tail);
+    this->sqArray = reinterpret_cast<uint32_t*>(sqBase + params.sq_off.array);
+    this->sqMask = *reinterpret_cast<uint32_t*>(sqBase + params.sq_off.ring_mask);
+    this->sqEntries = params.sq_entries;
+
+    std::byte* cqBase = static_cast<std::byte*>(this->cqRing);
+    this->cqHead = reinterpret_cast<uint32_t*>(cqBase + params.cq_off.head);
+    this->cqTail = reinterpret_cast<uint32_t*>(cqBase + params.cq_off.tail);
+    this->cqes = reinterpret_cast<io_uring_cqe*>(cqBase + params.cq_off.cqes);
+    this->cqMask = *reinterpret_cast<uint32_t*>(cqBase + params.cq_off.ring_mask);
+    this->sqTailLocal = *this->sqTail;
+#else
+    (void)entries;
+#endif
+}
+IoUring::IoUring(IoUring&& other) noexcept
+{
+    *this = std::move(other);
+}
+IoUring::~IoUring()
+{
+    this->release();
+}
+IoUring& IoUring::operator=(IoUring&& other) noexcept
+{
+    if (this != &other)
+    {
+        this->release();
+        this->ringFd = std::exchange(other.ringFd, -1);
+        this->sqRing = std::exchange(other.sqRing, nullptr);
+        this->cqRing = std::exchange(other.cqRing, nullptr);
+        this->sqRingSize = std::exchange(other.sqRingSize, 0);
+        this->cqRingSize = std::exchange(other.cqRingSize, 0);
+        this->sqes = std::exchange(other.sqes, nullptr);
+        this->sqesSize = std::exchange(other.sqesSize, 0);
+        this->sqHead = std::exchange(other.sqHead, nullptr);
+        this->sqTail = std::exchange(other.sqTail, nullptr);
+        this->sqTailLocal = std::exchange(other.sqTailLocal, 0);
+        this->sqArray = std::exchange(other.sqArray, nullptr);
+        this->sqMask = std::exchange(other.sqMask, 0);
+        this->sqEntries = std::exchange(other.sqEntries, 0);
+        this->cqHead = std::exchange(other.cqHead, nullptr);
+        this->cqTail = std::exchange(other.cqTail, nullptr);
+        this->cqes = std::exchange(other.cqes, nullptr);
+        this->cqMask = std::exchange(other.cqMask, 0);
+        this->pendingSubmit = std::exchange(other.pendingSubmit, 0);
+        this->inFlight = std::exchange(other.inFlight, 0);
+    }
+    return *this;
+}
+
+void IoUring::release()
+{
+#if __linux__
+    // Buffers handed to the kernel must not be freed under it.
+    IoCompletion discard;
+    if (this->ringFd >= 0 && this->cqes)
+    {
+        this->submit();
+        while (this->inFlight > 0 && this->wait(discard));
+    }
+
+    if (this->sqes)
+        munmap(this->sqes, this->sqesSize);
+    if (this->cqRing && this->cqRing != this->sqRing)
+        munmap(this->cqRing, this->cqRingSize);
+    if (this->sqRing)
+        munmap(this->sqRing, this->sqRingSize);
+    if (this->ringFd >= 0)
+        close(this->ringFd);
+#endif
+    this->ringFd = -1;
+    this->sqRing = this->cqRing = nullptr;
+    this->sqes = nullptr;
+    this->cqes = nullptr;
+    this->pendingSubmit = this->inFlight = 0;
+}
+
+bool IoUring::supported()
+{
+    static const bool probed = []
+    {
+        IoUring ring(1);
+        return (bool)ring;
+    }();
+    return probed;
+}
+
+io_uring_sqe* IoUring::nextSqe()
+{
+#if __linux__
+    if (this->ringFd < 0)
+        return nullptr;
+
+    if (this->sqTailLocal - loadAcquire(this->sqHead) >= this->sqEntries)
+        return nullptr;
+
+    // Published to the kernel in submit().
+    uint32_t index = this->sqTailLocal++ & this->sqMask;
+    io_uring_sqe* sqe = &this->sqes[index];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    this->sqArray[index] = index;
+    ++this->pendingSubmit;
+    return sqe;
+#else
+    return nullptr;
+#endif
+}
+
+bool IoUring::queueRead(int fd, void* buffer, uint32_t length, uint64_t offset, uint64_t userData)
+{
+#if __linux__
+    io_uring_sqe* sqe = this->nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    return true;
+#else
+    (void)fd, (void)buffer, (void)length, (void)offset, (void)userData;
+    return false;
+#endif
+}
+bool IoUring::queueStatx(int dirFd, const char* path, int flags, uint32_t mask, void* statxBuffer, uint64_t userData)
+{
+#if __linux__
+    io_uring_sqe* sqe = this->nextSqe();
+    if (!sqe)
+        return false;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirFd;
+    sqe->addr = (uint64_t)(uintptr_t)path;
+    sqe->len = mask;
+    sqe->off = (uint64_t)(uintptr_t)statxBuffer;
+    sqe->statx_flags = (uint32_t)flags;
+    sqe->user_data = userData;
+    return true;
+#else
+    (void)dirFd, (void)path, (void)flags, (void)mask, (void)statxBuffer, (void)userData;
+    return false;
+#endif
+}
+
+bool IoUring::submit(uint32_t waitFor)
+{
+#if __linux__
+    if (this->ringFd < 0)
+        return false;
+    if (this->pendingSubmit == 0 && waitFor == 0)
+        return true;
+
+    storeRelease(this->sqTail, this->sqTailLocal);
+    int submitted;
+    do submitted = sysIoUringEnter(this->ringFd, this->pendingSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+    while (submitted < 0 && errno == EINTR);
+    if (submitted < 0)
+        return false;
+
+    this->pendingSubmit -= (uint32_t)submitted;
+    this->inFlight += (uint32_t)submitted;
+    return true;
+#else
+    (void)waitFor;
+    return false;
+#endif
+}
+
+bool IoUring::poll(IoCompletion& completion)
+{
+#if __linux__
+    if (this->ringFd < 0)
+        return false;
+
+    uint32_t head = *this->cqHead;
+    if (head == loadAcquire(this->cqTail))
+        return false;
+
+    io_uring_cqe& cqe = this->cqes[head & this->cqMask];
+    completion = IoCompletion { .userData = cqe.user_data, .result = cqe.res };
+    storeRelease(this->cqHead, head + 1);
+    --this->inFlight;
+    return true;
+#else
+    (void)completion;
+    return false;
+#endif
+}
+bool IoUring::wait(IoCompletion& completion)
+{
+    while (!this->poll(completion))
+    {
+        if (this->inFlight == 0 && this->pendingSubmit == 0)
+            return false;
+        if (!this->submit(1))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct IoCompletion
+{
+    uint64_t userData;
+    int32_t result; // Bytes transferred, 0, or -errno.
+};
+
+// Bare-bones io_uring instance, talking to the kernel directly so there's no liburing dependency.
+// Not thread-safe: one submitter/reaper at a time. Always invalid off Linux, or where io_uring is disabled.
+class IoUring
+{
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    uint32_t* sqHead = nullptr;
+    uint32_t* sqTail = nullptr;
+    uint32_t sqTailLocal = 0;
+    uint32_t* sqArray = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t sqEntries = 0;
+    uint32_t* cqHead = nullptr;
+    uint32_t* cqTail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    uint32_t cqMask = 0;
+
+    uint32_t pendingSubmit = 0;
+    uint32_t inFlight = 0;
+
+    void release();
+    io_uring_sqe* nextSqe();
+public:
+    IoUring() = default;
+    explicit IoUring(uint32_t entries);
+    IoUring(const IoUring&) = delete;
+    IoUring(IoUring&& other) noexcept;
+    ~IoUring();
+
+    IoUring& operator=(const IoUring&) = delete;
+    IoUring& operator=(IoUring&& other) noexcept;
+
+    inline explicit operator bool() const
+    {
+        return this->ringFd >= 0;
+    }
+    // Operations queued or submitted whose completions haven't been reaped.
+    inline uint32_t pending() const
+    {
+        return this->pendingSubmit + this->inFlight;
+    }
+    inline uint32_t capacity() const
+    {
+        return this->sqEntries;
+    }
+
+    // Whether io_uring can be set up at all in this process, probed once.
+    static bool supported();
+
+    // Queue operations. Return false if the submission queue is full, call submit() and retry.
+    bool queueRead(int fd, void* buffer, uint32_t length, uint64_t offset, uint64_t userData);
+    // `statxBuffer` must point at a `struct statx` that outlives the operation.
+    bool queueStatx(int dirFd, const char* path, int flags, uint32_t mask, void* statxBuffer, uint64_t userData);
+
+    // Hands queued operations to the kernel, optionally blocking until `waitFor` completions are available.
+    bool submit(uint32_t waitFor = 0);
+    // Reaps one completion without blocking.
+    bool poll(IoCompletion& completion);
+    // Reaps one completion, blocking if none are ready.
+    bool wait(IoCompletion& completion);
+};
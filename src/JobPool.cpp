@@ -0,0 +1,61 @@
+#include "JobPool.h"
+
+#include <algorithm>
+
+JobPool::JobPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    this->workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+        this->workers.emplace_back([this](std::stop_token stop) { this->work(stop); });
+}
+JobPool::~JobPool()
+{
+    for (std::jthread& worker : this->workers)
+        worker.request_stop();
+    this->wake.notify_all();
+    this->workers.clear(); // Joins.
+}
+
+void JobPool::work(std::stop_token stop)
+{
+    while (true)
+    {
+        std::function<void(std::stop_token)> job;
+        {
+            std::unique_lock lock(this->mutex);
+            if (!this->wake.wait(lock, stop, [this] { return !this->jobs.empty(); }))
+                return;
+            job = std::move(this->jobs.front());
+            this->jobs.pop_front();
+            ++this->active;
+        }
+
+        job(stop);
+
+        std::lock_guard lock(this->mutex);
+        if (--this->active == 0 && this->jobs.empty())
+            this->idle.notify_all();
+    }
+}
+
+void JobPool::submit(std::function<void(std::stop_token)> job)
+{
+    {
+        std::lock_guard lock(this->mutex);
+        this->jobs.push_back(std::move(job));
+    }
+    this->wake.notify_one();
+}
+void JobPool::waitIdle()
+{
+    std::unique_lock lock(this->mutex);
+    this->idle.wait(lock, [this] { return this->active == 0 && this->jobs.empty(); });
+}
+
+JobPool& JobPool::background()
+{
+    static JobPool pool;
+    return pool;
+}
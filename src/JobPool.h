@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for background work (analysis, index building). Jobs get a stop token that trips when
+// the pool shuts down, so long ones should poll it.
+class JobPool
+{
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::condition_variable idle;
+    std::deque<std::function<void(std::stop_token)>> jobs;
+    uint32_t active = 0;
+    std::vector<std::jthread> workers;
+
+    void work(std::stop_token stop);
+public:
+    // `threadCount` of 0 uses every hardware thread.
+    explicit JobPool(uint32_t threadCount = 0);
+    JobPool(const JobPool&) = delete;
+    ~JobPool();
+
+    void submit(std::function<void(std::stop_token)> job);
+    // Blocks until the queue is empty and no job is running.
+    void waitIdle();
+
+    inline size_t threadCount() const
+    {
+        return this->workers.size();
+    }
+
+    // Shared pool for the player's background work.
+    static JobPool& background();
+};
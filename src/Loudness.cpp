@@ -0,0 +1,332 @@
+#include "Loudness.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include <JobPool.h>
+#include <MappedFileVFS.h>
+
+namespace
+{
+    // Absolute gate, and the offset between mean square and LUFS, per BS.1770-4.
+    constexpr double absoluteGateLufs = -70.0;
+    constexpr double lufsOffset = -0.691;
+    constexpr float silenceDb = -200.0f;
+
+    double energyToLufs(double energy)
+    {
+        return energy > 0.0 ? lufsOffset + 10.0 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+    }
+    double lufsToEnergy(double lufs)
+    {
+        return std::pow(10.0, (lufs - lufsOffset) / 10.0);
+    }
+
+    float channelWeight(ma_channel channel)
+    {
+        switch (channel)
+        {
+        case MA_CHANNEL_LFE:
+            return 0.0f;
+        case MA_CHANNEL_SIDE_LEFT:
+        case MA_CHANNEL_SIDE_RIGHT:
+        case MA_CHANNEL_BACK_LEFT:
+        case MA_CHANNEL_BACK_RIGHT:
+        case MA_CHANNEL_BACK_CENTER:
+            return 1.41f;
+        default:
+            return 1.0f;
+        }
+    }
+}
+
+LoudnessMeter::LoudnessMeter(uint32_t channels, uint32_t sampleRate, const ma_channel* channelMap) :
+channels(channels), groups((channels + 3) / 4), subBlockFrames(std::max(sampleRate / 10, 1u)), history(size_t(channels) * LoudnessMeter::truePeakTaps * 2, 0.0f)
+{
+    // K-weighting: the BS.1770 high shelf and high pass, re-derived for the actual sample rate from their analog prototypes.
+    auto biquad = [](double b0, double b1, double b2, double a0, double a1, double a2) -> Biquad
+    {
+        // Feedback coefficients stored negated so every tap is a multiply-add.
+        return Biquad
+        {
+            f32x4::splat(float(b0 / a0)), f32x4::splat(float(b1 / a0)), f32x4::splat(float(b2 / a0)),
+            f32x4::splat(float(-a1 / a0)), f32x4::splat(float(-a2 / a0))
+        };
+    };
+    {
+        double k = std::tan(std::numbers::pi * 1681.974450955533 / sampleRate), q = 0.7071752369554196;
+        double vh = std::pow(10.0, 3.999843853973347 / 20.0), vb = std::pow(vh, 0.4996667741545416);
+        this->shelf = biquad(vh + vb * k / q + k * k, 2.0 * (k * k - vh), vh - vb * k / q + k * k, 1.0 + k / q + k * k, 2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+    }
+    {
+        double k = std::tan(std::numbers::pi * 38.13547087602444 / sampleRate), q = 0.5003270373238773;
+        double a0 = 1.0 + k / q + k * k;
+        // The reference numerator is a plain 1, -2, 1, not scaled by a0 like the feedback side.
+        this->highPass = biquad(a0, -2.0 * a0, a0, a0, 2.0 * (k * k - 1.0), 1.0 - k / q + k * k);
+    }
+
+    for (uint32_t g = 0; g < this->groups.size(); g++)
+    {
+        float weights[4] { };
+        for (uint32_t lane = 0; lane < 4 && g * 4 + lane < channels; lane++)
+            weights[lane] = channelMap ? channelWeight(channelMap[g * 4 + lane]) : 1.0f;
+        this->groups[g].weight = f32x4::load(weights);
+    }
+
+    // 4x interpolator for true peak: Blackman-windowed sinc, split into four phases that run in the four lanes.
+    constexpr uint32_t taps = LoudnessMeter::truePeakTaps * 4;
+    double h[taps], phaseSum[4] { };
+    for (uint32_t n = 0; n < taps; n++)
+    {
+        double t = (double(n) - (taps - 1) / 2.0) / 4.0;
+        double sinc = t == 0.0 ? 1.0 : std::sin(std::numbers::pi * t) / (std::numbers::pi * t);
+        double window = 0.42 - 0.5 * std::cos(2.0 * std::numbers::pi * n / (taps - 1)) + 0.08 * std::cos(4.0 * std::numbers::pi * n / (taps - 1));
+        h[n] = sinc * window;
+        phaseSum[n % 4] += h[n];
+    }
+    for (uint32_t k = 0; k < LoudnessMeter::truePeakTaps; k++)
+        this->phaseTaps[k] = f32x4::set(float(h[k * 4] / phaseSum[0]), float(h[k * 4 + 1] / phaseSum[1]), float(h[k * 4 + 2] / phaseSum[2]), float(h[k * 4 + 3] / phaseSum[3]));
+}
+
+void LoudnessMeter::process(const float* interleaved, size_t frameCount)
+{
+    constexpr uint32_t taps = LoudnessMeter::truePeakTaps;
+    const Biquad s = this->shelf, hp = this->highPass;
+
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        const float* frame = interleaved + i * this->channels;
+
+        for (uint32_t g = 0; g < this->groups.size(); g++)
+        {
+            ChannelGroup& group = this->groups[g];
+            f32x4 x;
+            if (g * 4 + 4 <= this->channels)
+                x = f32x4::load(frame + g * 4);
+            else
+            {
+                float lanes[4] { };
+                std::copy(frame + g * 4, frame + this->channels, lanes);
+                x = f32x4::load(lanes);
+            }
+
+            f32x4 y = f32x4::mulAdd(s.b0, x, group.z[0]);
+            group.z[0] = f32x4::mulAdd(s.b1, x, f32x4::mulAdd(s.a1, y, group.z[1]));
+            group.z[1] = f32x4::mulAdd(s.b2, x, s.a2 * y);
+            x = y;
+            y = f32x4::mulAdd(hp.b0, x, group.z[2]);
+            group.z[2] = f32x4::mulAdd(hp.b1, x, f32x4::mulAdd(hp.a1, y, group.z[3]));
+            group.z[3] = f32x4::mulAdd(hp.b2, x, hp.a2 * y);
+
+            group.energy = f32x4::mulAdd(y, y, group.energy);
+        }
+
+        this->historyPos = (this->historyPos + taps - 1) % taps;
+        for (uint32_t c = 0; c < this->channels; c++)
+        {
+            float* window = &this->history[size_t(c) * taps * 2];
+            window[this->historyPos] = window[this->historyPos + taps] = frame[c];
+
+            // Newest sample first, so tap k pairs with x[n - k].
+            const float* recent = window + this->historyPos;
+            f32x4 acc = f32x4::zero();
+            for (uint32_t k = 0; k < taps; k++)
+                acc = f32x4::mulAdd(this->phaseTaps[k], f32x4::splat(recent[k]), acc);
+            this->peak = f32x4::max(this->peak, f32x4::max(f32x4::abs(acc), f32x4::abs(f32x4::splat(frame[c]))));
+        }
+
+        if (++this->subBlockPos == this->subBlockFrames)
+        {
+            f32x4 weighted = f32x4::zero();
+            for (ChannelGroup& group : this->groups)
+            {
+                weighted = f32x4::mulAdd(group.weight, group.energy, weighted);
+                group.energy = f32x4::zero();
+            }
+            this->subBlocks.push_back(double(weighted.sum()) / this->subBlockFrames);
+            this->subBlockPos = 0;
+        }
+    }
+    this->frames += frameCount;
+}
+
+float LoudnessMeter::integrated() const
+{
+    // 400 ms gating blocks overlapping by 75%, i.e. every run of four 100 ms sub-blocks.
+    std::vector<double> blocks;
+    if (this->subBlocks.size() >= 4)
+    {
+        blocks.reserve(this->subBlocks.size() - 3);
+        double run = this->subBlocks[0] + this->subBlocks[1] + this->subBlocks[2];
+        for (size_t i = 3; i < this->subBlocks.size(); i++)
+        {
+            run += this->subBlocks[i];
+            blocks.push_back(run / 4.0);
+            run -= this->subBlocks[i - 3];
+        }
+    }
+
+    auto gatedMean = [&](double threshold) -> std::optional<double>
+    {
+        double sum = 0.0;
+        size_t count = 0;
+        for (double block : blocks)
+        {
+            if (block > threshold)
+            {
+                sum += block;
+                ++count;
+            }
+        }
+        return count ? std::optional(sum / count) : std::nullopt;
+    };
+
+    std::optional<double> ungated = gatedMean(lufsToEnergy(absoluteGateLufs));
+    if (!ungated)
+        return float(absoluteGateLufs);
+    std::optional<double> gated = gatedMean(std::max(lufsToEnergy(absoluteGateLufs), lufsToEnergy(energyToLufs(*ungated) - 10.0)));
+    return float(std::max(energyToLufs(gated.value_or(*ungated)), absoluteGateLufs));
+}
+float LoudnessMeter::truePeak() const
+{
+    float peak = this->peak.maxLane();
+    return peak > 0.0f ? 20.0f * std::log10(peak) : silenceDb;
+}
+
+std::optional<TrackLoudness> Loudness::analyzeFile(const fs::path& file, std::stop_token stop)
+{
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    ma_decoder decoder;
+    // Decoding out of a mapping skips a copy per read. Anything unmappable goes through stdio.
+    FileMapping mapping(file);
+    ma_result result;
+    if (mapping)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        result = ma_decoder_init_memory(mapping.data(), mapping.size(), &config, &decoder);
+    }
+#if _WIN32
+    else result = ma_decoder_init_file_w(file.c_str(), &config, &decoder);
+#else
+    else result = ma_decoder_init_file(file.c_str(), &config, &decoder);
+#endif
+    if (result != MA_SUCCESS)
+        return std::nullopt;
+
+    ma_format format;
+    ma_uint32 channels, sampleRate;
+    ma_channel channelMap[MA_MAX_CHANNELS];
+    if (ma_decoder_get_data_format(&decoder, &format, &channels, &sampleRate, channelMap, MA_MAX_CHANNELS) != MA_SUCCESS || channels == 0 || sampleRate == 0)
+    {
+        ma_decoder_uninit(&decoder);
+        return std::nullopt;
+    }
+
+    LoudnessMeter meter(channels, sampleRate, channelMap);
+    constexpr ma_uint64 chunkFrames = 4096;
+    std::vector<float> buffer(chunkFrames * channels);
+    while (!stop.stop_requested())
+    {
+        ma_uint64 read = 0;
+        result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunkFrames, &read);
+        meter.process(buffer.data(), (size_t)read);
+        if (result != MA_SUCCESS || read < chunkFrames)
+            break;
+    }
+    ma_decoder_uninit(&decoder);
+    if (stop.stop_requested() || meter.framesProcessed() == 0)
+        return std::nullopt;
+
+    return TrackLoudness
+    {
+        .integrated = meter.integrated(),
+        .truePeak = meter.truePeak(),
+        .frames = meter.framesProcessed(),
+        .sampleRate = sampleRate
+    };
+}
+
+uint32_t Loudness::analyzeLibrary(bool force)
+{
+    auto library = MusicLibrary::snapshot();
+    uint32_t queuedNow = 0;
+    for (const LibraryTrack& track : library->tracks)
+    {
+        if (!force)
+        {
+            std::optional<TrackRecord> record = MusicLibrary::record(track);
+            if (record && record->loudness)
+                continue;
+        }
+        {
+            std::lock_guard guard(Loudness::inFlightMutex);
+            if (!Loudness::inFlight.insert(track.path.generic_u8string()).second)
+                continue;
+        }
+
+        ++queuedNow;
+        Loudness::queued.fetch_add(1, std::memory_order_relaxed);
+        JobPool::background().submit([track](std::stop_token stop)
+        {
+            std::optional<TrackLoudness> result = Loudness::analyzeFile(track.path, stop);
+            if (result)
+                MusicLibrary::updateRecord(track, [&](TrackRecord& record) { record.loudness = result; });
+            else if (!stop.stop_requested())
+                Loudness::failed.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard guard(Loudness::inFlightMutex);
+                Loudness::inFlight.erase(track.path.generic_u8string());
+            }
+            if (Loudness::finished.fetch_add(1, std::memory_order_acq_rel) + 1 == Loudness::queued.load(std::memory_order_acquire))
+                MusicLibrary::saveIndex();
+        });
+    }
+    return queuedNow;
+}
+
+float Loudness::gainDb(const fs::path& file)
+{
+    if (Loudness::mode == NormalizationMode::Off)
+        return 0.0f;
+
+    auto library = MusicLibrary::snapshot();
+    const LibraryTrack* track = MusicLibrary::find(*library, file);
+    std::optional<TrackRecord> record = track ? MusicLibrary::record(*track) : std::nullopt;
+    if (!record || !record->loudness)
+        return 0.0f;
+
+    double loudness = record->loudness->integrated;
+    float peak = record->loudness->truePeak;
+    if (Loudness::mode == NormalizationMode::Album)
+    {
+        // The folder is the album. Its loudness is the duration-weighted mean energy of its tracks, which only means
+        // something once all of them are measured, so until then this stays a track gain.
+        double energy = 0.0, seconds = 0.0;
+        float albumPeak = silenceDb;
+        bool complete = true;
+        fs::path album = file.parent_path();
+        for (const LibraryTrack& other : library->tracks)
+        {
+            if (other.path.parent_path() != album)
+                continue;
+            std::optional<TrackRecord> otherRecord = MusicLibrary::record(other);
+            if (!otherRecord || !otherRecord->loudness || otherRecord->loudness->sampleRate == 0)
+            {
+                complete = false;
+                break;
+            }
+            double duration = double(otherRecord->loudness->frames) / otherRecord->loudness->sampleRate;
+            energy += duration * lufsToEnergy(otherRecord->loudness->integrated);
+            seconds += duration;
+            albumPeak = std::max(albumPeak, otherRecord->loudness->truePeak);
+        }
+        if (complete && seconds > 0.0)
+        {
+            loudness = energyToLufs(energy / seconds);
+            peak = albumPeak;
+        }
+    }
+
+    return std::min({ float(Loudness::targetLufs - loudness), Loudness::maxBoostDb, Loudness::peakCeilingDb - peak });
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <unordered_set>
+#include <vector>
+
+#include <MusicLibrary.h>
+#include <Simd.h>
+
+namespace fs = std::filesystem;
+
+// ITU-R BS.1770 / EBU R128 meter: K-weighted, gated integrated loudness plus 4x oversampled true peak.
+// Channels run in SIMD lanes, four at a time. Feed it interleaved f32 frames in order.
+class LoudnessMeter
+{
+    struct Biquad
+    {
+        f32x4 b0, b1, b2, a1, a2;
+    };
+    struct ChannelGroup
+    {
+        f32x4 z[4] { f32x4::zero(), f32x4::zero(), f32x4::zero(), f32x4::zero() }; // Transposed direct form II state, two per stage.
+        f32x4 weight = f32x4::zero();
+        f32x4 energy = f32x4::zero();
+    };
+
+    static constexpr uint32_t truePeakTaps = 12; // Per phase, 48 in total.
+
+    uint32_t channels;
+    Biquad shelf, highPass;
+    std::vector<ChannelGroup> groups;
+    uint32_t subBlockFrames;
+    uint32_t subBlockPos = 0;
+    std::vector<double> subBlocks; // Channel-weighted mean square of each 100 ms.
+
+    f32x4 phaseTaps[truePeakTaps];
+    std::vector<float> history; // Per channel, `truePeakTaps` samples stored twice so a window never wraps.
+    uint32_t historyPos = 0;
+    f32x4 peak = f32x4::zero();
+    uint64_t frames = 0;
+public:
+    // `channelMap` may be null, in which case every channel is weighted as a front channel.
+    LoudnessMeter(uint32_t channels, uint32_t sampleRate, const ma_channel* channelMap = nullptr);
+
+    void process(const float* interleaved, size_t frameCount);
+
+    // LUFS, -70 (the absolute gate) for silence.
+    float integrated() const;
+    // dBTP.
+    float truePeak() const;
+    inline uint64_t framesProcessed() const
+    {
+        return this->frames;
+    }
+};
+
+enum class NormalizationMode
+{
+    Off,
+    Track, // Every track at the target loudness.
+    Album  // Tracks keep their level relative to the rest of their folder.
+};
+
+// Background loudness analysis of the library and the ReplayGain-style gain derived from it.
+struct Loudness
+{
+    Loudness() = delete;
+
+    inline static NormalizationMode mode = NormalizationMode::Track;
+    inline static float targetLufs = -18.0f; // ReplayGain 2.0 reference level.
+    inline static float peakCeilingDb = -1.0f; // Gain never pushes the true peak above this.
+    inline static float maxBoostDb = 12.0f;
+
+    inline static std::atomic<uint32_t> queued = 0;
+    inline static std::atomic<uint32_t> finished = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+
+    // Decodes all of `file`. Empty if it can't be decoded or `stop` trips first.
+    static std::optional<TrackLoudness> analyzeFile(const fs::path& file, std::stop_token stop = {});
+    // Queues every track without a current measurement (or every track, if `force`) on the background pool.
+    // The index is saved once the queue drains. Returns how many were queued.
+    static uint32_t analyzeLibrary(bool force = false);
+
+    // Gain for `file` under the current mode, in dB. 0 when unmeasured or off.
+    static float gainDb(const fs::path& file);
+private:
+    inline static std::mutex inFlightMutex;
+    inline static std::unordered_set<std::u8string> inFlight;
+};
@@ -0,0 +1,284 @@
+#include "MappedFileVFS.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include <ThreadTuning.h>
+#if _WIN32
+#define NOMINMAX 1
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileMapping::FileMapping(const fs::path& path)
+{
+#if _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return;
+    }
+
+    this->_data = static_cast<const std::byte*>(view);
+    this->_size = (size_t)size.QuadPart;
+    this->fileHandle = file;
+    this->mappingHandle = mapping;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+    {
+        ::close(fd);
+        return;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference to the file.
+    if (view == MAP_FAILED)
+        return;
+
+    this->_data = static_cast<const std::byte*>(view);
+    this->_size = (size_t)info.st_size;
+#endif
+}
+FileMapping::FileMapping(FileMapping&& other) noexcept
+{
+    *this = std::move(other);
+}
+FileMapping::~FileMapping()
+{
+    this->release();
+}
+FileMapping& FileMapping::operator=(FileMapping&& other) noexcept
+{
+    if (this != &other)
+    {
+        this->release();
+        this->_data = std::exchange(other._data, nullptr);
+        this->_size = std::exchange(other._size, 0);
+        this->_locked = std::exchange(other._locked, false);
+#if _WIN32
+        this->fileHandle = std::exchange(other.fileHandle, nullptr);
+        this->mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void FileMapping::release()
+{
+    if (!this->_data)
+        return;
+
+    if (this->_locked)
+        MemoryLock::unlock(this->_data, this->_size);
+    this->_locked = false;
+#if _WIN32
+    UnmapViewOfFile(this->_data);
+    CloseHandle(this->mappingHandle);
+    CloseHandle(this->fileHandle);
+    this->fileHandle = nullptr;
+    this->mappingHandle = nullptr;
+#else
+    munmap(const_cast<std::byte*>(this->_data), this->_size);
+#endif
+    this->_data = nullptr;
+    this->_size = 0;
+}
+
+bool FileMapping::lock()
+{
+    if (!this->_locked)
+        this->_locked = MemoryLock::lock(this->_data, this->_size);
+    return this->_locked;
+}
+void FileMapping::advise(FileAccessPattern pattern, size_t offset, size_t length) const
+{
+    if (!this->_data || offset >= this->_size)
+        return;
+    length = std::min(length, this->_size - offset);
+
+#if _WIN32
+    if (pattern == FileAccessPattern::WillNeed)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range { .VirtualAddress = const_cast<std::byte*>(this->_data + offset), .NumberOfBytes = length };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    // madvise() wants a page-aligned start.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t alignedOffset = offset / page * page;
+    int advice = MADV_NORMAL;
+    switch (pattern)
+    {
+    case FileAccessPattern::Sequential: advice = MADV_SEQUENTIAL; break;
+    case FileAccessPattern::Random: advice = MADV_RANDOM; break;
+    case FileAccessPattern::WillNeed: advice = MADV_WILLNEED; break;
+    }
+    madvise(const_cast<std::byte*>(this->_data + alignedOffset), length + (offset - alignedOffset), advice);
+#endif
+}
+
+void FileMapping::evictFromCache(const fs::path& path)
+{
+#if !_WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#endif
+}
+
+MappedFileVFS::MappedFileVFS()
+{
+    this->callbacks = ma_vfs_callbacks
+    {
+        .onOpen = MappedFileVFS::onOpen,
+        .onOpenW = MappedFileVFS::onOpenW,
+        .onClose = MappedFileVFS::onClose,
+        .onRead = MappedFileVFS::onRead,
+        .onWrite = MappedFileVFS::onWrite,
+        .onSeek = MappedFileVFS::onSeek,
+        .onTell = MappedFileVFS::onTell,
+        .onInfo = MappedFileVFS::onInfo
+    };
+    ma_default_vfs_init(&this->fallback, nullptr);
+}
+
+ma_result MappedFileVFS::openMapped(MappedFileVFS* self, const fs::path& path, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+    if ((openMode & MA_OPEN_MODE_WRITE) == 0)
+    {
+        FileMapping mapping(path);
+        if (mapping)
+        {
+            mapping.advise(FileAccessPattern::Sequential);
+            File* file = new(std::nothrow) File { .mapping = std::move(mapping) };
+            if (!file)
+                return MA_OUT_OF_MEMORY;
+            *pFile = file;
+            return MA_SUCCESS;
+        }
+    }
+
+    File* file = new(std::nothrow) File();
+    if (!file)
+        return MA_OUT_OF_MEMORY;
+#if _WIN32
+    ma_result result = ma_vfs_open_w(&self->fallback, path.c_str(), openMode, &file->fallback);
+#else
+    ma_result result = ma_vfs_open(&self->fallback, path.c_str(), openMode, &file->fallback);
+#endif
+    if (result != MA_SUCCESS)
+    {
+        delete file;
+        return result;
+    }
+    *pFile = file;
+    return MA_SUCCESS;
+}
+
+ma_result MappedFileVFS::onOpen(ma_vfs* pVFS, const char* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+    return MappedFileVFS::openMapped(static_cast<MappedFileVFS*>(pVFS), fs::path(pFilePath), openMode, pFile);
+}
+ma_result MappedFileVFS::onOpenW(ma_vfs* pVFS, const wchar_t* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile)
+{
+    return MappedFileVFS::openMapped(static_cast<MappedFileVFS*>(pVFS), fs::path(pFilePath), openMode, pFile);
+}
+ma_result MappedFileVFS::onClose(ma_vfs* pVFS, ma_vfs_file file)
+{
+    File* f = static_cast<File*>(file);
+    ma_result result = MA_SUCCESS;
+    if (f->fallback)
+        result = ma_vfs_close(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback);
+    delete f;
+    return result;
+}
+ma_result MappedFileVFS::onRead(ma_vfs* pVFS, ma_vfs_file file, void* pDst, size_t sizeInBytes, size_t* pBytesRead)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_read(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback, pDst, sizeInBytes, pBytesRead);
+
+    size_t toRead = std::min(sizeInBytes, f->mapping.size() - std::min(f->cursor, f->mapping.size()));
+    if (toRead > 0)
+    {
+        std::memcpy(pDst, f->mapping.data() + f->cursor, toRead);
+        f->cursor += toRead;
+    }
+    if (pBytesRead)
+        *pBytesRead = toRead;
+    return toRead == 0 && sizeInBytes > 0 ? MA_AT_END : MA_SUCCESS;
+}
+ma_result MappedFileVFS::onWrite(ma_vfs* pVFS, ma_vfs_file file, const void* pSrc, size_t sizeInBytes, size_t* pBytesWritten)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_write(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback, pSrc, sizeInBytes, pBytesWritten);
+    return MA_ACCESS_DENIED;
+}
+ma_result MappedFileVFS::onSeek(ma_vfs* pVFS, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_seek(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback, offset, origin);
+
+    ma_int64 base = 0;
+    switch (origin)
+    {
+    case ma_seek_origin_start: base = 0; break;
+    case ma_seek_origin_current: base = (ma_int64)f->cursor; break;
+    case ma_seek_origin_end: base = (ma_int64)f->mapping.size(); break;
+    }
+    if (base + offset < 0)
+        return MA_INVALID_ARGS;
+    f->cursor = (size_t)(base + offset);
+    return MA_SUCCESS;
+}
+ma_result MappedFileVFS::onTell(ma_vfs* pVFS, ma_vfs_file file, ma_int64* pCursor)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_tell(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback, pCursor);
+
+    *pCursor = (ma_int64)f->cursor;
+    return MA_SUCCESS;
+}
+ma_result MappedFileVFS::onInfo(ma_vfs* pVFS, ma_vfs_file file, ma_file_info* pInfo)
+{
+    File* f = static_cast<File*>(file);
+    if (f->fallback)
+        return ma_vfs_info(&static_cast<MappedFileVFS*>(pVFS)->fallback, f->fallback, pInfo);
+
+    pInfo->sizeInBytes = f->mapping.size();
+    return MA_SUCCESS;
+}
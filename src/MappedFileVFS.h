@@ -0,0 +1,95 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <cstddef>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+enum class FileAccessPattern
+{
+    Sequential,
+    Random,
+    WillNeed
+};
+
+// Read-only mapping of a whole file. Move-only, unmaps on destruction.
+class FileMapping
+{
+    const std::byte* _data = nullptr;
+    size_t _size = 0;
+    bool _locked = false;
+#if _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+    void release();
+public:
+    FileMapping() = default;
+    explicit FileMapping(const fs::path& path);
+    FileMapping(const FileMapping&) = delete;
+    FileMapping(FileMapping&& other) noexcept;
+    ~FileMapping();
+
+    FileMapping& operator=(const FileMapping&) = delete;
+    FileMapping& operator=(FileMapping&& other) noexcept;
+
+    inline const std::byte* data() const
+    {
+        return this->_data;
+    }
+    inline size_t size() const
+    {
+        return this->_size;
+    }
+    inline explicit operator bool() const
+    {
+        return this->_data != nullptr;
+    }
+
+    // Pins the whole mapping in RAM until released, through MemoryLock, so only when that's enabled.
+    bool lock();
+    // Hint the kernel about upcoming accesses. No-op where unsupported.
+    void advise(FileAccessPattern pattern, size_t offset = 0, size_t length = SIZE_MAX) const;
+    // Drop any cached pages of `path`, so the next open is cold. Best effort.
+    static void evictFromCache(const fs::path& path);
+};
+
+// miniaudio VFS serving reads straight out of memory-mapped files.
+// Writes, and anything that can't be mapped (empty or special files), go through the default stdio VFS instead.
+class MappedFileVFS
+{
+    ma_vfs_callbacks callbacks; // Must stay the first member, miniaudio reinterprets ma_vfs* as ma_vfs_callbacks*.
+    ma_default_vfs fallback;
+
+    struct File
+    {
+        FileMapping mapping;
+        size_t cursor = 0;
+        ma_vfs_file fallback = nullptr;
+    };
+
+    static ma_result onOpen(ma_vfs* pVFS, const char* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile);
+    static ma_result onOpenW(ma_vfs* pVFS, const wchar_t* pFilePath, ma_uint32 openMode, ma_vfs_file* pFile);
+    static ma_result onClose(ma_vfs* pVFS, ma_vfs_file file);
+    static ma_result onRead(ma_vfs* pVFS, ma_vfs_file file, void* pDst, size_t sizeInBytes, size_t* pBytesRead);
+    static ma_result onWrite(ma_vfs* pVFS, ma_vfs_file file, const void* pSrc, size_t sizeInBytes, size_t* pBytesWritten);
+    static ma_result onSeek(ma_vfs* pVFS, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin);
+    static ma_result onTell(ma_vfs* pVFS, ma_vfs_file file, ma_int64* pCursor);
+    static ma_result onInfo(ma_vfs* pVFS, ma_vfs_file file, ma_file_info* pInfo);
+
+    static ma_result openMapped(MappedFileVFS* self, const fs::path& path, ma_uint32 openMode, ma_vfs_file* pFile);
+public:
+    MappedFileVFS();
+    MappedFileVFS(const MappedFileVFS&) = delete;
+
+    inline ma_vfs* vfs()
+    {
+        return this;
+    }
+    inline ma_vfs* stdioVFS()
+    {
+        return &this->fallback;
+    }
+};
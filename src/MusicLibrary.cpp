@@ -0,0 +1,677 @@
+#include "MusicLibrary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <iterator>
+#if __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include <CueSheets.h>
+#include <IoUring.h>
+
+namespace
+{
+    // The index is a cache in native byte order: header, then per record the path, size, mtime and a list of tagged
+    // sections. Unknown tags are skipped, so new sections don't invalidate old indices. Bump the version otherwise.
+    constexpr char indexMagic[8] { 'T', 'C', 'R', 'D', 'I', 'D', 'X', '\0' };
+    constexpr uint32_t indexVersion = 1;
+
+    constexpr uint32_t fourcc(const char (&tag)[5])
+    {
+        return (uint32_t)tag[0] | (uint32_t)tag[1] << 8 | (uint32_t)tag[2] << 16 | (uint32_t)tag[3] << 24;
+    }
+    constexpr uint32_t loudnessTag = fourcc("LOUD");
+    constexpr uint32_t seekTableTag = fourcc("SEEK");
+    constexpr uint32_t waveformTag = fourcc("WAVE");
+    constexpr uint32_t trimTag = fourcc("TRIM");
+    // Formats were first cached as "FMT ", when untagged MP3s were recognized by a single frame header. Those records
+    // are left for the scan to sniff again.
+    constexpr uint32_t formatTag = fourcc("FMT2");
+    constexpr uint32_t cueSheetTag = fourcc("CUE ");
+
+    // A page: what a read costs anyway, and room enough to see past the zero padding some rippers put before the
+    // first MP3 frame.
+    constexpr size_t sniffBytes = 4096;
+
+    // The length in bytes of the MPEG audio frame whose header starts at `header`, or 0 if it isn't one. Free-format
+    // frames don't say how long they are, so they count as not one.
+    size_t mp3FrameLength(const uint8_t* header, size_t size)
+    {
+        static constexpr uint16_t bitrates[5][16] {
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 }, // MPEG-1 Layer I
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },    // MPEG-1 Layer II
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },     // MPEG-1 Layer III
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },    // MPEG-2 and 2.5 Layer I
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }          // MPEG-2 and 2.5 Layers II and III
+        };
+        static constexpr uint32_t sampleRates[3] { 44100, 48000, 32000 };
+
+        if (size < 4 || header[0] != 0xFF || (header[1] & 0xE0) != 0xE0)
+            return 0;
+        uint32_t version = header[1] >> 3 & 0x3, layer = header[1] >> 1 & 0x3;
+        uint32_t bitrateIndex = header[2] >> 4, sampleRateIndex = header[2] >> 2 & 0x3, padding = header[2] >> 1 & 0x1;
+        if (version == 1 || layer == 0 || bitrateIndex == 0 || bitrateIndex == 0xF || sampleRateIndex == 0x3)
+            return 0;
+
+        bool mpeg1 = version == 3;
+        uint32_t bitrate = bitrates[mpeg1 ? 3 - layer : layer == 3 ? 3 : 4][bitrateIndex] * 1000;
+        uint32_t sampleRate = sampleRates[sampleRateIndex] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+        if (layer == 3)
+            return (12 * bitrate / sampleRate + padding) * 4;
+        return (layer == 1 && !mpeg1 ? 72 : 144) * bitrate / sampleRate + padding;
+    }
+
+    struct IndexWriter
+    {
+        std::string bytes;
+
+        template <typename T>
+        void put(const T& value)
+        {
+            this->bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+        void putBytes(const void* data, size_t size)
+        {
+            this->bytes.append(static_cast<const char*>(data), size);
+        }
+        // Writes a section header, returning where its length goes once known.
+        size_t beginSection(uint32_t tag)
+        {
+            this->put(tag);
+            this->put(uint32_t(0));
+            return this->bytes.size();
+        }
+        void endSection(size_t start)
+        {
+            uint32_t length = uint32_t(this->bytes.size() - start);
+            std::memcpy(&this->bytes[start - sizeof(uint32_t)], &length, sizeof(length));
+        }
+    };
+    struct IndexReader
+    {
+        const char* cur;
+        const char* end;
+
+        template <typename T>
+        bool get(T& value)
+        {
+            if (size_t(this->end - this->cur) < sizeof(T))
+                return false;
+            std::memcpy(&value, this->cur, sizeof(T));
+            this->cur += sizeof(T);
+            return true;
+        }
+        bool skip(size_t size)
+        {
+            if (size_t(this->end - this->cur) < size)
+                return false;
+            this->cur += size;
+            return true;
+        }
+    };
+
+#if __linux__
+    constexpr uint32_t statxMask = STATX_SIZE | STATX_MTIME;
+    constexpr uint32_t statxBatch = 64;
+
+    int64_t stampOf(const struct statx_timestamp& ts)
+    {
+        return ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+    }
+    void statSync(LibraryTrack& track)
+    {
+        struct stat info;
+        if (::stat(track.path.c_str(), &info) == 0)
+        {
+            track.size = (uint64_t)info.st_size;
+            track.mtime = info.st_mtim.tv_sec * 1'000'000'000ll + info.st_mtim.tv_nsec;
+        }
+    }
+
+    // Stats every track in batches, keeping up to `statxBatch` requests in flight. Returns false if io_uring is unusable.
+    bool statBatched(std::vector<LibraryTrack>& tracks)
+    {
+        // Outlives the ring, whose destructor drains anything still writing into it.
+        std::vector<struct statx> results(tracks.size());
+        IoUring ring(statxBatch);
+        if (!ring)
+            return false;
+
+        size_t next = 0, done = 0;
+        while (done < tracks.size())
+        {
+            while (next < tracks.size() && ring.pending() < ring.capacity() &&
+                   ring.queueStatx(AT_FDCWD, tracks[next].path.c_str(), AT_STATX_SYNC_AS_STAT, statxMask, &results[next], next))
+                ++next;
+            ring.submit();
+
+            IoCompletion completion;
+            if (!ring.wait(completion))
+            {
+                // The ring broke mid-scan. Finish whatever didn't complete synchronously.
+                for (size_t i = done; i < tracks.size(); i++)
+                    if (tracks[i].mtime == 0)
+                        statSync(tracks[i]);
+                return true;
+            }
+            ++done;
+            LibraryTrack& track = tracks[completion.userData];
+            if (completion.result == 0)
+            {
+                track.size = results[completion.userData].stx_size;
+                track.mtime = stampOf(results[completion.userData].stx_mtime);
+            }
+            else statSync(track); // Kernels before 5.6 reject the opcode itself with -EINVAL.
+        }
+        return true;
+    }
+#endif
+}
+
+std::shared_ptr<const LibrarySnapshot> MusicLibrary::snapshot()
+{
+    if (auto ret = MusicLibrary::current.load(std::memory_order_acquire))
+        return ret;
+    return MusicLibrary::rescan();
+}
+std::shared_ptr<const LibrarySnapshot> MusicLibrary::rescan()
+{
+    auto ret = std::make_shared<const LibrarySnapshot>(MusicLibrary::scan(MusicLibrary::root));
+    MusicLibrary::current.store(ret, std::memory_order_release);
+    return ret;
+}
+bool MusicLibrary::rescanAsync(std::function<void()> then)
+{
+    if (MusicLibrary::scanInFlight.exchange(true, std::memory_order_acq_rel))
+        return false;
+
+    if (MusicLibrary::scanner.joinable())
+        MusicLibrary::scanner.join();
+    MusicLibrary::scanner = std::jthread([then = std::move(then)]
+    {
+        MusicLibrary::rescan();
+        MusicLibrary::scanInFlight.store(false, std::memory_order_release);
+        if (then)
+            then();
+    });
+    return true;
+}
+
+LibrarySnapshot MusicLibrary::scan(const fs::path& dir, bool allowIoUring)
+{
+    auto beg = std::chrono::steady_clock::now();
+
+    LibrarySnapshot ret;
+    std::error_code ec;
+    if (fs::exists(dir, ec))
+    {
+        // Directory iteration alone doesn't stat on Linux, the file type comes with the directory entry.
+        for (auto it = fs::recursive_directory_iterator(dir, fs::directory_options::skip_permission_denied, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (ec)
+                break;
+            if (!it->is_regular_file(ec))
+                continue;
+
+            LibraryTrack track;
+            track.path = it->path();
+            track.name = track.path.stem().u32string();
+            track.key = MusicLibrary::lowered(track.name);
+#if !__linux__
+            // Elsewhere the directory listing already carries these, so they're free.
+            track.size = it->file_size(ec);
+            track.mtime = (int64_t)it->last_write_time(ec).time_since_epoch().count();
+#endif
+            ret.tracks.push_back(std::move(track));
+        }
+    }
+
+#if __linux__
+    if (allowIoUring && IoUring::supported())
+        ret.usedIoUring = statBatched(ret.tracks);
+    if (!ret.usedIoUring)
+        for (LibraryTrack& track : ret.tracks)
+            statSync(track);
+#else
+    (void)allowIoUring;
+#endif
+
+    // Sniffing takes an open and a read per file, and CUE sheets a parse, so both are only done for files the index
+    // hasn't seen as they are now.
+    auto isSheet = [](const fs::path& path) { return MusicLibrary::lowered(path.extension().u32string()) == U".cue"; };
+    std::vector<size_t> unknown;
+    std::vector<std::pair<fs::path, std::shared_ptr<const CueSheet>>> sheets;
+    {
+        std::lock_guard guard(MusicLibrary::recordsMutex);
+        for (size_t i = 0; i < ret.tracks.size(); i++)
+        {
+            LibraryTrack& track = ret.tracks[i];
+            auto it = MusicLibrary::records.find(track.path.generic_u8string());
+            if (it != MusicLibrary::records.end() && it->second.size == track.size && it->second.mtime == track.mtime && it->second.format &&
+                (it->second.cueSheet || !isSheet(track.path)))
+            {
+                track.format = *it->second.format;
+                if (it->second.cueSheet)
+                    sheets.emplace_back(track.path, it->second.cueSheet);
+            }
+            else unknown.push_back(i);
+        }
+    }
+    std::vector<std::shared_ptr<const CueSheet>> parsed(unknown.size());
+    for (size_t i = 0; i < unknown.size(); i++)
+    {
+        LibraryTrack& track = ret.tracks[unknown[i]];
+        track.format = MusicLibrary::sniff(track.path);
+        if (track.format == AudioFormat::Other && isSheet(track.path))
+            parsed[i] = std::make_shared<const CueSheet>(CueSheets::parseFile(track.path));
+    }
+    if (!unknown.empty())
+    {
+        std::lock_guard guard(MusicLibrary::recordsMutex);
+        for (size_t i = 0; i < unknown.size(); i++)
+        {
+            const LibraryTrack& track = ret.tracks[unknown[i]];
+            TrackRecord& record = MusicLibrary::records[track.path.generic_u8string()];
+            if (record.size != track.size || record.mtime != track.mtime)
+                record = TrackRecord { .size = track.size, .mtime = track.mtime };
+            record.format = track.format;
+            if (parsed[i])
+            {
+                record.cueSheet = parsed[i];
+                sheets.emplace_back(track.path, std::move(parsed[i]));
+            }
+        }
+        MusicLibrary::recordsDirty = true;
+    }
+    ret.sniffed = unknown.size();
+    ret.skipped = std::erase_if(ret.tracks, [](const LibraryTrack& track) { return track.format == AudioFormat::Other; });
+
+    // In path order, so which of two sheets for the same file wins doesn't depend on the directory listing.
+    std::sort(sheets.begin(), sheets.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    ret.skipped += CueSheets::split(ret.tracks, sheets);
+    ret.cueTracks = size_t(std::count_if(ret.tracks.begin(), ret.tracks.end(), [](const LibraryTrack& track) { return track.span.has_value(); }));
+
+    std::sort(ret.tracks.begin(), ret.tracks.end(), [](const LibraryTrack& a, const LibraryTrack& b)
+    {
+        if (int order = a.path.compare(b.path); order != 0)
+            return order < 0;
+        return (a.span ? a.span->start : 0) < (b.span ? b.span->start : 0);
+    });
+    ret.scanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - beg).count();
+    return ret;
+}
+
+std::u32string MusicLibrary::lowered(const std::u32string& str)
+{
+    std::u32string ret(str);
+    std::transform(ret.begin(), ret.end(), ret.begin(), [](char32_t c) { return (char32_t)std::towlower((wint_t)c); });
+    return ret;
+}
+AudioFormat MusicLibrary::sniff(const fs::path& file)
+{
+    char bytes[sniffBytes];
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream)
+        return AudioFormat::Other;
+    stream.read(bytes, sizeof(bytes));
+    return MusicLibrary::sniff(reinterpret_cast<const uint8_t*>(bytes), size_t(stream.gcount()));
+}
+AudioFormat MusicLibrary::sniff(const uint8_t* bytes, size_t size)
+{
+    auto is = [&](size_t offset, const char* tag)
+    {
+        size_t length = std::strlen(tag);
+        return size >= offset + length && std::memcmp(bytes + offset, tag, length) == 0;
+    };
+
+    if ((is(0, "RIFF") || is(0, "RIFX") || is(0, "RF64")) && is(8, "WAVE"))
+        return AudioFormat::Wav;
+    if (is(0, "riff\x2E\x91\xCF\x11")) // Wave64, whose chunk IDs are GUIDs.
+        return AudioFormat::Wav;
+    if (is(0, "FORM") && (is(8, "AIFF") || is(8, "AIFC")))
+        return AudioFormat::Wav;
+    if (is(0, "fLaC"))
+        return AudioFormat::Flac;
+    if (is(0, "ID3"))
+    {
+        // An ID3v2 tag is mostly put in front of MP3s, but FLACs get them too. Look past it when it's all been read.
+        if (size >= 10)
+        {
+            size_t tagSize = 10 + (size_t(bytes[6] & 0x7F) << 21 | size_t(bytes[7] & 0x7F) << 14 | size_t(bytes[8] & 0x7F) << 7 | size_t(bytes[9] & 0x7F));
+            if (bytes[5] & 0x10)
+                tagSize += 10; // Footer.
+            if (tagSize + 4 <= size && std::memcmp(bytes + tagSize, "fLaC", 4) == 0)
+                return AudioFormat::Flac;
+        }
+        return AudioFormat::Mp3;
+    }
+
+    // Untagged MP3s start straight at a frame header, maybe after some zero padding. Four bytes alone are easily
+    // mistaken for one: a UTF-16 byte order mark followed by a letter looks like an MPEG-1 Layer I header. So it has to
+    // be followed by a second header, for the same stream, where the first says its frame ends.
+    size_t offset = 0;
+    while (offset < size && bytes[offset] == 0)
+        ++offset;
+    size_t length = mp3FrameLength(bytes + offset, size - offset);
+    if (length != 0 && offset + length < size)
+    {
+        const uint8_t* first = bytes + offset;
+        const uint8_t* second = first + length;
+        // Version, layer and sample rate stay the same throughout.
+        if (mp3FrameLength(second, size - offset - length) != 0 && (second[1] & 0xFE) == (first[1] & 0xFE) && (second[2] & 0x0C) == (first[2] & 0x0C))
+            return AudioFormat::Mp3;
+    }
+    return AudioFormat::Other;
+}
+
+const LibraryTrack* MusicLibrary::find(const LibrarySnapshot& snapshot, const fs::path& path)
+{
+    auto it = std::lower_bound(snapshot.tracks.begin(), snapshot.tracks.end(), path, [](const LibraryTrack& track, const fs::path& path)
+    {
+        return track.path < path;
+    });
+    return it != snapshot.tracks.end() && it->path == path ? &*it : nullptr;
+}
+
+bool MusicLibrary::loadIndex()
+{
+    std::ifstream file(MusicLibrary::indexFile, std::ios::binary);
+    if (!file)
+        return false;
+    std::string bytes { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+    IndexReader reader { bytes.data(), bytes.data() + bytes.size() };
+    char magic[sizeof(indexMagic)];
+    uint32_t version, count;
+    if (!reader.get(magic) || std::memcmp(magic, indexMagic, sizeof(magic)) != 0 || !reader.get(version) || version != indexVersion ||
+        !reader.get(count))
+        return false;
+
+    std::unordered_map<std::u8string, TrackRecord> loaded;
+    loaded.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t pathLength, sectionCount;
+        if (!reader.get(pathLength) || size_t(reader.end - reader.cur) < pathLength)
+            return false;
+        std::u8string path(reinterpret_cast<const char8_t*>(reader.cur), pathLength);
+        reader.skip(pathLength);
+
+        TrackRecord record;
+        if (!reader.get(record.size) || !reader.get(record.mtime) || !reader.get(sectionCount))
+            return false;
+        for (uint32_t j = 0; j < sectionCount; j++)
+        {
+            uint32_t tag, length;
+            if (!reader.get(tag) || !reader.get(length) || size_t(reader.end - reader.cur) < length)
+                return false;
+            IndexReader section { reader.cur, reader.cur + length };
+            reader.skip(length);
+
+            switch (tag)
+            {
+            case loudnessTag:
+                {
+                    TrackLoudness loudness;
+                    if (section.get(loudness.integrated) && section.get(loudness.truePeak) && section.get(loudness.frames) && section.get(loudness.sampleRate))
+                        record.loudness = loudness;
+                }
+                break;
+            case seekTableTag:
+                {
+                    auto table = std::make_shared<TrackSeekTable>();
+                    uint32_t byteCount;
+                    if (section.get(table->frames) && section.get(table->sampleRate) && section.get(table->pointCount) && section.get(byteCount) &&
+                        size_t(section.end - section.cur) >= byteCount)
+                    {
+                        table->points.assign(section.cur, section.cur + byteCount);
+                        record.seekTable = std::move(table);
+                    }
+                }
+                break;
+            case waveformTag:
+                {
+                    auto waveform = std::make_shared<TrackWaveform>();
+                    uint32_t bucketCount;
+                    if (section.get(waveform->frames) && section.get(waveform->sampleRate) && section.get(waveform->bucketFrames) && section.get(bucketCount) &&
+                        size_t(section.end - section.cur) >= size_t(bucketCount) * 3)
+                    {
+                        WaveformLevel& level = waveform->levels.emplace_back();
+                        auto bytes = reinterpret_cast<const uint8_t*>(section.cur);
+                        level.min.assign(bytes, bytes + bucketCount);
+                        level.max.assign(bytes + bucketCount, bytes + bucketCount * 2);
+                        level.rms.assign(bytes + bucketCount * 2, bytes + bucketCount * 3);
+                        waveform->buildLevels();
+                        record.waveform = std::move(waveform);
+                    }
+                }
+                break;
+            case trimTag:
+                {
+                    TrackTrim trim;
+                    if (section.get(trim.start) && section.get(trim.end) && section.get(trim.frames) && section.get(trim.sampleRate) && section.get(trim.thresholdDb))
+                        record.trim = trim;
+                }
+                break;
+            case formatTag:
+                {
+                    uint8_t format;
+                    if (section.get(format) && format <= uint8_t(AudioFormat::Mp3))
+                        record.format = AudioFormat(format);
+                }
+                break;
+            case cueSheetTag:
+                {
+                    auto sheet = std::make_shared<CueSheet>();
+                    uint32_t entryCount;
+                    bool ok = section.get(entryCount);
+                    for (uint32_t k = 0; ok && k < entryCount; k++)
+                    {
+                        CueEntry& entry = sheet->entries.emplace_back();
+                        uint32_t fileLength, titleLength;
+                        ok = section.get(entry.number) && section.get(entry.start) && section.get(fileLength) && size_t(section.end - section.cur) >= fileLength;
+                        if (!ok)
+                            break;
+                        entry.file.assign(reinterpret_cast<const char8_t*>(section.cur), fileLength);
+                        section.skip(fileLength);
+                        ok = section.get(titleLength) && size_t(section.end - section.cur) / sizeof(char32_t) >= titleLength;
+                        if (!ok)
+                            break;
+                        entry.title.resize(titleLength);
+                        std::memcpy(entry.title.data(), section.cur, titleLength * sizeof(char32_t));
+                        section.skip(titleLength * sizeof(char32_t));
+                    }
+                    if (ok)
+                        record.cueSheet = std::move(sheet);
+                }
+                break;
+            default:
+                break; // Written by a newer build.
+            }
+        }
+        loaded.insert_or_assign(std::move(path), std::move(record));
+    }
+
+    std::lock_guard guard(MusicLibrary::recordsMutex);
+    // Anything recorded before the load finished is newer, though it may only hold what's been worked out since. The
+    // rest comes from the index, as long as the file hasn't changed in between.
+    for (auto& [path, record] : MusicLibrary::records)
+    {
+        auto it = loaded.find(path);
+        if (it == loaded.end() || it->second.size != record.size || it->second.mtime != record.mtime)
+            continue;
+        TrackRecord& stored = it->second;
+        if (!record.loudness)
+            record.loudness = stored.loudness;
+        if (!record.seekTable)
+            record.seekTable = std::move(stored.seekTable);
+        if (!record.waveform)
+            record.waveform = std::move(stored.waveform);
+        if (!record.trim)
+            record.trim = stored.trim;
+        if (!record.format)
+            record.format = stored.format;
+        if (!record.cueSheet)
+            record.cueSheet = std::move(stored.cueSheet);
+    }
+    MusicLibrary::records.merge(loaded);
+    return true;
+}
+bool MusicLibrary::saveIndex()
+{
+    static std::mutex saveMutex; // Serializes writers of the temporary file.
+    std::lock_guard saveGuard(saveMutex);
+
+    IndexWriter writer;
+    {
+        std::lock_guard guard(MusicLibrary::recordsMutex);
+        if (!MusicLibrary::recordsDirty)
+            return true;
+
+        writer.putBytes(indexMagic, sizeof(indexMagic));
+        writer.put(indexVersion);
+        writer.put(uint32_t(MusicLibrary::records.size()));
+        for (auto& [path, record] : MusicLibrary::records)
+        {
+            writer.put(uint32_t(path.size()));
+            writer.putBytes(path.data(), path.size());
+            writer.put(record.size);
+            writer.put(record.mtime);
+            writer.put(uint32_t((record.loudness ? 1 : 0) + (record.seekTable ? 1 : 0) + (record.waveform ? 1 : 0) + (record.trim ? 1 : 0) +
+                                (record.format ? 1 : 0) + (record.cueSheet ? 1 : 0)));
+            if (record.loudness)
+            {
+                size_t section = writer.beginSection(loudnessTag);
+                writer.put(record.loudness->integrated);
+                writer.put(record.loudness->truePeak);
+                writer.put(record.loudness->frames);
+                writer.put(record.loudness->sampleRate);
+                writer.endSection(section);
+            }
+            if (record.seekTable)
+            {
+                size_t section = writer.beginSection(seekTableTag);
+                writer.put(record.seekTable->frames);
+                writer.put(record.seekTable->sampleRate);
+                writer.put(record.seekTable->pointCount);
+                writer.put(uint32_t(record.seekTable->points.size()));
+                writer.putBytes(record.seekTable->points.data(), record.seekTable->points.size());
+                writer.endSection(section);
+            }
+            if (record.waveform)
+            {
+                // The coarser levels are quick to rebuild, so they'd only double the size of the index.
+                const WaveformLevel& level = record.waveform->levels.front();
+                size_t section = writer.beginSection(waveformTag);
+                writer.put(record.waveform->frames);
+                writer.put(record.waveform->sampleRate);
+                writer.put(record.waveform->bucketFrames);
+                writer.put(uint32_t(level.min.size()));
+                writer.putBytes(level.min.data(), level.min.size());
+                writer.putBytes(level.max.data(), level.max.size());
+                writer.putBytes(level.rms.data(), level.rms.size());
+                writer.endSection(section);
+            }
+            if (record.trim)
+            {
+                size_t section = writer.beginSection(trimTag);
+                writer.put(record.trim->start);
+                writer.put(record.trim->end);
+                writer.put(record.trim->frames);
+                writer.put(record.trim->sampleRate);
+                writer.put(record.trim->thresholdDb);
+                writer.endSection(section);
+            }
+            if (record.format)
+            {
+                size_t section = writer.beginSection(formatTag);
+                writer.put(uint8_t(*record.format));
+                writer.endSection(section);
+            }
+            if (record.cueSheet)
+            {
+                size_t section = writer.beginSection(cueSheetTag);
+                writer.put(uint32_t(record.cueSheet->entries.size()));
+                for (const CueEntry& entry : record.cueSheet->entries)
+                {
+                    writer.put(entry.number);
+                    writer.put(entry.start);
+                    writer.put(uint32_t(entry.file.size()));
+                    writer.putBytes(entry.file.data(), entry.file.size());
+                    writer.put(uint32_t(entry.title.size()));
+                    writer.putBytes(entry.title.data(), entry.title.size() * sizeof(char32_t));
+                }
+                writer.endSection(section);
+            }
+        }
+        MusicLibrary::recordsDirty = false;
+    }
+
+    // Write-then-rename, so a crash mid-save leaves the previous index intact.
+    fs::path temp = fs::path(MusicLibrary::indexFile).concat(".tmp");
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.write(writer.bytes.data(), (std::streamsize)writer.bytes.size()))
+        {
+            std::lock_guard guard(MusicLibrary::recordsMutex);
+            MusicLibrary::recordsDirty = true;
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, MusicLibrary::indexFile, ec);
+    if (ec)
+    {
+        std::lock_guard guard(MusicLibrary::recordsMutex);
+        MusicLibrary::recordsDirty = true;
+    }
+    return !ec;
+}
+std::optional<TrackRecord> MusicLibrary::record(const LibraryTrack& track)
+{
+    std::lock_guard guard(MusicLibrary::recordsMutex);
+    auto it = MusicLibrary::records.find(track.path.generic_u8string());
+    if (it == MusicLibrary::records.end() || it->second.size != track.size || it->second.mtime != track.mtime)
+        return std::nullopt;
+    return it->second;
+}
+void MusicLibrary::updateRecord(const LibraryTrack& track, const std::function<void(TrackRecord&)>& update)
+{
+    std::lock_guard guard(MusicLibrary::recordsMutex);
+    TrackRecord& record = MusicLibrary::records[track.path.generic_u8string()];
+    if (record.size != track.size || record.mtime != track.mtime)
+        record = TrackRecord { .size = track.size, .mtime = track.mtime };
+    update(record);
+    MusicLibrary::recordsDirty = true;
+}
+
+void TrackWaveform::buildLevels()
+{
+    this->levels.resize(1);
+    while (this->levels.back().min.size() >= TrackWaveform::minBuckets * 2)
+    {
+        const WaveformLevel& finer = this->levels.back();
+        size_t count = (finer.min.size() + 1) / 2;
+        WaveformLevel coarser;
+        coarser.min.resize(count);
+        coarser.max.resize(count);
+        coarser.rms.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            // An odd last bucket stands alone.
+            size_t a = i * 2, b = std::min(a + 1, finer.min.size() - 1);
+            coarser.min[i] = std::min(finer.min[a], finer.min[b]);
+            coarser.max[i] = std::max(finer.max[a], finer.max[b]);
+            float meanSquare = (float(finer.rms[a]) * finer.rms[a] + float(finer.rms[b]) * finer.rms[b]) / 2.0f;
+            coarser.rms[i] = uint8_t(std::lround(std::sqrt(meanSquare)));
+        }
+        this->levels.push_back(std::move(coarser));
+    }
+}
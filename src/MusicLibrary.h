@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// What a file's first bytes say it holds, as far as the decoders go. See MusicLibrary::sniff.
+enum class AudioFormat : uint8_t
+{
+    Other, // Cover art, cue sheets, playlists, anything no decoder would take.
+    Wav,   // Also RF64, Wave64 and AIFF, which the WAV decoder reads too.
+    Flac,
+    Mp3,
+};
+
+// Where an entry of a CUE sheet lies in the file it shares with the sheet's other entries, in the sheet's own CD frames
+// of 1/75 s. Those convert exactly at any sample rate that's a multiple of 75, which covers all the usual ones.
+struct CueSpan
+{
+    uint32_t start = 0;
+    uint32_t end = 0; // 0 for the last entry of a file, which plays to its end.
+
+    inline uint64_t startFrame(uint32_t sampleRate) const
+    {
+        return uint64_t(this->start) * sampleRate / 75;
+    }
+    inline uint64_t endFrame(uint32_t sampleRate) const
+    {
+        return uint64_t(this->end) * sampleRate / 75;
+    }
+    bool operator==(const CueSpan&) const = default;
+};
+
+struct LibraryTrack
+{
+    std::u32string name; // File stem, what the player displays and matches against.
+    std::u32string key;  // Lowercased `name`.
+    fs::path path;
+    uint64_t size = 0;
+    int64_t mtime = 0;   // Opaque modification stamp, only ever compared for equality.
+    AudioFormat format = AudioFormat::Other;
+    // Set for the entries of a CUE sheet, which stand in for the file at `path` they're all part of.
+    std::optional<CueSpan> span;
+};
+
+struct TrackLoudness
+{
+    float integrated = 0.0f; // LUFS.
+    float truePeak = 0.0f;   // dBTP.
+    uint64_t frames = 0;
+    uint32_t sampleRate = 0;
+};
+
+// Where a track's audio starts and ends, with the digital silence around it left out. See Silence.
+struct TrackTrim
+{
+    uint64_t start = 0; // First frame with a sample above the threshold.
+    uint64_t end = 0;   // One past the last such frame. Equal to `start` for a track that's silent throughout.
+    uint64_t frames = 0;
+    uint32_t sampleRate = 0;
+    float thresholdDb = 0.0f; // What it was measured against, dBFS.
+};
+
+// Where to resume decoding an MP3 for any position, so seeks don't scan from the start. See SeekTables.
+struct TrackSeekTable
+{
+    uint64_t frames = 0;         // PCM frames in the stream.
+    uint32_t sampleRate = 0;
+    uint32_t pointCount = 0;     // 0 for tracks short enough to go without.
+    std::vector<uint8_t> points; // Delta and varint coded.
+};
+
+// One level of a TrackWaveform, a bucket per so many frames, across all channels.
+struct WaveformLevel
+{
+    std::vector<int8_t> min, max; // Fractions of full scale, times 127.
+    std::vector<uint8_t> rms;     // Times 255.
+};
+// Overview of a track for drawing, as a pyramid: level 0 has a bucket every `bucketFrames` frames, and every level after
+// it half as many buckets as the one before. Only level 0 is persisted. See Waveforms.
+struct TrackWaveform
+{
+    static constexpr size_t minBuckets = 32;
+
+    uint64_t frames = 0;
+    uint32_t sampleRate = 0;
+    uint32_t bucketFrames = 0;
+    std::vector<WaveformLevel> levels;
+
+    // Rebuilds every level past the first from it.
+    void buildLevels();
+};
+
+// One TRACK of a CUE sheet, as the sheet gives it. See CueSheets.
+struct CueEntry
+{
+    std::u8string file;   // The sheet's FILE it's in, relative to the sheet.
+    std::u32string title; // Empty if the sheet has none.
+    uint32_t number = 0;
+    uint32_t start = 0;   // Its INDEX 01, in CD frames. A pregap belongs to the entry before it.
+};
+struct CueSheet
+{
+    std::vector<CueEntry> entries; // In the sheet's order.
+};
+
+// What the persisted index remembers about a file. Only trusted while `size` and `mtime` still match the file.
+struct TrackRecord
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    std::optional<TrackLoudness> loudness;
+    // Shared, since the tables of long mixes run to hundreds of kilobytes and records get copied around.
+    std::shared_ptr<const TrackSeekTable> seekTable;
+    std::shared_ptr<const TrackWaveform> waveform;
+    std::optional<TrackTrim> trim;
+    // What sniffing made of it, so rescans only read files that are new or changed.
+    std::optional<AudioFormat> format;
+    std::shared_ptr<const CueSheet> cueSheet; // For `.cue` files.
+};
+
+// Immutable result of one scan, tracks sorted by path, entries of the same CUE sheet file in order. Only files that
+// sniff as audio are tracks, and those a CUE sheet splits up are only there as its entries.
+struct LibrarySnapshot
+{
+    std::vector<LibraryTrack> tracks;
+    size_t skipped = 0; // Files left out as not audio, or as played through the entries of a CUE sheet.
+    size_t cueTracks = 0; // Entries of CUE sheets among `tracks`.
+    size_t sniffed = 0; // Files whose format wasn't in the index yet, so had to be read.
+    double scanMs = 0.0;
+    bool usedIoUring = false;
+};
+
+// In-memory index of the music folder, so lookups and playlist walks don't hit the filesystem.
+// Scans batch their `statx` calls through io_uring where available, which keeps network mounts from serializing on
+// one round trip per file. Readers grab a snapshot; rescans publish a new one atomically.
+struct MusicLibrary
+{
+    MusicLibrary() = delete;
+
+    inline static fs::path root = "music/";
+    inline static fs::path indexFile = "tacrad.index";
+
+    // The current snapshot, scanning synchronously first if there's never been one.
+    static std::shared_ptr<const LibrarySnapshot> snapshot();
+    // Scans now, on the calling thread, and publishes the result.
+    static std::shared_ptr<const LibrarySnapshot> rescan();
+    // Scans on a background thread, then runs `then` on it. Returns false if a scan is already running.
+    static bool rescanAsync(std::function<void()> then = {});
+    inline static bool scanning()
+    {
+        return MusicLibrary::scanInFlight.load(std::memory_order_acquire);
+    }
+
+    // Walks `dir` without publishing anything. `allowIoUring` exists for benchmarking the synchronous path.
+    static LibrarySnapshot scan(const fs::path& dir, bool allowIoUring = true);
+    // What LibraryTrack::key holds for a `name`.
+    static std::u32string lowered(const std::u32string& str);
+    // Classifies a file by its first bytes, without decoding anything. Anything unreadable is Other.
+    static AudioFormat sniff(const fs::path& file);
+    static AudioFormat sniff(const uint8_t* bytes, size_t size);
+    // The track at `path` in `snapshot`, if any. The first, for a file split up by a CUE sheet.
+    static const LibraryTrack* find(const LibrarySnapshot& snapshot, const fs::path& path);
+
+    // Persisted per-track records. Safe to call from any thread.
+    static bool loadIndex();
+    // Writes the index out if anything changed since the last save.
+    static bool saveIndex();
+    static std::optional<TrackRecord> record(const LibraryTrack& track);
+    // Runs `update` on the record of `track`, first clearing it if the file changed since it was recorded.
+    static void updateRecord(const LibraryTrack& track, const std::function<void(TrackRecord&)>& update);
+private:
+    inline static std::mutex recordsMutex;
+    inline static std::unordered_map<std::u8string, TrackRecord> records;
+    inline static bool recordsDirty = false;
+
+    inline static std::atomic<std::shared_ptr<const LibrarySnapshot>> current;
+    inline static std::atomic<bool> scanInFlight = false;
+    inline static std::jthread scanner;
+};
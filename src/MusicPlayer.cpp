@@ -2,59 +2,276 @@
 
 #include <EntityComponentSystem/EntityManagement.h>
 
+#include <AudioEngine.h>
+#include <CueSheets.h>
+#include <PlaybackClock.h>
+#include <SeekScheduler.h>
 #include <TacradCLI.h>
+#include <TrackHistory.h>
 
 using namespace Firework;
 
-std::u32string MusicPlayer::musicLookup(std::u32string_view name, fs::path& file)
+std::optional<LibraryTrack> MusicPlayer::musicLookup(std::u32string_view name)
 {
-    std::u32string compare; compare.append(name);
-    for (auto& c : compare)
-        c = std::tolower(c);
+    std::u32string compare = MusicLibrary::lowered(std::u32string(name));
     
-    if (fs::exists("music/"))
+    auto find = [&](const LibrarySnapshot& library) -> const LibraryTrack*
     {
-        for (auto& dir : fs::recursive_directory_iterator("music/"))
+        for (auto& track : library.tracks)
+            if (track.key == compare)
+                return &track;
+        for (auto& track : library.tracks)
+            if (track.key.starts_with(compare))
+                return &track;
+        for (auto& track : library.tracks)
+            if (track.key.contains(compare))
+                return &track;
+        return nullptr;
+    };
+
+    auto library = MusicLibrary::snapshot();
+    const LibraryTrack* track = find(*library);
+    if (!track)
+    {
+        // Might have been added since the last scan.
+        library = MusicLibrary::rescan();
+        track = find(*library);
+    }
+    if (track)
+        return *track;
+    return std::nullopt;
+}
+
+bool MusicPlayer::streamed(const fs::path& file)
+{
+    switch (ioMode)
+    {
+    case TrackIO::Mapped:
+        return false;
+    case TrackIO::Streamed:
+        return true;
+    default:
+        // Page faults on a network mount stall the decoder just like blocking reads, so go through the prefetching VFS.
+        return AsyncFileVFS::isRemote(file);
+    }
+}
+ma_result MusicPlayer::initEffects()
+{
+    ma_node_graph* graph = ma_engine_get_node_graph(&engine);
+    ma_uint32 channels = ma_engine_get_channels(&engine), sampleRate = ma_engine_get_sample_rate(&engine);
+    if (ma_result result = stretcher.init(graph, channels, sampleRate); result != MA_SUCCESS)
+        return result;
+    if (ma_result result = equalizer.init(graph, channels, sampleRate); result != MA_SUCCESS)
+        return result;
+    if (ma_result result = convolver.init(graph, channels, sampleRate); result != MA_SUCCESS)
+        return result;
+    if (ma_result result = spectrumTap.init(graph, channels, sampleRate); result != MA_SUCCESS)
+        return result;
+    // Tracks -> stretcher -> equalizer -> convolver -> spectrum tap -> device.
+    if (ma_result result = ma_node_attach_output_bus(spectrumTap.node(), 0, ma_engine_get_endpoint(&engine), 0); result != MA_SUCCESS)
+        return result;
+    if (ma_result result = ma_node_attach_output_bus(convolver.node(), 0, spectrumTap.node(), 0); result != MA_SUCCESS)
+        return result;
+    if (ma_result result = ma_node_attach_output_bus(equalizer.node(), 0, convolver.node(), 0); result != MA_SUCCESS)
+        return result;
+    return ma_node_attach_output_bus(stretcher.node(), 0, equalizer.node(), 0);
+}
+void MusicPlayer::uninitEffects()
+{
+    stretcher.uninit();
+    equalizer.uninit();
+    convolver.uninit();
+    spectrumTap.uninit();
+}
+ma_node* MusicPlayer::effectInput()
+{
+    return stretcher.node();
+}
+ma_result MusicPlayer::initSound(ma_data_source* source, ma_uint32 flags)
+{
+    ma_sound_config config = ma_sound_config_init_2(&engine);
+    config.pDataSource = source;
+    config.flags = flags;
+    config.pInitialAttachment = effectInput();
+    ma_result result = ma_sound_init_ex(&engine, &config, &music);
+    if (result == MA_SUCCESS)
+    {
+        stretcher.reset();
+        PlaybackClock::track(&music);
+    }
+    return result;
+}
+ma_result MusicPlayer::initMusic(std::unique_ptr<LoadedTrack> track)
+{
+    ma_result result = initSound(track->dataSource(), track->soundFlags);
+    if (result != MA_SUCCESS)
+        return result;
+    musicFile = track->file;
+    musicTrack = std::move(track);
+    applyNormalization();
+    applyRange();
+    return MA_SUCCESS;
+}
+void MusicPlayer::loadMusic(const LibraryTrack& track, bool startPaused, std::function<void()> onFailure)
+{
+    const fs::path& file = track.path;
+    // Current from here on, so that pressing next again moves on from this one rather than the one it replaces.
+    musicName = track.name;
+    musicSpan = track.span;
+    loading = true;
+    paused = startPaused;
+    // Pausing or resuming while it loads changes how it starts.
+    auto done = [name = track.name, onFailure = std::move(onFailure)](std::unique_ptr<LoadedTrack> track)
+    {
+        loading = false;
+        if (track && initMusic(std::move(track)) == MA_SUCCESS)
         {
-            if (dir.is_regular_file())
-            {
-                if (toLower(dir.path().stem().u32string()) == compare)
-                {
-                    file = dir.path();
-                    return dir.path().stem().u32string();
-                }
-            }
+            // From the top of its range, as it would be opened. The next entry of a CUE sheet after one that played
+            // to its end through the same decoder is there already, so it carries on without a seek.
+            ma_uint64 cursor = 0;
+            if (ma_data_source_get_cursor_in_pcm_frames(musicTrack->dataSource(), &cursor) == MA_SUCCESS && cursor != 0)
+                ma_data_source_seek_to_pcm_frame(musicTrack->dataSource(), 0);
+            startLoaded(name, 0);
         }
-        for (auto& dir : fs::recursive_directory_iterator("music/"))
+        else
         {
-            if (dir.is_regular_file())
-            {
-                if (toLower(dir.path().stem().u32string()).starts_with(compare))
-                {
-                    file = dir.path();
-                    return dir.path().stem().u32string();
-                }
-            }
+            paused = false;
+            if (onFailure)
+                onFailure();
         }
-        for (auto& dir : fs::recursive_directory_iterator("music/"))
+    };
+
+    if (std::optional<RecentTrack> recent = TrackHistory::take(file, track.span))
+    {
+        // Still open from playing it recently.
+        TrackLoader::cancel();
+        done(std::move(recent->track));
+        return;
+    }
+    bool stream = streamed(file);
+    // Openings are of the start of the file, so only an entry of a CUE sheet that starts there can use one.
+    bool fromStart = !track.span || track.span->start == 0;
+    if (std::shared_ptr<const TrackHead> head = stream || !fromStart ? nullptr : HeadCache::find(file))
+    {
+        // Nothing to wait for, so it starts right here.
+        if (std::unique_ptr<LoadedTrack> track = LoadedTrack::fromHead(file, std::move(head)))
         {
-            if (dir.is_regular_file())
+            if (prefetchedFile == file)
             {
-                if (toLower(dir.path().stem().u32string()).contains(compare))
-                {
-                    file = dir.path();
-                    return dir.path().stem().u32string();
-                }
+                prefetchedFile.clear();
+                prefetchedMapping = FileMapping();
             }
+            TrackLoader::cancel();
+            done(std::move(track));
+            return;
         }
     }
+    FileMapping mapping = prefetchedFile == file ? std::move(prefetchedMapping) : FileMapping();
+    prefetchedFile.clear();
+    prefetchedMapping = FileMapping();
+    TrackLoader::load(file, stream, std::move(mapping), std::move(done));
+}
+void MusicPlayer::startLoaded(std::u32string name, uint64_t frame)
+{
+    if (frame)
+        ma_sound_seek_to_pcm_frame(&music, frame);
+    ma_sound_get_length_in_pcm_frames(&music, &frameLen);
+    ma_sound_get_length_in_seconds(&music, &musicLen);
+    musicName = std::move(name);
+    playing = true;
+    if (!paused)
+    {
+        AudioEngine::wake();
+        ma_sound_start(&music);
+    }
+    prefetchNext();
+}
+void MusicPlayer::uninitMusic()
+{
+    SeekScheduler::cancel();
+    ma_uint64 frame = 0;
+    ma_sound_get_cursor_in_pcm_frames(&music, &frame);
+    PlaybackClock::track(nullptr);
+    ma_sound_uninit(&music);
+    musicFile.clear();
+    trimBegin = 0.0f;
+    trimEnd = 1.0f;
+    // Kept open where it was left, in case it's gone back to.
+    TrackHistory::push({ std::move(musicTrack), musicName, musicSpan, frame, frameLen });
+}
+void MusicPlayer::applyNormalization()
+{
+    // Per-sound volume, so the user's volume (the engine's) stays separate.
+    ma_sound_set_volume(&music, ma_volume_db_to_linear(Loudness::gainDb(musicFile)));
+}
+void MusicPlayer::applyRange()
+{
+    trimBegin = 0.0f;
+    trimEnd = 1.0f;
+    ma_data_source* source = ma_sound_get_data_source(&music);
+    ma_uint32 sampleRate;
+    if (!source || ma_data_source_get_data_format(source, nullptr, nullptr, &sampleRate, nullptr, 0) != MA_SUCCESS)
+        return;
+    // Back from TrackHistory, it still has the range it last played, and would report that as its length. Clearing it
+    // leaves the cursor where it is.
+    ma_data_source_set_range_in_pcm_frames(source, 0, ~ma_uint64(0));
+    std::optional<TrackTrim> trim = Silence::find(musicFile);
+    ma_uint64 length = 0;
+    uint64_t begin, end;
+    ma_data_source_get_length_in_pcm_frames(source, &length);
+    if (!CueSheets::range(musicSpan, trim, sampleRate, length, begin, end) || ma_data_source_set_range_in_pcm_frames(source, begin, end) != MA_SUCCESS)
+        return;
+    double frames = length ? double(length) : trim && trim->sampleRate ? double(trim->frames) * sampleRate / trim->sampleRate : 0.0;
+    if (frames > 0.0)
+    {
+        trimBegin = float(std::min(begin / frames, 1.0));
+        trimEnd = float(std::min(end / frames, 1.0));
+    }
+}
+void MusicPlayer::prefetch(const fs::path& file)
+{
+    if (file == prefetchedFile || streamed(file))
+        return; // Streamed tracks prefetch through the VFS once opened.
 
-    file = "err.";
-    return U"Error! (This will end poorly later.)";
+    prefetchedMapping = FileMapping(file);
+    prefetchedFile = prefetchedMapping ? file : fs::path();
+    // Kicks off asynchronous read-ahead of the whole file.
+    prefetchedMapping.advise(FileAccessPattern::WillNeed);
+}
+void MusicPlayer::prefetchNext()
+{
+    switch (type)
+    {
+    case PlaylistType::Sequential:
+        {
+            auto library = MusicLibrary::snapshot();
+            auto it = std::find_if(library->tracks.begin(), library->tracks.end(), [](auto& track) { return track.name == musicName; });
+            if (it != library->tracks.end() && ++it != library->tracks.end())
+                prefetch(it->path);
+        }
+        break;
+    case PlaylistType::Shuffle:
+        break; // The next pick isn't known ahead of time.
+    case PlaylistType::Queued:
+        {
+            auto next = queuePos == queue.end() ? queue.begin() : std::next(queuePos);
+            if (next == queue.end() && loop)
+                next = queue.begin();
+            if (next != queue.end() && next != queuePos)
+                prefetch(next->path);
+        }
+        break;
+    }
 }
 
 void MusicPlayer::musicResume()
 {
+    // Scrubbing while paused may have left a stop scheduled and the fader down.
+    ma_sound_set_stop_time_in_pcm_frames(&music, ~(ma_uint64)0);
+    ma_sound_set_fade_in_pcm_frames(&music, -1.0f, 1.0f, 0);
+    // The stretcher went on taking silence while the track was stopped.
+    stretcher.reset();
+    AudioEngine::wake();
     ma_sound_start(&music);
     paused = false;
 }
@@ -66,44 +283,30 @@ void MusicPlayer::musicPause()
 
 void MusicPlayer::startMusic(std::u32string_view query)
 {
-    fs::path musicFile;
-    std::u32string _musicName = musicLookup(query, musicFile);
-    if (ma_sound_init_from_file(&engine, musicFile.string().c_str(), 0, nullptr, nullptr, &music) == MA_SUCCESS)
-    {
-        ma_sound_start(&music);
-        ma_sound_get_length_in_pcm_frames(&music, &frameLen);
-        ma_sound_get_length_in_seconds(&music, &musicLen);
-        musicName = _musicName;
-        playing = true;
-    }
-    else EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+    auto queryFailed = []
     {
-        cli->writeLine(U"[log.error] Music query doesn't exist!\n");
-    });
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+        {
+            cli->writeLine(U"[log.error] Music query doesn't exist!\n");
+        });
+    };
+    if (std::optional<LibraryTrack> track = musicLookup(query))
+        loadMusic(*track, false, queryFailed);
+    else queryFailed();
 }
 void MusicPlayer::tryPlayNextAlphabetical(std::u32string_view prev, bool wasPaused)
 {
-    fs::path file;
-    std::u32string name(1, U'z');
-    if (prev.empty() && fs::exists("music/"))
+    LibraryTrack pick { .name = std::u32string(1, U'z') };
+    auto library = MusicLibrary::snapshot();
+    if (prev.empty())
     {
-        for (auto it : fs::recursive_directory_iterator("music/"))
-        {
-            if (it.path().stem().u32string() < name)
-            {
-                file = it.path();
-                name = file.stem().u32string();
-            }
-        }
+        for (auto& track : library->tracks)
+            if (track.name < pick.name)
+                pick = track;
     }
     else
     {
-        std::vector<std::pair<std::u32string, fs::path>> tracks;
-        if (fs::exists("music/"))
-            for (auto it : fs::recursive_directory_iterator("music/"))
-                if (it.is_regular_file())
-                    tracks.push_back(std::make_pair(it.path().stem().u32string(), it.path()));
-
+        auto& tracks = library->tracks;
         if (tracks.empty())
         {
             EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
@@ -113,14 +316,10 @@ void MusicPlayer::tryPlayNextAlphabetical(std::u32string_view prev, bool wasPaus
             return;
         }
 
-        std::sort(tracks.begin(), tracks.end(), [](auto a, auto b)
-        {
-            return a.second < b.second;
-        });
         auto next = tracks.end();
         for (auto it = tracks.begin(); it != tracks.end(); ++it)
         {
-            if (it->first == prev)
+            if (it->name == prev)
             {
                 next = it;
                 break;
@@ -135,31 +334,77 @@ void MusicPlayer::tryPlayNextAlphabetical(std::u32string_view prev, bool wasPaus
             });
             return;
         }
-        name = next->first;
-        file = next->second;
+        pick = *next;
     }
-    if (ma_sound_init_from_file(&engine, file.string().c_str(), 0, nullptr, nullptr, &music) == MA_SUCCESS)
+    loadMusic(pick, wasPaused, [name = pick.name, file = pick.path]
     {
-        ma_sound_get_length_in_pcm_frames(&music, &frameLen);
-        ma_sound_get_length_in_seconds(&music, &musicLen);
-        musicName = std::move(name);
-        playing = true;
-        if (!wasPaused)
-            ma_sound_start(&music);
-        else paused = true;
-    }
-    else EntityManager2D::foreachEntityWithAll<TacradCLI>([&](Entity2D* entity, TacradCLI* cli)
-    {
-        cli->writeLine(std::u32string(U"[log.error] Music query doesn't exist! [dev] name: ").append(name).append(U", file: ").append(file.u32string()).append(U"\n"));
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([&](Entity2D* entity, TacradCLI* cli)
+        {
+            cli->writeLine(std::u32string(U"[log.error] Music query doesn't exist! [dev] name: ").append(name).append(U", file: ").append(file.u32string()).append(U"\n"));
+        });
     });
 }
 void MusicPlayer::stopMusic()
 {
-    ma_sound_stop(&music);
-    ma_sound_uninit(&music);
+    // A track still loading goes too.
+    TrackLoader::cancel();
+    loading = false;
+    if (playing)
+    {
+        ma_sound_stop(&music);
+        uninitMusic();
+    }
     playing = false;
     paused = false;
 }
+void MusicPlayer::previous(bool fromStart)
+{
+    auto noEarlier = []
+    {
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+        {
+            cli->writeLine(U"[log.info] No earlier track to go back to.\n");
+        });
+    };
+    if (TrackHistory::behind() == 0)
+    {
+        noEarlier();
+        return;
+    }
+    bool current = playing, wasPaused = paused;
+    if (playing || loading)
+        stopMusic();
+    std::optional<RecentTrack> recent = TrackHistory::previous(current);
+    if (!recent && current)
+    {
+        // Keeping the current track pushed the earlier one out. Carry on with it, then.
+        noEarlier();
+        recent = TrackHistory::previous(false);
+        fromStart = false;
+    }
+    if (!recent)
+        return;
+
+    // Right at the end, it's as good as finished, so it starts over.
+    uint32_t sampleRate = ma_engine_get_sample_rate(&engine);
+    uint64_t frame = fromStart || recent->frame + sampleRate >= recent->length ? 0 : recent->frame;
+    musicName = recent->name;
+    musicSpan = recent->span;
+    paused = wasPaused;
+    // Before the sound is attached, so it's there from the first frame. Its range is still set, and is the same
+    // once it's applied again.
+    ma_data_source_seek_to_pcm_frame(recent->track->dataSource(), frame);
+    if (initMusic(std::move(recent->track)) == MA_SUCCESS)
+        startLoaded(std::move(recent->name), 0);
+    else
+    {
+        paused = false;
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+        {
+            cli->writeLine(U"[log.error] Couldn't resume the previous track!\n");
+        });
+    }
+}
 void MusicPlayer::next()
 {
     bool wasPaused = MusicPlayer::paused;
@@ -185,45 +430,42 @@ void MusicPlayer::next()
 }
 void MusicPlayer::tryPlayNextShuffle(bool wasPaused)
 {
-    size_t ct = 0;
-    if (fs::exists("music/"))
-        for (auto& dir : fs::recursive_directory_iterator("music/"))
-            if (dir.path().stem().u32string() != musicName)
-                ++ct;
-    if (ct != 0)
+    auto library = MusicLibrary::snapshot();
+    auto candidates = std::make_shared<std::vector<LibraryTrack>>();
+    candidates->reserve(library->tracks.size());
+    for (auto& track : library->tracks)
+        if (track.name != musicName)
+            candidates->push_back(track);
+
+    if (candidates->empty())
     {
-        More:
-        for (auto& dir : fs::recursive_directory_iterator("music/"))
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
         {
-            if (dir.is_regular_file() && dir.path().stem().u32string() != musicName && dist(randEngine) < 1.0f / (float)ct)
-            {
-                fs::path musicFile;
-                std::u32string _musicName = musicLookup(dir.path().stem().u32string(), musicFile);
-                auto t = dir.path().stem().string();
-                if (ma_sound_init_from_file(&engine, musicFile.string().c_str(), 0, nullptr, nullptr, &music) == MA_SUCCESS)
-                {
-                    ma_sound_get_length_in_pcm_frames(&music, &frameLen);
-                    ma_sound_get_length_in_seconds(&music, &musicLen);
-                    musicName = std::move(_musicName);
-                    playing = true;
-                    if (!wasPaused)
-                        ma_sound_start(&music);
-                    else paused = true;
-
-                    return;
-                }
-                else EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
-                {
-                    cli->writeLine(U"[log.error] Failed to load next track, shuffling for new one.\n");
-                });
-            }
-        }
-        goto More;
+            cli->writeLine(U"[log.info] No music to play. (Add some!)\n");
+        });
+        return;
     }
-    else EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+
+    // Picks again from what's left each time a pick fails to load.
+    auto tryPick = std::make_shared<std::function<void()>>();
+    *tryPick = [candidates, wasPaused, weakTryPick = std::weak_ptr(tryPick)]
     {
-        cli->writeLine(U"[log.info] No music to play. (Add some!)\n");
-    });
+        if (candidates->empty())
+            return;
+        size_t pick = std::uniform_int_distribution<size_t>(0, candidates->size() - 1)(randEngine);
+        LibraryTrack track = std::move((*candidates)[pick]);
+        (*candidates)[pick] = std::move(candidates->back());
+        candidates->pop_back();
+        loadMusic(track, wasPaused, [tryPick = weakTryPick.lock()]
+        {
+            EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+            {
+                cli->writeLine(U"[log.error] Failed to load next track, shuffling for new one.\n");
+            });
+            (*tryPick)();
+        });
+    };
+    (*tryPick)();
 }
 void MusicPlayer::incrQueuePos()
 {
@@ -252,37 +494,19 @@ void MusicPlayer::incrQueuePos()
     }
     else ++queuePos;
 }
-void MusicPlayer::tryPlayNextQueued(bool wasPaused)
+void MusicPlayer::tryPlayNextQueued(bool wasPaused, size_t skipped)
 {
-    decltype(queuePos) prev = queuePos;
-
-    goto FirstTry;
-    {
-        Retry:
-        incrQueuePos();
-
-        if (queuePos == prev)
-            return;
-        else prev = queuePos;
-    }
-    FirstTry:
-    
-    if (ma_sound_init_from_file(&engine, queuePos->second.string().c_str(), 0, nullptr, nullptr, &music) == MA_SUCCESS)
-    {
-        ma_sound_get_length_in_pcm_frames(&music, &frameLen);
-        ma_sound_get_length_in_seconds(&music, &musicLen);
-        musicName = queuePos->first;
-        playing = true;
-        if (!wasPaused)
-            ma_sound_start(&music);
-        else paused = true;
-    }
-    else
+    if (queuePos == queue.end())
+        return;
+    loadMusic(*queuePos, wasPaused, [wasPaused, skipped, name = queuePos->name, path = queuePos->path]
     {
-        EntityManager2D::foreachEntityWithAll<TacradCLI>([](Entity2D* entity, TacradCLI* cli)
+        EntityManager2D::foreachEntityWithAll<TacradCLI>([&](Entity2D* entity, TacradCLI* cli)
         {
-            cli->writeLine(std::u32string(U"[log.error] Couldn't load next music track in queue, skipping! [dev] name: ").append(queuePos->first).append(U", path: ").append(queuePos->second.u32string()).append(U"\n"));
+            cli->writeLine(std::u32string(U"[log.error] Couldn't load next music track in queue, skipping! [dev] name: ").append(name).append(U", path: ").append(path.u32string()).append(U"\n"));
         });
-        goto Retry;
-    }
+        auto prev = queuePos;
+        incrQueuePos();
+        if (queuePos != prev && skipped + 1 < queue.size())
+            tryPlayNextQueued(wasPaused, skipped + 1);
+    });
 }
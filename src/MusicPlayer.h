@@ -3,10 +3,28 @@
 #include <miniaudio.h>
 #include <algorithm>
 #include <filesystem>
+#include <functional>
 #include <list>
+#include <memory>
+#include <optional>
 #include <random>
+#include <string>
 #include <vector>
 
+#include <AsyncFileVFS.h>
+#include <Convolution.h>
+#include <Equalizer.h>
+#include <HeadCache.h>
+#include <Loudness.h>
+#include <MappedFileVFS.h>
+#include <MusicLibrary.h>
+#include <Resampler.h>
+#include <SeekTables.h>
+#include <Silence.h>
+#include <Spectrum.h>
+#include <TimeStretch.h>
+#include <TrackLoader.h>
+
 namespace fs = std::filesystem;
 
 enum class PlaylistType
@@ -16,6 +34,13 @@ enum class PlaylistType
     Queued
 };
 
+enum class TrackIO
+{
+    Auto,     // Map local files, stream ones on network mounts.
+    Mapped,
+    Streamed
+};
+
 struct MusicPlayer
 {
     MusicPlayer() = delete;
@@ -24,10 +49,30 @@ struct MusicPlayer
     inline static std::mt19937 randEngine { seeder() };
     inline static std::uniform_real_distribution<float> dist { 0.0f, 1.0f };
 
+    inline static AsyncFileVFS vfs;
     inline static ma_engine engine;
     inline static ma_sound music;
+    // Effects between every track and the device. The stretcher comes first, so everything after it runs at the
+    // device's pace whatever the speed.
+    inline static TimeStretchNode stretcher;
+    inline static EqualizerNode equalizer;
+    inline static ConvolutionNode convolver;
+    // Last before the device, feeding the visualizer.
+    inline static SpectrumTapNode spectrumTap;
+
+    inline static TrackIO ioMode = TrackIO::Auto;
+    // How tracks at another rate than the device's are converted. Anything but Linear decodes mapped tracks through
+    // our own resampler instead of the resource manager; streamed tracks always go through the resource manager.
+    inline static ResamplerQuality resampleQuality = ResamplerQuality::Balanced;
+    // What `music` plays from.
+    inline static std::unique_ptr<LoadedTrack> musicTrack;
+    // Read-ahead for the track expected to play next.
+    inline static fs::path prefetchedFile;
+    inline static FileMapping prefetchedMapping;
     
     inline static bool playing = false;
+    // Set while the next track opens on TrackLoader's thread. `paused` then says whether it'll start paused.
+    inline static bool loading = false;
     inline static bool paused = false;
     inline static bool loop = false;
     inline static PlaylistType type = PlaylistType::Sequential;
@@ -36,25 +81,52 @@ struct MusicPlayer
     inline static ma_uint64 frameLen;
     inline static float musicLen;
     inline static std::u32string musicName;
+    inline static fs::path musicFile;
+    // Which part of `musicFile` the current track is, if it's an entry of a CUE sheet.
+    inline static std::optional<CueSpan> musicSpan;
+    // The part of the file the current track plays, as fractions of it, after trimming its silence.
+    inline static float trimBegin = 0.0f;
+    inline static float trimEnd = 1.0f;
 
-    inline static std::list<std::pair<std::u32string, fs::path>> queue;
+    inline static std::list<LibraryTrack> queue;
     inline static decltype(queue)::iterator queuePos = queue.end();
     
-    inline static std::u32string toLower(std::u32string_view str)
-    {
-        std::u32string ret(str.begin(), str.end());
-        std::transform(ret.begin(), ret.end(), ret.begin(), [](char32_t c){ return (char32_t)std::tolower((int)c); });
-        return ret;
-    }
-    static std::u32string musicLookup(std::u32string_view name, fs::path& file);
+    static std::optional<LibraryTrack> musicLookup(std::u32string_view name);
+
+    static bool streamed(const fs::path& file);
+    // Builds the effect chain in front of the engine's endpoint. Call once, after the engine is up.
+    static ma_result initEffects();
+    static void uninitEffects();
+    // Where tracks attach in the node graph.
+    static ma_node* effectInput();
+    static ma_result initSound(ma_data_source* source, ma_uint32 flags);
+    // Plays `track` through `music`, stopped.
+    static ma_result initMusic(std::unique_ptr<LoadedTrack> track);
+    // Opens `track` in the background, and plays it once it's ready, unless another load replaced it first. `onFailure`
+    // runs in its place if it can't be opened.
+    static void loadMusic(const LibraryTrack& track, bool startPaused, std::function<void()> onFailure);
+    // Starts `music`, just initialized, as `name` from `frame`, unless paused.
+    static void startLoaded(std::u32string name, uint64_t frame);
+    static void uninitMusic();
+    // Re-applies the normalization gain of the current track, e.g. after the mode changed.
+    static void applyNormalization();
+    // Limits the current track to its span of the file, if it's an entry of a CUE sheet, and to what's between its
+    // trim points, if it has any. Call before it starts.
+    static void applyRange();
+    static void prefetch(const fs::path& file);
+    static void prefetchNext();
 
     static void startMusic(std::u32string_view query);
     static void tryPlayNextAlphabetical(std::u32string_view prev, bool wasPaused);
     static void stopMusic();
     static void next();
+    // Goes back to the track played before this one, from where it was left or from its start, if TrackHistory still
+    // has it open.
+    static void previous(bool fromStart);
     static void tryPlayNextShuffle(bool wasPaused = false);
     static void incrQueuePos();
-    static void tryPlayNextQueued(bool wasPaused = false);
+    // `skipped` counts the tracks before it that couldn't be loaded, so a queue of nothing but those gives up.
+    static void tryPlayNextQueued(bool wasPaused = false, size_t skipped = 0);
 
     static void musicResume();
     static void musicPause();
@@ -0,0 +1,303 @@
+#include "OfflineRender.h"
+
+#include <miniaudio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <numbers>
+#include <sstream>
+
+#include <Convolution.h>
+#include <CueSheets.h>
+#include <JobPool.h>
+
+namespace
+{
+    constexpr ma_uint64 chunkFrames = 4096;
+
+    ma_result initEncoder(ma_encoder& encoder, const fs::path& output, const RenderSettings& settings)
+    {
+        ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, settings.channels, settings.sampleRate);
+#if _WIN32
+        return ma_encoder_init_file_w(output.c_str(), &config, &encoder);
+#else
+        return ma_encoder_init_file(output.c_str(), &config, &encoder);
+#endif
+    }
+    // Dithered down to what the encoder takes.
+    bool write(ma_encoder& encoder, const float* frames, ma_uint64 frameCount, std::vector<int16_t>& scratch, uint32_t channels)
+    {
+        scratch.resize(size_t(frameCount) * channels);
+        ma_pcm_convert(scratch.data(), ma_format_s16, frames, ma_format_f32, frameCount * channels, ma_dither_mode_triangle);
+        ma_uint64 written = 0;
+        return ma_encoder_write_pcm_frames(&encoder, scratch.data(), frameCount, &written) == MA_SUCCESS && written == frameCount;
+    }
+}
+
+std::optional<uint64_t> OfflineRender::renderTrack(const RenderTrack& track, const RenderSettings& settings, std::stop_token stop)
+{
+    ma_engine_config engineConfig = ma_engine_config_init();
+    engineConfig.noDevice = MA_TRUE;
+    engineConfig.channels = settings.channels;
+    engineConfig.sampleRate = settings.sampleRate;
+    auto engine = std::make_unique<ma_engine>();
+    if (ma_engine_init(&engineConfig, engine.get()) != MA_SUCCESS)
+        return std::nullopt;
+
+    // The same chain as playback, minus the visualizer tap.
+    ma_node_graph* graph = ma_engine_get_node_graph(engine.get());
+    auto equalizer = std::make_unique<EqualizerNode>();
+    auto convolver = std::make_unique<ConvolutionNode>();
+    std::optional<uint64_t> result;
+    ma_sound sound;
+    bool soundInitialized = false;
+    ma_encoder encoder;
+    bool encoderInitialized = false;
+    do
+    {
+        if (equalizer->init(graph, settings.channels, settings.sampleRate) != MA_SUCCESS ||
+            convolver->init(graph, settings.channels, settings.sampleRate) != MA_SUCCESS ||
+            ma_node_attach_output_bus(convolver->node(), 0, ma_engine_get_endpoint(engine.get()), 0) != MA_SUCCESS ||
+            ma_node_attach_output_bus(equalizer->node(), 0, convolver->node(), 0) != MA_SUCCESS)
+            break;
+        for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
+            equalizer->setBand(i, settings.bands[i]);
+        equalizer->setPreampDb(settings.preampDb);
+        if (!settings.impulse.empty() && !convolver->load(settings.impulse, stop))
+            break;
+        {
+            // Nothing pulls the graph until this thread does, so let the equalizer glide to its settings and the
+            // convolver take its impulse on silence first, rather than on the start of the track.
+            std::vector<float> silence(size_t(std::max(EqualizerNode::rampFrames, ConvolutionNode::blockFrames * 2)) * settings.channels, 0.0f);
+            uint32_t frames = uint32_t(silence.size() / settings.channels);
+            equalizer->process(silence.data(), silence.data(), frames);
+            std::fill(silence.begin(), silence.end(), 0.0f);
+            convolver->process(silence.data(), silence.data(), frames);
+        }
+
+        ma_sound_config soundConfig = ma_sound_config_init_2(engine.get());
+#if _WIN32
+        soundConfig.pFilePathW = track.source.c_str();
+#else
+        soundConfig.pFilePath = track.source.c_str();
+#endif
+        soundConfig.pInitialAttachment = equalizer->node();
+        if (ma_sound_init_ex(engine.get(), &soundConfig, &sound) != MA_SUCCESS)
+            break;
+        soundInitialized = true;
+        ma_sound_set_volume(&sound, ma_volume_db_to_linear(track.gainDb));
+        if (ma_data_source* source = ma_sound_get_data_source(&sound); (track.trim || track.span) && source)
+        {
+            // As in playback, so the crossfades join the tracks where their audio ends and starts.
+            ma_uint32 sampleRate;
+            ma_uint64 length = 0;
+            uint64_t begin, end;
+            ma_data_source_get_length_in_pcm_frames(source, &length);
+            if (ma_data_source_get_data_format(source, nullptr, nullptr, &sampleRate, nullptr, 0) == MA_SUCCESS &&
+                CueSheets::range(track.span, track.trim, sampleRate, length, begin, end))
+                ma_data_source_set_range_in_pcm_frames(source, begin, end);
+        }
+
+        if (initEncoder(encoder, track.output, settings) != MA_SUCCESS)
+            break;
+        encoderInitialized = true;
+
+        ma_sound_start(&sound);
+        std::vector<float> buffer(chunkFrames * settings.channels);
+        std::vector<int16_t> scratch;
+        uint64_t written = 0;
+        // Past the end of the track, what's still in the filters: the equalizer's wavefront and the impulse's tail.
+        uint64_t tail = equalizer->latencyFrames() + convolver->latencyFrames() + convolver->impulse().frames;
+        bool ok = true;
+        while (ok && !stop.stop_requested())
+        {
+            ma_uint64 frames = chunkFrames;
+            if (ma_sound_at_end(&sound))
+            {
+                if (tail == 0)
+                    break;
+                frames = std::min<uint64_t>(frames, tail);
+                tail -= frames;
+            }
+            ma_uint64 read = 0;
+            ok = ma_engine_read_pcm_frames(engine.get(), buffer.data(), frames, &read) == MA_SUCCESS &&
+                 write(encoder, buffer.data(), read, scratch, settings.channels);
+            written += read;
+            OfflineRender::framesRendered.fetch_add(read, std::memory_order_relaxed);
+        }
+        if (ok && !stop.stop_requested())
+            result = written;
+    }
+    while (false);
+
+    if (encoderInitialized)
+        ma_encoder_uninit(&encoder);
+    if (soundInitialized)
+        ma_sound_uninit(&sound);
+    equalizer->uninit();
+    convolver->uninit();
+    ma_engine_uninit(engine.get());
+    if (!result && encoderInitialized)
+    {
+        std::error_code error;
+        fs::remove(track.output, error);
+    }
+    return result;
+}
+
+std::optional<uint64_t> OfflineRender::join(const std::vector<fs::path>& parts, const fs::path& output, const RenderSettings& settings, std::stop_token stop)
+{
+    ma_encoder encoder;
+    if (initEncoder(encoder, output, settings) != MA_SUCCESS)
+        return std::nullopt;
+
+    uint32_t channels = settings.channels;
+    size_t fadeFrames = size_t(settings.crossfadeSeconds * settings.sampleRate);
+    std::vector<float> buffer(chunkFrames * channels);
+    // The end of the previous part, up to `fadeFrames`, held back to fade into the start of the next.
+    std::vector<float> tail;
+    std::vector<int16_t> scratch;
+    uint64_t written = 0;
+    bool ok = true;
+    // Equal power, so the overlap neither dips nor swells on uncorrelated material.
+    auto gains = [](size_t frame, size_t frames)
+    {
+        float angle = (frame + 0.5f) / frames * std::numbers::pi_v<float> / 2.0f;
+        return std::pair { std::sin(angle), std::cos(angle) };
+    };
+    for (const fs::path& part : parts)
+    {
+        ma_decoder_config config = ma_decoder_config_init(ma_format_f32, channels, settings.sampleRate);
+        ma_decoder decoder;
+#if _WIN32
+        if (ma_decoder_init_file_w(part.c_str(), &config, &decoder) != MA_SUCCESS)
+#else
+        if (ma_decoder_init_file(part.c_str(), &config, &decoder) != MA_SUCCESS)
+#endif
+            continue; // Failed to render, so it's left out.
+
+        size_t fading = tail.size() / channels, faded = 0;
+        std::vector<float> pending;
+        while (ok && !stop.stop_requested())
+        {
+            ma_uint64 read = 0;
+            ma_result result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunkFrames, &read);
+            for (size_t i = 0; faded < fading && i < read; i++, faded++)
+            {
+                auto [in, out] = gains(faded, fading);
+                for (uint32_t c = 0; c < channels; c++)
+                    buffer[i * channels + c] = buffer[i * channels + c] * in + tail[faded * channels + c] * out;
+            }
+            pending.insert(pending.end(), buffer.begin(), buffer.begin() + read * channels);
+            if (size_t frames = pending.size() / channels; frames > fadeFrames)
+            {
+                ok = write(encoder, pending.data(), frames - fadeFrames, scratch, channels);
+                pending.erase(pending.begin(), pending.begin() + (frames - fadeFrames) * channels);
+                written += frames - fadeFrames;
+            }
+            if (result != MA_SUCCESS || read < chunkFrames)
+                break;
+        }
+        ma_decoder_uninit(&decoder);
+        if (!ok || stop.stop_requested())
+            break;
+
+        // A part shorter than the crossfade: the rest of the previous one fades out over silence.
+        for (; faded < fading; faded++)
+        {
+            auto [in, out] = gains(faded, fading);
+            for (uint32_t c = 0; c < channels; c++)
+                pending.push_back(tail[faded * channels + c] * out);
+        }
+        tail = std::move(pending);
+    }
+    if (ok && !tail.empty())
+    {
+        ok = write(encoder, tail.data(), tail.size() / channels, scratch, channels);
+        written += tail.size() / channels;
+    }
+    ma_encoder_uninit(&encoder);
+    if (!ok || stop.stop_requested())
+        return std::nullopt;
+    return written;
+}
+
+bool OfflineRender::start(std::vector<RenderTrack> tracks, fs::path joined, RenderSettings settings)
+{
+    std::lock_guard guard(OfflineRender::mutex);
+    if (OfflineRender::state.running)
+        return false;
+    OfflineRender::state = RenderProgress { .running = true, .tracks = uint32_t(tracks.size()) };
+    OfflineRender::framesRendered.store(0, std::memory_order_relaxed);
+    OfflineRender::sampleRate = settings.sampleRate;
+    OfflineRender::began = std::chrono::steady_clock::now();
+
+    // The previous coordinator, if any, is past its last use of the state, so this join doesn't wait on the lock.
+    OfflineRender::coordinator = std::jthread([tracks = std::move(tracks), joined = std::move(joined), settings = std::move(settings)](std::stop_token stop)
+    {
+        uint32_t threads;
+        {
+            // Its own pool, so a render neither waits behind library analysis nor holds it up for its whole length.
+            JobPool pool(settings.threads);
+            threads = uint32_t(pool.threadCount());
+            for (const RenderTrack& track : tracks)
+            {
+                pool.submit([&track, &settings, stop](std::stop_token)
+                {
+                    std::optional<uint64_t> frames = OfflineRender::renderTrack(track, settings, stop);
+                    std::lock_guard guard(OfflineRender::mutex);
+                    if (frames)
+                        ++OfflineRender::state.finished;
+                    else if (!stop.stop_requested())
+                        ++OfflineRender::state.failed;
+                });
+            }
+            pool.waitIdle();
+        }
+
+        std::optional<uint64_t> joinedFrames;
+        if (!joined.empty() && !stop.stop_requested())
+        {
+            std::vector<fs::path> parts;
+            for (const RenderTrack& track : tracks)
+                parts.push_back(track.output);
+            joinedFrames = OfflineRender::join(parts, joined, settings, stop);
+        }
+
+        std::lock_guard guard(OfflineRender::mutex);
+        RenderProgress& state = OfflineRender::state;
+        state.audioSeconds = double(OfflineRender::framesRendered.load(std::memory_order_relaxed)) / settings.sampleRate;
+        state.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - OfflineRender::began).count();
+        std::ostringstream summary;
+        summary << std::fixed << std::setprecision(1);
+        summary << (stop.stop_requested() ? "Cancelled after " : "Rendered ") << state.finished << " of " << state.tracks << " tracks";
+        if (state.failed)
+            summary << " (" << state.failed << " failed)";
+        summary << ", " << state.audioSeconds / 60.0 << " min of audio in " << state.wallSeconds << " s, "
+                << (state.wallSeconds > 0.0 ? state.audioSeconds / state.wallSeconds : 0.0) << "x real time on " << threads << " threads.";
+        if (joinedFrames)
+            summary << "\n    Joined into " << joined.string() << ", " << double(*joinedFrames) / settings.sampleRate / 60.0 << " min.";
+        else if (!joined.empty() && !stop.stop_requested())
+            summary << "\n    Couldn't write " << joined.string() << '.';
+        state.summary = std::move(summary).str();
+        state.running = false;
+    });
+    return true;
+}
+void OfflineRender::cancel()
+{
+    OfflineRender::coordinator.request_stop();
+}
+RenderProgress OfflineRender::progress()
+{
+    std::lock_guard guard(OfflineRender::mutex);
+    RenderProgress progress = OfflineRender::state;
+    if (progress.running)
+    {
+        progress.audioSeconds = double(OfflineRender::framesRendered.load(std::memory_order_relaxed)) / OfflineRender::sampleRate;
+        progress.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - OfflineRender::began).count();
+    }
+    return progress;
+}
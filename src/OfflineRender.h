@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Equalizer.h>
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// What a render applies, captured from the player when it starts so later changes don't leak into it halfway.
+struct RenderSettings
+{
+    uint32_t sampleRate = 48000;
+    uint32_t channels = 2;
+    EqBand bands[EqualizerNode::bandCount];
+    float preampDb = 0.0f;
+    fs::path impulse;             // Empty for none.
+    float crossfadeSeconds = 0.0f;
+    uint32_t threads = 0;         // 0 for every hardware thread.
+};
+
+struct RenderTrack
+{
+    fs::path source;
+    fs::path output;
+    float gainDb = 0.0f;          // Normalization.
+    std::optional<TrackTrim> trim; // Silence at either end to skip, if any.
+    std::optional<CueSpan> span;   // The part of `source` to render, for an entry of a CUE sheet.
+};
+
+struct RenderProgress
+{
+    bool running = false;
+    uint32_t tracks = 0, finished = 0, failed = 0;
+    double audioSeconds = 0.0;    // Rendered so far.
+    double wallSeconds = 0.0;
+    std::string summary;          // Of the last render, once it's done.
+};
+
+// Headless rendering of tracks to 16-bit WAV, through the same gain, equalizer and impulse response as playback but
+// without a device: each track gets its own engine, pulled as fast as it will go, and tracks render in parallel on their
+// own pool. The renders are then joined, crossfading between them, into one file for the whole queue.
+struct OfflineRender
+{
+    OfflineRender() = delete;
+
+    // Between consecutive tracks in the joined render. 0 butts them together.
+    inline static float crossfadeSeconds = 2.0f;
+
+    // Renders `tracks` in the background, into `joined` too if it isn't empty. False if a render is already running.
+    static bool start(std::vector<RenderTrack> tracks, fs::path joined, RenderSettings settings);
+    static void cancel();
+    static RenderProgress progress();
+
+    // Renders one track on the calling thread. Returns the frames written, or nothing on failure or once `stop` trips.
+    static std::optional<uint64_t> renderTrack(const RenderTrack& track, const RenderSettings& settings, std::stop_token stop = {});
+    // Concatenates `parts` into `output`, with equal-power crossfades of `crossfadeSeconds` between them.
+    static std::optional<uint64_t> join(const std::vector<fs::path>& parts, const fs::path& output, const RenderSettings& settings, std::stop_token stop = {});
+private:
+    inline static std::mutex mutex;
+    inline static RenderProgress state;
+    inline static std::atomic<uint64_t> framesRendered = 0;
+    inline static uint32_t sampleRate = 0;
+    inline static std::chrono::steady_clock::time_point began;
+    inline static std::jthread coordinator;
+};
@@ -0,0 +1,113 @@
+#include "PlaybackClock.h"
+
+#include <algorithm>
+
+#include <AudioStats.h>
+#include <MusicPlayer.h>
+
+void PlaybackClock::dataCallback(ma_device* device, void* framesOut, const void* framesIn, ma_uint32 frameCount)
+{
+    PlaybackClock::mix((ma_engine*)device->pUserData, framesOut, frameCount);
+}
+void PlaybackClock::mix(ma_engine* engine, void* framesOut, ma_uint32 frameCount)
+{
+    Clock::time_point begin = Clock::now();
+    ma_uint64 delivered = 0;
+    ma_engine_read_pcm_frames(engine, framesOut, frameCount, &delivered);
+
+    // The generation is loaded first: a sound swapped in between pairs the new cursor with the old generation, which
+    // readers discard, never the other way round.
+    Sample sample;
+    sample.generation = PlaybackClock::generation.load(std::memory_order_acquire);
+    ma_sound* sound = PlaybackClock::tracked.load(std::memory_order_acquire);
+    bool atEnd = false;
+    if (sound)
+    {
+        sample.running = ma_sound_is_playing(sound);
+        atEnd = ma_sound_at_end(sound);
+        // The track's time counts what the stretcher has taken, some of which it's still holding back. Once the track
+        // stops, it goes on taking silence, so what it held last while the track played stands until it's reset. At
+        // the end there's nothing more to wait for.
+        if (atEnd)
+            PlaybackClock::held = 0;
+        else if (sample.running)
+            PlaybackClock::held = MusicPlayer::stretcher.heldFrames();
+        uint64_t time = ma_sound_get_time_in_pcm_frames(sound);
+        sample.cursor = time - std::min<uint64_t>(time, PlaybackClock::held);
+    }
+    sample.sampleRate = ma_engine_get_sample_rate(engine);
+    sample.speed = MusicPlayer::stretcher.speed();
+    sample.period = frameCount;
+    sample.timestamp = Clock::now();
+    PlaybackClock::publish(sample);
+    AudioStats::record(begin, sample.timestamp, frameCount, uint32_t(delivered), sample, atEnd);
+}
+void PlaybackClock::publish(const Sample& sample)
+{
+    uint32_t seq = PlaybackClock::sequence.load(std::memory_order_relaxed);
+    PlaybackClock::sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    PlaybackClock::cursor.store(sample.cursor, std::memory_order_relaxed);
+    PlaybackClock::sampleRate.store(sample.sampleRate, std::memory_order_relaxed);
+    PlaybackClock::speed.store(sample.speed, std::memory_order_relaxed);
+    PlaybackClock::period.store(sample.period, std::memory_order_relaxed);
+    PlaybackClock::running.store(sample.running, std::memory_order_relaxed);
+    PlaybackClock::sampleGeneration.store(sample.generation, std::memory_order_relaxed);
+    PlaybackClock::timestamp.store(sample.timestamp.time_since_epoch().count(), std::memory_order_relaxed);
+    PlaybackClock::sequence.store(seq + 2, std::memory_order_release);
+}
+void PlaybackClock::track(ma_sound* sound)
+{
+    PlaybackClock::tracked.store(sound, std::memory_order_release);
+    PlaybackClock::generation.fetch_add(1, std::memory_order_acq_rel);
+    // Nothing this tick should go on acting on the previous track's position.
+    PlaybackClock::latched = Frame();
+}
+
+PlaybackClock::Sample PlaybackClock::read()
+{
+    Sample sample;
+    uint32_t before, after;
+    do
+    {
+        before = PlaybackClock::sequence.load(std::memory_order_acquire);
+        sample.cursor = PlaybackClock::cursor.load(std::memory_order_relaxed);
+        sample.sampleRate = PlaybackClock::sampleRate.load(std::memory_order_relaxed);
+        sample.speed = PlaybackClock::speed.load(std::memory_order_relaxed);
+        sample.period = PlaybackClock::period.load(std::memory_order_relaxed);
+        sample.running = PlaybackClock::running.load(std::memory_order_relaxed);
+        sample.generation = PlaybackClock::sampleGeneration.load(std::memory_order_relaxed);
+        sample.timestamp = Clock::time_point(Clock::duration(PlaybackClock::timestamp.load(std::memory_order_relaxed)));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = PlaybackClock::sequence.load(std::memory_order_relaxed);
+    }
+    while ((before & 1) || before != after);
+    return sample;
+}
+void PlaybackClock::latch()
+{
+    Sample sample = PlaybackClock::read();
+    Frame& frame = PlaybackClock::latched;
+    if (sample.generation != PlaybackClock::generation.load(std::memory_order_acquire) || !sample.sampleRate)
+    {
+        frame = Frame();
+        return;
+    }
+
+    // The callback mixed up to `cursor`, and the track has kept advancing at the device rate times its speed since.
+    // Past one period the next callback is late, and running ahead of it would only have to be taken back.
+    double ahead = 0.0;
+    if (sample.running)
+    {
+        double elapsed = std::chrono::duration<double>(Clock::now() - sample.timestamp).count();
+        ahead = std::clamp(elapsed * sample.sampleRate, 0.0, (double)sample.period) * sample.speed;
+    }
+    frame.valid = true;
+    frame.cursor = sample.cursor;
+    frame.position = (double)sample.cursor + ahead;
+    frame.sampleRate = sample.sampleRate;
+}
+const PlaybackClock::Frame& PlaybackClock::frame()
+{
+    return PlaybackClock::latched;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// One callback's view.
+struct PlaybackClockSample
+{
+    uint64_t cursor = 0;     // Track frames heard so far, at the engine's rate.
+    uint32_t sampleRate = 0;
+    float speed = 1.0f;      // Track frames per device frame.
+    uint32_t period = 0;     // Frames in the callback.
+    bool running = false;    // Whether the track was advancing.
+    uint64_t generation = 0; // Of the track it was taken from.
+    std::chrono::steady_clock::time_point timestamp;
+};
+// A latched reading.
+struct PlaybackClockFrame
+{
+    bool valid = false;      // False until a callback has seen the current track.
+    uint64_t cursor = 0;     // As published. Decisions about the track's end go by this.
+    double position = 0.0;   // Extrapolated to the latch, in frames. Displays go by this.
+    uint32_t sampleRate = 0;
+
+    inline double seconds() const
+    {
+        return this->sampleRate ? this->position / this->sampleRate : 0.0;
+    }
+};
+
+// Where the current track is, as of the last audio callback. The device callback publishes the cursor after every mix
+// through a seqlock, so the audio thread never waits and readers never see half of one callback and half of the next.
+// The control thread latches it once per tick, and everything drawn or decided that tick uses that one reading,
+// extrapolated to when it was taken.
+struct PlaybackClock
+{
+    PlaybackClock() = delete;
+
+    using Clock = std::chrono::steady_clock;
+    using Sample = PlaybackClockSample;
+    using Frame = PlaybackClockFrame;
+
+    // Installed as the engine's device data callback.
+    static void dataCallback(ma_device* device, void* framesOut, const void* framesIn, ma_uint32 frameCount);
+    // The same, for an engine without a device, from whatever paces it.
+    static void mix(ma_engine* engine, void* framesOut, ma_uint32 frameCount);
+    // Control thread. Which sound the callback follows, or nullptr before it's uninitialized. Readings of the previous
+    // one are discarded from then on, including the one latched this tick.
+    static void track(ma_sound* sound);
+
+    // Any thread.
+    static Sample read();
+    // Control thread, once per tick, after commands have run.
+    static void latch();
+    static const Frame& frame();
+private:
+    static void publish(const Sample& sample);
+
+    inline static std::atomic<ma_sound*> tracked { nullptr };
+    inline static std::atomic<uint64_t> generation { 0 };
+
+    // Written only by the audio thread. Odd while a write is in progress.
+    inline static std::atomic<uint32_t> sequence { 0 };
+    inline static std::atomic<uint64_t> cursor { 0 };
+    inline static std::atomic<uint32_t> sampleRate { 0 };
+    inline static std::atomic<float> speed { 1.0f };
+    inline static std::atomic<uint32_t> period { 0 };
+    inline static std::atomic<bool> running { false };
+    inline static std::atomic<uint64_t> sampleGeneration { 0 };
+    inline static std::atomic<int64_t> timestamp { 0 };
+
+    inline static Frame latched;
+    // Audio thread. What the stretcher held back the last time the track was playing.
+    inline static uint32_t held = 0;
+};
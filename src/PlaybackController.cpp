@@ -0,0 +1,127 @@
+#include "PlaybackController.h"
+
+#include <iterator>
+
+#include <SeekScheduler.h>
+
+void PlaybackController::post(PlaybackCommand command)
+{
+    PlaybackController::commands.enqueue(std::move(command));
+}
+std::shared_ptr<const PlaybackState> PlaybackController::state()
+{
+    return PlaybackController::current.load(std::memory_order_acquire);
+}
+
+void PlaybackController::drain()
+{
+    PlaybackCommand command;
+    while (PlaybackController::commands.try_dequeue(command))
+        PlaybackController::execute(command);
+    PlaybackController::publishIfChanged();
+}
+void PlaybackController::execute(PlaybackCommand& command)
+{
+    switch (command.type)
+    {
+    case PlaybackCommandType::Play:
+        if (MusicPlayer::playing)
+            MusicPlayer::stopMusic();
+        MusicPlayer::startMusic(command.query);
+        break;
+    case PlaybackCommandType::Resume:
+        if (MusicPlayer::playing)
+            MusicPlayer::musicResume();
+        else if (MusicPlayer::loading)
+            MusicPlayer::paused = false; // Starts playing once loaded.
+        break;
+    case PlaybackCommandType::Pause:
+        if (MusicPlayer::playing)
+            MusicPlayer::musicPause();
+        else if (MusicPlayer::loading)
+            MusicPlayer::paused = true;
+        break;
+    case PlaybackCommandType::Toggle:
+        if (MusicPlayer::playing)
+        {
+            if (MusicPlayer::paused)
+                MusicPlayer::musicResume();
+            else MusicPlayer::musicPause();
+        }
+        else if (MusicPlayer::loading)
+            MusicPlayer::paused = !MusicPlayer::paused;
+        break;
+    case PlaybackCommandType::Stop:
+        if (MusicPlayer::playing || MusicPlayer::loading)
+            MusicPlayer::stopMusic();
+        break;
+    case PlaybackCommandType::Seek:
+    case PlaybackCommandType::Scrub:
+        // The track may have changed since the command was posted.
+        if (MusicPlayer::playing && command.frame <= MusicPlayer::frameLen)
+            SeekScheduler::request(command.frame, command.type == PlaybackCommandType::Scrub);
+        break;
+    case PlaybackCommandType::EndScrub:
+        SeekScheduler::endScrub();
+        break;
+    case PlaybackCommandType::Volume:
+        ma_engine_set_volume(&MusicPlayer::engine, command.value);
+        break;
+    case PlaybackCommandType::Speed:
+        MusicPlayer::stretcher.setSpeed(command.value);
+        break;
+    case PlaybackCommandType::Next:
+        MusicPlayer::next();
+        break;
+    case PlaybackCommandType::Previous:
+        MusicPlayer::previous(command.fromStart);
+        break;
+    case PlaybackCommandType::PlayQueued:
+        {
+            // The queue may have been edited since the command was posted.
+            if (command.index >= MusicPlayer::queue.size())
+                break;
+            auto pos = std::next(MusicPlayer::queue.begin(), command.index);
+            if (pos == MusicPlayer::queuePos && (MusicPlayer::playing || MusicPlayer::loading))
+                break;
+            bool wasPaused = MusicPlayer::paused;
+            if (MusicPlayer::playing)
+                MusicPlayer::stopMusic();
+            MusicPlayer::queuePos = pos;
+            MusicPlayer::tryPlayNextQueued(wasPaused);
+        }
+        break;
+    }
+}
+void PlaybackController::publishIfChanged()
+{
+    // Playlist edits and the end-of-track handling still change MusicPlayer directly on this thread, so rather than
+    // trusting commands to say what changed, compare.
+    std::shared_ptr<const PlaybackState> last = PlaybackController::current.load(std::memory_order_relaxed);
+    size_t queueIndex = MusicPlayer::queuePos == MusicPlayer::queue.end() ? 0 : size_t(std::distance(MusicPlayer::queue.begin(), MusicPlayer::queuePos)) + 1;
+    float volume = ma_engine_get_volume(&MusicPlayer::engine), speed = MusicPlayer::stretcher.speed();
+    if (last->playing == MusicPlayer::playing && last->paused == MusicPlayer::paused && last->loading == MusicPlayer::loading && last->file == MusicPlayer::musicFile &&
+        last->name == MusicPlayer::musicName && last->frameLength == MusicPlayer::frameLen &&
+        last->trimBegin == MusicPlayer::trimBegin && last->trimEnd == MusicPlayer::trimEnd && last->volume == volume && last->speed == speed &&
+        last->type == MusicPlayer::type && last->loop == MusicPlayer::loop && last->queueIndex == queueIndex)
+        return;
+
+    auto next = std::make_shared<PlaybackState>();
+    next->playing = MusicPlayer::playing;
+    next->paused = MusicPlayer::paused;
+    next->loading = MusicPlayer::loading;
+    next->name = MusicPlayer::musicName;
+    next->file = MusicPlayer::musicFile;
+    next->frameLength = MusicPlayer::frameLen;
+    next->seconds = MusicPlayer::musicLen;
+    next->sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine);
+    next->trimBegin = MusicPlayer::trimBegin;
+    next->trimEnd = MusicPlayer::trimEnd;
+    next->volume = volume;
+    next->speed = speed;
+    next->type = MusicPlayer::type;
+    next->loop = MusicPlayer::loop;
+    next->queueIndex = queueIndex;
+    next->version = last->version + 1;
+    PlaybackController::current.store(std::move(next), std::memory_order_release);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <concurrentqueue.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <MusicPlayer.h>
+
+namespace fs = std::filesystem;
+
+enum class PlaybackCommandType
+{
+    Play,     // `query`
+    Resume,
+    Pause,
+    Toggle,   // Pause if playing, resume if paused.
+    Stop,
+    Seek,     // `frame`
+    Scrub,    // `frame`, while the progress bar is dragged.
+    EndScrub,
+    Volume,   // `value`, linear.
+    Speed,    // `value`, as a multiple of the track's own, without changing its pitch.
+    Next,
+    Previous, // `fromStart`
+    PlayQueued // `index`, from the start of the queue.
+};
+
+struct PlaybackCommand
+{
+    PlaybackCommandType type;
+    uint64_t frame = 0;
+    float value = 0.0f;
+    std::u32string query;
+    bool fromStart = false;
+    size_t index = 0;
+};
+
+// What readers on any thread may know about playback, as of the last drain.
+struct PlaybackState
+{
+    bool playing = false;
+    bool paused = false;
+    bool loading = false; // `name` is opening in the background, and hasn't replaced what played before yet.
+    std::u32string name;
+    fs::path file;
+    uint64_t frameLength = 0;
+    float seconds = 0.0f;
+    uint32_t sampleRate = 0;
+    float trimBegin = 0.0f, trimEnd = 1.0f; // What part of the file plays, as fractions of it.
+    float volume = 1.0f;
+    float speed = 1.0f;
+    PlaylistType type = PlaylistType::Sequential;
+    bool loop = false;
+    size_t queueIndex = 0; // 1-based, 0 when not in the queue.
+    uint64_t version = 0;  // Bumped on every publish.
+};
+
+// The only way anything changes playback. Commands from any thread go into a lock-free queue, and the control thread
+// (the UI thread, whose tick is where MusicPlayer is allowed to change) runs them in order at the start of each tick.
+// What it leaves behind is published as an immutable snapshot, swapped in atomically.
+struct PlaybackController
+{
+    PlaybackController() = delete;
+
+    // Any thread.
+    static void post(PlaybackCommand command);
+    static std::shared_ptr<const PlaybackState> state();
+
+    // Control thread. Runs every queued command, then publishes the state if it changed, however it changed.
+    static void drain();
+private:
+    static void execute(PlaybackCommand& command);
+    static void publishIfChanged();
+
+    inline static moodycamel::ConcurrentQueue<PlaybackCommand> commands;
+    inline static std::atomic<std::shared_ptr<const PlaybackState>> current { std::make_shared<const PlaybackState>() };
+};
@@ -0,0 +1,356 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <numbers>
+#include <tuple>
+
+#include <Simd.h>
+
+namespace
+{
+    struct Preset
+    {
+        uint32_t taps;
+        uint32_t phases;
+        double beta;    // Kaiser window shape, roughly stopband attenuation in dB / 10 past 50 dB.
+        double rolloff; // Passband edge, as a fraction of the lower Nyquist frequency.
+    };
+    Preset preset(ResamplerQuality quality)
+    {
+        switch (quality)
+        {
+        case ResamplerQuality::Fast:
+            return Preset { 16, 128, 6.0, 0.86 };
+        case ResamplerQuality::Best:
+            return Preset { 64, 1024, 12.0, 0.945 };
+        case ResamplerQuality::Balanced:
+        default:
+            return Preset { 32, 256, 9.0, 0.91 };
+        }
+    }
+
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 64 && term > sum * 1e-17; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    std::mutex banksMutex;
+    std::map<std::tuple<ResamplerQuality, uint32_t, uint32_t>, std::weak_ptr<const SincFilterBank>> banks;
+}
+
+std::shared_ptr<const SincFilterBank> SincFilterBank::get(ResamplerQuality quality, uint32_t sampleRateIn, uint32_t sampleRateOut)
+{
+    uint32_t divisor = std::gcd(sampleRateIn, sampleRateOut);
+    auto key = std::make_tuple(quality, sampleRateIn / divisor, sampleRateOut / divisor);
+    std::lock_guard guard(banksMutex);
+    if (std::shared_ptr<const SincFilterBank> existing = banks[key].lock())
+        return existing;
+
+    Preset p = preset(quality);
+    // Downsampling lowers the cutoff, so the kernel stretches to keep the same transition band relative to it.
+    double ratio = std::min(1.0, double(sampleRateOut) / sampleRateIn);
+    double cutoff = 0.5 * ratio * p.rolloff;
+    uint32_t taps = (uint32_t(std::ceil(p.taps / ratio)) + 3) & ~3u;
+    int32_t half = int32_t(taps / 2);
+
+    auto bank = std::make_shared<SincFilterBank>();
+    bank->taps = taps;
+    bank->phases = p.phases;
+    bank->rows.resize(size_t(p.phases + 1) * taps);
+    bank->deltas.resize(size_t(p.phases + 1) * taps);
+    double windowNorm = besselI0(p.beta);
+    for (uint32_t phase = 0; phase <= p.phases; phase++)
+    {
+        // Tap j weighs input frame (j - (half - 1)) relative to the one just before the output position.
+        double fraction = double(phase) / p.phases, sum = 0.0;
+        float* row = &bank->rows[size_t(phase) * taps];
+        std::vector<double> values(taps);
+        for (uint32_t j = 0; j < taps; j++)
+        {
+            double d = double(int32_t(j) - (half - 1)) - fraction;
+            double u = d / half;
+            double window = std::abs(u) < 1.0 ? besselI0(p.beta * std::sqrt(1.0 - u * u)) / windowNorm : 0.0;
+            double x = 2.0 * cutoff * d;
+            double sinc = x == 0.0 ? 1.0 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+            values[j] = 2.0 * cutoff * sinc * window;
+            sum += values[j];
+        }
+        // Unity gain at DC on every phase, or the ripple between phases becomes a tone at the rate difference.
+        for (uint32_t j = 0; j < taps; j++)
+            row[j] = float(values[j] / sum);
+    }
+    for (uint32_t phase = 0; phase < p.phases; phase++)
+        for (uint32_t j = 0; j < taps; j++)
+            bank->deltas[size_t(phase) * taps + j] = bank->rows[size_t(phase + 1) * taps + j] - bank->rows[size_t(phase) * taps + j];
+
+    banks[key] = bank;
+    return bank;
+}
+
+SincResampler::SincResampler(uint32_t channels, uint32_t sampleRateIn, uint32_t sampleRateOut, ResamplerQuality quality) :
+bank(SincFilterBank::get(quality, sampleRateIn, sampleRateOut)), channels(channels)
+{
+    uint32_t divisor = std::gcd(sampleRateIn, sampleRateOut);
+    this->step = sampleRateIn / divisor;
+    this->denominator = sampleRateOut / divisor;
+    this->phaseScale = double(this->bank->phases) / this->denominator;
+    this->capacity = this->bank->taps + 1024;
+    this->history.assign(size_t(this->capacity) * channels, 0.0f);
+    this->coefficients.assign(this->bank->taps, 0.0f);
+    this->reset();
+}
+
+void SincResampler::reset(uint32_t fraction, uint32_t primingFrames)
+{
+    this->filled = std::min(primingFrames == ~0u ? this->bank->taps / 2 - 1 : primingFrames, this->capacity);
+    for (uint32_t c = 0; c < this->channels; c++)
+        std::fill_n(&this->history[size_t(c) * this->capacity], this->filled, 0.0f);
+    this->start = 0;
+    this->accumulator = fraction;
+}
+
+void SincResampler::process(const float* in, uint64_t& frameCountIn, float* out, uint64_t& frameCountOut)
+{
+    const uint32_t taps = this->bank->taps, channels = this->channels;
+    const float* rows = this->bank->rows.data();
+    const float* deltas = this->bank->deltas.data();
+    float* coefficients = this->coefficients.data();
+    uint64_t consumed = 0, produced = 0;
+
+    while (true)
+    {
+        while (produced < frameCountOut && this->start + taps <= this->filled)
+        {
+            double position = this->accumulator * this->phaseScale;
+            uint32_t phase = uint32_t(position);
+            f32x4 fraction = f32x4::splat(float(position - phase));
+            const float* row = rows + size_t(phase) * taps;
+            const float* delta = deltas + size_t(phase) * taps;
+            for (uint32_t j = 0; j < taps; j += 4)
+                f32x4::mulAdd(f32x4::load(delta + j), fraction, f32x4::load(row + j)).store(coefficients + j);
+
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                const float* x = &this->history[size_t(c) * this->capacity + this->start];
+                f32x4 acc0 = f32x4::zero(), acc1 = f32x4::zero();
+                uint32_t j = 0;
+                for (; j + 8 <= taps; j += 8)
+                {
+                    acc0 = f32x4::mulAdd(f32x4::load(coefficients + j), f32x4::load(x + j), acc0);
+                    acc1 = f32x4::mulAdd(f32x4::load(coefficients + j + 4), f32x4::load(x + j + 4), acc1);
+                }
+                if (j < taps)
+                    acc0 = f32x4::mulAdd(f32x4::load(coefficients + j), f32x4::load(x + j), acc0);
+                out[produced * channels + c] = (acc0 + acc1).sum();
+            }
+            produced++;
+
+            this->accumulator += this->step;
+            this->start += this->accumulator / this->denominator;
+            this->accumulator %= this->denominator;
+        }
+        if (produced == frameCountOut || consumed == frameCountIn)
+            break;
+
+        // Slide what's still needed to the front, then top up from the input.
+        if (this->start > 0)
+        {
+            uint32_t keep = this->filled > this->start ? this->filled - this->start : 0;
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                float* h = &this->history[size_t(c) * this->capacity];
+                std::copy(h + this->start, h + this->start + keep, h);
+            }
+            this->start -= this->filled - keep;
+            this->filled = keep;
+        }
+        uint32_t take = uint32_t(std::min<uint64_t>(frameCountIn - consumed, this->capacity - this->filled));
+        const float* src = in + consumed * channels;
+        for (uint32_t c = 0; c < channels; c++)
+        {
+            float* h = &this->history[size_t(c) * this->capacity + this->filled];
+            for (uint32_t i = 0; i < take; i++)
+                h[i] = src[size_t(i) * channels + c];
+        }
+        this->filled += take;
+        consumed += take;
+    }
+
+    frameCountIn = consumed;
+    frameCountOut = produced;
+}
+
+ResampledSource::~ResampledSource()
+{
+    this->uninit();
+}
+
+ma_result ResampledSource::init(const void* data, size_t size, uint32_t sampleRateOut, ResamplerQuality quality)
+{
+    ma_decoder_config decoderConfig = ma_decoder_config_init(ma_format_f32, 0, 0);
+    if (ma_result result = ma_decoder_init_memory(data, size, &decoderConfig, &this->decoder); result != MA_SUCCESS)
+        return result;
+    this->decoderInitialized = true;
+    return this->init(&this->decoder, sampleRateOut, quality);
+}
+ma_result ResampledSource::init(ma_data_source* input, uint32_t sampleRateOut, ResamplerQuality quality)
+{
+    this->input = input;
+    ma_format format;
+    if (ma_result result = ma_data_source_get_data_format(input, &format, &this->channels, &this->sampleRateIn, nullptr, 0); result != MA_SUCCESS)
+        return result;
+    if (format != ma_format_f32 || this->channels == 0 || this->sampleRateIn == 0)
+        return MA_INVALID_DATA;
+    this->sampleRateOut = sampleRateOut;
+    this->resampler = SincResampler(this->channels, this->sampleRateIn, sampleRateOut, quality);
+    this->pending.assign(size_t(1024) * this->channels, 0.0f);
+    ma_uint64 nativeLength = 0;
+    if (ma_data_source_get_length_in_pcm_frames(input, &nativeLength) == MA_SUCCESS)
+        this->length = (nativeLength * this->resampler.rateDenominator() + this->resampler.rateStep() - 1) / this->resampler.rateStep();
+
+    static ma_data_source_vtable vtable
+    {
+        .onRead = ResampledSource::onRead,
+        .onSeek = ResampledSource::onSeek,
+        .onGetDataFormat = ResampledSource::onGetDataFormat,
+        .onGetCursor = ResampledSource::onGetCursor,
+        .onGetLength = ResampledSource::onGetLength,
+        .onSetLooping = nullptr,
+        .flags = 0
+    };
+    ma_data_source_config config = ma_data_source_config_init();
+    config.vtable = &vtable;
+    if (ma_result result = ma_data_source_init(&config, &this->base); result != MA_SUCCESS)
+        return result;
+    this->sourceInitialized = true;
+    return this->seek(0);
+}
+void ResampledSource::uninit()
+{
+    if (this->sourceInitialized)
+    {
+        ma_data_source_uninit(&this->base);
+        this->sourceInitialized = false;
+    }
+    if (this->decoderInitialized)
+    {
+        ma_decoder_uninit(&this->decoder);
+        this->decoderInitialized = false;
+    }
+    this->input = nullptr;
+}
+
+ma_result ResampledSource::read(float* out, uint64_t frameCount, uint64_t& framesRead)
+{
+    const uint32_t chunkFrames = uint32_t(this->pending.size() / this->channels);
+    framesRead = 0;
+    while (framesRead < frameCount)
+    {
+        if (this->pendingFrames == 0)
+        {
+            this->pendingOffset = 0;
+            if (!this->inputEnded)
+            {
+                ma_uint64 read = 0;
+                ma_result result = ma_data_source_read_pcm_frames(this->input, this->pending.data(), chunkFrames, &read);
+                this->pendingFrames = uint32_t(read);
+                this->inputFed += read;
+                if (result != MA_SUCCESS || read < chunkFrames)
+                {
+                    // Every output frame up to the last input frame's position, rounded up, is still owed.
+                    this->inputEnded = true;
+                    uint64_t step = this->resampler.rateStep(), denominator = this->resampler.rateDenominator();
+                    this->endFrame = (this->inputFed * denominator + step - 1) / step;
+                }
+            }
+            else
+            {
+                // Silence past the end, to flush the filter's lookahead.
+                std::fill(this->pending.begin(), this->pending.end(), 0.0f);
+                this->pendingFrames = chunkFrames;
+            }
+        }
+
+        uint64_t want = frameCount - framesRead;
+        if (this->inputEnded)
+            want = std::min(want, this->endFrame > this->cursor ? this->endFrame - this->cursor : 0);
+        if (want == 0)
+            break;
+
+        uint64_t in = this->pendingFrames, produced = want;
+        this->resampler.process(this->pending.data() + size_t(this->pendingOffset) * this->channels, in, out + framesRead * this->channels, produced);
+        this->pendingOffset += uint32_t(in);
+        this->pendingFrames -= uint32_t(in);
+        framesRead += produced;
+        this->cursor += produced;
+    }
+    return framesRead == 0 && frameCount > 0 ? MA_AT_END : MA_SUCCESS;
+}
+ma_result ResampledSource::seek(uint64_t frame)
+{
+    // Output frame n is at input time n * step / denominator. Decode a little before that so the filter starts warm.
+    uint64_t step = this->resampler.rateStep(), denominator = this->resampler.rateDenominator();
+    uint64_t position = frame * step;
+    uint64_t inputFrame = position / denominator;
+    uint64_t lead = std::min<uint64_t>(inputFrame, this->resampler.taps() / 2 - 1);
+    if (ma_result result = ma_data_source_seek_to_pcm_frame(this->input, inputFrame - lead); result != MA_SUCCESS)
+        return result;
+
+    this->resampler.reset(uint32_t(position % denominator), uint32_t(this->resampler.taps() / 2 - 1 - lead));
+    this->pendingOffset = this->pendingFrames = 0;
+    this->cursor = frame;
+    this->inputFed = inputFrame - lead;
+    this->inputEnded = false;
+    this->endFrame = 0;
+    return MA_SUCCESS;
+}
+
+ma_result ResampledSource::onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    uint64_t read = 0;
+    ma_result result = static_cast<ResampledSource*>(pDataSource)->read(static_cast<float*>(pFramesOut), frameCount, read);
+    if (pFramesRead)
+        *pFramesRead = read;
+    return result;
+}
+ma_result ResampledSource::onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+{
+    return static_cast<ResampledSource*>(pDataSource)->seek(frameIndex);
+}
+ma_result ResampledSource::onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+{
+    ResampledSource* self = static_cast<ResampledSource*>(pDataSource);
+    if (pFormat)
+        *pFormat = ma_format_f32;
+    if (pChannels)
+        *pChannels = self->channels;
+    if (pSampleRate)
+        *pSampleRate = self->sampleRateOut;
+    if (pChannelMap)
+    {
+        ma_format format;
+        ma_uint32 channels, sampleRate;
+        ma_data_source_get_data_format(self->input, &format, &channels, &sampleRate, pChannelMap, channelMapCap);
+    }
+    return MA_SUCCESS;
+}
+ma_result ResampledSource::onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+{
+    *pCursor = static_cast<ResampledSource*>(pDataSource)->cursor;
+    return MA_SUCCESS;
+}
+ma_result ResampledSource::onGetLength(ma_data_source* pDataSource, ma_uint64* pLength)
+{
+    *pLength = static_cast<ResampledSource*>(pDataSource)->length;
+    return MA_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class ResamplerQuality
+{
+    // miniaudio's own linear resampler, through the resource manager.
+    Linear,
+    Fast,
+    Balanced,
+    Best
+};
+
+// Windowed-sinc (Kaiser) prototype, sampled at `phases` offsets per input sample so that any output position is a blend
+// of two neighbouring rows. Rows are padded to a multiple of four taps.
+struct SincFilterBank
+{
+    uint32_t taps = 0;
+    uint32_t phases = 0;
+    // (phases + 1) rows of `taps`, and the difference from each row to the next.
+    std::vector<float> rows, deltas;
+
+    // Shared between resamplers of the same quality and ratio.
+    static std::shared_ptr<const SincFilterBank> get(ResamplerQuality quality, uint32_t sampleRateIn, uint32_t sampleRateOut);
+};
+
+// Polyphase resampler over interleaved f32. Output frame n sits exactly at input time n * rateIn / rateOut, so there's
+// no delay to account for, but producing it takes half the filter's taps of lookahead.
+class SincResampler
+{
+    std::shared_ptr<const SincFilterBank> bank;
+    uint32_t channels = 0;
+    uint32_t step = 0, denominator = 1;
+    double phaseScale = 0.0;
+
+    // Per channel, `capacity` frames of deinterleaved input. The window of the next output starts at `start`.
+    std::vector<float> history;
+    std::vector<float> coefficients;
+    uint32_t capacity = 0;
+    uint32_t filled = 0, start = 0;
+    uint32_t accumulator = 0;
+public:
+    SincResampler() = default;
+    SincResampler(uint32_t channels, uint32_t sampleRateIn, uint32_t sampleRateOut, ResamplerQuality quality);
+
+    inline uint32_t taps() const
+    {
+        return this->bank ? this->bank->taps : 0;
+    }
+
+    // Starts over, `fraction` / rateDenominator() of an input frame past the first frame fed next, with `primingFrames` of
+    // silence before it. The default of taps() / 2 - 1 frames lines the first output up with the first input frame.
+    void reset(uint32_t fraction = 0, uint32_t primingFrames = ~0u);
+    // Input frames advanced per output frame are rateStep() / rateDenominator(), in lowest terms.
+    inline uint32_t rateStep() const
+    {
+        return this->step;
+    }
+    inline uint32_t rateDenominator() const
+    {
+        return this->denominator;
+    }
+    // Consumes up to `frameCountIn` and produces up to `frameCountOut`, updating both to what was actually done.
+    void process(const float* in, uint64_t& frameCountIn, float* out, uint64_t& frameCountOut);
+};
+
+// A decoder, at the file's own rate, resampled by SincResampler to a fixed output rate. Stands in for the resource
+// manager as the data source of a sound, so miniaudio's linear resampler never runs. Seeks are sample accurate.
+class ResampledSource
+{
+    ma_data_source_base base; // Must stay the first member, miniaudio reinterprets ma_data_source* as ma_data_source_base*.
+    bool sourceInitialized = false;
+    // What's resampled: either `decoder`, or a source the caller owns.
+    ma_data_source* input = nullptr;
+    ma_decoder decoder;
+    bool decoderInitialized = false;
+
+    SincResampler resampler;
+    uint32_t channels = 0;
+    uint32_t sampleRateIn = 0, sampleRateOut = 0;
+
+    std::vector<float> pending;
+    uint32_t pendingOffset = 0, pendingFrames = 0;
+    uint64_t cursor = 0;     // Output frames.
+    uint64_t inputFed = 0;   // Absolute input frames handed to the resampler.
+    bool inputEnded = false;
+    uint64_t endFrame = 0;   // Output frame count once the input has ended.
+    uint64_t length = 0;     // Output frames, measured up front: the input isn't safe to query while it's playing.
+
+    static ma_result onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead);
+    static ma_result onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex);
+    static ma_result onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap);
+    static ma_result onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor);
+    static ma_result onGetLength(ma_data_source* pDataSource, ma_uint64* pLength);
+
+    ma_result read(float* out, uint64_t frameCount, uint64_t& framesRead);
+    ma_result seek(uint64_t frame);
+public:
+    ResampledSource() = default;
+    ResampledSource(const ResampledSource&) = delete;
+    ~ResampledSource();
+
+    // Decodes from `data`, which must outlive the source.
+    ma_result init(const void* data, size_t size, uint32_t sampleRateOut, ResamplerQuality quality);
+    // Resamples `input`, which must produce f32 and outlive the source.
+    ma_result init(ma_data_source* input, uint32_t sampleRateOut, ResamplerQuality quality);
+    void uninit();
+
+    inline ma_data_source* dataSource()
+    {
+        return &this->base;
+    }
+    inline uint32_t nativeSampleRate() const
+    {
+        return this->sampleRateIn;
+    }
+};
@@ -8,6 +8,9 @@
 #include <InteractableProgressBar.h>
 #include <MusicPlayer.h>
 #include <NanoVGContext.h>
+#include <PlaybackClock.h>
+#include <PlaybackController.h>
+#include <Waveforms.h>
 
 #define RUNNING_TIME_TEXT_PADDING_Y 4.0f
 #define RUNNING_TIME_SPACING_AROUND_DIVIDER 10.0f
@@ -37,9 +40,22 @@ class RunningTime : public ComponentData2D
         {
             EngineEvent::OnTick += []
             {
-                EntityManager2D::foreachEntityWithAll<RunningTime>([](Entity2D* entity, RunningTime* runningTime)
+                auto state = PlaybackController::state();
+                // Read once, so the text and the bar agree.
+                float seconds = std::min((float)PlaybackClock::frame().seconds(), state->seconds);
+                // Looked up again when the track changes, or when an overview may have been built for it since.
+                static uint64_t waveformVersion = UINT64_MAX;
+                static uint32_t waveformsFinished = UINT32_MAX;
+                static std::shared_ptr<const TrackWaveform> waveform;
+                if (state->version != waveformVersion || (!waveform && Waveforms::finished.load(std::memory_order_relaxed) != waveformsFinished))
                 {
-                    if (MusicPlayer::playing)
+                    waveformVersion = state->version;
+                    waveformsFinished = Waveforms::finished.load(std::memory_order_relaxed);
+                    waveform = state->playing ? Waveforms::find(state->file) : nullptr;
+                }
+                EntityManager2D::foreachEntityWithAll<RunningTime>([&](Entity2D* entity, RunningTime* runningTime)
+                {
+                    if (state->playing)
                     {
                         constexpr auto sdFloat = [](float val, std::streamsize prec = 1) -> std::u32string
                         {
@@ -52,14 +68,17 @@ class RunningTime : public ComponentData2D
                             return ret;
                         };
 
-                        runningTime->runtime->text = sdFloat((float)ma_sound_get_time_in_pcm_frames(&MusicPlayer::music) / (float)ma_engine_get_sample_rate(&MusicPlayer::engine));
-                        runningTime->track->progress = (float)ma_sound_get_time_in_pcm_frames(&MusicPlayer::music) / (float)ma_engine_get_sample_rate(&MusicPlayer::engine) / MusicPlayer::musicLen;
+                        runningTime->runtime->text = sdFloat(seconds);
+                        runningTime->track->progress = seconds / state->seconds;
+                        runningTime->track->waveform = waveform;
+                        runningTime->track->waveformBegin = state->trimBegin;
+                        runningTime->track->waveformEnd = state->trimEnd;
 
                         std::u32string totalText;
                         totalText
-                        .append(sdFloat(MusicPlayer::musicLen))
+                        .append(sdFloat(state->seconds))
                         .append(U" (");
-                        if (int32_t mins = (int32_t)MusicPlayer::musicLen / 60; mins > 0)
+                        if (int32_t mins = (int32_t)state->seconds / 60; mins > 0)
                         {
                             std::wstring wminsStr = std::to_wstring(mins);
                             std::u32string minsStr; minsStr.reserve(wminsStr.size());
@@ -69,7 +88,7 @@ class RunningTime : public ComponentData2D
                             .append(minsStr)
                             .append(U"min ");
                         }
-                        std::wstring wsecsStr = std::to_wstring(int32_t(MusicPlayer::musicLen + 0.5f) % 60);
+                        std::wstring wsecsStr = std::to_wstring(int32_t(state->seconds + 0.5f) % 60);
                         std::u32string secsStr; secsStr.reserve(wsecsStr.size());
                         for (auto c : wsecsStr)
                             secsStr.push_back((char32_t)c);
@@ -79,6 +98,13 @@ class RunningTime : public ComponentData2D
 
                         runningTime->total->text = std::move(totalText);
                     }
+                    else if (state->loading)
+                    {
+                        runningTime->runtime->text = U"Loading";
+                        runningTime->track->progress = 0.0f;
+                        runningTime->track->waveform = nullptr;
+                        runningTime->total->text = state->name;
+                    }
                 });
             };
 
@@ -0,0 +1,132 @@
+#include "SeekScheduler.h"
+
+#include <algorithm>
+
+#include <AudioEngine.h>
+#include <MusicPlayer.h>
+
+namespace
+{
+    // How far the track's clock may have run past a target for the seek to count as landed, on top of the time since
+    // it was issued. About a device period.
+    constexpr uint32_t landingSlackMs = 30;
+    // Seeks that haven't shown up by then (the track paused, or was replaced) aren't measured.
+    constexpr uint32_t landingTimeoutMs = 1000;
+
+    double msSince(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+}
+
+void SeekScheduler::request(uint64_t frame, bool scrubbing)
+{
+    ++SeekScheduler::requests;
+    if (SeekScheduler::pending)
+        ++SeekScheduler::coalesced;
+    else SeekScheduler::pendingSince = Clock::now();
+    SeekScheduler::pending = frame;
+    SeekScheduler::scrubbing = scrubbing;
+
+    if (!scrubbing || msSince(SeekScheduler::lastIssue) >= SeekScheduler::intervalMs)
+        SeekScheduler::issue(frame);
+}
+void SeekScheduler::endScrub()
+{
+    SeekScheduler::scrubbing = false;
+    if (SeekScheduler::grainActive)
+    {
+        ma_sound_stop_with_fade_in_milliseconds(&MusicPlayer::music, SeekScheduler::grainFadeMs);
+        SeekScheduler::grainActive = false;
+    }
+    if (SeekScheduler::pending)
+        SeekScheduler::issue(*SeekScheduler::pending);
+}
+void SeekScheduler::issue(uint64_t frame)
+{
+    // Seeks only land, and the position only moves on screen, while the mixer runs, paused or not.
+    AudioEngine::wake();
+    ma_sound_seek_to_pcm_frame(&MusicPlayer::music, frame);
+    MusicPlayer::stretcher.reset();
+    ++SeekScheduler::issued;
+    SeekScheduler::lastIssue = Clock::now();
+
+    ma_uint64 engineTime = ma_engine_get_time_in_pcm_frames(&MusicPlayer::engine);
+    ma_uint32 sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine);
+    // Where the track was says nothing about whether it moved if that's already about where it's going.
+    ma_uint64 from = ma_sound_get_time_in_pcm_frames(&MusicPlayer::music);
+    uint64_t slack = uint64_t(landingSlackMs) * sampleRate / 1000;
+    SeekScheduler::awaiting = from < frame || from > frame + slack;
+    SeekScheduler::awaitTarget = frame;
+    SeekScheduler::awaitEngineTime = engineTime;
+    SeekScheduler::awaitSince = SeekScheduler::pendingSince;
+    SeekScheduler::pending.reset();
+
+    if (SeekScheduler::scrubbing && SeekScheduler::scrubGrains && MusicPlayer::paused)
+    {
+        // Fade in from the new position, and out again once the grain has played. A stop left over from the previous
+        // grain would keep this one silent.
+        ma_sound_set_stop_time_in_pcm_frames(&MusicPlayer::music, ~(ma_uint64)0);
+        ma_sound_set_fade_in_milliseconds(&MusicPlayer::music, 0.0f, 1.0f, SeekScheduler::grainFadeMs);
+        ma_sound_start(&MusicPlayer::music);
+        SeekScheduler::grainActive = true;
+        SeekScheduler::grainEnd = engineTime + uint64_t(SeekScheduler::grainMs) * sampleRate / 1000;
+    }
+}
+void SeekScheduler::tick()
+{
+    if (SeekScheduler::pending && msSince(SeekScheduler::lastIssue) >= SeekScheduler::intervalMs)
+        SeekScheduler::issue(*SeekScheduler::pending);
+
+    ma_uint64 engineTime = ma_engine_get_time_in_pcm_frames(&MusicPlayer::engine);
+    if (SeekScheduler::grainActive && engineTime >= SeekScheduler::grainEnd)
+    {
+        ma_sound_stop_with_fade_in_milliseconds(&MusicPlayer::music, SeekScheduler::grainFadeMs);
+        SeekScheduler::grainActive = false;
+    }
+
+    if (SeekScheduler::awaiting)
+    {
+        ma_uint64 position = ma_sound_get_time_in_pcm_frames(&MusicPlayer::music);
+        uint64_t slack = uint64_t(landingSlackMs) * ma_engine_get_sample_rate(&MusicPlayer::engine) / 1000;
+        // The track runs through the stretcher, so at its speed rather than the engine's.
+        uint64_t ran = uint64_t((engineTime - SeekScheduler::awaitEngineTime) * double(MusicPlayer::stretcher.speed()));
+        double ms = msSince(SeekScheduler::awaitSince);
+        if (position >= SeekScheduler::awaitTarget && position <= SeekScheduler::awaitTarget + ran + slack)
+        {
+            SeekScheduler::awaiting = false;
+            ++SeekScheduler::measured;
+            SeekScheduler::totalMs += ms;
+            SeekScheduler::lastMs = ms;
+            SeekScheduler::peakMs = std::max(SeekScheduler::peakMs, ms);
+        }
+        else if (ms > landingTimeoutMs)
+            SeekScheduler::awaiting = false;
+    }
+}
+void SeekScheduler::cancel()
+{
+    SeekScheduler::pending.reset();
+    SeekScheduler::scrubbing = false;
+    SeekScheduler::grainActive = false;
+    SeekScheduler::awaiting = false;
+}
+
+SeekScheduler::Stats SeekScheduler::stats()
+{
+    return Stats
+    {
+        .requests = SeekScheduler::requests,
+        .issued = SeekScheduler::issued,
+        .coalesced = SeekScheduler::coalesced,
+        .measured = SeekScheduler::measured,
+        .averageMs = SeekScheduler::measured ? SeekScheduler::totalMs / SeekScheduler::measured : 0.0,
+        .lastMs = SeekScheduler::lastMs,
+        .peakMs = SeekScheduler::peakMs
+    };
+}
+void SeekScheduler::resetStats()
+{
+    SeekScheduler::requests = SeekScheduler::issued = SeekScheduler::coalesced = SeekScheduler::measured = 0;
+    SeekScheduler::totalMs = SeekScheduler::lastMs = SeekScheduler::peakMs = 0.0;
+}
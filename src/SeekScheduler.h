@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Every seek of the current track goes through here. A seek is carried out by the audio thread on its next period, and
+// on some decoders it's the most expensive thing that thread does, so dragging the progress bar mustn't turn every mouse
+// move into one. Requests are coalesced to the latest target, and while scrubbing, real seeks are spaced at least
+// `intervalMs` apart. The last target always lands once the drag ends. Scrubbing a paused track plays a short grain of
+// each position that lands.
+// UI thread only.
+struct SeekScheduler
+{
+    SeekScheduler() = delete;
+
+    inline static uint32_t intervalMs = 40;
+    inline static bool scrubGrains = true;
+    inline static uint32_t grainMs = 80;
+    inline static uint32_t grainFadeMs = 6;
+
+    // Asks for the current track to be at `frame`, replacing any target not yet issued. While `scrubbing`, it's issued
+    // once the interval since the last seek has passed; otherwise right away.
+    static void request(uint64_t frame, bool scrubbing = false);
+    // The drag is over: issues whatever's pending now and silences any grain.
+    static void endScrub();
+    // Issues due seeks, ends grains and tracks when seeks become audible. Call every tick.
+    static void tick();
+    // Forgets pending work, for when the track goes away.
+    static void cancel();
+
+    struct Stats
+    {
+        uint64_t requests, issued, coalesced, measured;
+        // From the first request a seek stands for until its position is heard, at tick resolution.
+        double averageMs, lastMs, peakMs;
+    };
+    static Stats stats();
+    static void resetStats();
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static void issue(uint64_t frame);
+
+    inline static std::optional<uint64_t> pending;
+    inline static Clock::time_point pendingSince;
+    inline static Clock::time_point lastIssue;
+    inline static bool scrubbing = false;
+
+    // The grain playing, if any: it fades out once the engine clock reaches `grainEnd`.
+    inline static bool grainActive = false;
+    inline static uint64_t grainEnd = 0;
+
+    // The last issued seek, until the track's clock shows it landed.
+    inline static bool awaiting = false;
+    inline static uint64_t awaitTarget = 0;
+    inline static uint64_t awaitEngineTime = 0;
+    inline static Clock::time_point awaitSince;
+
+    inline static uint64_t requests = 0, issued = 0, coalesced = 0, measured = 0;
+    inline static double totalMs = 0.0, lastMs = 0.0, peakMs = 0.0;
+};
@@ -0,0 +1,297 @@
+#if _WIN32
+#define NOMINMAX 1
+#include <windows.h>
+#endif
+
+// miniaudio's MP3 decoder and its seek table API are only declared inside the implementation, so this is the file that
+// compiles it.
+#define MINIAUDIO_IMPLEMENTATION
+#include "SeekTables.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+#include <JobPool.h>
+#include <MappedFileVFS.h>
+
+namespace
+{
+    // dr_mp3 over a mapping through callbacks rather than ma_dr_mp3_init_memory, which doesn't track the byte
+    // positions seek tables are made of. Reading stops short once `stop` trips, which looks like the end of the file.
+    struct MemoryStream
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t position = 0;
+        std::stop_token stop;
+
+        static size_t onRead(void* pUserData, void* pBufferOut, size_t bytesToRead)
+        {
+            MemoryStream* self = static_cast<MemoryStream*>(pUserData);
+            if (self->stop.stop_requested())
+                return 0;
+            size_t count = std::min(bytesToRead, self->size - self->position);
+            std::copy_n(self->data + self->position, count, static_cast<uint8_t*>(pBufferOut));
+            self->position += count;
+            return count;
+        }
+        static ma_bool32 onSeek(void* pUserData, int offset, ma_dr_mp3_seek_origin origin)
+        {
+            MemoryStream* self = static_cast<MemoryStream*>(pUserData);
+            int64_t target = (origin == ma_dr_mp3_seek_origin_current ? int64_t(self->position) : 0) + offset;
+            if (target < 0 || uint64_t(target) > self->size)
+                return MA_FALSE;
+            self->position = size_t(target);
+            return MA_TRUE;
+        }
+    };
+
+    void putVarint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(uint8_t(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(uint8_t(value));
+    }
+    bool getVarint(const uint8_t*& cur, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for (uint32_t shift = 0; cur != end && shift < 64; shift += 7)
+        {
+            uint8_t byte = *cur++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // Points go in order, so positions are stored as the difference from the previous point: a couple of bytes each.
+    std::vector<uint8_t> encode(const std::vector<ma_dr_mp3_seek_point>& points)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(points.size() * 7);
+        ma_uint64 bytes = 0, frame = 0;
+        for (const ma_dr_mp3_seek_point& point : points)
+        {
+            putVarint(out, point.seekPosInBytes - bytes);
+            putVarint(out, point.pcmFrameIndex - frame);
+            putVarint(out, point.mp3FramesToDiscard);
+            putVarint(out, point.pcmFramesToDiscard);
+            bytes = point.seekPosInBytes;
+            frame = point.pcmFrameIndex;
+        }
+        return out;
+    }
+    bool decode(const TrackSeekTable& table, std::vector<ma_dr_mp3_seek_point>& points)
+    {
+        points.resize(table.pointCount);
+        const uint8_t* cur = table.points.data();
+        const uint8_t* end = cur + table.points.size();
+        ma_uint64 bytes = 0, frame = 0;
+        for (ma_dr_mp3_seek_point& point : points)
+        {
+            uint64_t bytesDelta, frameDelta, mp3Discard, pcmDiscard;
+            if (!getVarint(cur, end, bytesDelta) || !getVarint(cur, end, frameDelta) || !getVarint(cur, end, mp3Discard) ||
+                !getVarint(cur, end, pcmDiscard))
+                return false;
+            bytes += bytesDelta;
+            frame += frameDelta;
+            point.seekPosInBytes = bytes;
+            point.pcmFrameIndex = frame;
+            point.mp3FramesToDiscard = ma_uint16(mp3Discard);
+            point.pcmFramesToDiscard = ma_uint16(pcmDiscard);
+        }
+        return true;
+    }
+}
+
+bool SeekTables::applies(const fs::path& file)
+{
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+    return extension == ".mp3";
+}
+std::optional<TrackSeekTable> SeekTables::buildFile(const fs::path& file, std::stop_token stop)
+{
+    if (!SeekTables::applies(file))
+        return std::nullopt;
+    FileMapping mapping(file);
+    if (!mapping)
+        return std::nullopt;
+    mapping.advise(FileAccessPattern::Sequential);
+
+    MemoryStream stream { reinterpret_cast<const uint8_t*>(mapping.data()), mapping.size(), 0, stop };
+    auto mp3 = std::make_unique<ma_dr_mp3>();
+    if (!ma_dr_mp3_init(mp3.get(), MemoryStream::onRead, MemoryStream::onSeek, &stream, nullptr))
+        return std::nullopt;
+
+    TrackSeekTable table;
+    table.sampleRate = mp3->sampleRate;
+    ma_uint64 mp3Frames = 0, pcmFrames = 0;
+    bool ok = ma_dr_mp3_get_mp3_and_pcm_frame_count(mp3.get(), &mp3Frames, &pcmFrames) && !stop.stop_requested();
+    table.frames = pcmFrames;
+    if (ok && table.sampleRate != 0 && pcmFrames >= uint64_t(SeekTables::minSeconds) * table.sampleRate)
+    {
+        ma_uint32 pointCount = ma_uint32(std::min<ma_uint64>(mp3Frames / SeekTables::framesPerPoint, UINT32_MAX));
+        std::vector<ma_dr_mp3_seek_point> points(pointCount);
+        ok = pointCount > 0 && ma_dr_mp3_calculate_seek_points(mp3.get(), &pointCount, points.data()) && !stop.stop_requested();
+        if (ok)
+        {
+            points.resize(pointCount);
+            table.pointCount = pointCount;
+            table.points = encode(points);
+        }
+    }
+    ma_dr_mp3_uninit(mp3.get());
+    if (!ok)
+        return std::nullopt;
+    return table;
+}
+uint32_t SeekTables::buildLibrary()
+{
+    auto library = MusicLibrary::snapshot();
+    uint32_t queuedNow = 0;
+    for (const LibraryTrack& track : library->tracks)
+    {
+        if (!SeekTables::applies(track.path))
+            continue;
+        std::optional<TrackRecord> record = MusicLibrary::record(track);
+        if (record && record->seekTable)
+            continue;
+        {
+            std::lock_guard guard(SeekTables::inFlightMutex);
+            if (!SeekTables::inFlight.insert(track.path.generic_u8string()).second)
+                continue;
+        }
+
+        ++queuedNow;
+        SeekTables::queued.fetch_add(1, std::memory_order_relaxed);
+        JobPool::background().submit([track](std::stop_token stop)
+        {
+            std::optional<TrackSeekTable> result = SeekTables::buildFile(track.path, stop);
+            if (result)
+            {
+                auto table = std::make_shared<const TrackSeekTable>(std::move(*result));
+                MusicLibrary::updateRecord(track, [&](TrackRecord& record) { record.seekTable = table; });
+            }
+            else if (!stop.stop_requested())
+                SeekTables::failed.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard guard(SeekTables::inFlightMutex);
+                SeekTables::inFlight.erase(track.path.generic_u8string());
+            }
+            if (SeekTables::finished.fetch_add(1, std::memory_order_acq_rel) + 1 == SeekTables::queued.load(std::memory_order_acquire))
+                MusicLibrary::saveIndex();
+        });
+    }
+    return queuedNow;
+}
+std::shared_ptr<const TrackSeekTable> SeekTables::find(const fs::path& file)
+{
+    auto library = MusicLibrary::snapshot();
+    const LibraryTrack* track = MusicLibrary::find(*library, file);
+    std::optional<TrackRecord> record = track ? MusicLibrary::record(*track) : std::nullopt;
+    return record ? record->seekTable : nullptr;
+}
+
+struct Mp3Source::Decoder
+{
+    ma_dr_mp3 mp3;
+    bool initialized = false;
+    MemoryStream stream;
+    std::vector<ma_dr_mp3_seek_point> points; // Bound to `mp3`, which keeps a pointer to them.
+};
+
+Mp3Source::Mp3Source() = default;
+Mp3Source::~Mp3Source()
+{
+    this->uninit();
+}
+
+ma_result Mp3Source::init(const void* data, size_t size, const TrackSeekTable& table)
+{
+    this->decoder = std::make_unique<Decoder>();
+    Decoder& decoder = *this->decoder;
+    if (!decode(table, decoder.points))
+        return MA_INVALID_DATA;
+
+    decoder.stream.data = static_cast<const uint8_t*>(data);
+    decoder.stream.size = size;
+    if (!ma_dr_mp3_init(&decoder.mp3, MemoryStream::onRead, MemoryStream::onSeek, &decoder.stream, nullptr))
+        return MA_INVALID_DATA;
+    decoder.initialized = true;
+    if (decoder.mp3.channels == 0 || decoder.mp3.sampleRate != table.sampleRate)
+        return MA_INVALID_DATA; // Not what the table was built from.
+    if (!decoder.points.empty() && !ma_dr_mp3_bind_seek_table(&decoder.mp3, ma_uint32(decoder.points.size()), decoder.points.data()))
+        return MA_ERROR;
+    // Known from the table, rather than scanning the whole file once more.
+    this->length = table.frames;
+
+    static ma_data_source_vtable vtable
+    {
+        .onRead = Mp3Source::onRead,
+        .onSeek = Mp3Source::onSeek,
+        .onGetDataFormat = Mp3Source::onGetDataFormat,
+        .onGetCursor = Mp3Source::onGetCursor,
+        .onGetLength = Mp3Source::onGetLength,
+        .onSetLooping = nullptr,
+        .flags = 0
+    };
+    ma_data_source_config config = ma_data_source_config_init();
+    config.vtable = &vtable;
+    return ma_data_source_init(&config, &this->base);
+}
+void Mp3Source::uninit()
+{
+    if (this->decoder && this->decoder->initialized)
+    {
+        ma_data_source_uninit(&this->base);
+        ma_dr_mp3_uninit(&this->decoder->mp3);
+    }
+    this->decoder.reset();
+}
+uint32_t Mp3Source::sampleRate() const
+{
+    return this->decoder ? this->decoder->mp3.sampleRate : 0;
+}
+
+ma_result Mp3Source::onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead)
+{
+    ma_dr_mp3& mp3 = static_cast<Mp3Source*>(pDataSource)->decoder->mp3;
+    ma_uint64 read = ma_dr_mp3_read_pcm_frames_f32(&mp3, frameCount, static_cast<float*>(pFramesOut));
+    if (pFramesRead)
+        *pFramesRead = read;
+    return read == 0 && frameCount > 0 ? MA_AT_END : MA_SUCCESS;
+}
+ma_result Mp3Source::onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex)
+{
+    ma_dr_mp3& mp3 = static_cast<Mp3Source*>(pDataSource)->decoder->mp3;
+    return ma_dr_mp3_seek_to_pcm_frame(&mp3, frameIndex) ? MA_SUCCESS : MA_ERROR;
+}
+ma_result Mp3Source::onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap)
+{
+    ma_dr_mp3& mp3 = static_cast<Mp3Source*>(pDataSource)->decoder->mp3;
+    if (pFormat)
+        *pFormat = ma_format_f32;
+    if (pChannels)
+        *pChannels = mp3.channels;
+    if (pSampleRate)
+        *pSampleRate = mp3.sampleRate;
+    if (pChannelMap)
+        ma_channel_map_init_standard(ma_standard_channel_map_default, pChannelMap, channelMapCap, mp3.channels);
+    return MA_SUCCESS;
+}
+ma_result Mp3Source::onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor)
+{
+    *pCursor = static_cast<Mp3Source*>(pDataSource)->decoder->mp3.currentPCMFrame;
+    return MA_SUCCESS;
+}
+ma_result Mp3Source::onGetLength(ma_data_source* pDataSource, ma_uint64* pLength)
+{
+    *pLength = static_cast<Mp3Source*>(pDataSource)->length;
+    return MA_SUCCESS;
+}
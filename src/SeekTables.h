@@ -0,0 +1,76 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <unordered_set>
+
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// Frame-offset seek tables for MP3. Without one, miniaudio finds a position by decoding from the start of the file,
+// which on hour-long VBR mixes costs hundreds of milliseconds per seek. A table is built once per file in the
+// background by walking the frame headers, persisted in the library index, and bound to Mp3Source at play time.
+struct SeekTables
+{
+    SeekTables() = delete;
+
+    // One point every so many MP3 frames (~26 ms each at 44.1 kHz). A seek resumes at most this many frames early.
+    inline static uint32_t framesPerPoint = 4;
+    // Tracks shorter than this get an empty table, recording that they were checked: scanning them is quick anyway.
+    inline static uint32_t minSeconds = 300;
+
+    inline static std::atomic<uint32_t> queued = 0;
+    inline static std::atomic<uint32_t> finished = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+
+    // Whether `file` is a format seek tables are built for.
+    static bool applies(const fs::path& file);
+    // Walks all of `file`. Empty if it isn't a decodable MP3, can't be mapped, or `stop` trips first.
+    static std::optional<TrackSeekTable> buildFile(const fs::path& file, std::stop_token stop = {});
+    // Queues every applicable track without a table on the background pool, saving the index once the queue drains.
+    // Returns how many were queued.
+    static uint32_t buildLibrary();
+    // The table recorded for the current contents of `file`, if any.
+    static std::shared_ptr<const TrackSeekTable> find(const fs::path& file);
+private:
+    inline static std::mutex inFlightMutex;
+    inline static std::unordered_set<std::u8string> inFlight;
+};
+
+// An MP3 decoded straight out of memory with a seek table bound, for use as the data source of a sound.
+class Mp3Source
+{
+    ma_data_source_base base; // Must stay the first member, miniaudio reinterprets ma_data_source* as ma_data_source_base*.
+
+    // miniaudio only declares its MP3 decoder in the implementation, so it stays out of this header.
+    struct Decoder;
+    std::unique_ptr<Decoder> decoder;
+    uint64_t length = 0;
+
+    static ma_result onRead(ma_data_source* pDataSource, void* pFramesOut, ma_uint64 frameCount, ma_uint64* pFramesRead);
+    static ma_result onSeek(ma_data_source* pDataSource, ma_uint64 frameIndex);
+    static ma_result onGetDataFormat(ma_data_source* pDataSource, ma_format* pFormat, ma_uint32* pChannels, ma_uint32* pSampleRate, ma_channel* pChannelMap, size_t channelMapCap);
+    static ma_result onGetCursor(ma_data_source* pDataSource, ma_uint64* pCursor);
+    static ma_result onGetLength(ma_data_source* pDataSource, ma_uint64* pLength);
+public:
+    Mp3Source();
+    Mp3Source(const Mp3Source&) = delete;
+    ~Mp3Source();
+
+    // Decodes from `data`, which must outlive the source. `table` must have been built from the same bytes.
+    ma_result init(const void* data, size_t size, const TrackSeekTable& table);
+    void uninit();
+
+    inline ma_data_source* dataSource()
+    {
+        return &this->base;
+    }
+    uint32_t sampleRate() const;
+};
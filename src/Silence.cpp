@@ -0,0 +1,175 @@
+#include "Silence.h"
+
+#include <miniaudio.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <JobPool.h>
+#include <MappedFileVFS.h>
+#include <Simd.h>
+
+namespace
+{
+    // Frames are tested a block at a time, and only blocks with something above the threshold are looked into.
+    constexpr uint32_t blockFrames = 64;
+
+    float peak(const float* samples, size_t count)
+    {
+        f32x4 high = f32x4::zero();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            high = f32x4::max(high, f32x4::max(f32x4::max(f32x4::abs(f32x4::load(samples + i)), f32x4::abs(f32x4::load(samples + i + 4))),
+                                               f32x4::max(f32x4::abs(f32x4::load(samples + i + 8)), f32x4::abs(f32x4::load(samples + i + 12)))));
+        }
+        for (; i + 4 <= count; i += 4)
+            high = f32x4::max(high, f32x4::abs(f32x4::load(samples + i)));
+        float ret = high.maxLane();
+        for (; i < count; i++)
+            ret = std::max(ret, std::abs(samples[i]));
+        return ret;
+    }
+}
+
+std::optional<TrackTrim> Silence::analyzeFile(const fs::path& file, float thresholdDb, std::stop_token stop)
+{
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    ma_decoder decoder;
+    // Decoding out of a mapping skips a copy per read. Anything unmappable goes through stdio.
+    FileMapping mapping(file);
+    ma_result result;
+    if (mapping)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        result = ma_decoder_init_memory(mapping.data(), mapping.size(), &config, &decoder);
+    }
+#if _WIN32
+    else result = ma_decoder_init_file_w(file.c_str(), &config, &decoder);
+#else
+    else result = ma_decoder_init_file(file.c_str(), &config, &decoder);
+#endif
+    if (result != MA_SUCCESS)
+        return std::nullopt;
+
+    ma_format format;
+    ma_uint32 channels, sampleRate;
+    if (ma_decoder_get_data_format(&decoder, &format, &channels, &sampleRate, nullptr, 0) != MA_SUCCESS || channels == 0 || sampleRate == 0)
+    {
+        ma_decoder_uninit(&decoder);
+        return std::nullopt;
+    }
+
+    const float threshold = ma_volume_db_to_linear(thresholdDb);
+    auto loud = [&](const float* frame)
+    {
+        for (uint32_t c = 0; c < channels; c++)
+            if (std::abs(frame[c]) > threshold)
+                return true;
+        return false;
+    };
+
+    TrackTrim trim { .sampleRate = sampleRate, .thresholdDb = thresholdDb };
+    bool found = false;
+    constexpr ma_uint64 chunkFrames = blockFrames * 64;
+    std::vector<float> buffer(chunkFrames * channels);
+    uint64_t frames = 0;
+    while (!stop.stop_requested())
+    {
+        ma_uint64 read = 0;
+        result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunkFrames, &read);
+        for (ma_uint64 start = 0; start < read; start += blockFrames)
+        {
+            uint32_t count = uint32_t(std::min<ma_uint64>(blockFrames, read - start));
+            const float* block = buffer.data() + start * channels;
+            if (peak(block, size_t(count) * channels) <= threshold)
+                continue;
+            // To the frame, at either end of the block.
+            uint32_t first = 0, last = count;
+            while (!loud(block + size_t(first) * channels))
+                ++first;
+            while (!loud(block + size_t(last - 1) * channels))
+                --last;
+            if (!found)
+            {
+                trim.start = frames + start + first;
+                found = true;
+            }
+            trim.end = frames + start + last;
+        }
+        frames += read;
+        if (result != MA_SUCCESS || read < chunkFrames)
+            break;
+    }
+    ma_decoder_uninit(&decoder);
+    if (stop.stop_requested() || frames == 0)
+        return std::nullopt;
+
+    trim.frames = frames;
+    return trim;
+}
+
+uint32_t Silence::analyzeLibrary(bool force)
+{
+    auto library = MusicLibrary::snapshot();
+    uint32_t queuedNow = 0;
+    float thresholdDb = Silence::thresholdDb;
+    for (const LibraryTrack& track : library->tracks)
+    {
+        if (!force)
+        {
+            std::optional<TrackRecord> record = MusicLibrary::record(track);
+            if (record && record->trim && record->trim->thresholdDb == thresholdDb)
+                continue;
+        }
+        {
+            std::lock_guard guard(Silence::inFlightMutex);
+            if (!Silence::inFlight.insert(track.path.generic_u8string()).second)
+                continue;
+        }
+
+        ++queuedNow;
+        Silence::queued.fetch_add(1, std::memory_order_relaxed);
+        JobPool::background().submit([track, thresholdDb](std::stop_token stop)
+        {
+            std::optional<TrackTrim> result = Silence::analyzeFile(track.path, thresholdDb, stop);
+            if (result)
+                MusicLibrary::updateRecord(track, [&](TrackRecord& record) { record.trim = result; });
+            else if (!stop.stop_requested())
+                Silence::failed.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard guard(Silence::inFlightMutex);
+                Silence::inFlight.erase(track.path.generic_u8string());
+            }
+            if (Silence::finished.fetch_add(1, std::memory_order_acq_rel) + 1 == Silence::queued.load(std::memory_order_acquire))
+                MusicLibrary::saveIndex();
+        });
+    }
+    return queuedNow;
+}
+
+std::optional<TrackTrim> Silence::find(const fs::path& file)
+{
+    auto library = MusicLibrary::snapshot();
+    const LibraryTrack* track = MusicLibrary::find(*library, file);
+    std::optional<TrackRecord> record = track ? MusicLibrary::record(*track) : std::nullopt;
+    return record ? record->trim : std::nullopt;
+}
+
+bool Silence::range(const TrackTrim& trim, uint32_t sampleRate, uint64_t length, uint64_t& begin, uint64_t& end)
+{
+    // A track that's silent throughout plays as it is.
+    if (!Silence::trim || trim.end <= trim.start || trim.sampleRate == 0 || sampleRate == 0)
+        return false;
+    uint64_t hold = uint64_t(std::max(Silence::holdMs, 0.0f) / 1000.0f * trim.sampleRate);
+    uint64_t to = std::min(trim.end + hold, trim.frames);
+    if (trim.start == 0 && to == trim.frames)
+        return false;
+
+    begin = trim.start * sampleRate / trim.sampleRate;
+    end = (to * sampleRate + trim.sampleRate - 1) / trim.sampleRate;
+    // The track's own length at this rate may round differently, or come from a decoder that counts differently.
+    if (length)
+        end = to == trim.frames ? length : std::min(end, length);
+    return end > begin;
+}
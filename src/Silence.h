@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <unordered_set>
+
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// Digital silence at either end of tracks, found once in the background and kept in the library index as trim points.
+// Playback and renders skip it by setting the range of the track's data source, so nothing is decoded twice.
+struct Silence
+{
+    Silence() = delete;
+
+    // Whether playback and renders skip the silence.
+    inline static bool trim = true;
+    // Frames with no sample above this count as silence, in dBFS. Changing it takes a re-analysis.
+    inline static float thresholdDb = -60.0f;
+    // How long a track keeps playing past its last frame above the threshold, so fades and tails below it aren't cut.
+    inline static float holdMs = 250.0f;
+
+    inline static std::atomic<uint32_t> queued = 0;
+    inline static std::atomic<uint32_t> finished = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+
+    // Decodes all of `file`. Empty if it can't be decoded or `stop` trips first.
+    static std::optional<TrackTrim> analyzeFile(const fs::path& file, float thresholdDb, std::stop_token stop = {});
+    // Queues every track not yet measured against the current threshold (or every track, if `force`) on the
+    // background pool. The index is saved once the queue drains. Returns how many were queued.
+    static uint32_t analyzeLibrary(bool force = false);
+    // The trim points recorded for the current contents of `file`, if any.
+    static std::optional<TrackTrim> find(const fs::path& file);
+    // The frames of a track that play, at `sampleRate`, hold included. `length` is the whole track's at that rate, 0 if
+    // unknown. False if trimming is off or would change nothing.
+    static bool range(const TrackTrim& trim, uint32_t sampleRate, uint64_t length, uint64_t& begin, uint64_t& end);
+private:
+    inline static std::mutex inFlightMutex;
+    inline static std::unordered_set<std::u8string> inFlight;
+};
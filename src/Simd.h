@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TACRAD_SIMD_SSE 1
+#include <emmintrin.h>
+#include <pmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define TACRAD_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Four float lanes, over SSE2 or NEON where available and plain arrays elsewhere. Just the operations the DSP code needs.
+struct f32x4
+{
+#if TACRAD_SIMD_SSE
+    __m128 v;
+#elif TACRAD_SIMD_NEON
+    float32x4_t v;
+#else
+    float v[4];
+#endif
+
+    inline static f32x4 zero()
+    {
+        return f32x4::splat(0.0f);
+    }
+    inline static f32x4 splat(float x)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_set1_ps(x) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vdupq_n_f32(x) };
+#else
+        return f32x4 { { x, x, x, x } };
+#endif
+    }
+    inline static f32x4 set(float a, float b, float c, float d)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_setr_ps(a, b, c, d) };
+#elif TACRAD_SIMD_NEON
+        float lanes[4] { a, b, c, d };
+        return f32x4 { vld1q_f32(lanes) };
+#else
+        return f32x4 { { a, b, c, d } };
+#endif
+    }
+    // Unaligned.
+    inline static f32x4 load(const float* p)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_loadu_ps(p) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vld1q_f32(p) };
+#else
+        return f32x4 { { p[0], p[1], p[2], p[3] } };
+#endif
+    }
+    inline void store(float* p) const
+    {
+#if TACRAD_SIMD_SSE
+        _mm_storeu_ps(p, this->v);
+#elif TACRAD_SIMD_NEON
+        vst1q_f32(p, this->v);
+#else
+        for (int i = 0; i < 4; i++)
+            p[i] = this->v[i];
+#endif
+    }
+
+    inline friend f32x4 operator+(f32x4 a, f32x4 b)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_add_ps(a.v, b.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vaddq_f32(a.v, b.v) };
+#else
+        return f32x4 { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+#endif
+    }
+    inline friend f32x4 operator-(f32x4 a, f32x4 b)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_sub_ps(a.v, b.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vsubq_f32(a.v, b.v) };
+#else
+        return f32x4 { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+#endif
+    }
+    inline friend f32x4 operator*(f32x4 a, f32x4 b)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_mul_ps(a.v, b.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vmulq_f32(a.v, b.v) };
+#else
+        return f32x4 { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } };
+#endif
+    }
+    inline f32x4& operator+=(f32x4 other)
+    {
+        return *this = *this + other;
+    }
+
+    // a * b + c. Not necessarily fused.
+    inline static f32x4 mulAdd(f32x4 a, f32x4 b, f32x4 c)
+    {
+#if TACRAD_SIMD_NEON
+        return f32x4 { vmlaq_f32(c.v, a.v, b.v) };
+#else
+        return a * b + c;
+#endif
+    }
+    inline static f32x4 max(f32x4 a, f32x4 b)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_max_ps(a.v, b.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vmaxq_f32(a.v, b.v) };
+#else
+        return f32x4 { { std::fmax(a.v[0], b.v[0]), std::fmax(a.v[1], b.v[1]), std::fmax(a.v[2], b.v[2]), std::fmax(a.v[3], b.v[3]) } };
+#endif
+    }
+    inline static f32x4 min(f32x4 a, f32x4 b)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_min_ps(a.v, b.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vminq_f32(a.v, b.v) };
+#else
+        return f32x4 { { std::fmin(a.v[0], b.v[0]), std::fmin(a.v[1], b.v[1]), std::fmin(a.v[2], b.v[2]), std::fmin(a.v[3], b.v[3]) } };
+#endif
+    }
+    inline static f32x4 abs(f32x4 a)
+    {
+#if TACRAD_SIMD_SSE
+        return f32x4 { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) };
+#elif TACRAD_SIMD_NEON
+        return f32x4 { vabsq_f32(a.v) };
+#else
+        return f32x4 { { std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3]) } };
+#endif
+    }
+
+    // [feed[0..N), prev[0..4-N)]: moves a wavefront of N-lane values one slot up, feeding new values in at the bottom.
+    template <uint32_t N>
+    inline static f32x4 shiftIn(f32x4 feed, f32x4 prev)
+    {
+        static_assert(N == 1 || N == 2);
+#if TACRAD_SIMD_SSE
+        if constexpr (N == 1)
+            return f32x4 { _mm_move_ss(_mm_shuffle_ps(prev.v, prev.v, _MM_SHUFFLE(2, 1, 0, 0)), feed.v) };
+        else return f32x4 { _mm_movelh_ps(feed.v, prev.v) };
+#elif TACRAD_SIMD_NEON
+        if constexpr (N == 1)
+            return f32x4 { vextq_f32(vdupq_n_f32(vgetq_lane_f32(feed.v, 0)), prev.v, 3) };
+        else return f32x4 { vcombine_f32(vget_low_f32(feed.v), vget_low_f32(prev.v)) };
+#else
+        if constexpr (N == 1)
+            return f32x4 { { feed.v[0], prev.v[0], prev.v[1], prev.v[2] } };
+        else return f32x4 { { feed.v[0], feed.v[1], prev.v[0], prev.v[1] } };
+#endif
+    }
+    // The top N lanes of `v`, moved to the bottom. What falls out of shiftIn().
+    template <uint32_t N>
+    inline static f32x4 topLanes(f32x4 v)
+    {
+        static_assert(N == 1 || N == 2);
+#if TACRAD_SIMD_SSE
+        if constexpr (N == 1)
+            return f32x4 { _mm_shuffle_ps(v.v, v.v, _MM_SHUFFLE(3, 3, 3, 3)) };
+        else return f32x4 { _mm_movehl_ps(v.v, v.v) };
+#elif TACRAD_SIMD_NEON
+        if constexpr (N == 1)
+            return f32x4 { vdupq_n_f32(vgetq_lane_f32(v.v, 3)) };
+        else return f32x4 { vcombine_f32(vget_high_f32(v.v), vget_high_f32(v.v)) };
+#else
+        if constexpr (N == 1)
+            return f32x4 { { v.v[3], v.v[3], v.v[3], v.v[3] } };
+        else return f32x4 { { v.v[2], v.v[3], v.v[2], v.v[3] } };
+#endif
+    }
+
+    inline float lane(size_t i) const
+    {
+        float lanes[4];
+        this->store(lanes);
+        return lanes[i];
+    }
+    inline float sum() const
+    {
+        float lanes[4];
+        this->store(lanes);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+    inline float maxLane() const
+    {
+        float lanes[4];
+        this->store(lanes);
+        return std::fmax(std::fmax(lanes[0], lanes[1]), std::fmax(lanes[2], lanes[3]));
+    }
+    inline float minLane() const
+    {
+        float lanes[4];
+        this->store(lanes);
+        return std::fmin(std::fmin(lanes[0], lanes[1]), std::fmin(lanes[2], lanes[3]));
+    }
+};
+
+// Flushes denormals to zero on this thread while in scope. IIR tails decaying into denormals otherwise cost a
+// microcode assist per operation, which shows up as CPU spikes right when playback goes quiet.
+class FlushDenormals
+{
+#if TACRAD_SIMD_SSE
+    unsigned int saved;
+public:
+    inline FlushDenormals() : saved(_mm_getcsr())
+    {
+        _mm_setcsr(this->saved | _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON);
+    }
+    inline ~FlushDenormals()
+    {
+        _mm_setcsr(this->saved);
+    }
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+    uint64_t saved;
+public:
+    inline FlushDenormals()
+    {
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(this->saved));
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(this->saved | (uint64_t(1) << 24)));
+    }
+    inline ~FlushDenormals()
+    {
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(this->saved));
+    }
+#else
+public:
+    // 32-bit NEON already flushes, and elsewhere there's nothing portable to do.
+    inline FlushDenormals() = default;
+#endif
+    FlushDenormals(const FlushDenormals&) = delete;
+};
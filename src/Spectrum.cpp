@@ -0,0 +1,213 @@
+#include "Spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numbers>
+
+#include <Simd.h>
+
+namespace
+{
+    // Frames the tap converts to stereo at a time, whatever the graph hands it.
+    constexpr uint32_t tapChunkFrames = 512;
+
+    float toDb(float power)
+    {
+        return power > 0.0f ? 10.0f * std::log10(power) : -std::numeric_limits<float>::infinity();
+    }
+}
+
+SpectrumTapNode::~SpectrumTapNode()
+{
+    this->uninit();
+}
+
+ma_result SpectrumTapNode::init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate)
+{
+    this->channels = channels;
+    this->_sampleRate = sampleRate;
+    this->ring.init(size_t(SpectrumTapNode::ringFrames) * 2);
+    this->stereo.assign(size_t(tapChunkFrames) * 2, 0.0f);
+
+    if (!graph)
+        return MA_SUCCESS;
+
+    static ma_node_vtable vtable
+    {
+        .onProcess = SpectrumTapNode::onProcess,
+        .onGetRequiredInputFrameCount = nullptr,
+        .inputBusCount = 1,
+        .outputBusCount = 1,
+        .flags = 0
+    };
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &vtable;
+    config.pInputChannels = &this->channels;
+    config.pOutputChannels = &this->channels;
+    ma_result result = ma_node_init(graph, &config, nullptr, &this->base);
+    this->nodeInitialized = result == MA_SUCCESS;
+    return result;
+}
+void SpectrumTapNode::uninit()
+{
+    if (this->nodeInitialized)
+    {
+        ma_node_uninit(&this->base, nullptr);
+        this->nodeInitialized = false;
+    }
+}
+
+void SpectrumTapNode::process(const float* in, float* out, uint32_t frameCount)
+{
+    if (in != out)
+        std::memcpy(out, in, sizeof(float) * frameCount * this->channels);
+
+    for (uint32_t done = 0; done < frameCount;)
+    {
+        uint32_t count = std::min(frameCount - done, tapChunkFrames);
+        const float* frames = in + size_t(done) * this->channels;
+        uint32_t right = this->channels > 1 ? 1 : 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            this->stereo[i * 2] = frames[size_t(i) * this->channels];
+            this->stereo[i * 2 + 1] = frames[size_t(i) * this->channels + right];
+        }
+        // A full ring means the UI isn't looking, so there's no point trying the rest.
+        if (this->ring.write(this->stereo.data(), size_t(count) * 2) < size_t(count) * 2)
+            break;
+        done += count;
+    }
+}
+
+void SpectrumTapNode::onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut)
+{
+    static_cast<SpectrumTapNode*>(pNode)->process(ppFramesIn[0], ppFramesOut[0], *pFrameCountOut);
+}
+
+void SpectrumAnalyzer::init(SpectrumTapNode& tap)
+{
+    constexpr uint32_t n = SpectrumAnalyzer::fftSize;
+    this->fft = std::make_unique<Fft>(n);
+    this->window.resize(n);
+    // Periodic Hann.
+    for (uint32_t i = 0; i < n; i++)
+        this->window[i] = float(0.5 - 0.5 * std::cos(2.0 * std::numbers::pi * i / n));
+    this->history.assign(n, 0.0f);
+    this->windowed.assign(n, 0.0f);
+    this->scratch.assign(size_t(SpectrumAnalyzer::maxFramesPerUpdate) * 2, 0.0f);
+    uint32_t bins = this->fft->bins();
+    // Rounded up to whole vectors, the tail is never binned.
+    this->re.assign((bins + 3) & ~3u, 0.0f);
+    this->im.assign((bins + 3) & ~3u, 0.0f);
+    this->power.assign((bins + 3) & ~3u, 0.0f);
+
+    // Log-spaced edges, each band at least one bin wide.
+    float nyquist = tap.sampleRate() / 2.0f;
+    float top = std::min(SpectrumAnalyzer::maxFrequency, nyquist * 0.95f);
+    float bottom = std::min(SpectrumAnalyzer::minFrequency, top / 2.0f);
+    for (uint32_t b = 0; b <= SpectrumAnalyzer::bandCount; b++)
+    {
+        float frequency = bottom * std::pow(top / bottom, float(b) / SpectrumAnalyzer::bandCount);
+        uint32_t bin = uint32_t(std::lround(frequency * n / tap.sampleRate()));
+        if (b > 0)
+            bin = std::max(bin, this->bandStart[b - 1] + 1);
+        this->bandStart[b] = std::min(std::max(bin, 1u), bins);
+    }
+
+    this->_bands.fill(0.0f);
+    this->meters.fill(SpectrumMeter { SpectrumAnalyzer::floorDb, SpectrumAnalyzer::floorDb, SpectrumAnalyzer::floorDb });
+    this->holdLeft.fill(0.0f);
+    // Whatever piled up before anyone looked is stale.
+    tap.ring.skip(tap.ring.available());
+    this->tap = &tap;
+}
+
+void SpectrumAnalyzer::update(float seconds)
+{
+    constexpr uint32_t n = SpectrumAnalyzer::fftSize;
+    SpscRing<float>& ring = this->tap->ring;
+
+    // Only the newest frames count, so anything past the budget goes unread.
+    size_t frames = ring.available() / 2;
+    if (frames > SpectrumAnalyzer::maxFramesPerUpdate)
+    {
+        ring.skip((frames - SpectrumAnalyzer::maxFramesPerUpdate) * 2);
+        frames = SpectrumAnalyzer::maxFramesPerUpdate;
+    }
+    frames = ring.read(this->scratch.data(), frames * 2) / 2;
+    const float* samples = this->scratch.data();
+    float fall = SpectrumAnalyzer::fallDbPerSecond * seconds;
+
+    // Meters. Two stereo frames per vector, left in the even lanes.
+    f32x4 peak = f32x4::zero(), squares = f32x4::zero();
+    size_t i = 0;
+    for (; i + 4 <= frames * 2; i += 4)
+    {
+        f32x4 v = f32x4::load(samples + i);
+        peak = f32x4::max(peak, f32x4::abs(v));
+        squares = f32x4::mulAdd(v, v, squares);
+    }
+    float peaks[2] { std::fmax(peak.lane(0), peak.lane(2)), std::fmax(peak.lane(1), peak.lane(3)) };
+    float sums[2] { squares.lane(0) + squares.lane(2), squares.lane(1) + squares.lane(3) };
+    for (; i < frames * 2; i++)
+    {
+        peaks[i & 1] = std::fmax(peaks[i & 1], std::fabs(samples[i]));
+        sums[i & 1] += samples[i] * samples[i];
+    }
+    for (uint32_t c = 0; c < 2; c++)
+    {
+        SpectrumMeter& meter = this->meters[c];
+        float peakDb = frames ? toDb(peaks[c] * peaks[c]) : SpectrumAnalyzer::floorDb;
+        float rmsDb = frames ? toDb(sums[c] / frames) : SpectrumAnalyzer::floorDb;
+        meter.peakDb = std::max({ peakDb, meter.peakDb - fall, SpectrumAnalyzer::floorDb });
+        meter.rmsDb = std::max({ rmsDb, meter.rmsDb - fall, SpectrumAnalyzer::floorDb });
+        if (meter.peakDb >= meter.holdDb)
+        {
+            meter.holdDb = meter.peakDb;
+            this->holdLeft[c] = SpectrumAnalyzer::holdSeconds;
+        }
+        else if ((this->holdLeft[c] -= seconds) <= 0.0f)
+            meter.holdDb = std::max(meter.holdDb - fall, meter.peakDb);
+    }
+
+    if (!frames)
+    {
+        // Paused or stopped: let the bands settle rather than freezing on the last spectrum.
+        float step = fall / -SpectrumAnalyzer::floorDb;
+        for (float& band : this->_bands)
+            band = std::max(band - step, 0.0f);
+        return;
+    }
+
+    // The newest `fftSize` frames, mixed to mono.
+    size_t fresh = std::min(frames, size_t(n));
+    std::memmove(this->history.data(), this->history.data() + fresh, sizeof(float) * (n - fresh));
+    const float* newest = samples + (frames - fresh) * 2;
+    float* tail = this->history.data() + (n - fresh);
+    for (size_t j = 0; j < fresh; j++)
+        tail[j] = 0.5f * (newest[j * 2] + newest[j * 2 + 1]);
+
+    for (uint32_t j = 0; j < n; j += 4)
+        (f32x4::load(this->history.data() + j) * f32x4::load(this->window.data() + j)).store(this->windowed.data() + j);
+    this->fft->forward(this->windowed.data(), this->re.data(), this->im.data());
+
+    // A full-scale sine through the Hann window peaks at n / 4.
+    f32x4 scale = f32x4::splat(16.0f / (float(n) * float(n)));
+    for (size_t j = 0; j < this->power.size(); j += 4)
+    {
+        f32x4 re = f32x4::load(this->re.data() + j), im = f32x4::load(this->im.data() + j);
+        (f32x4::mulAdd(re, re, im * im) * scale).store(this->power.data() + j);
+    }
+
+    float step = fall / -SpectrumAnalyzer::floorDb;
+    for (uint32_t b = 0; b < SpectrumAnalyzer::bandCount; b++)
+    {
+        if (this->bandStart[b] >= this->bandStart[b + 1])
+            continue; // Past Nyquist at low rates.
+        float strongest = *std::max_element(this->power.begin() + this->bandStart[b], this->power.begin() + this->bandStart[b + 1]);
+        float level = SpectrumAnalyzer::normalize(toDb(strongest));
+        this->_bands[b] = std::max(level, this->_bands[b] - step);
+    }
+}
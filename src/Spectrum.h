@@ -0,0 +1,110 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <Fft.h>
+#include <SpscRing.h>
+
+// Pass-through node that copies what it hears into a ring for SpectrumAnalyzer, as interleaved stereo (the first two
+// channels, or mono twice). When the analyzer falls behind, frames are dropped, never waited for.
+class SpectrumTapNode
+{
+public:
+    static constexpr uint32_t ringFrames = 16384;
+private:
+    ma_node_base base; // Must stay the first member, miniaudio reinterprets ma_node* as ma_node_base*.
+
+    uint32_t channels = 0;
+    uint32_t _sampleRate = 0;
+    bool nodeInitialized = false;
+
+    SpscRing<float> ring;
+    std::vector<float> stereo;
+
+    static void onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+
+    friend class SpectrumAnalyzer;
+public:
+    SpectrumTapNode() = default;
+    SpectrumTapNode(const SpectrumTapNode&) = delete;
+    ~SpectrumTapNode();
+
+    // `graph` may be null, for using process() directly.
+    ma_result init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate);
+    void uninit();
+
+    inline ma_node* node()
+    {
+        return &this->base;
+    }
+    inline uint32_t sampleRate() const
+    {
+        return this->_sampleRate;
+    }
+
+    // Audio side. `in` and `out` are interleaved and may alias.
+    void process(const float* in, float* out, uint32_t frameCount);
+};
+
+struct SpectrumMeter
+{
+    float peakDb, rmsDb, holdDb;
+};
+
+// The reading end of a SpectrumTapNode, for the UI thread. Every update() takes whatever arrived since the last one,
+// at most `maxFramesPerUpdate` of the newest frames, meters it, and runs one windowed FFT over the latest `fftSize`
+// frames, binned into log-spaced bands. So a frame's cost is bounded whatever the frame rate, and nothing allocates
+// after init().
+class SpectrumAnalyzer
+{
+public:
+    static constexpr uint32_t fftSize = 2048;
+    static constexpr uint32_t bandCount = 48;
+    static constexpr uint32_t maxFramesPerUpdate = 8192;
+    static constexpr float minFrequency = 40.0f;
+    static constexpr float maxFrequency = 16000.0f;
+    // Levels are shown from here up to 0 dBFS.
+    static constexpr float floorDb = -72.0f;
+    // How fast bands and meters fall once the signal drops, and how long peaks hold first.
+    static constexpr float fallDbPerSecond = 40.0f;
+    static constexpr float holdSeconds = 1.5f;
+private:
+    SpectrumTapNode* tap = nullptr;
+    std::unique_ptr<Fft> fft;
+    std::vector<float> window, history, scratch, windowed, re, im, power;
+    // Bins [bandStart[b], bandStart[b + 1]) make band b.
+    std::array<uint32_t, SpectrumAnalyzer::bandCount + 1> bandStart {};
+
+    std::array<float, SpectrumAnalyzer::bandCount> _bands {};
+    std::array<SpectrumMeter, 2> meters {};
+    std::array<float, 2> holdLeft {};
+public:
+    // Any thread but the audio thread, once the tap is initialized. Reading from then on is this analyzer's alone.
+    void init(SpectrumTapNode& tap);
+    inline bool ready() const
+    {
+        return this->tap != nullptr;
+    }
+
+    // UI thread, once per frame. `seconds` since the last update, for the ballistics.
+    void update(float seconds);
+
+    // Per band, 0 at `floorDb` and below, 1 at full scale.
+    inline const std::array<float, SpectrumAnalyzer::bandCount>& bands() const
+    {
+        return this->_bands;
+    }
+    // Left and right.
+    inline const SpectrumMeter& meter(uint32_t channel) const
+    {
+        return this->meters[channel];
+    }
+    inline static float normalize(float db)
+    {
+        return db <= SpectrumAnalyzer::floorDb ? 0.0f : db >= 0.0f ? 1.0f : 1.0f - db / SpectrumAnalyzer::floorDb;
+    }
+};
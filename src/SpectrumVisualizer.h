@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+
+#include <EntityComponentSystem/ComponentData.h>
+
+#include <MusicPlayer.h>
+#include <NanoVGContext.h>
+#include <Spectrum.h>
+
+#define SPECTRUM_BAR_GAP 2.0f
+#define SPECTRUM_METER_WIDTH 6.0f
+#define SPECTRUM_METER_GAP 3.0f
+
+using namespace Firework;
+using namespace Firework::Internal;
+
+// Spectrum bars with a pair of level meters to their right, for whatever reaches the device.
+class SpectrumVisualizer : public ComponentData2D
+{
+    struct View
+    {
+        std::array<float, SpectrumAnalyzer::bandCount> bands;
+        std::array<SpectrumMeter, 2> meters;
+    };
+
+    inline void renderOffload()
+    {
+        CoreEngine::queueRenderJobForFrame([w = Window::pixelWidth(), h = Window::pixelHeight(), bounds = NanoVG::boundsFromRectTransform(this->rectTransform()), view = this->view]
+        {
+            nvgBeginFrame(NanoVG::context, +w, +h, 1.0f);
+
+            float metersWidth = SPECTRUM_METER_WIDTH * 2.0f + SPECTRUM_METER_GAP * 2.0f;
+            float barWidth = (bounds.width - metersWidth) / SpectrumAnalyzer::bandCount;
+            float bottom = bounds.y + bounds.height;
+
+            nvgBeginPath(NanoVG::context);
+            for (uint32_t b = 0; b < SpectrumAnalyzer::bandCount; b++)
+            {
+                float height = bounds.height * view.bands[b];
+                nvgRect(NanoVG::context, bounds.x + b * barWidth, bottom - height, std::max(barWidth - SPECTRUM_BAR_GAP, 1.0f), height);
+            }
+            nvgFillColor(NanoVG::context, nvgRGB(0x4c, 0x4c, 0x4c));
+            nvgFill(NanoVG::context);
+            nvgClosePath(NanoVG::context);
+
+            for (uint32_t c = 0; c < 2; c++)
+            {
+                float x = bounds.x + bounds.width - metersWidth + SPECTRUM_METER_GAP * 2.0f + c * (SPECTRUM_METER_WIDTH + SPECTRUM_METER_GAP);
+                float peak = bounds.height * SpectrumAnalyzer::normalize(view.meters[c].peakDb);
+                float rms = bounds.height * SpectrumAnalyzer::normalize(view.meters[c].rmsDb);
+                float hold = bounds.height * SpectrumAnalyzer::normalize(view.meters[c].holdDb);
+
+                nvgBeginPath(NanoVG::context);
+                nvgRect(NanoVG::context, x, bottom - peak, SPECTRUM_METER_WIDTH, peak);
+                nvgFillColor(NanoVG::context, nvgRGB(0x4c, 0x4c, 0x4c));
+                nvgFill(NanoVG::context);
+                nvgClosePath(NanoVG::context);
+
+                nvgBeginPath(NanoVG::context);
+                nvgRect(NanoVG::context, x, bottom - rms, SPECTRUM_METER_WIDTH, rms);
+                nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                nvgFill(NanoVG::context);
+                nvgClosePath(NanoVG::context);
+
+                if (hold > 0.0f)
+                {
+                    nvgBeginPath(NanoVG::context);
+                    nvgRect(NanoVG::context, x, bottom - hold, SPECTRUM_METER_WIDTH, 1.0f);
+                    nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                    nvgFill(NanoVG::context);
+                    nvgClosePath(NanoVG::context);
+                }
+            }
+
+            nvgEndFrame(NanoVG::context);
+        }, false);
+    }
+
+    inline static struct System
+    {
+        inline System()
+        {
+            EngineEvent::OnTick += []
+            {
+                // The tap only exists once the engine is up.
+                if (!SpectrumVisualizer::analyzer.ready())
+                {
+                    if (!MusicPlayer::spectrumTap.sampleRate())
+                        return;
+                    SpectrumVisualizer::analyzer.init(MusicPlayer::spectrumTap);
+                }
+                SpectrumVisualizer::analyzer.update(Time::deltaTime());
+                EntityManager2D::foreachEntityWithAll<SpectrumVisualizer>([](Entity2D* entity, SpectrumVisualizer* visualizer)
+                {
+                    visualizer->view.bands = SpectrumVisualizer::analyzer.bands();
+                    visualizer->view.meters = { SpectrumVisualizer::analyzer.meter(0), SpectrumVisualizer::analyzer.meter(1) };
+                });
+            };
+
+            InternalEngineEvent::OnRenderOffloadForComponent2D += [](Component2D* component)
+            {
+                switch (component->typeIndex())
+                {
+                case __typeid(SpectrumVisualizer).qualifiedNameHash():
+                    static_cast<SpectrumVisualizer*>(component)->renderOffload();
+                    break;
+                }
+            };
+        }
+    } system;
+
+    // One reader per tap, however many visualizers show it.
+    inline static SpectrumAnalyzer analyzer;
+
+    View view {};
+};
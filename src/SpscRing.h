@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Wait-free single producer, single consumer ring of trivially copyable values. Sized once by init(), before either
+// side is running; after that neither side allocates or waits. The writer drops what doesn't fit rather than
+// overwriting what the reader hasn't taken yet.
+template <typename T>
+class SpscRing
+{
+    std::vector<T> buffer;
+    size_t mask = 0;
+    // Total values ever written and read. Each is only stored by its own side.
+    alignas(64) std::atomic<size_t> head = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+public:
+    // `capacity` is rounded up to a power of two.
+    inline void init(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        this->buffer.assign(size, T());
+        this->mask = size - 1;
+        this->head.store(0, std::memory_order_relaxed);
+        this->tail.store(0, std::memory_order_relaxed);
+    }
+    inline size_t capacity() const
+    {
+        return this->buffer.size();
+    }
+
+    // Writer side. Returns how many of `count` values fit.
+    inline size_t write(const T* values, size_t count)
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        size_t free = this->buffer.size() - (head - this->tail.load(std::memory_order_acquire));
+        count = std::min(count, free);
+        size_t start = head & this->mask;
+        size_t first = std::min(count, this->buffer.size() - start);
+        std::copy(values, values + first, this->buffer.data() + start);
+        std::copy(values + first, values + count, this->buffer.data());
+        this->head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Reader side.
+    inline size_t available() const
+    {
+        return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_relaxed);
+    }
+    // Returns how many of `count` values there were.
+    inline size_t read(T* values, size_t count)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        count = std::min(count, this->head.load(std::memory_order_acquire) - tail);
+        size_t start = tail & this->mask;
+        size_t first = std::min(count, this->buffer.size() - start);
+        std::copy(this->buffer.data() + start, this->buffer.data() + start + first, values);
+        std::copy(this->buffer.data(), this->buffer.data() + (count - first), values + first);
+        this->tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+    // Drops up to `count` of the oldest values unread.
+    inline size_t skip(size_t count)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        count = std::min(count, this->head.load(std::memory_order_acquire) - tail);
+        this->tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+};
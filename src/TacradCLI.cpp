@@ -1,11 +1,26 @@
 #include "TacradCLI.h"
 
+#include <fstream>
+#include <iomanip>
 #include <span>
 
 #include <Components/Mask.h>
 
+#include <AudioEngine.h>
+#include <AudioStats.h>
+#include <Benchmark.h>
 #include <DropShadow.h>
+#include <HeadCache.h>
+#include <JobPool.h>
 #include <MusicPlayer.h>
+#include <OfflineRender.h>
+#include <PlaybackClock.h>
+#include <PlaybackController.h>
+#include <SeekScheduler.h>
+#include <Silence.h>
+#include <TrackHistory.h>
+#include <TrackLoader.h>
+#include <Waveforms.h>
 
 using namespace Firework;
 
@@ -94,6 +109,24 @@ constexpr auto hashString = [](std::u32string_view toHash) -> uint64_t
     return result;
 };
 
+// Whole-argument float parse.
+constexpr auto parseFloat = [](std::u32string_view arg, float& out) -> bool
+{
+    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv;
+    char* readEnd = nullptr;
+    std::string convBytes = conv.to_bytes(arg.data(), arg.data() + arg.size());
+    out = std::strtof(convBytes.c_str(), &readEnd);
+    return !convBytes.empty() && (readEnd - convBytes.data()) == convBytes.size();
+};
+// Reports are plain ASCII.
+constexpr auto widen = [](const std::string& str) -> std::u32string
+{
+    std::u32string ret; ret.reserve(str.size());
+    for (auto c : str)
+        ret.push_back((char32_t)c);
+    return ret;
+};
+
 std::vector<std::pair<uint64_t, TacradCLI::Command>> TacradCLI::commands
 {
     {
@@ -210,8 +243,12 @@ UR"(    desc:
             .execute = &TacradCLI::commandSeek,
             .name = U"seek",
             .description =
-UR"(    args: [seconds]
+UR"(    args: [seconds | flag] [value]
         seconds: Point in the track to seek to.
+        flag:
+        Flag is one of -
+        --scrub [alias: -s]: Turn playing short grains while dragging the progress bar of a paused track on or off, or show the scrub settings without a value.
+        --interval [alias: -i]: Set the least time between seeks while dragging the progress bar, in milliseconds.
     desc:
     Seeks to a point in the music track currently playing.)"
         }
@@ -239,6 +276,20 @@ UR"(    args: [linVolume]
             .aliasOf = { U"volume" }
         }
     },
+    {
+        hashString(U"speed"),
+        Command
+        {
+            .execute = &TacradCLI::commandSpeed,
+            .name = U"speed",
+            .description =
+UR"(    args: [multiple]
+        multiple: Playback speed from 0.5 to 2.0, where 1.0 is as recorded. Shows the current speed without one.
+    desc:
+    Play faster or slower without changing pitch, for rehearsal or spoken word. The running time and seeks stay in the
+    track's own time.)"
+        }
+    },
     {
         hashString(U"stop"),
         Command
@@ -277,6 +328,34 @@ UR"(    desc:
             .aliasOrHidden = true
         }
     },
+    {
+        hashString(U"prev"),
+        Command
+        {
+            .execute = &TacradCLI::commandPrevious,
+            .name = U"prev",
+            .description =
+UR"(    args: [flag] [value...]
+        flag:
+        Flag is one of -
+        (none): Go back to the track played before this one, from where it was left.
+        --start [alias: -s]: Go back to the track played before this one, from its start.
+        --keep [alias: -k]: Keep value tracks open to go back to, within an optional second value in MB. 0 keeps none.
+        --list [alias: -l]: List the tracks kept open, and where each was left.
+    desc:
+    Go back to a recent track. The last few stay open and paused, so going back, or forward again, starts at once.)"
+        }
+    },
+    {
+        hashString(U"<<"),
+        Command
+        {
+            .execute = &TacradCLI::commandPrevious,
+            .name = U"<<",
+            .aliasOrHidden = true,
+            .aliasOf = { U"prev" }
+        }
+    },
     {
         hashString(U"playlist"),
         Command
@@ -324,6 +403,236 @@ UR"(    args: [flag]
             .aliasOf = { U"playl" }
         }
     },
+    {
+        hashString(U"eq"),
+        Command
+        {
+            .execute = &TacradCLI::commandEq,
+            .name = U"eq",
+            .description =
+UR"(    args: [flag] [args...]
+        flag:
+        Flag is one of -
+        (none): List the equalizer bands.
+        --band [alias: -b]: Adjust a band. Changes glide in over a few milliseconds.
+            args: [index] [gainDb] [opt: frequencyHz] [opt: q]
+        --type [alias: -ty]: Set the filter type of a band.
+            args: [index] [type]
+                type: peak, lowshelf, highshelf, lowpass or highpass.
+        --preamp [alias: -p]: Set the gain in dB applied before the bands, e.g. to make headroom for boosts.
+        --reset [alias: -r]: Flatten every band and the preamp.
+    desc:
+    Parametric equalizer.)"
+        }
+    },
+    {
+        hashString(U"convolve"),
+        Command
+        {
+            .execute = &TacradCLI::commandConvolve,
+            .name = U"convolve",
+            .description =
+UR"(    args: [flag] [args...]
+        flag:
+        Flag is one of -
+        (none): Show the loaded impulse response and the convolver's CPU time per block.
+        --load [alias: -l]: Load an impulse response in the background, e.g. for room correction. Crossfades in once ready.
+            args: [file...]
+        --clear [alias: -c]: Remove the impulse response.
+        --reset-stats [alias: -rs]: Reset the CPU time counters.
+    desc:
+    Convolution with an impulse response, after the equalizer.)"
+        }
+    },
+    {
+        hashString(U"conv"),
+        Command
+        {
+            .execute = &TacradCLI::commandConvolve,
+            .name = U"conv",
+            .aliasOrHidden = true,
+            .aliasOf = { U"convolve" }
+        }
+    },
+    {
+        hashString(U"loudness"),
+        Command
+        {
+            .execute = &TacradCLI::commandLoudness,
+            .name = U"loudness",
+            .description =
+UR"(    args: [flag] [value]
+        flag:
+        Flag is one of -
+        (none): Show the normalization settings, analysis progress and the current track's measurements.
+        --mode [alias: -m]: Set normalization to value - off, track, or album (tracks in a folder keep their relative levels).
+        --target [alias: -t]: Set the target loudness to value, in LUFS. Default is -18.
+        --analyze [alias: -a]: Re-measure every track in the library.
+    desc:
+    Control loudness normalization (EBU R128 measurement, ReplayGain-style gain).)"
+        }
+    },
+    {
+        hashString(U"norm"),
+        Command
+        {
+            .execute = &TacradCLI::commandLoudness,
+            .name = U"norm",
+            .aliasOrHidden = true,
+            .aliasOf = { U"loudness" }
+        }
+    },
+    {
+        hashString(U"silence"),
+        Command
+        {
+            .execute = &TacradCLI::commandSilence,
+            .name = U"silence",
+            .description =
+UR"(    args: [flag] [value]
+        flag:
+        Flag is one of -
+        (none): Show the trim settings, analysis progress and the current track's trim points.
+        --trim [alias: -t]: Turn skipping the silence at either end of tracks on or off, from the next track.
+        --threshold [alias: -th]: Set the level at or below which audio counts as silence to value, in dBFS. Default is -60. Re-measures the library.
+        --hold [alias: -h]: Set how long tracks keep playing past their last audio above the threshold to value, in ms. Default is 250.
+        --analyze [alias: -a]: Re-measure every track in the library.
+    desc:
+    Trim digital silence from the start and end of tracks, for tighter transitions.)"
+        }
+    },
+    {
+        hashString(U"resample"),
+        Command
+        {
+            .execute = &TacradCLI::commandResample,
+            .name = U"resample",
+            .description =
+UR"(    args: [flag] [value]
+        flag:
+        Flag is one of -
+        (none): Show the resampler quality and whether the current track is being resampled.
+        --quality [alias: -q]: Set how tracks at another sample rate than the device's are converted, from the next track.
+            value: linear (miniaudio's own), fast, balanced or best.
+    desc:
+    Sample rate conversion settings.)"
+        }
+    },
+    {
+        hashString(U"library"),
+        Command
+        {
+            .execute = &TacradCLI::commandLibrary,
+            .name = U"library",
+            .description =
+UR"(    args: [flag] [value]
+        flag:
+        Flag is one of -
+        (none): Show how many tracks are indexed and how the last scan went.
+        --rescan [alias: -r]: Rescan the music folder in the background.
+        --io [alias: -io]: Set how tracks are read to value - auto (stream network mounts, map the rest), mmap, or stream.
+        --waveform [alias: -w]: Turn the waveform overview on the progress bar on or off.
+        --heads [alias: -hd]: Keep the first value seconds of upcoming queued tracks decoded (0 turns it off), within an optional budget in MB, default 64.
+    desc:
+    Inspect or refresh the music library index. Files that aren't audio are left out, and single-file rips with a CUE sheet
+    beside them are indexed as the sheet's tracks.)"
+        }
+    },
+    {
+        hashString(U"lib"),
+        Command
+        {
+            .execute = &TacradCLI::commandLibrary,
+            .name = U"lib",
+            .aliasOrHidden = true,
+            .aliasOf = { U"library" }
+        }
+    },
+    {
+        hashString(U"stats"),
+        Command
+        {
+            .execute = &TacradCLI::commandStats,
+            .name = U"stats",
+            .description =
+UR"(    args: [what] [flag]
+        what:
+        What is one of -
+        seek: Seeks requested, issued and coalesced, and how long until a seek is heard.
+        audio: Audio callback durations, late and overrunning callbacks, and frames the engine or track fell short by.
+        flag:
+        --reset [alias: -r]: Clear the counters instead.
+        --dump [alias: -d]: For audio, also write the histograms and the last periods to audio-stats.txt.
+    desc:
+    Show playback statistics.)"
+        }
+    },
+    {
+        hashString(U"render"),
+        Command
+        {
+            .execute = &TacradCLI::commandRender,
+            .name = U"render",
+            .description =
+UR"(    args: [flag] [value]
+        flag:
+        Flag is one of -
+        (none): Show how the running or last render is going.
+        --out [alias: -o]: Render every queued track to a WAV file in the value directory, then join them into queue.wav.
+        --crossfade [alias: -x]: Set the crossfade between tracks in the joined file to value seconds.
+        --cancel [alias: -c]: Stop the running render.
+    desc:
+    Render the queue to files faster than real time, through the current equalizer, impulse response and normalization.)"
+        }
+    },
+    {
+        hashString(U"engine"),
+        Command
+        {
+            .execute = &TacradCLI::commandEngine,
+            .name = U"engine",
+            .description =
+UR"(    args: [flag]
+        flag:
+        Flag is one of -
+        (none): Show the engine setup asked for in tacrad.cfg, and what the device gave.
+        --latency [alias: -l]: Time starting a sound until it's mixed and until it's audible, on a null device set up the same way.
+    desc:
+    Inspect the audio engine. Its setup is read from tacrad.cfg at startup, as key = value lines:
+        period_frames, periods, sample_rate, channels: Numbers, 0 or absent for the device's choice.
+        profile: low_latency or conservative.
+        backend: default, null (a real-time device nobody hears) or none (no device, for headless use).
+        job_threads: Resource manager threads decoding streamed tracks, 1 or more.
+        audio_scheduling, decode_scheduling: fifo or rr with a priority from 1 to 99, as in "fifo 80", or normal. Refused without
+            CAP_SYS_NICE or an rtprio limit, in which case the threads keep normal scheduling and "engine" says why.
+        audio_cpus, decode_cpus, ui_cpus: CPUs to pin each thread to, as in "2,3" or "0-3".
+        lock_memory: on or off. Pins loaded tracks and streaming buffers in RAM, within the memlock limit.
+        idle_suspend_ms: How long nothing plays, stopped or paused, before the device is stopped, 10000 by default. 0 keeps it
+            running. It starts again on play, resume or seek, and "engine" shows how long that took.)"
+        }
+    },
+    {
+        hashString(U"bench"),
+        Command
+        {
+            .execute = &TacradCLI::commandBench,
+            .name = U"bench",
+            .description =
+UR"(    args: [flag] [trackName...]
+        flag:
+        Flag is one of -
+        --vfs: Time opening trackName up to its first decoded frame, cold and warm, through the stdio, memory-mapped and io_uring file paths.
+        --scan: Time scanning the music folder with batched io_uring statx against one stat per file.
+        --loudness: Time loudness analysis of the library on increasing thread counts.
+        --eq: Time the equalizer per frame and band, against a scalar cascade.
+        --conv: Time the convolver per block for increasing impulse lengths.
+        --resample: Time each resampler quality, and measure its aliasing and passband.
+        --decode [jsonFile]: Time opening, decoding and seeking generated WAVs and a few library tracks of each format in the background, and write
+        the results to jsonFile, bench-decode.json if not given. The tacrad-bench tool runs the same without the player.
+    desc:
+    Run a performance benchmark.)"
+        }
+    },
     {
         hashString(U"exit"),
         Command
@@ -378,18 +687,16 @@ void TacradCLI::commandClear(const std::vector<std::u32string>& cmd)
 }
 void TacradCLI::commandPlayOrTogglePlaying(const std::vector<std::u32string>& cmd)
 {
-    if (cmd.size() == 1 && MusicPlayer::playing)
-    {
-        if (MusicPlayer::paused)
-            MusicPlayer::musicResume();
-        else MusicPlayer::musicPause();
-    }
+    // Still loading counts: the toggle decides whether it starts playing once it's open.
+    auto state = PlaybackController::state();
+    if (cmd.size() == 1 && (state->playing || state->loading))
+        PlaybackController::post({ .type = PlaybackCommandType::Toggle });
     else this->commandPlay(cmd);
 }
 void TacradCLI::commandResumeOrPlay(const std::vector<std::u32string>& cmd)
 {
-    if (cmd.size() == 1 && MusicPlayer::paused)
-        MusicPlayer::musicResume();
+    if (cmd.size() == 1 && PlaybackController::state()->paused)
+        PlaybackController::post({ .type = PlaybackCommandType::Resume });
     else this->commandPlay(cmd);
 }
 void TacradCLI::commandPlay(const std::vector<std::u32string>& cmd)
@@ -400,16 +707,13 @@ void TacradCLI::commandPlay(const std::vector<std::u32string>& cmd)
         return;
     }
 
-    if (MusicPlayer::playing)
-        MusicPlayer::stopMusic();
-
     std::u32string lookupName = cmd[1];
     for (auto& word : std::span(++++cmd.begin(), cmd.end()))
     {
         lookupName.push_back(U' ');
         lookupName.append(word);
     }
-    MusicPlayer::startMusic(lookupName);
+    PlaybackController::post({ .type = PlaybackCommandType::Play, .query = std::move(lookupName) });
 }
 void TacradCLI::commandResume(const std::vector<std::u32string>& cmd)
 {
@@ -419,8 +723,8 @@ void TacradCLI::commandResume(const std::vector<std::u32string>& cmd)
         return;
     }
 
-    if (MusicPlayer::playing)
-        MusicPlayer::musicResume();
+    if (auto state = PlaybackController::state(); state->playing || state->loading)
+        PlaybackController::post({ .type = PlaybackCommandType::Resume });
     else this->writeLine(U"[log.error] Not currently playing music! Use \"play\" and \"stop\" to change media.\n");
 }
 void TacradCLI::commandPause(const std::vector<std::u32string>& cmd)
@@ -431,8 +735,8 @@ void TacradCLI::commandPause(const std::vector<std::u32string>& cmd)
         return;
     }
 
-    if (MusicPlayer::playing)
-        MusicPlayer::musicPause();
+    if (auto state = PlaybackController::state(); state->playing || state->loading)
+        PlaybackController::post({ .type = PlaybackCommandType::Pause });
     else this->writeLine(U"[log.error] Not currently playing music! Use \"play\" and \"stop\" to change media.\n");
 }
 void TacradCLI::commandSeek(const std::vector<std::u32string>& cmd)
@@ -442,28 +746,64 @@ void TacradCLI::commandSeek(const std::vector<std::u32string>& cmd)
         this->writeLine(U"[log.error] Seek position argument (in seconds) must be given to \"seek\"!\n");
         return;
     }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--scrub"):
+    case hashString(U"-s"):
+        if (cmd.size() < 3)
+        {
+            std::ostringstream info;
+            info << "[log.info] scrub grains " << (SeekScheduler::scrubGrains ? "on" : "off") << ", " << SeekScheduler::grainMs
+                 << " ms each, seeks while dragging at least " << SeekScheduler::intervalMs << " ms apart.\n";
+            this->writeLine(widen(info.str()));
+            return;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"on"):
+            SeekScheduler::scrubGrains = true;
+            break;
+        case hashString(U"off"):
+            SeekScheduler::scrubGrains = false;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"seek --scrub\" takes on or off!\n");
+        }
+        return;
+    case hashString(U"--interval"):
+    case hashString(U"-i"):
+        {
+            float ms;
+            if (cmd.size() < 3 || !parseFloat(cmd[2], ms) || ms < 0.0f)
+            {
+                this->writeLine(U"[log.error] \"seek --interval\" requires a non-negative interval in milliseconds!\n");
+                return;
+            }
+            SeekScheduler::intervalMs = (uint32_t)ms;
+        }
+        return;
+    }
+
     if (cmd.size() > 2) [[unlikely]]
     {
         this->writeLine(U"[log.error] Extra arguments given to \"seek\"!\n");
         return;
     }
 
-    if (MusicPlayer::playing)
+    auto state = PlaybackController::state();
+    if (state->playing)
     {
-        std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv;
-        char* readEnd = nullptr;
-        std::string convBytes = conv.to_bytes(cmd[1]);
-        float q = std::strtof(convBytes.c_str(), &readEnd);
-    
-        if ((readEnd - convBytes.data()) != convBytes.size())
+        float q;
+        if (!parseFloat(cmd[1], q))
         {
             this->writeLine(U"[log.error] Invalid index argument given to \"seek\"!\n");
             return;
         }
 
-        float seekQuery = (float)ma_engine_get_sample_rate(&MusicPlayer::engine) * q;
-        if (seekQuery >= 0.0f && seekQuery <= MusicPlayer::frameLen)
-            ma_sound_seek_to_pcm_frame(&MusicPlayer::music, (ma_uint64)seekQuery);
+        float seekQuery = (float)state->sampleRate * q;
+        if (seekQuery >= 0.0f && seekQuery <= state->frameLength)
+            PlaybackController::post({ .type = PlaybackCommandType::Seek, .frame = (uint64_t)seekQuery });
         else this->writeLine(U"[log.error] Seek query out of duration of media!\n");
     }
     else this->writeLine(U"[log.error] Not currently playing music! Use \"play\" and \"stop\" to change media.\n");
@@ -487,12 +827,35 @@ void TacradCLI::commandVolume(const std::vector<std::u32string>& cmd)
         wvStr.push_back(c);
     std::wistringstream ss(std::move(wvStr));
     float v; ss >> v;
-    ma_engine_set_volume(&MusicPlayer::engine, v);
+    PlaybackController::post({ .type = PlaybackCommandType::Volume, .value = v });
+}
+void TacradCLI::commandSpeed(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() > 2) [[unlikely]]
+    {
+        this->writeLine(U"[log.error] Extra arguments given to \"speed\"!\n");
+        return;
+    }
+    if (cmd.size() < 2)
+    {
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(2) << "[log.info] Playing at " << PlaybackController::state()->speed << "x.\n";
+        this->writeLine(widen(std::move(info).str()));
+        return;
+    }
+
+    float speed;
+    if (!parseFloat(cmd[1], speed) || speed < TimeStretchNode::minSpeed || speed > TimeStretchNode::maxSpeed)
+    {
+        this->writeLine(U"[log.error] \"speed\" takes a multiple from 0.5 to 2.0!\n");
+        return;
+    }
+    PlaybackController::post({ .type = PlaybackCommandType::Speed, .value = speed });
 }
 void TacradCLI::commandStop(const std::vector<std::u32string>& cmd)
 {
-    if (MusicPlayer::playing)
-        MusicPlayer::stopMusic();
+    if (auto state = PlaybackController::state(); state->playing || state->loading)
+        PlaybackController::post({ .type = PlaybackCommandType::Stop });
     else this->writeLine(U"[log.error] Not currently playing music! Use \"play\" to start media.\n");
 }
 void TacradCLI::commandNext(const std::vector<std::u32string>& cmd)
@@ -500,7 +863,59 @@ void TacradCLI::commandNext(const std::vector<std::u32string>& cmd)
     if (cmd.size() > 2)
         this->writeLine(U"[log.error] Extra arguments given to \"playl\"!\n");
     
-    MusicPlayer::next();
+    PlaybackController::post({ .type = PlaybackCommandType::Next });
+}
+void TacradCLI::commandPrevious(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        PlaybackController::post({ .type = PlaybackCommandType::Previous });
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--start"):
+    case hashString(U"-s"):
+        PlaybackController::post({ .type = PlaybackCommandType::Previous, .fromStart = true });
+        break;
+    case hashString(U"--keep"):
+    case hashString(U"-k"):
+        {
+            float tracks, megabytes = float(TrackHistory::budgetBytes >> 20);
+            if (cmd.size() < 3 || cmd.size() > 4 || !parseFloat(cmd[2], tracks) || tracks < 0.0f || tracks > 32.0f ||
+                (cmd.size() == 4 && (!parseFloat(cmd[3], megabytes) || megabytes < 1.0f)))
+            {
+                this->writeLine(U"[log.error] \"prev --keep\" requires a track count from 0 to 32, and optionally a budget in MB!\n");
+                break;
+            }
+            TrackHistory::depth = uint32_t(tracks);
+            TrackHistory::budgetBytes = size_t(megabytes * 1048576.0f);
+            TrackHistory::trim();
+        }
+        break;
+    case hashString(U"--list"):
+    case hashString(U"-l"):
+        {
+            std::ostringstream info;
+            info << std::fixed << std::setprecision(1) << "[log.info] " << TrackHistory::list().size() << " of " << TrackHistory::depth << " tracks kept open in "
+                 << TrackHistory::bytes() / 1048576.0 << " of " << TrackHistory::budgetBytes / 1048576.0 << " MB, " << TrackHistory::resumed << " gone back or forward to, "
+                 << TrackHistory::carried << " CUE sheet entries carried on from the one before.\n";
+            this->writeLine(widen(info.str()));
+            uint32_t sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine);
+            size_t index = 0;
+            for (const RecentTrack& recent : TrackHistory::list())
+            {
+                std::ostringstream line;
+                line << std::fixed << std::setprecision(1) << "    " << (index++ < TrackHistory::behind() ? "before" : "after ") << ", left at "
+                     << double(recent.frame) / sampleRate << " of " << double(recent.length) / sampleRate << " s: ";
+                this->writeLine(widen(line.str()).append(recent.name).append(U"\n"));
+            }
+        }
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"prev\".\n");
+    }
 }
 void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
 {
@@ -558,10 +973,14 @@ void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
                 lookupName.push_back(U' ');
                 lookupName.append(word);
             }
-            fs::path path;
-            std::u32string name = MusicPlayer::musicLookup(lookupName, path);
-            MusicPlayer::queue.push_back(std::make_pair(name, std::move(path)));
-            this->writeLine(std::u32string(U"[log.info] Adding \"").append(name).append(U"\" to playlist music queue.\n"));
+            std::optional<LibraryTrack> track = MusicPlayer::musicLookup(lookupName);
+            if (!track)
+            {
+                this->writeLine(U"[log.error] Music query doesn't exist!\n");
+                break;
+            }
+            this->writeLine(std::u32string(U"[log.info] Adding \"").append(track->name).append(U"\" to playlist music queue.\n"));
+            MusicPlayer::queue.push_back(std::move(*track));
         }
         break;
     case hashString(U"--list"):
@@ -585,7 +1004,7 @@ void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
                     std::u32string iStr; iStr.reserve(wiStr.size());
                     for (auto c : wiStr)
                         iStr.push_back(c);
-                    playlist.append(iStr).append(U". ").append(it->first);
+                    playlist.append(iStr).append(U". ").append(it->name);
                     if (it == MusicPlayer::queuePos)
                         playlist.append(U" < You Are Here");
                     playlist.push_back(U'\n');
@@ -623,17 +1042,7 @@ void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
                 break;
             }
 
-            auto queryPos = MusicPlayer::queue.begin();
-            std::advance(queryPos, index - 1);
-
-            if (MusicPlayer::queuePos != queryPos)
-            {
-                MusicPlayer::queuePos = queryPos;
-                bool wasPaused = MusicPlayer::paused;
-                if (MusicPlayer::playing)
-                    MusicPlayer::stopMusic();
-                MusicPlayer::tryPlayNextQueued(MusicPlayer::paused);
-            }
+            PlaybackController::post({ .type = PlaybackCommandType::PlayQueued, .index = size_t(index - 1) });
         }
         break;
     case hashString(U"--remove"):
@@ -667,13 +1076,12 @@ void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
             auto queryPos = MusicPlayer::queue.begin();
             std::advance(queryPos, index - 1);
 
+            // Removing what's playing moves on to what came after it, or back to the start.
             if (MusicPlayer::queuePos == queryPos)
             {
-                MusicPlayer::queuePos = ++decltype(queryPos)(queryPos) != MusicPlayer::queue.end() ? queryPos : MusicPlayer::queue.begin();
-                bool wasPaused = MusicPlayer::paused;
-                if (MusicPlayer::playing)
-                    MusicPlayer::stopMusic();
-                MusicPlayer::tryPlayNextQueued(MusicPlayer::paused);
+                MusicPlayer::queuePos = MusicPlayer::queue.end();
+                if (MusicPlayer::queue.size() > 1)
+                    PlaybackController::post({ .type = PlaybackCommandType::PlayQueued, .index = size_t(index) < MusicPlayer::queue.size() ? size_t(index - 1) : 0 });
             }
 
             MusicPlayer::queue.erase(queryPos);
@@ -733,50 +1141,832 @@ void TacradCLI::commandPlaylist(const std::vector<std::u32string>& cmd)
         this->writeLine(U"[log.warn] Unknown flag argument given to \"playl\".\n");
     }
 }
-void TacradCLI::commandExit(const std::vector<std::u32string>& cmd)
+void TacradCLI::commandEq(const std::vector<std::u32string>& cmd)
 {
-    if (MusicPlayer::playing)
-        MusicPlayer::stopMusic();
-    Application::quit();
-}
+    EqualizerNode& eq = MusicPlayer::equalizer;
+    constexpr const char* typeNames[] { "peak", "lowshelf", "highshelf", "lowpass", "highpass" };
 
-void TacradCLI::onCommand(std::u32string_view command)
-{
-    constexpr auto split = [](std::u32string_view str) -> std::vector<std::u32string>
+    if (cmd.size() < 2)
     {
-        std::vector<std::u32string> ret;
-        size_t beg = 0, end = str.find_first_of(U' ', beg);
-        while (end != std::u32string_view::npos)
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(1) << "[log.info] preamp " << eq.preampDb() << " dB, latency " << eq.latencyFrames() << " frames.\n";
+        for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
         {
-            if (str.begin() + beg != str.begin() + end)
-                ret.push_back(std::u32string(str.begin() + beg, str.begin() + end));
+            const EqBand& band = eq.band(i);
+            info << "    " << std::setw(2) << i + 1 << ": " << std::left << std::setw(10) << typeNames[(int)band.type] << std::right
+                 << std::setw(8) << band.frequency << " Hz  " << std::setw(6) << band.gainDb << " dB  q " << std::setprecision(2) << band.q
+                 << std::setprecision(1) << '\n';
+        }
+        this->writeLine(widen(info.str()));
+        return;
+    }
 
-            beg = end + 1;
-            end = str.find_first_of(' ', beg);
+    auto parseIndex = [&](const std::u32string& arg, uint32_t& index) -> bool
+    {
+        float value;
+        if (!parseFloat(arg, value) || value != std::floor(value) || value < 1.0f || value > EqualizerNode::bandCount)
+        {
+            this->writeLine(U"[log.error] Band index must be between 1 and 10!\n");
+            return false;
         }
-        if (str.begin() + beg != str.end()) [[likely]]
-            ret.push_back(std::u32string(str.begin() + beg, str.end()));
-        return std::move(ret);
+        index = uint32_t(value) - 1;
+        return true;
     };
 
-    if (this->cmdHistory.empty() || this->cmdHistory.back() != command)
-        this->cmdHistory.emplace_back(command.begin(), command.end());
-    this->nextHistoryIndex = this->cmdHistory.size() - 1;
-
-    std::vector<std::u32string> cmd = split(command);
-
-    if (!cmd.empty())
+    switch (hashString(cmd[1]))
     {
-        auto it = TacradCLI::commands.begin();
-        while (it != TacradCLI::commands.end() && it->first != hashString(cmd[0]))
-            ++it;
-        if (it == TacradCLI::commands.end())
+    case hashString(U"--band"):
+    case hashString(U"-b"):
         {
-            for (char c : cmd[0])
+            if (cmd.size() < 4 || cmd.size() > 6)
             {
-                if (!std::isspace(c))
-                {
-                    this->writeLine(U"[log.error] Unknown command! Enter \"help\" to view a list of available commands!\n");
+                this->writeLine(U"[log.error] \"eq --band\" takes an index, a gain in dB, and optionally a frequency and q!\n");
+                break;
+            }
+            uint32_t index;
+            if (!parseIndex(cmd[2], index))
+                break;
+            EqBand band = eq.band(index);
+            if (!parseFloat(cmd[3], band.gainDb) || (cmd.size() > 4 && !parseFloat(cmd[4], band.frequency)) || (cmd.size() > 5 && !parseFloat(cmd[5], band.q)))
+            {
+                this->writeLine(U"[log.error] Invalid number given to \"eq --band\"!\n");
+                break;
+            }
+            if (band.frequency <= 0.0f || band.q <= 0.0f)
+            {
+                this->writeLine(U"[log.error] Frequency and q must be positive!\n");
+                break;
+            }
+            eq.setBand(index, band);
+        }
+        break;
+    case hashString(U"--type"):
+    case hashString(U"-ty"):
+        {
+            if (cmd.size() != 4)
+            {
+                this->writeLine(U"[log.error] \"eq --type\" takes an index and a filter type!\n");
+                break;
+            }
+            uint32_t index;
+            if (!parseIndex(cmd[2], index))
+                break;
+            EqBand band = eq.band(index);
+            switch (hashString(cmd[3]))
+            {
+            case hashString(U"peak"):
+                band.type = EqBandType::Peak;
+                break;
+            case hashString(U"lowshelf"):
+                band.type = EqBandType::LowShelf;
+                break;
+            case hashString(U"highshelf"):
+                band.type = EqBandType::HighShelf;
+                break;
+            case hashString(U"lowpass"):
+                band.type = EqBandType::LowPass;
+                break;
+            case hashString(U"highpass"):
+                band.type = EqBandType::HighPass;
+                break;
+            default:
+                this->writeLine(U"[log.error] Filter type must be one of peak, lowshelf, highshelf, lowpass or highpass!\n");
+                return;
+            }
+            eq.setBand(index, band);
+        }
+        break;
+    case hashString(U"--preamp"):
+    case hashString(U"-p"):
+        {
+            float db;
+            if (cmd.size() != 3 || !parseFloat(cmd[2], db))
+            {
+                this->writeLine(U"[log.error] \"eq --preamp\" takes a gain in dB!\n");
+                break;
+            }
+            eq.setPreampDb(db);
+        }
+        break;
+    case hashString(U"--reset"):
+    case hashString(U"-r"):
+        eq.reset();
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"eq\".\n");
+    }
+}
+void TacradCLI::commandConvolve(const std::vector<std::u32string>& cmd)
+{
+    ConvolutionNode& convolver = MusicPlayer::convolver;
+    if (cmd.size() < 2)
+    {
+        ImpulseInfo impulse = convolver.impulse();
+        ConvolutionNode::BlockStats stats = convolver.stats();
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(1) << "[log.info] ";
+        if (impulse.partitions)
+        {
+            info << "impulse " << (impulse.source.empty() ? std::string("from memory") : impulse.source.filename().string()) << ", "
+                 << impulse.frames << " frames x " << impulse.channels << " channels in " << impulse.partitions << " partitions"
+                 << (impulse.truncated ? " (truncated)" : "") << ".\n";
+        }
+        else info << "no impulse loaded, passing through.\n";
+        if (convolver.loading())
+            info << "    loading in progress.\n";
+        if (std::string error = convolver.lastError(); !error.empty())
+            info << "    last load failed: " << error << ".\n";
+        info << "    " << convolver.latencyFrames() << " frames latency, " << stats.blocks << " blocks, per block avg " << stats.averageUs << " us ("
+             << stats.averageLoad * 100.0 << "%), last " << stats.lastUs << " us, peak " << stats.peakUs << " us (" << stats.peakLoad * 100.0 << "%).\n";
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--load"):
+    case hashString(U"-l"):
+        {
+            if (cmd.size() < 3)
+            {
+                this->writeLine(U"[log.error] \"convolve --load\" requires a file!\n");
+                break;
+            }
+            std::u32string name = cmd[2];
+            for (auto it = cmd.begin() + 3; it != cmd.end(); ++it)
+                name.append(U" ").append(*it);
+            fs::path file(name);
+            if (!fs::is_regular_file(file))
+            {
+                this->writeLine(U"[log.error] No such file!\n");
+                break;
+            }
+            JobPool::background().submit([file](std::stop_token stop) { MusicPlayer::convolver.load(file, stop); });
+            this->writeLine(U"[log.info] Loading impulse response in the background, see \"convolve\" for progress.\n");
+        }
+        break;
+    case hashString(U"--clear"):
+    case hashString(U"-c"):
+        convolver.clear();
+        break;
+    case hashString(U"--reset-stats"):
+    case hashString(U"-rs"):
+        convolver.resetStats();
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"convolve\".\n");
+    }
+}
+void TacradCLI::commandLoudness(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(1) << "[log.info] normalization ";
+        switch (Loudness::mode)
+        {
+        case NormalizationMode::Off: info << "off"; break;
+        case NormalizationMode::Track: info << "track"; break;
+        case NormalizationMode::Album: info << "album"; break;
+        }
+        info << ", target " << Loudness::targetLufs << " LUFS, analyzed " << Loudness::finished.load() << '/' << Loudness::queued.load();
+        if (uint32_t failed = Loudness::failed.load())
+            info << " (" << failed << " undecodable)";
+        info << ".\n";
+        if (MusicPlayer::playing)
+        {
+            auto library = MusicLibrary::snapshot();
+            const LibraryTrack* track = MusicLibrary::find(*library, MusicPlayer::musicFile);
+            std::optional<TrackRecord> record = track ? MusicLibrary::record(*track) : std::nullopt;
+            if (record && record->loudness)
+                info << "    current track: " << record->loudness->integrated << " LUFS, " << record->loudness->truePeak << " dBTP, gain "
+                     << Loudness::gainDb(MusicPlayer::musicFile) << " dB.\n";
+            else info << "    current track isn't analyzed yet.\n";
+        }
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--mode"):
+    case hashString(U"-m"):
+        if (cmd.size() < 3)
+        {
+            this->writeLine(U"[log.error] \"loudness --mode\" requires one of off, track or album!\n");
+            break;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"off"):
+            Loudness::mode = NormalizationMode::Off;
+            break;
+        case hashString(U"track"):
+            Loudness::mode = NormalizationMode::Track;
+            break;
+        case hashString(U"album"):
+            Loudness::mode = NormalizationMode::Album;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"loudness --mode\" requires one of off, track or album!\n");
+            return;
+        }
+        if (MusicPlayer::playing)
+            MusicPlayer::applyNormalization();
+        break;
+    case hashString(U"--target"):
+    case hashString(U"-t"):
+        {
+            if (cmd.size() < 3)
+            {
+                this->writeLine(U"[log.error] \"loudness --target\" requires a target in LUFS, e.g. -18!\n");
+                break;
+            }
+            float target;
+            if (!parseFloat(cmd[2], target))
+            {
+                this->writeLine(U"[log.error] Invalid target argument given to \"loudness --target\"!\n");
+                break;
+            }
+            Loudness::targetLufs = target;
+            if (MusicPlayer::playing)
+                MusicPlayer::applyNormalization();
+        }
+        break;
+    case hashString(U"--analyze"):
+    case hashString(U"-a"):
+        this->writeLine(widen("[log.info] Analyzing " + std::to_string(Loudness::analyzeLibrary(true)) + " tracks in the background.\n"));
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"loudness\".\n");
+    }
+}
+void TacradCLI::commandSilence(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(1) << "[log.info] trimming " << (Silence::trim ? "on" : "off") << ", threshold "
+             << Silence::thresholdDb << " dBFS, hold " << Silence::holdMs << " ms, analyzed " << Silence::finished.load() << '/' << Silence::queued.load();
+        if (uint32_t failed = Silence::failed.load())
+            info << " (" << failed << " undecodable)";
+        info << ".\n";
+        if (MusicPlayer::playing)
+        {
+            std::optional<TrackTrim> trim = Silence::find(MusicPlayer::musicFile);
+            if (trim && trim->end > trim->start)
+            {
+                info << std::setprecision(2) << "    current track: audio from " << double(trim->start) / trim->sampleRate << " s to "
+                     << double(trim->end) / trim->sampleRate << " s of " << double(trim->frames) / trim->sampleRate << " s";
+                if (MusicPlayer::trimBegin > 0.0f || MusicPlayer::trimEnd < 1.0f)
+                    info << ", playing " << MusicPlayer::trimBegin * 100.0f << "% to " << MusicPlayer::trimEnd * 100.0f << "% of it";
+                info << ".\n";
+            }
+            else if (trim)
+                info << "    current track is silent throughout.\n";
+            else info << "    current track isn't analyzed yet.\n";
+        }
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--trim"):
+    case hashString(U"-t"):
+        if (cmd.size() < 3)
+        {
+            this->writeLine(U"[log.error] \"silence --trim\" requires on or off!\n");
+            break;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"on"):
+            Silence::trim = true;
+            break;
+        case hashString(U"off"):
+            Silence::trim = false;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"silence --trim\" requires on or off!\n");
+            return;
+        }
+        this->writeLine(U"[log.info] Takes effect from the next track.\n");
+        break;
+    case hashString(U"--threshold"):
+    case hashString(U"-th"):
+        {
+            float threshold;
+            if (cmd.size() < 3 || !parseFloat(cmd[2], threshold) || threshold >= 0.0f || threshold < -120.0f)
+            {
+                this->writeLine(U"[log.error] \"silence --threshold\" requires a level in dBFS from -120 to 0, e.g. -60!\n");
+                break;
+            }
+            Silence::thresholdDb = threshold;
+            this->writeLine(widen("[log.info] Re-measuring " + std::to_string(Silence::analyzeLibrary()) + " tracks in the background.\n"));
+        }
+        break;
+    case hashString(U"--hold"):
+    case hashString(U"-h"):
+        {
+            float ms;
+            if (cmd.size() < 3 || !parseFloat(cmd[2], ms) || ms < 0.0f)
+            {
+                this->writeLine(U"[log.error] \"silence --hold\" requires a time in ms, e.g. 250!\n");
+                break;
+            }
+            Silence::holdMs = ms;
+            this->writeLine(U"[log.info] Takes effect from the next track.\n");
+        }
+        break;
+    case hashString(U"--analyze"):
+    case hashString(U"-a"):
+        this->writeLine(widen("[log.info] Analyzing " + std::to_string(Silence::analyzeLibrary(true)) + " tracks in the background.\n"));
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"silence\".\n");
+    }
+}
+void TacradCLI::commandResample(const std::vector<std::u32string>& cmd)
+{
+    constexpr const char* qualityNames[] { "linear", "fast", "balanced", "best" };
+    if (cmd.size() < 2)
+    {
+        std::ostringstream info;
+        info << "[log.info] resampler quality " << qualityNames[(int)MusicPlayer::resampleQuality] << ", current track ";
+        if (MusicPlayer::musicTrack && MusicPlayer::musicTrack->source)
+            info << "resampled from " << MusicPlayer::musicTrack->source->nativeSampleRate() << " Hz by the sinc resampler";
+        else info << "not using the sinc resampler";
+        info << ", device at " << ma_engine_get_sample_rate(&MusicPlayer::engine) << " Hz.\n";
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--quality"):
+    case hashString(U"-q"):
+        if (cmd.size() < 3)
+        {
+            this->writeLine(U"[log.error] \"resample --quality\" requires one of linear, fast, balanced or best!\n");
+            break;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"linear"):
+            MusicPlayer::resampleQuality = ResamplerQuality::Linear;
+            break;
+        case hashString(U"fast"):
+            MusicPlayer::resampleQuality = ResamplerQuality::Fast;
+            break;
+        case hashString(U"balanced"):
+            MusicPlayer::resampleQuality = ResamplerQuality::Balanced;
+            break;
+        case hashString(U"best"):
+            MusicPlayer::resampleQuality = ResamplerQuality::Best;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"resample --quality\" requires one of linear, fast, balanced or best!\n");
+            return;
+        }
+        // Tracks kept open to go back to were opened the old way.
+        TrackHistory::clear();
+        this->writeLine(U"[log.info] Takes effect from the next track.\n");
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"resample\".\n");
+    }
+}
+void TacradCLI::commandLibrary(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        auto library = MusicLibrary::snapshot();
+        std::ostringstream info;
+        info << "[log.info] " << library->tracks.size() << " tracks indexed, last scan took " << library->scanMs << " ms"
+             << (library->usedIoUring ? " with batched io_uring statx" : " with synchronous stat")
+             << (MusicLibrary::scanning() ? ", rescan in progress" : "") << ".\n"
+             << "    other files: " << library->skipped << " left out as not audio or split up by CUE sheets, " << library->sniffed
+             << " sniffed by the last scan, the rest known from the index. " << library->cueTracks << " tracks are CUE sheet entries.\n"
+             << "    track reads: " << (AsyncFileVFS::asynchronous() ? "io_uring" : "synchronous") << " when streamed, mode ";
+        switch (MusicPlayer::ioMode)
+        {
+        case TrackIO::Auto: info << "auto"; break;
+        case TrackIO::Mapped: info << "mmap"; break;
+        case TrackIO::Streamed: info << "stream"; break;
+        }
+        info << ".\n    mp3 seek tables: built " << SeekTables::finished.load() << '/' << SeekTables::queued.load();
+        if (uint32_t failed = SeekTables::failed.load())
+            info << " (" << failed << " undecodable)";
+        info << (MusicPlayer::musicTrack && MusicPlayer::musicTrack->mp3 ? ", current track seeks through one" : "") << ".\n";
+        info << "    waveform overviews: built " << Waveforms::finished.load() << '/' << Waveforms::queued.load();
+        if (uint32_t failed = Waveforms::failed.load())
+            info << " (" << failed << " undecodable)";
+        info << ", shown on the progress bar " << (Waveforms::display ? "on" : "off") << ".\n";
+        info << std::fixed << std::setprecision(1) << "    queued track openings: " << HeadCache::cachedCount() << " cached in "
+             << HeadCache::cachedBytes() / 1048576.0 << " of " << HeadCache::budgetBytes / 1048576.0 << " MB, "
+             << HeadCache::seconds << " s each";
+        if (uint32_t failed = HeadCache::failed.load())
+            info << " (" << failed << " undecodable)";
+        info << ", " << HeadCache::hits.load() << " tracks started from one, " << HeadCache::misses.load() << " before it was ready";
+        if (MusicPlayer::musicTrack && MusicPlayer::musicTrack->head)
+            info << (MusicPlayer::musicTrack->head->caughtUp() ? ", current track did and has caught up" : ", current track did and is still opening");
+        info << ".\n";
+        info << "    track loads: " << TrackLoader::started.load() << " started, " << TrackLoader::completed.load() << " opened, "
+             << TrackLoader::cancelled.load() << " replaced before they finished";
+        if (uint32_t failed = TrackLoader::failed.load())
+            info << ", " << failed << " failed";
+        info << ", " << TrackLoader::lastLoadMs() << " ms last, " << TrackLoader::peakLoadMs() << " ms peak" << (MusicPlayer::loading ? ", one loading now" : "") << ".\n";
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--rescan"):
+    case hashString(U"-r"):
+        if (MusicLibrary::rescanAsync([] { Loudness::analyzeLibrary(); Silence::analyzeLibrary(); SeekTables::buildLibrary(); Waveforms::buildLibrary(); }))
+            this->writeLine(U"[log.info] Rescanning music library in the background.\n");
+        else this->writeLine(U"[log.warn] A rescan is already in progress.\n");
+        break;
+    case hashString(U"--io"):
+    case hashString(U"-io"):
+        if (cmd.size() < 3)
+        {
+            this->writeLine(U"[log.error] \"library --io\" requires one of auto, mmap or stream!\n");
+            break;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"auto"):
+            MusicPlayer::ioMode = TrackIO::Auto;
+            break;
+        case hashString(U"mmap"):
+            MusicPlayer::ioMode = TrackIO::Mapped;
+            break;
+        case hashString(U"stream"):
+            MusicPlayer::ioMode = TrackIO::Streamed;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"library --io\" requires one of auto, mmap or stream!\n");
+            return;
+        }
+        TrackHistory::clear();
+        this->writeLine(U"[log.info] Takes effect from the next track.\n");
+        break;
+    case hashString(U"--waveform"):
+    case hashString(U"-w"):
+        if (cmd.size() < 3)
+        {
+            this->writeLine(U"[log.error] \"library --waveform\" requires on or off!\n");
+            break;
+        }
+        switch (hashString(cmd[2]))
+        {
+        case hashString(U"on"):
+            Waveforms::display = true;
+            break;
+        case hashString(U"off"):
+            Waveforms::display = false;
+            break;
+        default:
+            this->writeLine(U"[log.error] \"library --waveform\" requires on or off!\n");
+        }
+        break;
+    case hashString(U"--heads"):
+    case hashString(U"-hd"):
+        {
+            float seconds, megabytes = float(HeadCache::budgetBytes >> 20);
+            if (cmd.size() < 3 || cmd.size() > 4 || !parseFloat(cmd[2], seconds) || seconds < 0.0f || seconds > 60.0f ||
+                (cmd.size() == 4 && (!parseFloat(cmd[3], megabytes) || megabytes < 1.0f)))
+            {
+                this->writeLine(U"[log.error] \"library --heads\" requires seconds from 0 to 60, and optionally a budget in MB!\n");
+                break;
+            }
+            HeadCache::seconds = seconds;
+            HeadCache::budgetBytes = size_t(megabytes * 1048576.0f);
+            this->writeLine(seconds > 0.0f ? U"[log.info] Caching the openings of queued tracks.\n" : U"[log.info] Not caching the openings of queued tracks.\n");
+        }
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"library\".\n");
+    }
+}
+void TacradCLI::commandStats(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2) [[unlikely]]
+    {
+        this->writeLine(U"[log.error] \"stats\" requires what to show, one of seek or audio!\n");
+        return;
+    }
+    bool reset = cmd.size() > 2 && (cmd[2] == U"--reset" || cmd[2] == U"-r");
+    bool dump = cmd.size() > 2 && (cmd[2] == U"--dump" || cmd[2] == U"-d");
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"seek"):
+        {
+            if (reset)
+            {
+                SeekScheduler::resetStats();
+                return;
+            }
+            SeekScheduler::Stats stats = SeekScheduler::stats();
+            std::ostringstream info;
+            info << std::fixed << std::setprecision(1) << "[log.info] " << stats.requests << " seeks requested, " << stats.issued << " issued, "
+                 << stats.coalesced << " coalesced.\n"
+                 << "    request to audible: " << stats.averageMs << " ms average, " << stats.lastMs << " ms last, " << stats.peakMs
+                 << " ms peak over " << stats.measured << " seeks.\n";
+            this->writeLine(widen(info.str()));
+        }
+        break;
+    case hashString(U"audio"):
+        {
+            if (reset)
+            {
+                AudioStats::resetStats();
+                return;
+            }
+            AudioStats::Stats stats = AudioStats::stats();
+            std::ostringstream info;
+            info << std::fixed << std::setprecision(1) << "[log.info] " << stats.callbacks << " callbacks, " << stats.late << " late, "
+                 << stats.overruns << " overran their period, " << stats.shortCallbacks << " short.\n"
+                 << "    frames: " << stats.framesRequested << " requested, " << stats.framesDelivered << " delivered, track fell "
+                 << stats.trackFramesShort << " short.\n"
+                 << "    callback: " << stats.averageUs << " us average, " << stats.peakUs << " us peak, load " << stats.averageLoad * 100.0
+                 << "% average, " << stats.peakLoad * 100.0 << "% peak.\n"
+                 << "    decode and mix: " << stats.averageDecodeUs << " us average, " << stats.peakDecodeUs << " us peak.\n";
+            for (auto [name, histogram] : { std::pair { "callback", &stats.callbackHistogram }, std::pair { "decode", &stats.decodeHistogram } })
+            {
+                info << "    " << name << " us histogram:";
+                for (uint32_t b = 0; b < AudioStats::histogramBuckets; b++)
+                {
+                    if ((*histogram)[b])
+                        info << ' ' << AudioStats::bucketFloorUs(b) << (b + 1 == AudioStats::histogramBuckets ? "+" : "") << ':' << (*histogram)[b];
+                }
+                info << '\n';
+            }
+            if (dump)
+            {
+                if (AudioStats::dump("audio-stats.txt"))
+                    info << "    (written to audio-stats.txt)\n";
+                else info << "[log.error] Couldn't write audio-stats.txt!\n";
+            }
+            this->writeLine(widen(info.str()));
+        }
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown argument given to \"stats\".\n");
+    }
+}
+void TacradCLI::commandRender(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        RenderProgress progress = OfflineRender::progress();
+        std::ostringstream info;
+        info << std::fixed << std::setprecision(1);
+        if (progress.running)
+        {
+            info << "[log.info] Rendering, " << progress.finished << '/' << progress.tracks << " tracks done, " << progress.audioSeconds / 60.0
+                 << " min of audio in " << progress.wallSeconds << " s ("
+                 << (progress.wallSeconds > 0.0 ? progress.audioSeconds / progress.wallSeconds : 0.0) << "x real time).\n";
+        }
+        else if (!progress.summary.empty())
+            info << "[log.info] " << progress.summary << '\n';
+        else info << "[log.info] Nothing rendered yet.\n";
+        info << "    crossfade between tracks: " << OfflineRender::crossfadeSeconds << " s.\n";
+        this->writeLine(widen(info.str()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--out"):
+    case hashString(U"-o"):
+        {
+            if (cmd.size() < 3)
+            {
+                this->writeLine(U"[log.error] \"render --out\" requires a directory to render into!\n");
+                break;
+            }
+            if (MusicPlayer::queue.empty())
+            {
+                this->writeLine(U"[log.error] There's nothing queued to render!\n");
+                break;
+            }
+            std::u32string dirName = cmd[2];
+            for (auto& word : std::span(++++++cmd.begin(), cmd.end()))
+            {
+                dirName.push_back(U' ');
+                dirName.append(word);
+            }
+            fs::path dir(dirName);
+            std::error_code ec;
+            fs::create_directories(dir, ec);
+            if (!fs::is_directory(dir))
+            {
+                this->writeLine(U"[log.error] Couldn't create the output directory!\n");
+                break;
+            }
+
+            // Everything the player applies is read here, on the thread that changes it.
+            RenderSettings settings
+            {
+                .sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine),
+                .preampDb = MusicPlayer::equalizer.preampDb(),
+                .impulse = MusicPlayer::convolver.impulse().source,
+                .crossfadeSeconds = OfflineRender::crossfadeSeconds
+            };
+            for (uint32_t i = 0; i < EqualizerNode::bandCount; i++)
+                settings.bands[i] = MusicPlayer::equalizer.band(i);
+
+            std::vector<RenderTrack> tracks;
+            for (const LibraryTrack& track : MusicPlayer::queue)
+            {
+                std::ostringstream number;
+                number << std::setw(2) << std::setfill('0') << tracks.size() + 1 << ' ';
+                tracks.push_back(RenderTrack
+                {
+                    .source = track.path,
+                    .output = dir / fs::path(widen(number.str()).append(track.name).append(U".wav")),
+                    .gainDb = Loudness::gainDb(track.path),
+                    .trim = Silence::trim ? Silence::find(track.path) : std::nullopt,
+                    .span = track.span
+                });
+            }
+            size_t count = tracks.size();
+            if (OfflineRender::start(std::move(tracks), dir / "queue.wav", std::move(settings)))
+                this->writeLine(widen("[log.info] Rendering " + std::to_string(count) + " tracks in the background.\n"));
+            else this->writeLine(U"[log.warn] A render is already running.\n");
+        }
+        break;
+    case hashString(U"--crossfade"):
+    case hashString(U"-x"):
+        {
+            float seconds;
+            if (cmd.size() < 3 || !parseFloat(cmd[2], seconds) || seconds < 0.0f)
+            {
+                this->writeLine(U"[log.error] \"render --crossfade\" requires a length in seconds, 0 or more!\n");
+                break;
+            }
+            OfflineRender::crossfadeSeconds = seconds;
+            this->writeLine(U"[log.info] Takes effect from the next render.\n");
+        }
+        break;
+    case hashString(U"--cancel"):
+    case hashString(U"-c"):
+        OfflineRender::cancel();
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"render\".\n");
+    }
+}
+void TacradCLI::commandEngine(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2)
+    {
+        this->writeLine(widen("[log.info] " + AudioEngine::describe()));
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--latency"):
+    case hashString(U"-l"):
+        this->writeLine(std::u32string(U"[log.info] Measuring start latency...\n").append(widen(AudioEngine::measureLatency())));
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"engine\".\n");
+    }
+}
+void TacradCLI::commandBench(const std::vector<std::u32string>& cmd)
+{
+    if (cmd.size() < 2) [[unlikely]]
+    {
+        this->writeLine(U"[log.error] \"bench\" takes at least a flag argument!\n");
+        return;
+    }
+
+    switch (hashString(cmd[1]))
+    {
+    case hashString(U"--vfs"):
+        {
+            if (cmd.size() < 3)
+            {
+                this->writeLine(U"[log.error] \"bench --vfs\" requires at least a one-word music track query!\n");
+                break;
+            }
+            std::u32string lookupName = cmd[2];
+            for (auto& word : std::span(++++++cmd.begin(), cmd.end()))
+            {
+                lookupName.push_back(U' ');
+                lookupName.append(word);
+            }
+            std::optional<LibraryTrack> track = MusicPlayer::musicLookup(lookupName);
+            if (!track || !fs::exists(track->path))
+            {
+                this->writeLine(U"[log.error] Music query doesn't exist!\n");
+                break;
+            }
+            this->writeLine(std::u32string(U"[log.info] Benchmarking \"").append(track->name).append(U"\"...\n").append(widen(Benchmark::fileOpenLatency(track->path))));
+        }
+        break;
+    case hashString(U"--scan"):
+        this->writeLine(std::u32string(U"[log.info] Benchmarking library scans...\n").append(widen(Benchmark::libraryScan(MusicLibrary::root))));
+        break;
+    case hashString(U"--eq"):
+        this->writeLine(std::u32string(U"[log.info] Benchmarking equalizer...\n").append(widen(Benchmark::equalizer())));
+        break;
+    case hashString(U"--conv"):
+        this->writeLine(std::u32string(U"[log.info] Benchmarking convolution...\n").append(widen(Benchmark::convolution())));
+        break;
+    case hashString(U"--resample"):
+        this->writeLine(std::u32string(U"[log.info] Benchmarking resamplers...\n").append(widen(Benchmark::resampler())));
+        break;
+    case hashString(U"--decode"):
+        {
+            if (cmd.size() > 3)
+            {
+                this->writeLine(U"[log.error] Extra arguments given to \"bench --decode\"!\n");
+                break;
+            }
+            if (TacradCLI::benchRunning.exchange(true))
+            {
+                this->writeLine(U"[log.warn] A decoder benchmark is already running.\n");
+                break;
+            }
+            // Its own thread: it runs for a good while, and the background pool is shared with analyses that would
+            // skew it.
+            static JobPool benchPool(1);
+            fs::path jsonFile = cmd.size() > 2 ? fs::path(cmd[2]) : fs::path("bench-decode.json");
+            benchPool.submit([jsonFile, dir = MusicLibrary::root](std::stop_token)
+            {
+                std::string json;
+                std::u32string report = std::u32string(U"[log.info] Decoder benchmark finished.\n").append(widen(Benchmark::decoders(dir, json)));
+                if (Benchmark::writeJson(jsonFile, json))
+                    TacradCLI::backgroundLines.enqueue(report.append(U"    (written to ").append(jsonFile.u32string()).append(U")\n"));
+                else
+                {
+                    TacradCLI::backgroundLines.enqueue(std::move(report));
+                    TacradCLI::backgroundLines.enqueue(std::u32string(U"[log.error] Couldn't write results to ").append(jsonFile.u32string()).append(U"!\n"));
+                }
+                TacradCLI::benchRunning = false;
+            });
+            this->writeLine(U"[log.info] Benchmarking decoders in the background...\n");
+        }
+        break;
+    case hashString(U"--loudness"):
+        this->writeLine(std::u32string(U"[log.info] Benchmarking loudness analysis...\n").append(widen(Benchmark::loudnessThroughput(MusicLibrary::root))));
+        break;
+    default:
+        this->writeLine(U"[log.warn] Unknown flag argument given to \"bench\".\n");
+    }
+}
+void TacradCLI::commandExit(const std::vector<std::u32string>& cmd)
+{
+    if (MusicPlayer::playing)
+        MusicPlayer::stopMusic();
+    Application::quit();
+}
+
+void TacradCLI::onCommand(std::u32string_view command)
+{
+    constexpr auto split = [](std::u32string_view str) -> std::vector<std::u32string>
+    {
+        std::vector<std::u32string> ret;
+        size_t beg = 0, end = str.find_first_of(U' ', beg);
+        while (end != std::u32string_view::npos)
+        {
+            if (str.begin() + beg != str.begin() + end)
+                ret.push_back(std::u32string(str.begin() + beg, str.begin() + end));
+
+            beg = end + 1;
+            end = str.find_first_of(' ', beg);
+        }
+        if (str.begin() + beg != str.end()) [[likely]]
+            ret.push_back(std::u32string(str.begin() + beg, str.end()));
+        return std::move(ret);
+    };
+
+    if (this->cmdHistory.empty() || this->cmdHistory.back() != command)
+        this->cmdHistory.emplace_back(command.begin(), command.end());
+    this->nextHistoryIndex = this->cmdHistory.size() - 1;
+
+    std::vector<std::u32string> cmd = split(command);
+
+    if (!cmd.empty())
+    {
+        auto it = TacradCLI::commands.begin();
+        while (it != TacradCLI::commands.end() && it->first != hashString(cmd[0]))
+            ++it;
+        if (it == TacradCLI::commands.end())
+        {
+            for (char c : cmd[0])
+            {
+                if (!std::isspace(c))
+                {
+                    this->writeLine(U"[log.error] Unknown command! Enter \"help\" to view a list of available commands!\n");
                     break;
                 }
             }
@@ -793,11 +1983,25 @@ static struct TacradCLISystem
         {
             TacradCLI::font = file_cast<TrueTypeFontPackageFile>(PackageManager::lookupFileByPath(L"assets/Inconsolata/static/Inconsolata-Regular.ttf"));
             
-            if (ma_result code = ma_engine_init(nullptr, &MusicPlayer::engine); code != MA_SUCCESS) [[unlikely]]
+            std::string configErrors;
+            if (!AudioEngine::loadConfig(configErrors)) [[unlikely]]
+                Debug::logError("Couldn't read ", AudioEngine::configFile.string(), ", using the default engine setup.\n");
+            if (!configErrors.empty()) [[unlikely]]
+                Debug::logError(configErrors);
+            if (ma_result code = AudioEngine::init(); code != MA_SUCCESS) [[unlikely]]
             {
                 Debug::logError("Audio engine failed to initialize with code ", code, ".\n");
                 Application::quit();
             }
+            ThreadTuning::apply(ThreadRole::Ui, AudioEngine::settings.uiThread);
+            if (ma_result code = MusicPlayer::initEffects(); code != MA_SUCCESS) [[unlikely]]
+            {
+                Debug::logError("Audio effects failed to initialize with code ", code, ".\n");
+                Application::quit();
+            }
+            // Index the library while the window comes up, rather than on the first "play", then measure whatever's new.
+            MusicLibrary::loadIndex();
+            MusicLibrary::rescanAsync([] { Loudness::analyzeLibrary(); Silence::analyzeLibrary(); SeekTables::buildLibrary(); Waveforms::buildLibrary(); });
             
             Input::beginQueryTextInput();
         };
@@ -810,8 +2014,13 @@ static struct TacradCLISystem
                 if (MusicPlayer::playing)
                     MusicPlayer::stopMusic();
             });
+            TrackLoader::shutdown();
+            TrackHistory::clear();
+            MusicLibrary::saveIndex();
+            OfflineRender::cancel();
                 
-            ma_engine_uninit(&MusicPlayer::engine);
+            MusicPlayer::uninitEffects();
+            AudioEngine::uninit();
         };
 
         auto onTextInput = [](Key key)
@@ -911,10 +2120,26 @@ static struct TacradCLISystem
         
         EngineEvent::OnTick += []
         {
+            TrackLoader::collect();
+            PlaybackController::drain();
+            PlaybackClock::latch();
+            MusicPlayer::convolver.collect();
+            SeekScheduler::tick();
+            HeadCache::sync();
+            AudioEngine::tick();
+            std::u32string line;
+            while (TacradCLI::backgroundLines.try_dequeue(line))
+            {
+                EntityManager2D::foreachEntityWithAll<TacradCLI>([&](Entity2D* entity, TacradCLI* cli)
+                {
+                    cli->writeLine(line);
+                });
+            }
             EntityManager2D::foreachEntityWithAll<TacradCLI>([&](Entity2D* entity, TacradCLI* cli)
             {
-                ma_uint64 curFrame = ma_sound_get_time_in_pcm_frames(&MusicPlayer::music);
-                if (MusicPlayer::playing && curFrame != MusicPlayer::prevFrame)
+                const PlaybackClock::Frame& clock = PlaybackClock::frame();
+                ma_uint64 curFrame = clock.cursor;
+                if (MusicPlayer::playing && clock.valid && curFrame != MusicPlayer::prevFrame)
                 {
                     if (curFrame >= MusicPlayer::frameLen)
                     {
@@ -946,6 +2171,7 @@ static struct TacradCLISystem
                             TrackRestart:
                             MusicPlayer::paused = true;
                             ma_sound_seek_to_pcm_frame(&MusicPlayer::music, 0);
+                            MusicPlayer::stretcher.reset();
                         }
                     }
                     MusicPlayer::prevFrame = curFrame;
@@ -2,6 +2,8 @@
 
 #define NOMINMAX 1
 
+#include <concurrentqueue.h>
+#include <atomic>
 #include <format>
 #include <miniaudio.h>
 #include <random>
@@ -67,6 +69,10 @@ Welcome to the tacrad CLI! (Enter "help" for details.)
 
     bool seekIfOutOfFrame = false;
 
+    // Lines from commands left running in the background, written out at the next tick.
+    inline static moodycamel::ConcurrentQueue<std::u32string> backgroundLines;
+    inline static std::atomic<bool> benchRunning = false;
+
     // In **characters**.
     uint32_t width();
 
@@ -83,9 +89,21 @@ Welcome to the tacrad CLI! (Enter "help" for details.)
     void commandPause(const std::vector<std::u32string>& cmd);
     void commandSeek(const std::vector<std::u32string>& cmd);
     void commandVolume(const std::vector<std::u32string>& cmd);
+    void commandSpeed(const std::vector<std::u32string>& cmd);
     void commandStop(const std::vector<std::u32string>& cmd);
     void commandNext(const std::vector<std::u32string>& cmd);
+    void commandPrevious(const std::vector<std::u32string>& cmd);
     void commandPlaylist(const std::vector<std::u32string>& cmd);
+    void commandConvolve(const std::vector<std::u32string>& cmd);
+    void commandSilence(const std::vector<std::u32string>& cmd);
+    void commandResample(const std::vector<std::u32string>& cmd);
+    void commandEq(const std::vector<std::u32string>& cmd);
+    void commandLoudness(const std::vector<std::u32string>& cmd);
+    void commandLibrary(const std::vector<std::u32string>& cmd);
+    void commandStats(const std::vector<std::u32string>& cmd);
+    void commandRender(const std::vector<std::u32string>& cmd);
+    void commandEngine(const std::vector<std::u32string>& cmd);
+    void commandBench(const std::vector<std::u32string>& cmd);
     void commandExit(const std::vector<std::u32string>& cmd);
 public:
     inline TacradCLI() = default;
@@ -0,0 +1,224 @@
+#include "ThreadTuning.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#if _WIN32
+#define NOMINMAX 1
+#include <windows.h>
+#else
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+    std::string errorText(int error)
+    {
+#if _WIN32
+        return "error " + std::to_string(error);
+#else
+        std::string text = std::strerror(error);
+        if (error == EPERM)
+            text += " (needs CAP_SYS_NICE, or an rtprio limit in /etc/security/limits.conf)";
+        return text;
+#endif
+    }
+    std::string cpuList(uint64_t cpus)
+    {
+        std::string list;
+        for (uint32_t cpu = 0; cpu < 64; cpu++)
+        {
+            if (cpus & (uint64_t(1) << cpu))
+                list.append(list.empty() ? "" : ",").append(std::to_string(cpu));
+        }
+        return list;
+    }
+    bool parseNumber(std::string_view text, uint32_t& out)
+    {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+}
+
+bool ThreadTuning::parsePolicy(std::string_view text, ThreadSettings& settings)
+{
+    size_t space = text.find(' ');
+    std::string_view name = text.substr(0, space);
+    if (name == "normal")
+    {
+        settings.policy = SchedulingPolicy::Normal;
+        settings.priority = 0;
+        return space == std::string_view::npos;
+    }
+    if (name != "fifo" && name != "rr")
+        return false;
+
+    uint32_t priority = 0;
+    std::string_view value = space == std::string_view::npos ? std::string_view() : text.substr(text.find_first_not_of(' ', space));
+    if (!parseNumber(value, priority) || priority < 1 || priority > 99)
+        return false;
+    settings.policy = name == "fifo" ? SchedulingPolicy::Fifo : SchedulingPolicy::RoundRobin;
+    settings.priority = int(priority);
+    return true;
+}
+bool ThreadTuning::parseCpus(std::string_view text, uint64_t& cpus)
+{
+    uint64_t parsed = 0;
+    while (!text.empty())
+    {
+        size_t comma = text.find(',');
+        std::string_view range = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t dash = range.find('-');
+        uint32_t first, last;
+        if (!parseNumber(range.substr(0, dash), first))
+            return false;
+        if (dash == std::string_view::npos)
+            last = first;
+        else if (!parseNumber(range.substr(dash + 1), last))
+            return false;
+        if (first > last || last >= 64)
+            return false;
+        for (uint32_t cpu = first; cpu <= last; cpu++)
+            parsed |= uint64_t(1) << cpu;
+    }
+    cpus = parsed;
+    return parsed != 0;
+}
+
+void ThreadTuning::apply(ThreadRole role, const ThreadSettings& settings)
+{
+    size_t index = size_t(role);
+    ThreadTuning::threads[index].fetch_add(1, std::memory_order_relaxed);
+
+    int scheduling = 0;
+    if (settings.policy != SchedulingPolicy::Normal)
+    {
+#if _WIN32
+        // Needs no rights. The multimedia class scheduler would go further, but through avrt.
+        if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+            scheduling = int(GetLastError());
+#else
+        int policy = settings.policy == SchedulingPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+        sched_param param {};
+        param.sched_priority = std::clamp(settings.priority, sched_get_priority_min(policy), sched_get_priority_max(policy));
+        // Refused, the thread just keeps normal scheduling, which is what the fallback is.
+        scheduling = pthread_setschedparam(pthread_self(), policy, &param);
+#endif
+    }
+    ThreadTuning::schedulingError[index].store(scheduling, std::memory_order_relaxed);
+
+    int affinity = 0;
+    if (settings.cpus)
+    {
+#if _WIN32
+        if (!SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(settings.cpus)))
+            affinity = int(GetLastError());
+#elif __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (uint32_t cpu = 0; cpu < 64; cpu++)
+        {
+            if (settings.cpus & (uint64_t(1) << cpu))
+                CPU_SET(cpu, &set);
+        }
+        affinity = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        affinity = ENOTSUP;
+#endif
+    }
+    ThreadTuning::affinityError[index].store(affinity, std::memory_order_relaxed);
+}
+std::string ThreadTuning::describe(ThreadRole role, const ThreadSettings& settings)
+{
+    size_t index = size_t(role);
+    std::ostringstream info;
+    switch (settings.policy)
+    {
+    case SchedulingPolicy::Normal: info << "normal scheduling"; break;
+    case SchedulingPolicy::Fifo: info << "SCHED_FIFO " << settings.priority; break;
+    case SchedulingPolicy::RoundRobin: info << "SCHED_RR " << settings.priority; break;
+    }
+    info << (settings.cpus ? " on CPUs " + cpuList(settings.cpus) : std::string(" on any CPU"));
+
+    uint32_t threads = ThreadTuning::threads[index].load(std::memory_order_relaxed);
+    int scheduling = ThreadTuning::schedulingError[index].load(std::memory_order_relaxed);
+    int affinity = ThreadTuning::affinityError[index].load(std::memory_order_relaxed);
+    if (threads == 0)
+        info << ", no thread started yet";
+    else
+    {
+        info << ", " << threads << (threads == 1 ? " thread" : " threads");
+        if (scheduling > 0)
+            info << ", scheduling refused, kept normal: " << errorText(scheduling);
+        if (affinity > 0)
+            info << ", pinning refused: " << errorText(affinity);
+        if (scheduling <= 0 && affinity <= 0)
+            info << ", applied";
+    }
+    return std::move(info).str();
+}
+
+bool MemoryLock::lock(const void* data, size_t size)
+{
+    if (!MemoryLock::enabled.load(std::memory_order_relaxed) || !data || size == 0)
+        return false;
+#if _WIN32
+    bool ok = VirtualLock(const_cast<void*>(data), size);
+    int error = ok ? 0 : int(GetLastError());
+#else
+    bool ok = mlock(data, size) == 0;
+    int error = ok ? 0 : errno;
+#endif
+    if (!ok)
+    {
+        MemoryLock::failures.fetch_add(1, std::memory_order_relaxed);
+        MemoryLock::lastError.store(error, std::memory_order_relaxed);
+        return false;
+    }
+    MemoryLock::lockedBytes.fetch_add(size, std::memory_order_relaxed);
+    return true;
+}
+void MemoryLock::unlock(const void* data, size_t size)
+{
+#if _WIN32
+    VirtualUnlock(const_cast<void*>(data), size);
+#else
+    munlock(data, size);
+#endif
+    MemoryLock::lockedBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+std::string MemoryLock::describe()
+{
+    std::ostringstream info;
+    if (!MemoryLock::enabled.load(std::memory_order_relaxed))
+        return "off";
+    info << std::fixed << std::setprecision(1) << MemoryLock::lockedBytes.load(std::memory_order_relaxed) / (1024.0 * 1024.0) << " MB locked";
+#if !_WIN32
+    rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0)
+    {
+        if (limit.rlim_cur == RLIM_INFINITY)
+            info << " of an unlimited allowance";
+        else info << " of a " << limit.rlim_cur / (1024 * 1024) << " MB allowance (RLIMIT_MEMLOCK)";
+    }
+#endif
+    if (uint64_t failures = MemoryLock::failures.load(std::memory_order_relaxed))
+    {
+        int error = MemoryLock::lastError.load(std::memory_order_relaxed);
+        info << ", " << failures << " refused, last: ";
+#if _WIN32
+        info << "error " << error << " (the working set may need raising)";
+#else
+        info << std::strerror(error) << (error == ENOMEM || error == EPERM ? " (raise memlock in /etc/security/limits.conf)" : "");
+#endif
+    }
+    return std::move(info).str();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class SchedulingPolicy
+{
+    Normal,
+    Fifo,       // SCHED_FIFO.
+    RoundRobin  // SCHED_RR.
+};
+
+struct ThreadSettings
+{
+    SchedulingPolicy policy = SchedulingPolicy::Normal;
+    int priority = 0;   // 1 to 99 for the real-time policies.
+    uint64_t cpus = 0;  // Bit per CPU. 0 leaves the affinity alone.
+};
+
+enum class ThreadRole
+{
+    Audio,   // The device callback, or the thread pumping the engine without one.
+    Decode,  // Resource manager job threads, which stream and decode tracks.
+    Ui
+};
+
+// Real-time scheduling and CPU pinning for the threads playback depends on. Each thread applies its own settings when it
+// starts, and how that went is kept per role, so a missing permission shows up in "engine" rather than as a glitch.
+// Off Linux, the real-time policies map to the highest thread priority the platform gives without special rights.
+struct ThreadTuning
+{
+    ThreadTuning() = delete;
+
+    static constexpr uint32_t roleCount = 3;
+
+    // Parses "fifo 80", "rr 50" or "normal".
+    static bool parsePolicy(std::string_view text, ThreadSettings& settings);
+    // Parses CPU lists like "2,3" or "0-3,6".
+    static bool parseCpus(std::string_view text, uint64_t& cpus);
+
+    // On the calling thread. Real-time scheduling that's refused falls back to normal scheduling.
+    static void apply(ThreadRole role, const ThreadSettings& settings);
+    // What `settings` asked of `role`, and what each thread got.
+    static std::string describe(ThreadRole role, const ThreadSettings& settings);
+private:
+    // -1 until a thread of the role has tried, then 0 or the error of the last failure.
+    inline static std::array<std::atomic<int>, roleCount> schedulingError { -1, -1, -1 }, affinityError { -1, -1, -1 };
+    inline static std::array<std::atomic<uint32_t>, roleCount> threads {};
+};
+
+// Pins memory the decoder reads from, so neither paging nor swap can stall it. Only when enabled; what was pinned,
+// and the last refusal, are kept for diagnostics.
+struct MemoryLock
+{
+    MemoryLock() = delete;
+
+    inline static std::atomic<bool> enabled = false;
+    inline static std::atomic<uint64_t> lockedBytes = 0;
+    inline static std::atomic<uint64_t> failures = 0;
+    inline static std::atomic<int> lastError = 0;
+
+    // Pins, and faults in, the pages of [data, data + size). False if disabled or refused.
+    static bool lock(const void* data, size_t size);
+    // Of a range `lock` succeeded on.
+    static void unlock(const void* data, size_t size);
+    static std::string describe();
+};
@@ -0,0 +1,305 @@
+#include "TimeStretch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include <AudioStats.h>
+#include <Simd.h>
+
+namespace
+{
+    float dot(const float* a, const float* b, uint32_t n)
+    {
+        f32x4 acc0 = f32x4::zero(), acc1 = f32x4::zero();
+        uint32_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            acc0 = f32x4::mulAdd(f32x4::load(a + i), f32x4::load(b + i), acc0);
+            acc1 = f32x4::mulAdd(f32x4::load(a + i + 4), f32x4::load(b + i + 4), acc1);
+        }
+        for (; i + 4 <= n; i += 4)
+            acc0 = f32x4::mulAdd(f32x4::load(a + i), f32x4::load(b + i), acc0);
+        float sum = (acc0 + acc1).sum();
+        for (; i < n; i++)
+            sum += a[i] * b[i];
+        return sum;
+    }
+    // Correlation against the template, normalized by the candidate's energy only: the template is the same for every
+    // candidate.
+    float score(float correlation, float energy)
+    {
+        return correlation / std::sqrt(energy + 1e-9f);
+    }
+}
+
+TimeStretchNode::~TimeStretchNode()
+{
+    this->uninit();
+}
+
+ma_result TimeStretchNode::init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate)
+{
+    this->channels = channels;
+    this->sampleRate = sampleRate;
+    // 20 ms hops under 40 ms windows, which suits music and speech alike, and up to 10 ms either way to find a fit. In
+    // multiples of 16 frames, so the quarter-rate search and the vector loops come out even.
+    this->hop = std::max(64u, sampleRate / 50 & ~15u);
+    this->tolerance = this->hop / 2 & ~3u;
+    this->capacity = this->hop * 16;
+
+    // Everything the audio thread touches is sized here, and never again.
+    this->input.assign(size_t(this->capacity) * channels, 0.0f);
+    this->mono.assign(this->capacity, 0.0f);
+    this->coarse.assign(this->capacity / 4, 0.0f);
+    this->segment.assign(size_t(this->hop) * channels, 0.0f);
+    this->rise.resize(size_t(this->hop) * channels);
+    this->fall.resize(size_t(this->hop) * channels);
+    // Periodic Hann, whose halves add up to exactly 1 a hop apart.
+    for (uint32_t i = 0; i < this->hop; i++)
+    {
+        float w = float(0.5 - 0.5 * std::cos(std::numbers::pi * i / this->hop));
+        std::fill_n(this->rise.begin() + size_t(i) * channels, channels, w);
+        std::fill_n(this->fall.begin() + size_t(i) * channels, channels, 1.0f - w);
+    }
+    this->fill = this->readPos = this->segmentRemaining = 0;
+    this->stretching = false;
+    this->resetsSeen = this->resets.load(std::memory_order_relaxed);
+    this->held.store(0, std::memory_order_relaxed);
+
+    if (!graph)
+        return MA_SUCCESS;
+
+    static ma_node_vtable vtable
+    {
+        .onProcess = TimeStretchNode::onProcess,
+        .onGetRequiredInputFrameCount = TimeStretchNode::onGetRequiredInputFrameCount,
+        .inputBusCount = 1,
+        .outputBusCount = 1,
+        .flags = MA_NODE_FLAG_DIFFERENT_PROCESSING_RATES
+    };
+    ma_node_config config = ma_node_config_init();
+    config.vtable = &vtable;
+    config.pInputChannels = &this->channels;
+    config.pOutputChannels = &this->channels;
+    ma_result result = ma_node_init(graph, &config, nullptr, &this->base);
+    this->nodeInitialized = result == MA_SUCCESS;
+    return result;
+}
+void TimeStretchNode::uninit()
+{
+    if (this->nodeInitialized)
+    {
+        ma_node_uninit(&this->base, nullptr);
+        this->nodeInitialized = false;
+    }
+}
+
+void TimeStretchNode::setSpeed(float speed)
+{
+    this->_speed.store(std::clamp(speed, TimeStretchNode::minSpeed, TimeStretchNode::maxSpeed), std::memory_order_relaxed);
+}
+void TimeStretchNode::reset()
+{
+    this->resets.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t TimeStretchNode::heldFrames() const
+{
+    return this->held.load(std::memory_order_relaxed) + (this->nodeInitialized ? this->base.cachedFrameCountIn : 0);
+}
+
+uint32_t TimeStretchNode::take(const float* in, uint32_t frameCount)
+{
+    // Enough ahead of the read position for any window at any speed, and no more, or what's held back would creep up
+    // with every read rounded up. The rest stays in miniaudio's cache until it's wanted.
+    const uint32_t wanted = 3 * this->hop + 2 * this->tolerance, ahead = this->fill - this->readPos;
+    frameCount = std::min(frameCount, wanted > ahead ? wanted - ahead : 0);
+    if (this->fill + frameCount > this->capacity)
+        this->compact();
+    frameCount = std::min(frameCount, this->capacity - this->fill);
+    if (frameCount == 0)
+        return 0;
+
+    const uint32_t C = this->channels;
+    std::copy_n(in, size_t(frameCount) * C, this->input.data() + size_t(this->fill) * C);
+    const float scale = 1.0f / C;
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < C; c++)
+            sum += in[size_t(i) * C + c];
+        this->mono[this->fill + i] = sum * scale;
+    }
+    // Groups of four completed by this read.
+    for (uint32_t g = this->fill / 4; g < (this->fill + frameCount) / 4; g++)
+    {
+        const float* m = this->mono.data() + g * 4;
+        this->coarse[g] = (m[0] + m[1] + m[2] + m[3]) * 0.25f;
+    }
+    this->fill += frameCount;
+    return frameCount;
+}
+void TimeStretchNode::compact()
+{
+    // Nothing before the read position goes out again, and the next window can't start more than the tolerance
+    // before the last one's nominal position. Kept four-aligned for the quarter-rate copy.
+    uint32_t keepFrom = this->readPos;
+    if (this->stretching)
+        keepFrom = uint32_t(std::clamp<int64_t>(int64_t(std::floor(this->nominal)) - this->tolerance, 0, this->readPos));
+    keepFrom &= ~3u;
+    if (keepFrom == 0)
+        return;
+
+    const uint32_t C = this->channels;
+    const uint32_t kept = this->fill - keepFrom;
+    std::memmove(this->input.data(), this->input.data() + size_t(keepFrom) * C, size_t(kept) * C * sizeof(float));
+    std::memmove(this->mono.data(), this->mono.data() + keepFrom, size_t(kept) * sizeof(float));
+    std::memmove(this->coarse.data(), this->coarse.data() + keepFrom / 4, size_t(kept / 4) * sizeof(float));
+    this->fill = kept;
+    this->readPos -= keepFrom;
+    this->nominal -= keepFrom;
+}
+uint32_t TimeStretchNode::search(uint32_t first, uint32_t last) const
+{
+    // What the window would have to start with to carry on the last one seamlessly: the input right after it.
+    const uint32_t lengthCoarse = this->hop / 4;
+    const float* targetCoarse = this->coarse.data() + this->readPos / 4;
+
+    uint32_t best = first;
+    uint32_t from = (first + 3) / 4, to = last / 4;
+    if (from <= to)
+    {
+        float energy = dot(this->coarse.data() + from, this->coarse.data() + from, lengthCoarse);
+        float bestScore = -INFINITY;
+        for (uint32_t j = from;; j++)
+        {
+            float s = score(dot(targetCoarse, this->coarse.data() + j, lengthCoarse), energy);
+            if (s > bestScore)
+            {
+                bestScore = s;
+                best = j * 4;
+            }
+            if (j == to)
+                break;
+            float leaving = this->coarse[j], entering = this->coarse[j + lengthCoarse];
+            energy = std::max(0.0f, energy + entering * entering - leaving * leaving);
+        }
+    }
+
+    // Refined at the full rate, within what a quarter-rate step could have missed.
+    const float* target = this->mono.data() + this->readPos;
+    uint32_t refineFrom = std::max(first, best >= 3 ? best - 3 : 0), refineTo = std::min(last, best + 3);
+    float bestScore = -INFINITY;
+    for (uint32_t c = refineFrom; c <= refineTo; c++)
+    {
+        const float* candidate = this->mono.data() + c;
+        float s = score(dot(target, candidate, this->hop), dot(candidate, candidate, this->hop));
+        if (s > bestScore)
+        {
+            bestScore = s;
+            best = c;
+        }
+    }
+    return best;
+}
+bool TimeStretchNode::nextWindow(float speed)
+{
+    double next = this->nominal + this->hop * double(speed);
+    int64_t center = std::llround(next);
+    uint32_t first = uint32_t(std::max<int64_t>(center - this->tolerance, 0)), last = uint32_t(std::max<int64_t>(center + this->tolerance, 0));
+    // The falling half of the last window, and every candidate for this one.
+    if (std::max(this->readPos, last) + this->hop > this->fill)
+        return false;
+
+    uint32_t start = first == last ? first : this->search(first, last);
+    const uint32_t C = this->channels;
+    const float* falling = this->input.data() + size_t(this->readPos) * C;
+    const float* rising = this->input.data() + size_t(start) * C;
+    for (size_t i = 0; i < size_t(this->hop) * C; i += 4)
+    {
+        f32x4 mixed = f32x4::mulAdd(f32x4::load(falling + i), f32x4::load(this->fall.data() + i), f32x4::load(rising + i) * f32x4::load(this->rise.data() + i));
+        mixed.store(this->segment.data() + i);
+    }
+    this->readPos = start + this->hop;
+    this->nominal = next;
+    this->segmentRemaining = this->hop;
+    return true;
+}
+
+void TimeStretchNode::process(const float* in, uint32_t& frameCountIn, float* out, uint32_t& frameCountOut)
+{
+    if (uint32_t resets = this->resets.load(std::memory_order_acquire); resets != this->resetsSeen)
+    {
+        this->resetsSeen = resets;
+        this->fill = this->readPos = this->segmentRemaining = 0;
+        this->stretching = false;
+    }
+
+    const uint32_t C = this->channels;
+    if (!this->stretching && this->segmentRemaining == 0 && this->fill == this->readPos && this->speed() == 1.0f)
+    {
+        uint32_t frames = std::min(frameCountIn, frameCountOut);
+        std::copy_n(in, size_t(frames) * C, out);
+        frameCountIn = frameCountOut = frames;
+        this->fill = this->readPos = 0;
+        this->held.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t consumed = this->take(in, frameCountIn);
+    uint32_t produced = 0;
+    while (produced < frameCountOut)
+    {
+        if (this->segmentRemaining)
+        {
+            uint32_t frames = std::min(this->segmentRemaining, frameCountOut - produced);
+            std::copy_n(this->segment.data() + size_t(this->hop - this->segmentRemaining) * C, size_t(frames) * C, out + size_t(produced) * C);
+            this->segmentRemaining -= frames;
+            produced += frames;
+            continue;
+        }
+
+        float speed = this->speed();
+        if (speed == 1.0f)
+        {
+            // The falling half of the last window and the rising half of one starting right after it add up to the
+            // input as it was, so from a window boundary, 1x is a plain copy of what's held back.
+            this->stretching = false;
+            uint32_t frames = std::min(this->fill - this->readPos, frameCountOut - produced);
+            if (frames == 0)
+                break;
+            std::copy_n(this->input.data() + size_t(this->readPos) * C, size_t(frames) * C, out + size_t(produced) * C);
+            this->readPos += frames;
+            produced += frames;
+            continue;
+        }
+        if (!this->stretching)
+        {
+            // As if a window had started a hop back, with its rising half already out.
+            this->stretching = true;
+            this->nominal = double(this->readPos) - this->hop;
+        }
+        if (!this->nextWindow(speed))
+            break;
+    }
+    frameCountIn = consumed;
+    frameCountOut = produced;
+    // From the frame going out next to the last one taken.
+    this->held.store(this->fill - this->readPos + this->segmentRemaining, std::memory_order_relaxed);
+}
+
+void TimeStretchNode::onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut)
+{
+    AudioStats::EffectScope timed;
+    uint32_t frameCountIn = *pFrameCountIn, frameCountOut = *pFrameCountOut;
+    static_cast<TimeStretchNode*>(pNode)->process(ppFramesIn[0], frameCountIn, ppFramesOut[0], frameCountOut);
+    *pFrameCountIn = frameCountIn;
+    *pFrameCountOut = frameCountOut;
+}
+ma_result TimeStretchNode::onGetRequiredInputFrameCount(ma_node* pNode, ma_uint32 outputFrameCount, ma_uint32* pInputFrameCount)
+{
+    *pInputFrameCount = std::max(1u, uint32_t(std::ceil(outputFrameCount * static_cast<TimeStretchNode*>(pNode)->speed())));
+    return MA_SUCCESS;
+}
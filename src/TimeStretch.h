@@ -0,0 +1,86 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Pitch-preserving speed change by WSOLA. Output is overlap-added from Hann windows of the input at a fixed hop, each
+// window taken from near where the speed says it should start, at the offset that best carries on from the previous
+// one. The best offset is found by correlation on a mono mixdown, first at a quarter of the rate and then refined, so
+// the search costs about what the overlap-add does.
+// Reads more or less input than it writes, and holds some back: heldFrames() is how much, so the clock of a track
+// feeding it can be taken back to what's being heard. At 1x with nothing held back, input goes straight through.
+// The speed changes from any thread and takes effect at the next window; reset() drops what's held, for seeks.
+class TimeStretchNode
+{
+public:
+    static constexpr float minSpeed = 0.5f;
+    static constexpr float maxSpeed = 2.0f;
+private:
+    ma_node_base base; // Must stay the first member, miniaudio reinterprets ma_node* as ma_node_base*.
+
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t hop = 0;       // Output frames per window, half its length.
+    uint32_t tolerance = 0; // How far a window may start from its nominal position, either way.
+    bool nodeInitialized = false;
+
+    // Settings side.
+    std::atomic<float> _speed = 1.0f;
+    std::atomic<uint32_t> resets = 0;
+
+    // Audio side. Input is kept from the earliest frame the next window could start at, along with a mono mixdown and
+    // a quarter-rate copy of it for the search. Positions index into it.
+    std::vector<float> input, mono, coarse;
+    std::vector<float> rise, fall; // The window's halves, per sample of interleaved frames.
+    std::vector<float> segment;    // The last window's output.
+    uint32_t capacity = 0, fill = 0;
+    uint32_t readPos = 0;          // Where the input next goes out, straight or under the falling half of a window.
+    double nominal = 0.0;          // Where the last window would have started, had it not been moved to fit.
+    uint32_t segmentRemaining = 0;
+    bool stretching = false;
+    uint32_t resetsSeen = 0;
+    std::atomic<uint32_t> held = 0;
+
+    static void onProcess(ma_node* pNode, const float** ppFramesIn, ma_uint32* pFrameCountIn, float** ppFramesOut, ma_uint32* pFrameCountOut);
+    static ma_result onGetRequiredInputFrameCount(ma_node* pNode, ma_uint32 outputFrameCount, ma_uint32* pInputFrameCount);
+
+    uint32_t take(const float* in, uint32_t frameCount);
+    void compact();
+    uint32_t search(uint32_t first, uint32_t last) const;
+    bool nextWindow(float speed);
+public:
+    TimeStretchNode() = default;
+    TimeStretchNode(const TimeStretchNode&) = delete;
+    ~TimeStretchNode();
+
+    // `graph` may be null, for using process() directly.
+    ma_result init(ma_node_graph* graph, uint32_t channels, uint32_t sampleRate);
+    void uninit();
+
+    inline ma_node* node()
+    {
+        return &this->base;
+    }
+
+    // Any thread.
+    inline float speed() const
+    {
+        return this->_speed.load(std::memory_order_relaxed);
+    }
+    // Clamped to [minSpeed, maxSpeed].
+    void setSpeed(float speed);
+    // Drops the input held back, on the next process(). For when what's coming in no longer follows on from it.
+    void reset();
+
+    // Audio side. Consumes up to `frameCountIn` frames of `in` and writes up to `frameCountOut` to `out`, updating both
+    // counts to what was done.
+    void process(const float* in, uint32_t& frameCountIn, float* out, uint32_t& frameCountOut);
+    // Input frames taken but not yet heard, including any miniaudio still has cached for the node.
+    uint32_t heldFrames() const;
+    inline uint32_t hopFrames() const
+    {
+        return this->hop;
+    }
+};
@@ -0,0 +1,98 @@
+#include "TrackHistory.h"
+
+#include <algorithm>
+
+void TrackHistory::push(RecentTrack recent)
+{
+    TrackHistory::settle();
+    if (!recent.track)
+        return;
+    if (recent.span && recent.span->end != 0 && recent.frame >= recent.length)
+        TrackHistory::setAside = std::move(recent);
+    else TrackHistory::keep(std::move(recent));
+}
+std::optional<RecentTrack> TrackHistory::previous(bool currentPushed)
+{
+    TrackHistory::settle();
+    size_t skip = currentPushed ? 1 : 0;
+    if (TrackHistory::position <= skip)
+        return std::nullopt;
+    size_t index = TrackHistory::position - skip - 1;
+    RecentTrack recent = std::move(TrackHistory::entries[index]);
+    TrackHistory::entries.erase(TrackHistory::entries.begin() + index);
+    // What played after it, the current track included, is now ahead.
+    TrackHistory::position = index;
+    ++TrackHistory::resumed;
+    return recent;
+}
+std::optional<RecentTrack> TrackHistory::take(const fs::path& file, const std::optional<CueSpan>& span)
+{
+    if (TrackHistory::setAside && TrackHistory::setAside->track->file == file)
+    {
+        RecentTrack recent = std::move(*TrackHistory::setAside);
+        TrackHistory::setAside.reset();
+        if (span && span->start == recent.span->end)
+            ++TrackHistory::carried;
+        else ++TrackHistory::resumed;
+        return recent;
+    }
+    TrackHistory::settle();
+    auto it = std::find_if(TrackHistory::entries.begin(), TrackHistory::entries.end(), [&](const RecentTrack& recent) { return recent.track->file == file; });
+    if (it == TrackHistory::entries.end())
+        return std::nullopt;
+    if (size_t(it - TrackHistory::entries.begin()) < TrackHistory::position)
+        --TrackHistory::position;
+    RecentTrack recent = std::move(*it);
+    TrackHistory::entries.erase(it);
+    ++TrackHistory::resumed;
+    return recent;
+}
+void TrackHistory::clear()
+{
+    TrackHistory::setAside.reset();
+    TrackHistory::entries.clear();
+    TrackHistory::position = 0;
+}
+
+size_t TrackHistory::bytes()
+{
+    size_t bytes = TrackHistory::setAside ? TrackHistory::setAside->track->bytes() : 0;
+    for (const RecentTrack& recent : TrackHistory::entries)
+        bytes += recent.track->bytes();
+    return bytes;
+}
+void TrackHistory::trim()
+{
+    size_t bytes = TrackHistory::bytes() - (TrackHistory::setAside ? TrackHistory::setAside->track->bytes() : 0);
+    while (!TrackHistory::entries.empty() && (TrackHistory::entries.size() > TrackHistory::depth || bytes > TrackHistory::budgetBytes))
+    {
+        // Whichever end is further from the current track.
+        if (TrackHistory::position >= TrackHistory::entries.size() - TrackHistory::position)
+        {
+            bytes -= TrackHistory::entries.front().track->bytes();
+            TrackHistory::entries.pop_front();
+            --TrackHistory::position;
+        }
+        else
+        {
+            bytes -= TrackHistory::entries.back().track->bytes();
+            TrackHistory::entries.pop_back();
+        }
+    }
+}
+void TrackHistory::settle()
+{
+    if (!TrackHistory::setAside)
+        return;
+    RecentTrack recent = std::move(*TrackHistory::setAside);
+    TrackHistory::setAside.reset();
+    TrackHistory::keep(std::move(recent));
+}
+void TrackHistory::keep(RecentTrack recent)
+{
+    if (TrackHistory::depth == 0)
+        return;
+    TrackHistory::entries.insert(TrackHistory::entries.begin() + TrackHistory::position, std::move(recent));
+    ++TrackHistory::position;
+    TrackHistory::trim();
+}
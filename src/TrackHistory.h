@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <MusicLibrary.h>
+#include <TrackLoader.h>
+
+namespace fs = std::filesystem;
+
+// A track that was played and left open, paused where it was left.
+struct RecentTrack
+{
+    std::unique_ptr<LoadedTrack> track;
+    std::u32string name;
+    std::optional<CueSpan> span;
+    uint64_t frame;  // Where it was left, in the sound's frames.
+    uint64_t length; // Likewise.
+};
+
+// Tracks played recently, kept open in the order they played, so going back to one resumes it at once instead of
+// looking it up and opening it again. Going back leaves the track it came from ahead of it, so going forward again
+// is just as quick. Within `depth` tracks and `budgetBytes`, dropping whatever's furthest from the current track.
+// An entry of a CUE sheet played to its end is set aside for the next one instead, budget or not: a single-file rip
+// easily outgrows it, and the next entry carries on through the same decoder from right where it stopped.
+struct TrackHistory
+{
+    TrackHistory() = delete;
+
+    inline static uint32_t depth = 3;
+    inline static size_t budgetBytes = size_t(256) << 20;
+
+    inline static uint32_t resumed = 0; // Tracks gone back or forward to without opening them again.
+    inline static uint32_t carried = 0; // Entries of CUE sheets that carried on from the one before.
+
+    // Control thread. Keeps a track that stopped playing, just behind wherever the current one will be.
+    static void push(RecentTrack recent);
+    // Control thread. The track before the current one, taken out. `currentPushed` says whether the current track
+    // was just pushed, in which case it's left ahead of the one returned.
+    static std::optional<RecentTrack> previous(bool currentPushed);
+    // Control thread. `file`, if it's being kept open, taken out. The entry of a CUE sheet set aside goes first, if
+    // it's in `file`, and is counted as carried if `span` starts where it ended.
+    static std::optional<RecentTrack> take(const fs::path& file, const std::optional<CueSpan>& span = std::nullopt);
+    // Control thread. Closes everything, before the resource manager goes away.
+    static void clear();
+
+    // How many tracks are kept behind and ahead of the current one, besides any entry set aside.
+    inline static size_t behind()
+    {
+        return TrackHistory::position;
+    }
+    inline static size_t ahead()
+    {
+        return TrackHistory::entries.size() - TrackHistory::position;
+    }
+    static size_t bytes();
+    // Oldest first.
+    inline static const std::deque<RecentTrack>& list()
+    {
+        return TrackHistory::entries;
+    }
+    // Drops tracks until what's kept fits `depth` and `budgetBytes`, say after they changed.
+    static void trim();
+private:
+    // In the order they played. Those before `position` played before the current track, the rest after it.
+    inline static std::deque<RecentTrack> entries;
+    inline static size_t position = 0;
+    inline static std::optional<RecentTrack> setAside;
+
+    // Pushes whatever's set aside after all, once the next track didn't take it.
+    static void settle();
+    static void keep(RecentTrack recent);
+};
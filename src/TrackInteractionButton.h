@@ -7,6 +7,7 @@
 #include <InteractableProgressBar.h>
 #include <MusicPlayer.h>
 #include <NanoVGContext.h>
+#include <PlaybackController.h>
 #include <RunningTime.h>
 
 #define BUTTON_PADDING 5.0f
@@ -47,13 +48,25 @@ class TrackInteractionButton : public ComponentData2D
                 delete TrackInteractionButton::cursorDefault;
                 delete TrackInteractionButton::cursorHover;
             };
+            EngineEvent::OnTick += []
+            {
+                // Whatever changed playback, the play/pause button shows what a click would do now. While a track is
+                // still loading, that's whether it starts playing once open, shown dimmed until it does.
+                auto state = PlaybackController::state();
+                TrackInteractionButtonType toggle = (state->playing || state->loading) && !state->paused ? TrackInteractionButtonType::Pause : TrackInteractionButtonType::Play;
+                EntityManager2D::foreachEntityWithAll<TrackInteractionButton>([&](Entity2D* entity, TrackInteractionButton* button)
+                {
+                    if (button->type == TrackInteractionButtonType::Play || button->type == TrackInteractionButtonType::Pause)
+                        button->type = toggle;
+                    button->loading = state->loading;
+                });
+            };
             EngineEvent::OnMouseDown += [](MouseButton button)
             {
                 switch (button)
                 {
                 case MouseButton::Left:
-                    bool setPlay = false;
-                    bool setPause = false;
+                    auto state = PlaybackController::state();
                     EntityManager2D::foreachEntityWithAll<TrackInteractionButton>([&](Entity2D* entity, TrackInteractionButton* button)
                     {
                         if (button->rectTransform()->queryPointIn(Input::mousePosition()))
@@ -61,28 +74,21 @@ class TrackInteractionButton : public ComponentData2D
                             switch (button->type)
                             {
                             case TrackInteractionButtonType::Play:
-                                if (MusicPlayer::playing)
-                                {
-                                    MusicPlayer::musicResume();
-                                    button->type = TrackInteractionButtonType::Pause;
-                                }
+                                if (state->playing || state->loading)
+                                    PlaybackController::post({ .type = PlaybackCommandType::Resume });
                                 break;
                             case TrackInteractionButtonType::Pause:
-                                if (MusicPlayer::playing)
-                                {
-                                    MusicPlayer::musicPause();
-                                    button->type = TrackInteractionButtonType::Play;
-                                }
+                                if (state->playing || state->loading)
+                                    PlaybackController::post({ .type = PlaybackCommandType::Pause });
                                 break;
                             case TrackInteractionButtonType::Stop:
-                                if (MusicPlayer::playing)
+                                if (state->playing || state->loading)
                                 {
                                     button->runningTime->runtime->active = false;
                                     button->runningTime->slash->active = false;
                                     button->runningTime->total->active = false;
                                     button->runningTime->track->active = false;
-                                    MusicPlayer::stopMusic();
-                                    setPlay = true;
+                                    PlaybackController::post({ .type = PlaybackCommandType::Stop });
                                 }
                                 break;
                             case TrackInteractionButtonType::Next:
@@ -90,30 +96,11 @@ class TrackInteractionButton : public ComponentData2D
                                 button->runningTime->slash->active = true;
                                 button->runningTime->total->active = true;
                                 button->runningTime->track->active = true;
-                                MusicPlayer::next();
-                                if (MusicPlayer::paused)
-                                    setPlay = true;
-                                else setPause = true;
+                                PlaybackController::post({ .type = PlaybackCommandType::Next });
                                 break;
                             }
                         }
                     });
-                    if (setPlay)
-                    {
-                        EntityManager2D::foreachEntityWithAll<TrackInteractionButton>([&](Entity2D* entity, TrackInteractionButton* button)
-                        {
-                            if (button->type == TrackInteractionButtonType::Pause)
-                                button->type = TrackInteractionButtonType::Play;
-                        });
-                    }
-                    if (setPause)
-                    {
-                        EntityManager2D::foreachEntityWithAll<TrackInteractionButton>([&](Entity2D* entity, TrackInteractionButton* button)
-                        {
-                            if (button->type == TrackInteractionButtonType::Play)
-                                button->type = TrackInteractionButtonType::Pause;
-                        });
-                    }
                     break;
                 }
             };
@@ -143,10 +130,12 @@ class TrackInteractionButton : public ComponentData2D
 public:
     TrackInteractionButtonType type;
     RunningTime* runningTime = nullptr;
+    bool loading = false;
 
     inline void renderOffload()
     {
-        CoreEngine::queueRenderJobForFrame([w = Window::pixelWidth(), h = Window::pixelHeight(), bounds = NanoVG::boundsFromRectTransform(this->rectTransform()), type = this->type]
+        CoreEngine::queueRenderJobForFrame([w = Window::pixelWidth(), h = Window::pixelHeight(), bounds = NanoVG::boundsFromRectTransform(this->rectTransform()), type = this->type,
+                                       loading = this->loading]
         {
             nvgBeginFrame(NanoVG::context, +w, +h, 1.0f);
 
@@ -167,7 +156,7 @@ public:
                     nvgLineTo(NanoVG::context, bounds.x + xOffset + BUTTON_PADDING + (bounds.height - BUTTON_PADDING * 2.0f) * std::sqrt(3.0f) / 2.0f, bounds.y + bounds.height / 2.0f);
                     nvgLineTo(NanoVG::context, bounds.x + xOffset + BUTTON_PADDING, bounds.y + bounds.height - BUTTON_PADDING);
                     nvgClosePath(NanoVG::context);
-                    nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                    nvgFillColor(NanoVG::context, nvgRGBA(0xff, 0xff, 0xff, loading ? 0x80 : 0xff));
                     nvgFill(NanoVG::context);
                 }
                 break;
@@ -182,7 +171,7 @@ public:
                         bounds.x + BUTTON_PADDING + centrelineOffset - PAUSE_BUTTON_BAR_WIDTH / 2.0f - PAUSE_BUTTON_BAR_WIDTH, bounds.y + BUTTON_PADDING + PAUSE_BUTTON_EXTRA_VERTICAL_PADDING,
                         PAUSE_BUTTON_BAR_WIDTH, bounds.height - BUTTON_PADDING * 2.0f - PAUSE_BUTTON_EXTRA_VERTICAL_PADDING * 2.0f
                     );
-                    nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                    nvgFillColor(NanoVG::context, nvgRGBA(0xff, 0xff, 0xff, loading ? 0x80 : 0xff));
                     nvgFill(NanoVG::context);
                     
                     nvgBeginPath(NanoVG::context);
@@ -192,7 +181,7 @@ public:
                         bounds.x + BUTTON_PADDING + centrelineOffset + PAUSE_BUTTON_BAR_WIDTH / 2.0f, bounds.y + BUTTON_PADDING + PAUSE_BUTTON_EXTRA_VERTICAL_PADDING,
                         PAUSE_BUTTON_BAR_WIDTH, bounds.height - BUTTON_PADDING * 2.0f - PAUSE_BUTTON_EXTRA_VERTICAL_PADDING * 2.0f
                     );
-                    nvgFillColor(NanoVG::context, nvgRGB(0xff, 0xff, 0xff));
+                    nvgFillColor(NanoVG::context, nvgRGBA(0xff, 0xff, 0xff, loading ? 0x80 : 0xff));
                     nvgFill(NanoVG::context);
                 }
                 break;
@@ -0,0 +1,213 @@
+#include "TrackLoader.h"
+
+#include <algorithm>
+
+#include <JobPool.h>
+#include <MusicPlayer.h>
+
+namespace
+{
+    // Its own thread rather than the background pool, which a library scan can keep busy for minutes. One is enough:
+    // only the latest load is ever wanted, and a cancelled one gives up at its next step.
+    JobPool& loadPool()
+    {
+        static JobPool pool(1);
+        return pool;
+    }
+    // Tells apart registrations of the same file by tracks open at the same time, one playing and one kept in
+    // TrackHistory, which would otherwise share whichever mapping was registered first.
+    std::atomic<uint64_t> registrations = 0;
+}
+
+LoadedTrack::~LoadedTrack()
+{
+    // Top down, each source before what it reads from.
+    this->head.reset();
+    this->source.reset();
+    this->mp3.reset();
+    if (this->resource)
+        ma_resource_manager_data_source_uninit(this->resource.get());
+    if (!this->resourceName.empty())
+        ma_resource_manager_unregister_data(this->resourceManager, this->resourceName.c_str());
+}
+ma_data_source* LoadedTrack::dataSource()
+{
+    if (this->head)
+        return this->head->dataSource();
+    if (this->source)
+        return this->source->dataSource();
+    if (this->mp3)
+        return this->mp3->dataSource();
+    return this->resource.get();
+}
+size_t LoadedTrack::bytes() const
+{
+    return this->mapping.size() + (this->head ? this->head->bytes() : 0);
+}
+
+std::unique_ptr<LoadedTrack> LoadedTrack::open(const fs::path& file, bool stream, FileMapping mapping, ma_resource_manager* resourceManager,
+                                               ma_uint32 sampleRate, ResamplerQuality quality, std::stop_token stop)
+{
+    auto track = std::make_unique<LoadedTrack>();
+    track->file = file;
+    track->resourceManager = resourceManager;
+    if (!stream && !mapping)
+        mapping = FileMapping(file);
+    if (stop.stop_requested())
+        return nullptr;
+    // Only when lock_memory is on. Prefetched, the pages are already resident, so this is mostly bookkeeping.
+    mapping.lock();
+
+    std::string resourceName = file.string();
+    auto openResource = [&](ma_uint32 flags)
+    {
+        // Waits for the resource manager to have opened it, as a sound loading a file would, so its format is known.
+        track->resource = std::make_unique<ma_resource_manager_data_source>();
+        if (ma_resource_manager_data_source_init(resourceManager, resourceName.c_str(), flags | MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_WAIT_INIT, nullptr, track->resource.get()) != MA_SUCCESS)
+        {
+            track->resource.reset();
+            return false;
+        }
+        return true;
+    };
+    if (stream)
+        return openResource(MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_STREAM) ? std::move(track) : nullptr;
+
+    // Long MP3s seek through the table built for them in the background, rather than decoding from the start of the file.
+    std::shared_ptr<const TrackSeekTable> seekTable = mapping ? SeekTables::find(file) : nullptr;
+    if (seekTable && seekTable->pointCount > 0)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        auto mp3 = std::make_unique<Mp3Source>();
+        if (mp3->init(mapping.data(), mapping.size(), *seekTable) == MA_SUCCESS)
+        {
+            if (stop.stop_requested())
+                return nullptr;
+            if (quality != ResamplerQuality::Linear && mp3->sampleRate() != sampleRate)
+            {
+                track->source = std::make_unique<ResampledSource>();
+                if (track->source->init(mp3->dataSource(), sampleRate, quality) != MA_SUCCESS)
+                    track->source.reset(); // The sound's own resampler will do.
+            }
+            // No pitch when resampled ourselves, so the sound's own resampler is bypassed entirely.
+            track->soundFlags = track->source ? MA_SOUND_FLAG_NO_PITCH : 0;
+            track->mp3 = std::move(mp3);
+            track->mapping = std::move(mapping);
+            return track;
+        }
+    }
+
+    // Tracks that need resampling decode through our own converter, still straight out of the mapping. Already at the
+    // device's rate, there's nothing for it to do, and the resource manager's path is just as good.
+    if (mapping && quality != ResamplerQuality::Linear)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        auto source = std::make_unique<ResampledSource>();
+        if (source->init(mapping.data(), mapping.size(), sampleRate, quality) == MA_SUCCESS && source->nativeSampleRate() != sampleRate)
+        {
+            track->source = std::move(source);
+            track->soundFlags = MA_SOUND_FLAG_NO_PITCH;
+            track->mapping = std::move(mapping);
+            return track;
+        }
+    }
+    if (stop.stop_requested())
+        return nullptr;
+
+    // Registered encoded data isn't copied, so the decoder reads straight from the page cache. Unmappable files take the VFS path.
+    if (mapping)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        // The decoder recognizes registered data by its content, so the name only has to be unique.
+        std::string registered = resourceName + "#" + std::to_string(registrations.fetch_add(1, std::memory_order_relaxed));
+        if (ma_resource_manager_register_encoded_data(resourceManager, registered.c_str(), mapping.data(), mapping.size()) == MA_SUCCESS)
+            track->resourceName = resourceName = std::move(registered);
+        else mapping = FileMapping();
+    }
+    track->mapping = std::move(mapping);
+    // Unregisters on the way out if this fails.
+    return openResource(0) ? std::move(track) : nullptr;
+}
+std::unique_ptr<LoadedTrack> LoadedTrack::fromHead(const fs::path& file, std::shared_ptr<const TrackHead> head)
+{
+    auto track = std::make_unique<LoadedTrack>();
+    track->file = file;
+    track->head = std::make_unique<HeadStartSource>();
+    if (track->head->init(std::move(head)) != MA_SUCCESS)
+        return nullptr;
+    track->soundFlags = MA_SOUND_FLAG_NO_PITCH;
+    return track;
+}
+
+void TrackLoader::load(const fs::path& file, bool stream, FileMapping mapping, Done done)
+{
+    TrackLoader::cancel();
+    TrackLoader::started.fetch_add(1, std::memory_order_relaxed);
+    TrackLoader::pendingDone = std::move(done);
+    TrackLoader::pendingSince = Clock::now();
+
+    uint64_t generation = TrackLoader::generation.load(std::memory_order_relaxed);
+    std::stop_source source;
+    TrackLoader::inFlight = source;
+    // The pool's own token only trips on shutdown, so the load's is checked alongside it.
+    loadPool().submit([file, stream, mapping = std::make_shared<FileMapping>(std::move(mapping)), generation, source,
+                       resourceManager = ma_engine_get_resource_manager(&MusicPlayer::engine), sampleRate = ma_engine_get_sample_rate(&MusicPlayer::engine),
+                       quality = MusicPlayer::resampleQuality](std::stop_token poolStop)
+    {
+        std::stop_source stop;
+        std::stop_callback forwardLoad(source.get_token(), [&] { stop.request_stop(); });
+        std::stop_callback forwardPool(poolStop, [&] { stop.request_stop(); });
+        std::unique_ptr<LoadedTrack> track = stop.stop_requested() ? nullptr :
+            LoadedTrack::open(file, stream, std::move(*mapping), resourceManager, sampleRate, quality, stop.get_token());
+        if (stop.stop_requested())
+            return; // Whatever it opened goes with it, here rather than on the control thread.
+
+        std::lock_guard guard(TrackLoader::mutex);
+        if (generation != TrackLoader::generation.load(std::memory_order_relaxed))
+            return;
+        TrackLoader::ready = true;
+        TrackLoader::readyGeneration = generation;
+        TrackLoader::readyTrack = std::move(track);
+    });
+}
+void TrackLoader::cancel()
+{
+    std::unique_ptr<LoadedTrack> stale;
+    {
+        std::lock_guard guard(TrackLoader::mutex);
+        TrackLoader::generation.fetch_add(1, std::memory_order_relaxed);
+        TrackLoader::ready = false;
+        stale = std::move(TrackLoader::readyTrack);
+    }
+    TrackLoader::inFlight.request_stop();
+    if (TrackLoader::pendingDone)
+    {
+        TrackLoader::cancelled.fetch_add(1, std::memory_order_relaxed);
+        TrackLoader::pendingDone = nullptr;
+    }
+}
+void TrackLoader::collect()
+{
+    if (!TrackLoader::pendingDone)
+        return;
+    std::unique_ptr<LoadedTrack> track;
+    {
+        std::lock_guard guard(TrackLoader::mutex);
+        if (!TrackLoader::ready || TrackLoader::readyGeneration != TrackLoader::generation.load(std::memory_order_relaxed))
+            return;
+        TrackLoader::ready = false;
+        track = std::move(TrackLoader::readyTrack);
+    }
+    TrackLoader::lastMs = std::chrono::duration<double, std::milli>(Clock::now() - TrackLoader::pendingSince).count();
+    TrackLoader::peakMs = std::max(TrackLoader::peakMs, TrackLoader::lastMs);
+    (track ? TrackLoader::completed : TrackLoader::failed).fetch_add(1, std::memory_order_relaxed);
+    // Cleared first: `done` may well start another load.
+    Done done = std::move(TrackLoader::pendingDone);
+    TrackLoader::pendingDone = nullptr;
+    done(std::move(track));
+}
+void TrackLoader::shutdown()
+{
+    TrackLoader::cancel();
+    loadPool().waitIdle();
+}
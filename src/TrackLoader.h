@@ -0,0 +1,108 @@
+#pragma once
+
+#include <miniaudio.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+
+#include <HeadCache.h>
+#include <MappedFileVFS.h>
+#include <Resampler.h>
+#include <SeekTables.h>
+
+namespace fs = std::filesystem;
+
+// A track opened for playback, and everything it decodes through. The sound plays the topmost of the sources that
+// are set: the head start, the resampler, the MP3 decoder, then the resource manager's.
+struct LoadedTrack
+{
+    fs::path file;
+    // Backing store while it's decoded out of a mapping, registered with `resourceManager` under `resourceName` when
+    // that's what decodes it.
+    FileMapping mapping;
+    ma_resource_manager* resourceManager = nullptr;
+    std::string resourceName;
+    std::unique_ptr<ma_resource_manager_data_source> resource;
+    // Mapped MP3s with a seek table decode through it, below `source` if that's resampling them.
+    std::unique_ptr<Mp3Source> mp3;
+    // How tracks at another rate than the device's are converted, unless the sound's own resampler does it.
+    std::unique_ptr<ResampledSource> source;
+    // Queued tracks whose opening HeadCache had ready play through it, in place of everything above.
+    std::unique_ptr<HeadStartSource> head;
+    ma_uint32 soundFlags = 0;
+
+    LoadedTrack() = default;
+    LoadedTrack(const LoadedTrack&) = delete;
+    ~LoadedTrack();
+
+    ma_data_source* dataSource();
+    // What keeping it open holds on to: its mapping, or the opening and mapping of its head start.
+    size_t bytes() const;
+
+    // Any thread. Opens `file` the way MusicPlayer::streamed, its resampler quality and the device's rate say it should
+    // play, reusing `mapping` if it's already mapped. Null if it can't be opened, or `stop` trips first.
+    static std::unique_ptr<LoadedTrack> open(const fs::path& file, bool stream, FileMapping mapping, ma_resource_manager* resourceManager,
+                                             ma_uint32 sampleRate, ResamplerQuality quality, std::stop_token stop = {});
+    // Plays from a cached opening straight away, while the file is opened and decoded up to where the opening ends.
+    static std::unique_ptr<LoadedTrack> fromHead(const fs::path& file, std::shared_ptr<const TrackHead> head);
+};
+
+// Opens tracks on a thread of its own, so the control thread never waits on the disk or a decoder. Only the latest
+// load matters: starting one cancels whichever was in flight, which stops where it is and is never delivered.
+struct TrackLoader
+{
+    TrackLoader() = delete;
+
+    // Null if the track couldn't be opened.
+    using Done = std::function<void(std::unique_ptr<LoadedTrack>)>;
+
+    inline static std::atomic<uint32_t> started = 0;
+    inline static std::atomic<uint32_t> completed = 0;
+    inline static std::atomic<uint32_t> cancelled = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+
+    // Control thread. Opens `file` in the background and hands it to `done` on the control thread, from a later collect().
+    static void load(const fs::path& file, bool stream, FileMapping mapping, Done done);
+    // Control thread. Drops the load in flight, if any. Its `done` never runs.
+    static void cancel();
+    // Control thread, every tick. Delivers the load that finished, if it's still the latest.
+    static void collect();
+    // Control thread. Cancels, then waits for the loader's thread, before the resource manager goes away.
+    static void shutdown();
+
+    // Control thread.
+    inline static bool busy()
+    {
+        return bool(TrackLoader::pendingDone);
+    }
+    inline static double lastLoadMs()
+    {
+        return TrackLoader::lastMs;
+    }
+    inline static double peakLoadMs()
+    {
+        return TrackLoader::peakMs;
+    }
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Bumped by every load and cancel, so a job finishing for a load since replaced knows to throw its track away.
+    inline static std::atomic<uint64_t> generation = 0;
+    inline static std::stop_source inFlight;
+
+    // Control thread only.
+    inline static Done pendingDone;
+    inline static Clock::time_point pendingSince;
+    inline static double lastMs = 0.0, peakMs = 0.0;
+
+    inline static std::mutex mutex;
+    inline static bool ready = false;
+    inline static uint64_t readyGeneration = 0;
+    inline static std::unique_ptr<LoadedTrack> readyTrack;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Wait-free single producer, single consumer hand-off of the latest value. The writer fills writeBuffer() and
+// publishes; the reader calls update() and sees the newest published value in readBuffer(). Neither side ever waits.
+template <typename T>
+class TripleBuffer
+{
+    static constexpr uint8_t indexMask = 0b011;
+    static constexpr uint8_t freshBit = 0b100;
+
+    T buffers[3];
+    std::atomic<uint8_t> middle = 1;
+    uint8_t back = 0;
+    uint8_t front = 2;
+public:
+    // Writer side.
+    inline T& writeBuffer()
+    {
+        return this->buffers[this->back];
+    }
+    inline void publish()
+    {
+        this->back = this->middle.exchange(this->back | TripleBuffer::freshBit, std::memory_order_acq_rel) & TripleBuffer::indexMask;
+    }
+
+    // Reader side. Returns whether there was anything new.
+    inline bool update()
+    {
+        if (!(this->middle.load(std::memory_order_relaxed) & TripleBuffer::freshBit))
+            return false;
+        this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & TripleBuffer::indexMask;
+        return true;
+    }
+    inline const T& readBuffer() const
+    {
+        return this->buffers[this->front];
+    }
+
+    // For sizing the buffers up front, before either side is running.
+    template <typename Func>
+    inline void forEach(Func&& func)
+    {
+        for (T& buffer : this->buffers)
+            func(buffer);
+    }
+};
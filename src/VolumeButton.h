@@ -7,6 +7,7 @@
 #include <InteractableProgressBar.h>
 #include <MusicPlayer.h>
 #include <NanoVGContext.h>
+#include <PlaybackController.h>
 
 #define VOLUME_LINE_STROKE_THICKNESS 2.0f
 #define VOLUME_BUTTON_EXTRA_PADDING 2.0f
@@ -30,7 +31,7 @@ class VolumeButton : public ComponentData2D
                     {
                         button->prevVolume = button->volumeBar->progress;
                         if (!button->muted)
-                            ma_engine_set_volume(&MusicPlayer::engine, button->volumeBar->progress);
+                            PlaybackController::post({ .type = PlaybackCommandType::Volume, .value = button->volumeBar->progress });
                     }
                 });
             };
@@ -44,7 +45,7 @@ class VolumeButton : public ComponentData2D
                         if (button->rectTransform()->queryPointIn(Input::mousePosition()))
                         {
                             button->muted = !button->muted;
-                            ma_engine_set_volume(&MusicPlayer::engine, button->muted ? 0.0f : button->volumeBar->progress);
+                            PlaybackController::post({ .type = PlaybackCommandType::Volume, .value = button->muted ? 0.0f : button->volumeBar->progress });
                         }
                     });
                     break;
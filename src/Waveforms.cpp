@@ -0,0 +1,178 @@
+#include "Waveforms.h"
+
+#include <miniaudio.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <JobPool.h>
+#include <MappedFileVFS.h>
+#include <Simd.h>
+
+namespace
+{
+    // The decode pass collects buckets of this many frames, since the length isn't known until it's done, then merges
+    // them down to Waveforms::buckets.
+    constexpr uint32_t scanBucketFrames = 256;
+
+    struct ScanBucket
+    {
+        float min, max, squares;
+        uint32_t samples;
+    };
+
+    ScanBucket scan(const float* samples, size_t count)
+    {
+        f32x4 low = f32x4::splat(0.0f), high = f32x4::splat(0.0f), squares = f32x4::zero();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            f32x4 v = f32x4::load(samples + i);
+            low = f32x4::min(low, v);
+            high = f32x4::max(high, v);
+            squares = f32x4::mulAdd(v, v, squares);
+        }
+        ScanBucket bucket { low.minLane(), high.maxLane(), squares.sum(), uint32_t(count) };
+        for (; i < count; i++)
+        {
+            bucket.min = std::min(bucket.min, samples[i]);
+            bucket.max = std::max(bucket.max, samples[i]);
+            bucket.squares += samples[i] * samples[i];
+        }
+        return bucket;
+    }
+    int8_t quantizePeak(float value)
+    {
+        return int8_t(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+    }
+}
+
+std::optional<TrackWaveform> Waveforms::buildFile(const fs::path& file, std::stop_token stop)
+{
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+    ma_decoder decoder;
+    // Decoding out of a mapping skips a copy per read. Anything unmappable goes through stdio.
+    FileMapping mapping(file);
+    ma_result result;
+    if (mapping)
+    {
+        mapping.advise(FileAccessPattern::Sequential);
+        result = ma_decoder_init_memory(mapping.data(), mapping.size(), &config, &decoder);
+    }
+#if _WIN32
+    else result = ma_decoder_init_file_w(file.c_str(), &config, &decoder);
+#else
+    else result = ma_decoder_init_file(file.c_str(), &config, &decoder);
+#endif
+    if (result != MA_SUCCESS)
+        return std::nullopt;
+
+    ma_format format;
+    ma_uint32 channels, sampleRate;
+    if (ma_decoder_get_data_format(&decoder, &format, &channels, &sampleRate, nullptr, 0) != MA_SUCCESS || channels == 0 || sampleRate == 0)
+    {
+        ma_decoder_uninit(&decoder);
+        return std::nullopt;
+    }
+
+    constexpr ma_uint64 chunkFrames = scanBucketFrames * 16;
+    std::vector<float> buffer(chunkFrames * channels);
+    std::vector<ScanBucket> scanned;
+    uint64_t frames = 0;
+    while (!stop.stop_requested())
+    {
+        ma_uint64 read = 0;
+        result = ma_decoder_read_pcm_frames(&decoder, buffer.data(), chunkFrames, &read);
+        for (ma_uint64 start = 0; start < read; start += scanBucketFrames)
+        {
+            ma_uint64 count = std::min<ma_uint64>(scanBucketFrames, read - start);
+            scanned.push_back(scan(buffer.data() + start * channels, size_t(count * channels)));
+        }
+        frames += read;
+        if (result != MA_SUCCESS || read < chunkFrames)
+            break;
+    }
+    ma_decoder_uninit(&decoder);
+    if (stop.stop_requested() || frames == 0)
+        return std::nullopt;
+
+    size_t perBucket = (scanned.size() + Waveforms::buckets - 1) / Waveforms::buckets;
+    size_t count = (scanned.size() + perBucket - 1) / perBucket;
+    TrackWaveform waveform { .frames = frames, .sampleRate = sampleRate, .bucketFrames = uint32_t(perBucket * scanBucketFrames) };
+    WaveformLevel& level = waveform.levels.emplace_back();
+    level.min.resize(count);
+    level.max.resize(count);
+    level.rms.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        ScanBucket merged { 0.0f, 0.0f, 0.0f, 0 };
+        for (size_t j = i * perBucket; j < std::min((i + 1) * perBucket, scanned.size()); j++)
+        {
+            merged.min = std::min(merged.min, scanned[j].min);
+            merged.max = std::max(merged.max, scanned[j].max);
+            merged.squares += scanned[j].squares;
+            merged.samples += scanned[j].samples;
+        }
+        level.min[i] = quantizePeak(merged.min);
+        level.max[i] = quantizePeak(merged.max);
+        level.rms[i] = uint8_t(std::lround(std::min(std::sqrt(merged.squares / std::max(merged.samples, 1u)), 1.0f) * 255.0f));
+    }
+    waveform.buildLevels();
+    return waveform;
+}
+
+uint32_t Waveforms::buildLibrary()
+{
+    auto library = MusicLibrary::snapshot();
+    uint32_t queuedNow = 0;
+    for (const LibraryTrack& track : library->tracks)
+    {
+        std::optional<TrackRecord> record = MusicLibrary::record(track);
+        if (record && record->waveform)
+            continue;
+        {
+            std::lock_guard guard(Waveforms::inFlightMutex);
+            if (!Waveforms::inFlight.insert(track.path.generic_u8string()).second)
+                continue;
+        }
+
+        ++queuedNow;
+        Waveforms::queued.fetch_add(1, std::memory_order_relaxed);
+        JobPool::background().submit([track](std::stop_token stop)
+        {
+            std::optional<TrackWaveform> result = Waveforms::buildFile(track.path, stop);
+            if (result)
+            {
+                auto waveform = std::make_shared<const TrackWaveform>(std::move(*result));
+                MusicLibrary::updateRecord(track, [&](TrackRecord& record) { record.waveform = waveform; });
+            }
+            else if (!stop.stop_requested())
+                Waveforms::failed.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard guard(Waveforms::inFlightMutex);
+                Waveforms::inFlight.erase(track.path.generic_u8string());
+            }
+            if (Waveforms::finished.fetch_add(1, std::memory_order_acq_rel) + 1 == Waveforms::queued.load(std::memory_order_acquire))
+                MusicLibrary::saveIndex();
+        });
+    }
+    return queuedNow;
+}
+
+std::shared_ptr<const TrackWaveform> Waveforms::find(const fs::path& file)
+{
+    auto library = MusicLibrary::snapshot();
+    const LibraryTrack* track = MusicLibrary::find(*library, file);
+    std::optional<TrackRecord> record = track ? MusicLibrary::record(*track) : std::nullopt;
+    return record ? record->waveform : nullptr;
+}
+
+const WaveformLevel& Waveforms::levelFor(const TrackWaveform& waveform, float width)
+{
+    for (size_t i = waveform.levels.size(); i-- > 1;)
+    {
+        if (float(waveform.levels[i].min.size()) >= width)
+            return waveform.levels[i];
+    }
+    return waveform.levels.front();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <unordered_set>
+
+#include <MusicLibrary.h>
+
+namespace fs = std::filesystem;
+
+// Waveform overviews for the progress bar. Each track is decoded once in the background, straight through, and its
+// min/max/RMS pyramid kept in the library index, so drawing one at any width is a lookup.
+struct Waveforms
+{
+    Waveforms() = delete;
+
+    // Buckets in the finest level, for tracks long enough to fill them. About the widest a progress bar gets.
+    inline static uint32_t buckets = 2048;
+    // Whether the progress bar draws the overview of the current track, when it has one.
+    inline static bool display = true;
+
+    inline static std::atomic<uint32_t> queued = 0;
+    inline static std::atomic<uint32_t> finished = 0;
+    inline static std::atomic<uint32_t> failed = 0;
+
+    // Decodes all of `file`. Empty if it can't be decoded or `stop` trips first.
+    static std::optional<TrackWaveform> buildFile(const fs::path& file, std::stop_token stop = {});
+    // Queues every track without an overview on the background pool, saving the index once the queue drains.
+    // Returns how many were queued.
+    static uint32_t buildLibrary();
+    // The overview recorded for the current contents of `file`, if any.
+    static std::shared_ptr<const TrackWaveform> find(const fs::path& file);
+    // The coarsest level of `waveform` with at least `width` buckets, or the finest if none has.
+    static const WaveformLevel& levelFor(const TrackWaveform& waveform, float width);
+private:
+    inline static std::mutex inFlightMutex;
+    inline static std::unordered_set<std::u8string> inFlight;
+};
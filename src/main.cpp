@@ -15,7 +15,6 @@
 #include <windows.h>
 #endif
 
-#define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 
 #include <Components/Mask.h>
@@ -25,7 +24,9 @@
 #include <DropShadow.h>
 #include <HorizontalBar.h>
 #include <InteractableProgressBar.h>
+#include <PlaybackController.h>
 #include <RunningTime.h>
+#include <SpectrumVisualizer.h>
 #include <TacradCLI.h>
 #include <TrackInteractionButton.h>
 #include <VolumeButton.h>
@@ -55,6 +56,8 @@ inline TacradCLI* textEntryInput;
 #define RUNNING_TIME_WIDTH 180.0f
 #define TITLE_TEXT_HEIGHT 36.0f
 #define SUBHEADING_TEXT_HEIGHT 22.0f
+#define SPECTRUM_HEIGHT 96.0f
+#define SPECTRUM_PADDING_TOP 12.0f
 
 int main()
 {
@@ -112,6 +115,17 @@ int main()
         subheadingTextComponent->fontSize = SUBHEADING_TEXT_HEIGHT;
         subheadingTextComponent->fontFile = headingFont;
 
+        Entity2D* spectrum = new Entity2D();
+        spectrum->parent = ui;
+        spectrum->name = L"Spectrum Visualizer";
+        spectrum->rectTransform()->localPosition =
+            sysm::vector2(0, subheadingText->rectTransform()->localPosition().y + subheadingText->rectTransform()->rect().bottom - SPECTRUM_PADDING_TOP);
+        spectrum->rectTransform()->rect = RectFloat(0, (float)Window::pixelWidth() / 2.0f - TRACK_INTERACTION_PADDING_SIDE, -SPECTRUM_HEIGHT,
+                                                    -(float)Window::pixelWidth() / 2.0f + TRACK_INTERACTION_PADDING_SIDE);
+        spectrum->rectTransform()->rectAnchor = RectFloat(0, 1, 0, 1);
+        spectrum->rectTransform()->positionAnchor = RectFloat(1, 0, 0, 0);
+        spectrum->addComponent<SpectrumVisualizer>();
+
         Entity2D* upperHitbox = new Entity2D();
         upperHitbox->parent = hBarConEntity;
         upperHitbox->name = L"Horizontal Bar Hitbox Upper";
@@ -215,16 +229,22 @@ int main()
         progressBar->rectTransform()->rectAnchor = RectFloat(0, 2, 0, 0);
         InteractableProgressBar* progress = progressBar->addComponent<InteractableProgressBar>();
         progress->active = false;
+        progress->waveformHeight = DIVIDER_HEIGHT - DIVIDER_BAR_HEIGHT * 4.0f;
         durationDisplay->track = progress;
         progress->OnDragProgressChanged = [progress]
         {
-            if (MusicPlayer::playing)
+            auto state = PlaybackController::state();
+            if (state->playing)
             {
-                float seekQuery = (float)ma_engine_get_sample_rate(&MusicPlayer::engine) * progress->progress * MusicPlayer::musicLen;
-                if (seekQuery >= 0.0f && seekQuery <= MusicPlayer::frameLen)
-                    ma_sound_seek_to_pcm_frame(&MusicPlayer::music, (ma_uint64)seekQuery);
+                float seekQuery = (float)state->sampleRate * progress->progress * state->seconds;
+                if (seekQuery >= 0.0f && seekQuery <= state->frameLength)
+                    PlaybackController::post({ .type = PlaybackCommandType::Scrub, .frame = (uint64_t)seekQuery });
             }
         };
+        progress->OnDragEnded = []
+        {
+            PlaybackController::post({ .type = PlaybackCommandType::EndScrub });
+        };
 
         textEntry = new Entity2D();
         hBarCon->below = textEntry->rectTransform();